@@ -0,0 +1,850 @@
+/**
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Microbenchmarks for the generators and primitives; built and run
+ * by `make bench`.
+ *
+ * Every benchmark is run in batches of doubling size until a batch
+ * takes at least the minimum time, and the best of BENCH_REPEATS
+ * such batches is reported as one CSV (default) or JSON record:
+ *
+ *   name, size, threads, calls, ns_per_call, cycles_per_byte, mb_per_s
+ *
+ * size is the number of bytes produced (or the operand size for the
+ * bignum benchmarks) per call. For the multi-threaded benchmarks all
+ * threads run the same call and the figures are for the aggregate,
+ * i.e. ns_per_call is the wall time divided by the total number of
+ * calls. cycles_per_byte is left empty (null) without a TSC.
+ *
+ * Usage: xbench [--json] [--quick] [--min-ms N] [filter]
+ */
+
+#include "common/bignum.h"
+#include "common/defs.h"
+#include "crypto/aes.h"
+#include "rand/chacha_drbg.h"
+#include "rand/ctr_drbg.h"
+#include "rand/hash_drbg.h"
+#include "rand/hmac_drbg.h"
+#include "rand/random.h"
+#include "rand/trivium.h"
+#include "rand/xr_rng.h"
+#ifdef _WIN32
+#include "rand/rngw32.h"
+#include <process.h>
+#else
+#include "rand/rngposix.h"
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386)
+#include <x86intrin.h> /* __rdtsc */
+#define BENCH_HAVE_TSC
+#endif
+
+/* Number of timed batches per benchmark; the fastest one is kept */
+#define BENCH_REPEATS 3
+
+/* Default and --quick minimum batch time in milliseconds */
+#define BENCH_MIN_MS 100
+#define BENCH_QUICK_MIN_MS 10
+
+/* Largest request size of the size sweeps */
+#define BENCH_MAX_SIZE (64 * 1024)
+
+/* Thread counts for the contention benchmarks */
+static const int bench_threads[] = {1, 2, 4, 8};
+#define BENCH_MAX_THREADS 8
+
+/* Request sizes swept by the byte-oriented benchmarks */
+static const size_t bench_sizes[] = {16, 64, 256, 1024, 4096, 16384, 65536};
+
+/* Number of variates per call of the random.c samplers */
+#define BENCH_VARIATES 1024
+
+/* One benchmark call; returns 0 on success */
+typedef int (*bench_fn)(void *ctx, size_t size);
+
+static struct {
+  int json;
+  long min_ms;
+  const char *filter;
+  int nrecords;
+} opts = {0, BENCH_MIN_MS, NULL, 0};
+
+static uint8_t bench_buf[BENCH_MAX_THREADS][BENCH_MAX_SIZE] ALIGN(64);
+
+static uint64_t now_ns(void) {
+#ifdef _WIN32
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER t;
+
+  if (!freq.QuadPart)
+    QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t);
+  return (uint64_t)((double)t.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static uint64_t now_cycles(void) {
+#if defined(BENCH_HAVE_TSC)
+  return (uint64_t)__rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/* Print one result record */
+static void report(const char *name, size_t size, int threads, uint64_t calls,
+                   uint64_t ns, uint64_t cycles) {
+  double ns_per_call = (double)ns / (double)calls;
+  double bytes = (double)size * (double)calls;
+  double mb_per_s = ns ? bytes * 1e3 / (double)ns : 0.0;
+  char cpb[32] = "";
+
+#if defined(BENCH_HAVE_TSC)
+  snprintf(cpb, sizeof(cpb), "%.3f", (double)cycles / bytes);
+#else
+  (void)cycles;
+#endif
+
+  if (opts.json) {
+    printf("%s\n  {\"name\": \"%s\", \"size\": %zu, \"threads\": %d, "
+           "\"calls\": %llu, \"ns_per_call\": %.3f, \"cycles_per_byte\": "
+           "%s, \"mb_per_s\": %.3f}",
+           opts.nrecords ? "," : "", name, size, threads,
+           (unsigned long long)calls, ns_per_call, cpb[0] ? cpb : "null",
+           mb_per_s);
+  } else {
+    printf("%s,%zu,%d,%llu,%.3f,%s,%.3f\n", name, size, threads,
+           (unsigned long long)calls, ns_per_call, cpb, mb_per_s);
+  }
+  fflush(stdout);
+  opts.nrecords++;
+}
+
+static int selected(const char *name) {
+  return opts.filter == NULL || strstr(name, opts.filter) != NULL;
+}
+
+/**
+ * Time fn(ctx, size) in batches of doubling size until a batch runs
+ * for at least opts.min_ms, then keep the fastest of BENCH_REPEATS
+ * batches of that size; fn uses threads threads per call.
+ */
+static void run_mt(const char *name, bench_fn fn, void *ctx, size_t size,
+                   int threads) {
+  uint64_t batch = 1, best_ns = UINT64_MAX, best_cycles = 0;
+  uint64_t t0, c0, ns, cycles;
+  uint64_t min_ns = (uint64_t)opts.min_ms * 1000000ULL;
+
+  if (!selected(name))
+    return;
+
+  /* Warm up */
+  if (fn(ctx, size) != 0) {
+    fprintf(stderr, "%s (size %zu) failed\n", name, size);
+    return;
+  }
+
+  for (;;) {
+    t0 = now_ns();
+    for (uint64_t i = 0; i < batch; i++)
+      fn(ctx, size);
+    if ((ns = now_ns() - t0) >= min_ns || batch >= (1ULL << 40))
+      break;
+    /* Jump close to the target in one step once the batch is long
+       enough to be timed reliably */
+    batch = (ns > min_ns / 64) ? batch * (min_ns / ns + 1) : batch * 2;
+  }
+
+  for (int r = 0; r < BENCH_REPEATS; r++) {
+    t0 = now_ns();
+    c0 = now_cycles();
+    for (uint64_t i = 0; i < batch; i++)
+      fn(ctx, size);
+    cycles = now_cycles() - c0;
+    ns = now_ns() - t0;
+    if (ns < best_ns) {
+      best_ns = ns;
+      best_cycles = cycles;
+    }
+  }
+
+  report(name, size, threads, batch, best_ns, best_cycles);
+}
+
+static void run(const char *name, bench_fn fn, void *ctx, size_t size) {
+  run_mt(name, fn, ctx, size, 1);
+}
+
+/* Run fn over every request size of the sweep up to max_size */
+static void run_sweep(const char *name, bench_fn fn, void *ctx,
+                      size_t max_size) {
+  for (size_t i = 0; i < count(bench_sizes) && bench_sizes[i] <= max_size;
+       i++)
+    run(name, fn, ctx, bench_sizes[i]);
+}
+
+/*
+ * DRBGs
+ */
+
+static const uint8_t bench_entropy[64] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15,
+    0x88, 0x09, 0xcf, 0x4f, 0x3c, 0x76, 0x2e, 0x71, 0x60, 0xf3, 0x8b,
+    0x4d, 0xa5, 0x6a, 0x78, 0x4d, 0x90, 0x45, 0x19, 0x0c, 0xfe, 0x00,
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b,
+    0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+    0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f};
+
+static int b_ctr_drbg(void *ctx, size_t size) {
+  return ctr_drbg_generate((CTR_DRBG_STATE *)ctx, bench_buf[0], size, NULL,
+                           0) != SUCCESS;
+}
+
+static int b_chacha_drbg(void *ctx, size_t size) {
+  return chacha_drbg_fetch((CHACHA_DRBG_STATE *)ctx, bench_buf[0], size) !=
+         SUCCESS;
+}
+
+static int b_hash_drbg(void *ctx, size_t size) {
+  return hash_drbg_generate((HASH_DRBG_STATE *)ctx, bench_buf[0], size, NULL,
+                            0) != ERR_HASH_DRBG_SUCCESS;
+}
+
+static int b_hmac_drbg(void *ctx, size_t size) {
+  return hmac_drbg_generate((HMAC_DRBG_STATE *)ctx, bench_buf[0], size, NULL,
+                            0) != ERR_HMAC_DRBG_SUCCESS;
+}
+
+static void bench_drbgs(void) {
+  CTR_DRBG_STATE ctr;
+  CHACHA_DRBG_STATE chacha;
+  HASH_DRBG_STATE *hash;
+  HMAC_DRBG_STATE *hmac;
+
+  if (ctr_drbg_init(&ctr, bench_entropy, NULL, 0) == SUCCESS) {
+    run_sweep("ctr_drbg_generate", b_ctr_drbg, &ctr, BENCH_MAX_SIZE);
+    ctr_drbg_clear(&ctr);
+  }
+
+  if (chacha_drbg_init(&chacha, bench_entropy, NULL, 0) == SUCCESS) {
+    run_sweep("chacha_drbg_generate", b_chacha_drbg, &chacha, BENCH_MAX_SIZE);
+    chacha_drbg_clear(&chacha);
+  }
+
+  if ((hash = hash_drbg_new()) != NULL) {
+    if (hash_drbg_init(hash, bench_entropy, 32, bench_entropy + 32, 16, NULL,
+                       0) == ERR_HASH_DRBG_SUCCESS)
+      run_sweep("hash_drbg_generate", b_hash_drbg, hash, BENCH_MAX_SIZE);
+    hash_drbg_clear(hash);
+  }
+
+  if ((hmac = hmac_drbg_new()) != NULL) {
+    if (hmac_drbg_init(hmac, bench_entropy, 32, bench_entropy + 32, 16, NULL,
+                       0) == ERR_HMAC_DRBG_SUCCESS)
+      run_sweep("hmac_drbg_generate", b_hmac_drbg, hmac, BENCH_MAX_SIZE);
+    hmac_drbg_clear(hmac);
+  }
+}
+
+/*
+ * xr_rng: the vtable against the static dispatch of the same engine
+ */
+
+static int b_xr_rng(void *ctx, size_t size) {
+  return xr_rng_generate((xr_rng *)ctx, bench_buf[0], size) != SUCCESS;
+}
+
+static int b_xr_rng_ctr(void *ctx, size_t size) {
+  return xr_rng_generate_as((xr_rng *)ctx, XR_RNG_CTR_DRBG, bench_buf[0],
+                            size) != SUCCESS;
+}
+
+static int b_xr_rng_trivium(void *ctx, size_t size) {
+  return xr_rng_generate_as((xr_rng *)ctx, XR_RNG_TRIVIUM, bench_buf[0],
+                            size) != SUCCESS;
+}
+
+/* A batch of 16-byte nonces, one per packet */
+#define BENCH_NONCE_LEN 16
+#define BENCH_NONCES 256
+
+static int b_xr_rng_nonces(void *ctx, size_t size) {
+  for (size_t off = 0; off < size; off += BENCH_NONCE_LEN)
+    if (xr_rng_generate((xr_rng *)ctx, bench_buf[0] + off, BENCH_NONCE_LEN) !=
+        SUCCESS)
+      return 1;
+  return 0;
+}
+
+static int b_xr_rng_iov(void *ctx, size_t size) {
+  static xr_iovec iov[BENCH_NONCES];
+  int n = (int)(size / BENCH_NONCE_LEN);
+
+  /* Every other nonce slot, as in a packet buffer */
+  for (int i = 0; i < n; i++) {
+    iov[i].iov_base = bench_buf[0] + 2 * i * BENCH_NONCE_LEN;
+    iov[i].iov_len = BENCH_NONCE_LEN;
+  }
+  return xr_rng_generate_iov((xr_rng *)ctx, iov, n) != SUCCESS;
+}
+
+static void bench_xr_rng(void) {
+  xr_rng *rng;
+
+  if ((rng = xr_rng_new_engine(XR_RNG_CTR_DRBG, NULL, NULL)) != NULL) {
+    run_sweep("xr_rng_generate/ctr_drbg", b_xr_rng, rng, BENCH_MAX_SIZE);
+    run_sweep("xr_rng_ctr_generate", b_xr_rng_ctr, rng, BENCH_MAX_SIZE);
+    run("xr_rng_generate/nonces", b_xr_rng_nonces, rng,
+        BENCH_NONCES * BENCH_NONCE_LEN);
+    run("xr_rng_generate_iov/nonces", b_xr_rng_iov, rng,
+        BENCH_NONCES * BENCH_NONCE_LEN);
+    xr_rng_free(rng);
+  }
+
+  if ((rng = xr_rng_new_engine(XR_RNG_TRIVIUM, NULL, NULL)) != NULL) {
+    run_sweep("xr_rng_generate/trivium", b_xr_rng, rng, BENCH_MAX_SIZE);
+    run_sweep("xr_rng_trivium_generate", b_xr_rng_trivium, rng,
+              BENCH_MAX_SIZE);
+    xr_rng_free(rng);
+  }
+}
+
+/*
+ * AES-256
+ */
+
+static int b_aes_block(void *ctx, size_t size) {
+  (void)size;
+  aes256_encr_block(bench_buf[0], bench_buf[0], (const aes256_ks_t *)ctx);
+  return 0;
+}
+
+static int b_aes_ctr(void *ctx, size_t size) {
+  static uint8_t ctr[AES_BLOCK_SIZE];
+
+  aes256_ctr_blocks(ctr, bench_buf[0], size / AES_BLOCK_SIZE,
+                    (const aes256_ks_t *)ctx);
+  return 0;
+}
+
+static void bench_aes(void) {
+  aes256_key_t key;
+  aes256_ks_t ks;
+
+  memcpy(key.k, bench_entropy, AES256_KEY_SIZE);
+  aes256_expand_key(&key, &ks);
+
+  run("aes256_encr_block", b_aes_block, &ks, AES_BLOCK_SIZE);
+  run_sweep("aes256_ctr_blocks", b_aes_ctr, &ks, BENCH_MAX_SIZE);
+
+  zeroize((uint8_t *)&ks, sizeof(ks));
+}
+
+/*
+ * Trivium and the RNG
+ */
+
+static int b_trivium64(void *ctx, size_t size) {
+  (void)ctx;
+  (void)size;
+  *(volatile u64 *)bench_buf[0] = TriviumRand64();
+  return 0;
+}
+
+static int b_trivium_fill(void *ctx, size_t size) {
+  (void)ctx;
+  TriviumFill(bench_buf[0], size);
+  return 0;
+}
+
+static int b_rng_fetch(void *ctx, size_t size) {
+  (void)ctx;
+  return !RngFetchBytes(bench_buf[0], size);
+}
+
+static int b_rng_mix(void *ctx, size_t size) {
+  (void)ctx;
+  (void)size;
+  RngMix();
+  return 0;
+}
+
+static void bench_rng(void) {
+  run("TriviumRand64", b_trivium64, NULL, sizeof(u64));
+  run_sweep("TriviumFill", b_trivium_fill, NULL, BENCH_MAX_SIZE);
+
+  run_sweep("RngFetchBytes", b_rng_fetch, NULL, BENCH_MAX_SIZE);
+
+  if (RngStartPrefetch(RNG_RING_DEFAULT_WATERMARK, RNG_RING_DEFAULT_BATCH)) {
+    run_sweep("RngFetchBytes/prefetch", b_rng_fetch, NULL, RNG_RING_SLOT_SIZE);
+    RngStopPrefetch();
+  }
+
+  /* RngMix() is RandPoolMix() under the pool lock */
+  run("RandPoolMix", b_rng_mix, NULL, RNG_POOL_SIZE);
+}
+
+/*
+ * Bignum
+ */
+
+typedef struct {
+  HMAC_DRBG_STATE *drbg;
+  BIGNUM A, B, E, N, RR, X;
+  int nbits;
+} BN_BENCH;
+
+static int bench_f_rng(void *ctx, uint8_t *out, size_t len,
+                       const uint8_t *addn, size_t addn_len) {
+  (void)addn;
+  (void)addn_len;
+  return hmac_drbg_generate_bulk((HMAC_DRBG_STATE *)ctx, out, len) !=
+         ERR_HMAC_DRBG_SUCCESS;
+}
+
+/* Set X to a random nbits-bit number with the top bit set */
+static int bn_bench_rand(BN_BENCH *b, BIGNUM *X, int nbits) {
+  size_t nlimbs = BN_BITS_TO_LIMBS(nbits);
+
+  if (bn_grow(X, nlimbs) != 0 ||
+      bench_f_rng(b->drbg, (uint8_t *)X->p, nlimbs * sizeof(bn_uint_t), NULL,
+                  0) != 0)
+    return 1;
+  return bn_set_bit(X, nbits - 1, 1);
+}
+
+static int b_bn_mul(void *ctx, size_t size) {
+  BN_BENCH *b = (BN_BENCH *)ctx;
+  (void)size;
+  return bn_mul(&b->A, &b->B, &b->X);
+}
+
+static int b_bn_exp_mod(void *ctx, size_t size) {
+  BN_BENCH *b = (BN_BENCH *)ctx;
+  (void)size;
+  return bn_exp_mod(&b->A, &b->E, &b->N, &b->RR, &b->X);
+}
+
+static int b_bn_prime(void *ctx, size_t size) {
+  BN_BENCH *b = (BN_BENCH *)ctx;
+  (void)size;
+  return bn_generate_proabable_prime(&b->X, b->nbits, bench_f_rng, b->drbg);
+}
+
+static void bench_bignum(void) {
+  static const int mul_bits[] = {256, 1024, 2048, 4096};
+  static const int exp_bits[] = {1024, 2048};
+  static const int prime_bits[] = {512, 1024};
+  BN_BENCH b;
+
+  if ((b.drbg = hmac_drbg_new()) == NULL)
+    return;
+  if (hmac_drbg_init(b.drbg, bench_entropy, 32, bench_entropy + 32, 16, NULL,
+                     0) != ERR_HMAC_DRBG_SUCCESS)
+    goto cleanup;
+
+  bn_init(&b.A, &b.B, &b.E, &b.N, &b.RR, &b.X, NULL);
+
+  for (size_t i = 0; i < count(mul_bits); i++) {
+    if (bn_bench_rand(&b, &b.A, mul_bits[i]) ||
+        bn_bench_rand(&b, &b.B, mul_bits[i]))
+      break;
+    run("bn_mul", b_bn_mul, &b, (size_t)mul_bits[i] / 8);
+  }
+
+  for (size_t i = 0; i < count(exp_bits); i++) {
+    bn_zfree(&b.RR, NULL);
+    bn_init(&b.RR, NULL);
+    if (bn_bench_rand(&b, &b.A, exp_bits[i] - 1) ||
+        bn_bench_rand(&b, &b.E, exp_bits[i]) ||
+        bn_bench_rand(&b, &b.N, exp_bits[i]))
+      break;
+    bn_set_lsb(&b.N);
+    run("bn_exp_mod", b_bn_exp_mod, &b, (size_t)exp_bits[i] / 8);
+  }
+
+  for (size_t i = 0; i < count(prime_bits); i++) {
+    b.nbits = prime_bits[i];
+    run("bn_generate_proabable_prime", b_bn_prime, &b,
+        (size_t)prime_bits[i] / 8);
+  }
+
+  bn_zfree(&b.A, &b.B, &b.E, &b.N, &b.RR, &b.X, NULL);
+cleanup:
+  hmac_drbg_clear(b.drbg);
+}
+
+/*
+ * random.c samplers; each call draws BENCH_VARIATES variates
+ */
+
+static int b_range_u64(void *ctx, size_t size) {
+  (void)ctx;
+  return xr_rand_range_u64_fill((uint64_t *)bench_buf[0],
+                                size / sizeof(uint64_t), 1,
+                                1000003) != SUCCESS;
+}
+
+static int b_range_u32(void *ctx, size_t size) {
+  (void)ctx;
+  return xr_rand_range_u32_fill((uint32_t *)bench_buf[0],
+                                size / sizeof(uint32_t), 1, 1000003) !=
+         SUCCESS;
+}
+
+static int b_uniform(void *ctx, size_t size) {
+  (void)ctx;
+  return xr_uniform_fill((double *)bench_buf[0], size / sizeof(double), -1.0,
+                         1.0) != SUCCESS;
+}
+
+static int b_uniformf(void *ctx, size_t size) {
+  (void)ctx;
+  return xr_uniform_fillf((float *)bench_buf[0], size / sizeof(float), -1.0f,
+                          1.0f) != SUCCESS;
+}
+
+static int b_normal(void *ctx, size_t size) {
+  return xr_normal_fill_ex((double *)bench_buf[0], size / sizeof(double), 0.0,
+                           1.0, *(xr_normal_method_t *)ctx) != SUCCESS;
+}
+
+static int b_normalf(void *ctx, size_t size) {
+  return xr_normal_fillf_ex((float *)bench_buf[0], size / sizeof(float), 0.0f,
+                            1.0f, *(xr_normal_method_t *)ctx) != SUCCESS;
+}
+
+static int b_exponential(void *ctx, size_t size) {
+  (void)ctx;
+  return xr_exponential_fill((double *)bench_buf[0], size / sizeof(double),
+                             1.5) != SUCCESS;
+}
+
+static int b_triangular(void *ctx, size_t size) {
+  (void)ctx;
+  return xr_triangular_fill((double *)bench_buf[0], size / sizeof(double), 0.0,
+                            1.0, 0.25) != SUCCESS;
+}
+
+static int b_poisson(void *ctx, size_t size) {
+  return xr_poisson_fill((int64_t *)bench_buf[0], size / sizeof(int64_t),
+                         *(double *)ctx) != SUCCESS;
+}
+
+static int b_binomial(void *ctx, size_t size) {
+  return xr_binomial_fill((int64_t *)bench_buf[0], size / sizeof(int64_t),
+                          *(int *)ctx, 0.3) != SUCCESS;
+}
+
+static int b_randstr(void *ctx, size_t size) {
+  /* One byte is left for the NUL */
+  return xr_randstr_fill((char *)bench_buf[0], size - 1, (const char *)ctx) !=
+         SUCCESS;
+}
+
+static int b_discrete(void *ctx, size_t size) {
+  return xr_discrete_fill((const xr_discrete_table *)ctx,
+                          (uint32_t *)bench_buf[0],
+                          size / sizeof(uint32_t)) != SUCCESS;
+}
+
+/* Outcomes of the Zipf-like table for xr_discrete_fill() */
+#define BENCH_DISCRETE_K 1000
+
+static void bench_random(void) {
+  xr_normal_method_t zig = XR_NORMAL_ZIGGURAT, bm = XR_NORMAL_BOX_MULLER;
+  double lambda_small = 4.0, lambda_large = 100.0;
+  int trials_small = 20, trials_large = 1000;
+  static double weights[BENCH_DISCRETE_K];
+  xr_discrete_table *table;
+
+  run("xr_rand_range_u64_fill", b_range_u64, NULL,
+      BENCH_VARIATES * sizeof(uint64_t));
+  run("xr_rand_range_u32_fill", b_range_u32, NULL,
+      BENCH_VARIATES * sizeof(uint32_t));
+  run("xr_uniform_fill", b_uniform, NULL, BENCH_VARIATES * sizeof(double));
+  run("xr_uniform_fillf", b_uniformf, NULL, BENCH_VARIATES * sizeof(float));
+  run("xr_normal_fill/ziggurat", b_normal, &zig,
+      BENCH_VARIATES * sizeof(double));
+  run("xr_normal_fill/box_muller", b_normal, &bm,
+      BENCH_VARIATES * sizeof(double));
+  run("xr_normal_fillf/ziggurat", b_normalf, &zig,
+      BENCH_VARIATES * sizeof(float));
+  run("xr_normal_fillf/box_muller", b_normalf, &bm,
+      BENCH_VARIATES * sizeof(float));
+  run("xr_exponential_fill", b_exponential, NULL,
+      BENCH_VARIATES * sizeof(double));
+  run("xr_triangular_fill", b_triangular, NULL,
+      BENCH_VARIATES * sizeof(double));
+  /* Both sides of the inversion / PTRS and inversion / BTPE cutoffs */
+  run("xr_poisson_fill/small", b_poisson, &lambda_small,
+      BENCH_VARIATES * sizeof(int64_t));
+  run("xr_poisson_fill/large", b_poisson, &lambda_large,
+      BENCH_VARIATES * sizeof(int64_t));
+  run("xr_binomial_fill/small", b_binomial, &trials_small,
+      BENCH_VARIATES * sizeof(int64_t));
+  run("xr_binomial_fill/large", b_binomial, &trials_large,
+      BENCH_VARIATES * sizeof(int64_t));
+  run("xr_randstr_fill/hex", b_randstr, XR_ALPHABET_HEX, BENCH_VARIATES);
+  run("xr_randstr_fill/base64url", b_randstr, XR_ALPHABET_BASE64URL,
+      BENCH_VARIATES);
+
+  for (size_t i = 0; i < BENCH_DISCRETE_K; i++)
+    weights[i] = 1.0 / (double)(i + 1);
+  if ((table = xr_discrete_table_new(weights, BENCH_DISCRETE_K)) != NULL) {
+    run("xr_discrete_fill", b_discrete, table,
+        BENCH_VARIATES * sizeof(uint32_t));
+    xr_discrete_table_free(table);
+  }
+}
+
+/*
+ * Contention: every thread calls RngFetchBytes() (which is served by
+ * its own DRBG, or by the shared prefetch ring) or a thread-private
+ * CTR_DRBG for the same number of calls
+ */
+
+typedef struct {
+  int id;
+  int use_rng;
+  size_t size;
+  uint64_t calls;
+  CTR_DRBG_STATE drbg;
+} BENCH_THREAD;
+
+#ifdef _WIN32
+static unsigned __stdcall bench_thread_proc(void *arg)
+#else
+static void *bench_thread_proc(void *arg)
+#endif
+{
+  BENCH_THREAD *t = (BENCH_THREAD *)arg;
+
+  for (uint64_t i = 0; i < t->calls; i++) {
+    if (t->use_rng)
+      RngFetchBytes(bench_buf[t->id], t->size);
+    else
+      ctr_drbg_generate(&t->drbg, bench_buf[t->id], t->size, NULL, 0);
+  }
+  return 0;
+}
+
+/* Run nthreads threads of calls_per_thread calls each; returns the
+   wall time in nanoseconds (or 0 if a thread could not be started) */
+static uint64_t run_threads(BENCH_THREAD *t, int nthreads, uint64_t *cycles) {
+  uint64_t t0, c0;
+  int started = 0;
+#ifdef _WIN32
+  HANDLE h[BENCH_MAX_THREADS];
+#else
+  pthread_t h[BENCH_MAX_THREADS];
+#endif
+
+  t0 = now_ns();
+  c0 = now_cycles();
+  for (; started < nthreads; started++) {
+#ifdef _WIN32
+    h[started] = (HANDLE)_beginthreadex(NULL, 0, bench_thread_proc,
+                                        &t[started], 0, NULL);
+    if (h[started] == NULL)
+      break;
+#else
+    if (pthread_create(&h[started], NULL, bench_thread_proc, &t[started]))
+      break;
+#endif
+  }
+  for (int i = 0; i < started; i++) {
+#ifdef _WIN32
+    WaitForSingleObject(h[i], INFINITE);
+    CloseHandle(h[i]);
+#else
+    pthread_join(h[i], NULL);
+#endif
+  }
+  *cycles = now_cycles() - c0;
+
+  return (started == nthreads) ? now_ns() - t0 : 0;
+}
+
+static void run_contention(const char *name, int use_rng, size_t size) {
+  static BENCH_THREAD t[BENCH_MAX_THREADS];
+  uint64_t min_ns = (uint64_t)opts.min_ms * 1000000ULL;
+  uint64_t calls, ns, cycles, best_ns, best_cycles;
+
+  if (!selected(name))
+    return;
+
+  for (int i = 0; i < BENCH_MAX_THREADS; i++) {
+    t[i].id = i;
+    t[i].use_rng = use_rng;
+    t[i].size = size;
+    if (!use_rng && ctr_drbg_init(&t[i].drbg, bench_entropy, NULL, 0))
+      return;
+  }
+
+  for (size_t n = 0; n < count(bench_threads); n++) {
+    int nthreads = bench_threads[n];
+
+    /* Size the run so that it takes about the minimum time */
+    calls = 16;
+    for (;;) {
+      for (int i = 0; i < nthreads; i++)
+        t[i].calls = calls;
+      if ((ns = run_threads(t, nthreads, &cycles)) == 0)
+        goto cleanup;
+      if (ns >= min_ns)
+        break;
+      calls = (ns > min_ns / 64) ? calls * (min_ns / ns + 1) : calls * 2;
+    }
+
+    best_ns = ns;
+    best_cycles = cycles;
+    for (int r = 1; r < BENCH_REPEATS; r++) {
+      if ((ns = run_threads(t, nthreads, &cycles)) && ns < best_ns) {
+        best_ns = ns;
+        best_cycles = cycles;
+      }
+    }
+
+    report(name, size, nthreads, calls * nthreads, best_ns, best_cycles);
+  }
+
+cleanup:
+  for (int i = 0; i < BENCH_MAX_THREADS; i++) {
+    if (!use_rng)
+      ctr_drbg_clear(&t[i].drbg);
+  }
+}
+
+/* One large fill, as for wiping a disk */
+#define BENCH_FILL_SIZE (16 * 1024 * 1024)
+
+typedef struct {
+  CTR_DRBG_STATE drbg;
+  uint8_t *buf;
+  int nthreads;
+} BENCH_FILL;
+
+static int b_ctr_drbg_bulk(void *ctx, size_t size) {
+  BENCH_FILL *f = (BENCH_FILL *)ctx;
+  return ctr_drbg_generate_bulk(&f->drbg, f->buf, size) != SUCCESS;
+}
+
+static int b_ctr_drbg_parallel(void *ctx, size_t size) {
+  BENCH_FILL *f = (BENCH_FILL *)ctx;
+  return ctr_drbg_generate_parallel(&f->drbg, f->buf, size, f->nthreads) !=
+         SUCCESS;
+}
+
+static void bench_fill(void) {
+  static BENCH_FILL f;
+
+  if ((f.buf = malloc(BENCH_FILL_SIZE)) == NULL)
+    return;
+
+  if (ctr_drbg_init(&f.drbg, bench_entropy, NULL, 0) == SUCCESS) {
+    run("mt/ctr_drbg_generate_bulk", b_ctr_drbg_bulk, &f, BENCH_FILL_SIZE);
+    for (size_t n = 0; n < count(bench_threads); n++) {
+      f.nthreads = bench_threads[n];
+      run_mt("mt/ctr_drbg_generate_parallel", b_ctr_drbg_parallel, &f,
+             BENCH_FILL_SIZE, f.nthreads);
+    }
+    ctr_drbg_clear(&f.drbg);
+  }
+
+  free(f.buf);
+}
+
+static void bench_contention(void) {
+  run_contention("mt/RngFetchBytes", 1, 64);
+  run_contention("mt/RngFetchBytes", 1, 4096);
+
+  if (RngStartPrefetch(RNG_RING_DEFAULT_WATERMARK, RNG_RING_DEFAULT_BATCH)) {
+    run_contention("mt/RngFetchBytes/prefetch", 1, 64);
+    RngStopPrefetch();
+  }
+
+  /* No shared state; the scaling baseline */
+  run_contention("mt/ctr_drbg_generate", 0, 4096);
+
+  bench_fill();
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "Usage: %s [--json] [--quick] [--min-ms N] [filter]\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--json")) {
+      opts.json = 1;
+    } else if (!strcmp(argv[i], "--quick")) {
+      opts.min_ms = BENCH_QUICK_MIN_MS;
+    } else if (!strcmp(argv[i], "--min-ms") && i + 1 < argc) {
+      opts.min_ms = strtol(argv[++i], NULL, 10);
+      if (opts.min_ms <= 0) {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (argv[i][0] == '-') {
+      usage(argv[0]);
+      return 1;
+    } else {
+      opts.filter = argv[i];
+    }
+  }
+
+  if (!RngStart()) {
+    fprintf(stderr, "RngStart() failed\n");
+    return 1;
+  }
+
+  if (opts.json)
+    printf("[");
+  else
+    printf("name,size,threads,calls,ns_per_call,cycles_per_byte,mb_per_s\n");
+
+  bench_drbgs();
+  bench_xr_rng();
+  bench_aes();
+  bench_rng();
+  bench_bignum();
+  bench_random();
+  bench_contention();
+
+  if (opts.json)
+    printf("\n]\n");
+
+  RngStop();
+
+  return 0;
+}
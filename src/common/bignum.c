@@ -18,6 +18,20 @@
 #include <stdarg.h>
 #include <string.h>
 
+#if defined(_WIN32)
+#include <process.h>
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/* mulx/adcx/adox multiply-accumulate for 64-bit limbs on x86_64,
+   selected at runtime if the CPU supports BMI2 and ADX */
+#if (WORD_SIZE == 8) && defined(__GNUC__) && defined(__x86_64__)
+#define BN_MULX_ADX
+#include <cpuid.h>
+#endif
+
 /* Initialize one or multiple BIGNUM(s)
 
    Note: Every BIGNUM variable MUST be initialized before
@@ -40,6 +54,26 @@ void bn_init(BIGNUM *X, ...) {
   va_end(args);
 }
 
+/* Initialize X over the inline storage buf, e.g. on the stack
+
+   X starts out empty and grows within buf up to BN_INLINE_LIMBS
+   limbs without touching the allocator; a larger value moves it
+   to the heap for good. bn_zfree zeroizes buf and leaves X empty
+   over it again, and buf must outlive X.
+
+   Note: The limbs of buf past X->n are always zero */
+void bn_init_inline(BIGNUM *X, bn_inline_t buf) {
+  BN_REQUIRE(X, "X is null");
+  BN_REQUIRE(buf, "buf is null");
+
+  memset(buf, 0, sizeof(bn_inline_t));
+
+  X->p = buf;
+  X->n = 0;
+  X->s = 1;
+  X->f = BN_FLAG_BORROWED | BN_FLAG_INLINE;
+}
+
 /* Zero and free one or multiple BIGNUM(s) */
 void bn_zfree(BIGNUM *X, ...) {
   va_list args;
@@ -49,13 +83,20 @@ void bn_zfree(BIGNUM *X, ...) {
   while (X != NULL) {
     if (X->p != NULL && X->n > 0) {
       zeroize(X->p, X->n * WORD_SIZE);
-      free(X->p);
+
+      /* Borrowed limbs are given back with bn_ctx_end */
+      if (!(X->f & BN_FLAG_BORROWED))
+        free(X->p);
+    }
+
+    /* An inline BIGNUM keeps its storage for reuse */
+    if (!(X->f & BN_FLAG_INLINE)) {
+      X->p = NULL;
+      X->f = 0;
     }
 
-    X->p = NULL;
     X->n = 0;
     X->s = 1;
-    X->f = 0;
 
     X = va_arg(args, BIGNUM *);
   }
@@ -76,6 +117,13 @@ int bn_grow(BIGNUM *X, const size_t nlimbs) {
   if (X->n >= nlimbs)
     return 0;
 
+  /* Grow in place within the inline storage, which is zero
+     past X->n */
+  if ((X->f & BN_FLAG_INLINE) && nlimbs <= BN_INLINE_LIMBS) {
+    X->n = nlimbs;
+    return 0;
+  }
+
   s = X->s;
   f = X->f;
 
@@ -90,7 +138,7 @@ int bn_grow(BIGNUM *X, const size_t nlimbs) {
   X->p = p;
   X->n = nlimbs;
   X->s = s;
-  X->f = f;
+  X->f = f & ~(BN_FLAG_BORROWED | BN_FLAG_INLINE);
 
   return 0;
 }
@@ -118,6 +166,13 @@ int bn_shrink(BIGNUM *X, const size_t nlimbs) {
   if (i < nlimbs)
     i = nlimbs;
 
+  /* Stay within the inline storage, zeroizing the limbs given up */
+  if ((X->f & BN_FLAG_INLINE) && i <= X->n) {
+    zeroize(X->p + i, (X->n - i) * WORD_SIZE);
+    X->n = i;
+    return 0;
+  }
+
   if ((p = calloc(i, WORD_SIZE)) == NULL)
     return BN_ERR_OUT_OF_MEMORY;
 
@@ -129,11 +184,116 @@ int bn_shrink(BIGNUM *X, const size_t nlimbs) {
   X->p = p;
   X->n = nlimbs;
   X->s = s;
-  X->f = f;
+  X->f = f & ~(BN_FLAG_BORROWED | BN_FLAG_INLINE);
+
+  return 0;
+}
+
+/* Allocate a scratch arena of nlimbs limbs for BIGNUM temporaries,
+   or of BN_CTX_DEFAULT_LIMBS limbs if nlimbs is 0
+
+   Note: The limbs handed out by bn_ctx_get are always zero, since
+   the arena is zeroized as the temporaries are given back */
+int bn_ctx_init(BN_CTX *ctx, size_t nlimbs) {
+  BN_REQUIRE(ctx, "ctx is null");
+
+  if (nlimbs == 0)
+    nlimbs = BN_CTX_DEFAULT_LIMBS;
+
+  ctx->size = 0;
+  ctx->used = 0;
+
+  if ((ctx->p = calloc(nlimbs, WORD_SIZE)) == NULL)
+    return BN_ERR_OUT_OF_MEMORY;
+
+  ctx->size = nlimbs;
+
+  return 0;
+}
+
+/* Zero and free the scratch arena */
+void bn_ctx_free(BN_CTX *ctx) {
+  BN_REQUIRE(ctx, "ctx is null");
+
+  if (ctx->p != NULL) {
+    zeroize(ctx->p, ctx->used * WORD_SIZE);
+    free(ctx->p);
+  }
+
+  ctx->p = NULL;
+  ctx->size = 0;
+  ctx->used = 0;
+}
+
+/* Get the current top of the arena, to be passed to bn_ctx_end */
+size_t bn_ctx_start(const BN_CTX *ctx) {
+  return (ctx != NULL) ? ctx->used : 0;
+}
+
+/* Borrow nlimbs zeroed limbs from the arena for an empty X, or
+   allocate them on the heap if ctx is NULL or the arena is exhausted
+
+   Note: Unlike bn_grow, this does not enforce BN_MAX_LIMBS, so that
+   it can also hand out scratch space that does not hold a value */
+static int bn_ctx_get_hlp(BN_CTX *ctx, BIGNUM *X, const size_t nlimbs) {
+  if (nlimbs == 0)
+    return 0;
+
+  if (ctx == NULL || ctx->p == NULL || nlimbs > ctx->size - ctx->used) {
+    if ((X->p = calloc(nlimbs, WORD_SIZE)) == NULL)
+      return BN_ERR_OUT_OF_MEMORY;
+
+    X->n = nlimbs;
+    return 0;
+  }
+
+  X->p = ctx->p + ctx->used;
+  X->n = nlimbs;
+  X->f |= BN_FLAG_BORROWED;
+
+  ctx->used += nlimbs;
 
   return 0;
 }
 
+/* Borrow nlimbs limbs from the arena for X, which must be empty
+
+   If ctx is NULL or the arena is exhausted, the limbs are allocated
+   on the heap instead; either way X must be released with bn_zfree
+   before the matching bn_ctx_end. A borrowed BIGNUM that has to grow
+   is moved to the heap by bn_grow. */
+int bn_ctx_get(BN_CTX *ctx, BIGNUM *X, const size_t nlimbs) {
+  BN_REQUIRE(X, "X is null");
+  BN_REQUIRE(X->p == NULL, "X is not empty");
+
+  if (nlimbs > BN_MAX_LIMBS)
+    return BN_ERR_NOT_ENOUGH_LIMBS;
+
+  return bn_ctx_get_hlp(ctx, X, nlimbs);
+}
+
+/* Zero and give back all limbs borrowed since mark was taken */
+void bn_ctx_end(BN_CTX *ctx, size_t mark) {
+  if (ctx == NULL || ctx->p == NULL)
+    return;
+
+  BN_REQUIRE(mark <= ctx->used, "mark is invalid");
+
+  zeroize(ctx->p + mark, (ctx->used - mark) * WORD_SIZE);
+  ctx->used = mark;
+}
+
+/* Initialize X over n limbs of (stack) memory that it does not own;
+   bn_zfree only zeroizes them, and bn_grow moves X to the heap */
+static inline void bn_init_borrowed(BIGNUM *X, bn_uint_t *p, size_t n) {
+  memset(p, 0, n * WORD_SIZE);
+
+  X->p = p;
+  X->n = n;
+  X->s = 1;
+  X->f = BN_FLAG_BORROWED;
+}
+
 /* Copy the value of a udbl to the least significant
    limbs of the BIGNUM */
 int bn_from_udbl(BIGNUM *X, const bn_udbl_t n) {
@@ -146,7 +306,7 @@ int bn_from_udbl(BIGNUM *X, const bn_udbl_t n) {
   memset(X->p, 0, X->n * WORD_SIZE);
 
   X->s = 1;
-  X->f = 0;
+  X->f &= BN_FLAG_BORROWED | BN_FLAG_INLINE;
 
   n_cpy = n;
 
@@ -159,10 +319,10 @@ int bn_from_udbl(BIGNUM *X, const bn_udbl_t n) {
 #elif (WORD_SIZE == 2)
   X->p[0] = (n_cpy & 0x0000ffff);
   X->p[1] = (n_cpy & 0xffff0000) >> 16;
-#elif (WORD_SIZE == 4)
+#elif (WORD_SIZE == 4) || (WORD_SIZE == 8)
   X->p[0] = (bn_uint_t)n_cpy;
-  n_cpy >>= 32;
-  X->p[1] = n_cpy;
+  n_cpy >>= BIW;
+  X->p[1] = (bn_uint_t)n_cpy;
 #endif
 
 cleanup:
@@ -199,7 +359,7 @@ int bn_from_sdbl(BIGNUM *X, const bn_sdbl_t n) {
   memset(X->p, 0, X->n * WORD_SIZE);
 
   X->s = BN_DBL_TO_SIGN(n);
-  X->f = 0;
+  X->f &= BN_FLAG_BORROWED | BN_FLAG_INLINE;
 
   n_abs = bn_sdbl_abs(n);
 
@@ -212,10 +372,10 @@ int bn_from_sdbl(BIGNUM *X, const bn_sdbl_t n) {
 #elif (WORD_SIZE == 2)
   X->p[0] = (n_abs & 0x0000ffff);
   X->p[1] = (n_abs & 0xffff0000) >> 16;
-#elif (WORD_SIZE == 4)
+#elif (WORD_SIZE == 4) || (WORD_SIZE == 8)
   X->p[0] = (bn_uint_t)n_abs;
-  n_abs >>= 32;
-  X->p[1] = n_abs;
+  n_abs >>= BIW;
+  X->p[1] = (bn_uint_t)n_abs;
 #endif
 
 cleanup:
@@ -245,9 +405,9 @@ void bn_to_udbl(const BIGNUM *X, bn_udbl_t *n) {
 #elif (WORD_SIZE == 2)
   t += X->p[0];
   t += X->p[1] << 16;
-#elif (WORD_SIZE == 4)
-  t += X->p[1];
-  t <<= 32;
+#elif (WORD_SIZE == 4) || (WORD_SIZE == 8)
+  t += (X->n > 1) ? X->p[1] : 0;
+  t <<= BIW;
   t += X->p[0];
 #endif
 
@@ -271,76 +431,254 @@ static inline int bn_get_digit(bn_uint_t *d, int radix, char c) {
   return 0;
 }
 
+/* Conversion between radix strings and limbs
+
+   Radix 16 maps nibbles straight to limbs. Any other radix works on
+   chunks of e digits, where B = radix^e is the largest power of the
+   radix below 2^BIH, and on the powers P[i] = B^(2^i) of B, which
+   hold e * 2^i digits each: a number of more than BN_RADIX_DC_LIMBS
+   limbs is split at the largest such power and both halves are
+   converted separately [Knuth, TAOCP vol. 2, 4.4]. Reading costs one
+   multiplication per split, which bn_mul does by Karatsuba; writing
+   costs one division per split, in place of a bn_div per digit.
+   Smaller numbers take one pass over the limbs per chunk of e digits. */
+#define BN_RADIX_DC_LIMBS 16
+#define BN_RADIX_POWS 16
+
+/* The chunk size e (in digits) and B = radix^e */
+static void bn_radix_chunk(int radix, int *e, bn_uint_t *B) {
+  *B = radix;
+  for (*e = 1; *B * radix < ((bn_uint_t)1 << BIH); ++(*e))
+    *B *= radix;
+}
+
+/* P[i] = P[i-1]^2 for i up to n, P[0] must be set; the powers are
+   kept without leading zero limbs, which bn_mul would carry along */
+static int bn_radix_pows(BIGNUM *P, int n) {
+  int ret = 0, i;
+  BIGNUM T;
+
+  bn_init(&T, NULL);
+
+  for (i = 1; i <= n; ++i) {
+    BN_CHECK(bn_mul(&P[i - 1], &P[i - 1], &T));
+    BN_CHECK(bn_assign(&P[i], &T));
+  }
+
+cleanup:
+
+  bn_zfree(&T, NULL);
+
+  return ret;
+}
+
+/* X = |s[0..len)| for len <= e * 2 * BN_RADIX_DC_LIMBS, the digits
+   having been checked */
+static int bn_read_chunks(int radix, const char *s, int len, int e,
+                          BIGNUM *X) {
+  int ret, i, j, c, n;
+  bn_uint_t d, v, m, carry;
+  bn_udbl_t t;
+  BIGNUM T;
+  bn_inline_t tp;
+
+  bn_init_inline(&T, tp);
+
+  /* The leading chunk takes the remainder digits */
+  c = len % e;
+  if (c == 0)
+    c = e;
+
+  for (i = 0, n = 0; i < len; i += c, c = e) {
+    for (j = 0, v = 0, m = 1; j < c; ++j, m *= radix) {
+      bn_get_digit(&d, radix, s[i + j]);
+      v = v * radix + d;
+    }
+
+    /* T = T * radix^c + v */
+    for (j = 0, carry = v; j < n; ++j) {
+      t = (bn_udbl_t)T.p[j] * m + carry;
+      T.p[j] = (bn_uint_t)t;
+      carry = (bn_uint_t)(t >> BIW);
+    }
+    if (carry != 0)
+      T.p[n++] = carry;
+  }
+
+  T.n = (n > 0) ? n : 1;
+  ret = bn_assign(X, &T);
+
+  bn_zfree(&T, NULL);
+
+  return ret;
+}
+
+/* X = |s[0..len)|, splitting at the powers P[0..np] */
+static int bn_read_dc(int radix, const char *s, int len, int e, BIGNUM *P,
+                      int np, BIGNUM *X) {
+  int ret = 0, i;
+  BIGNUM H, L, T;
+
+  if (len <= e * 2 * BN_RADIX_DC_LIMBS)
+    return bn_read_chunks(radix, s, len, e, X);
+
+  /* Split off the low e * 2^i < len digits */
+  for (i = np; i > 0 && (e << i) >= len; --i)
+    ;
+
+  bn_init(&H, &L, &T, NULL);
+
+  BN_CHECK(bn_read_dc(radix, s, len - (e << i), e, P, i, &H));
+  BN_CHECK(bn_read_dc(radix, s + len - (e << i), e << i, e, P, i, &L));
+
+  /* X = H * P[i] + L */
+  BN_CHECK(bn_mul(&H, &P[i], &T));
+  BN_CHECK(bn_add_abs(&T, &L, &T));
+  BN_CHECK(bn_assign(X, &T));
+
+cleanup:
+
+  bn_zfree(&H, &L, &T, NULL);
+
+  return ret;
+}
+
 /* Read X from an ASCII string */
 int bn_read_string(int radix, char *s, BIGNUM *X) {
   BN_REQUIRE(X, "X is null");
+  BN_REQUIRE(s, "s is null");
 
-  int ret = 0, i, j, n;
-  bn_uint_t d;
-  BIGNUM T;
+  int ret = 0, i, j, len, neg, e, np;
+  bn_uint_t d, B;
+  BIGNUM P[BN_RADIX_POWS];
 
   if (radix < 2 || radix > 16)
     return BN_ERR_BAD_INPUT_DATA;
 
-  bn_init(&T, NULL);
+  neg = (s[0] == '-');
+  s += neg;
+  len = (int)strlen(s);
+
+  for (i = 0; i < len; ++i) {
+    if ((ret = bn_get_digit(&d, radix, s[i])) != 0)
+      return ret;
+  }
+
+  /* Leading zeros would only cost limbs */
+  for (; len > 1 && s[0] == '0'; --len)
+    ++s;
+
+  for (i = 0; i < BN_RADIX_POWS; ++i)
+    bn_init(&P[i], NULL);
+  np = 0;
 
   if (radix == 16) {
-    n = BN_BITS_TO_LIMBS(strlen(s) << 2);
-    BN_CHECK(bn_grow(X, n));
+    BN_CHECK(bn_grow(X, BN_BITS_TO_LIMBS(len << 2)));
     BN_CHECK(bn_from_udbl(X, 0));
 
-    for (i = strlen(s) - 1, j = 0; i >= 0; i--, j++) {
-      if (i == 0 && s[i] == '-') {
-        X->s = -1;
-        break;
-      }
-
-      BN_CHECK(bn_get_digit(&d, radix, s[i]));
+    for (i = len - 1, j = 0; i >= 0; i--, j++) {
+      bn_get_digit(&d, radix, s[i]);
       X->p[j / (2 * WORD_SIZE)] |= d << ((j % (2 * WORD_SIZE)) << 2);
     }
   } else {
-    BN_CHECK(bn_from_udbl(X, 0));
+    bn_radix_chunk(radix, &e, &B);
 
-    for (i = 0; i < (int)strlen(s); i++) {
-      if (i == 0 && s[i] == '-') {
-        X->s = -1;
-        continue;
-      }
+    /* The powers needed for len digits */
+    while (np < BN_RADIX_POWS - 1 && (e << (np + 1)) < len)
+      ++np;
 
-      BN_CHECK(bn_get_digit(&d, radix, s[i]));
-      BN_CHECK(bn_mul_sdbl(X, radix, &T));
-      BN_CHECK(bn_add_sdbl(&T, d, X));
-    }
+    BN_CHECK(bn_from_udbl(&P[0], B));
+    if (len > e * 2 * BN_RADIX_DC_LIMBS)
+      BN_CHECK(bn_radix_pows(P, np));
+
+    BN_CHECK(bn_read_dc(radix, s, len, e, P, np, X));
   }
 
+  X->s = (neg && !bn_is_zero(X)) ? -1 : 1;
+
 cleanup:
 
-  bn_zfree(&T, NULL);
+  for (i = 0; i < BN_RADIX_POWS; ++i)
+    bn_zfree(&P[i], NULL);
 
   return ret;
 }
 
-/* Helper to write the digits high-order first */
-static int bn_write_hlp(int radix, char **p, BIGNUM *X) {
+/* Write the digits of 0 <= X < 2^(BIW * BN_RADIX_DC_LIMBS) at *p,
+   zero padded to pad digits if pad is nonzero; X is destroyed */
+static void bn_write_chunks(int radix, char **p, BIGNUM *X, int e, bn_uint_t B,
+                            int pad) {
+  static const char digits[] = "0123456789ABCDEF";
+  char buf[(BN_RADIX_DC_LIMBS + 1) * BIW];
+  int i, j, n, len;
+  bn_uint_t x, y, zh, zl;
+  const bn_uint_t lo = ((bn_uint_t)1 << BIH) - 1;
+
+  for (n = X->n; n > 0 && X->p[n - 1] == 0; --n)
+    ;
+
+  /* The digits come out low-order first */
+  for (len = 0; n > 0;) {
+    for (i = n - 1, y = 0; i >= 0; --i) {
+      x = X->p[i];
+      y = (y << BIH) | (x >> BIH);
+      zh = y / B;
+      y -= zh * B;
+      y = (y << BIH) | (x & lo);
+      zl = y / B;
+      y -= zl * B;
+      X->p[i] = (zh << BIH) | zl;
+    }
+
+    if (X->p[n - 1] == 0)
+      --n;
+
+    for (j = 0; j < e; ++j, y /= radix)
+      buf[len++] = digits[y % radix];
+  }
+
+  while (len > 0 && buf[len - 1] == '0')
+    --len;
+
+  if (len == 0 && pad == 0)
+    buf[len++] = '0';
+
+  for (; pad > len; --pad)
+    *(*p)++ = '0';
+
+  while (len > 0)
+    *(*p)++ = buf[--len];
+}
+
+/* Write the digits of 0 <= X < P[i + 1] at *p, zero padded to pad
+   digits if pad is nonzero; X is destroyed */
+static int bn_write_dc(int radix, char **p, BIGNUM *X, int e, bn_uint_t B,
+                       BIGNUM *P, int i, int pad) {
   int ret = 0;
-  bn_uint_t r;
+  BIGNUM Q, R;
 
-  if (radix < 2 || radix > 16)
-    return BN_ERR_BAD_INPUT_DATA;
+  /* Find the split, if X is not small */
+  while (i >= 0 && BN_BITS_TO_LIMBS(bn_msb(X)) > BN_RADIX_DC_LIMBS &&
+         bn_cmp_abs(X, &P[i]) < 0)
+    --i;
 
-  BN_CHECK(bn_mod_uint(X, radix, &r));
-  BN_CHECK(bn_div_sdbl(X, radix, X, NULL));
+  if (i < 0 || BN_BITS_TO_LIMBS(bn_msb(X)) <= BN_RADIX_DC_LIMBS) {
+    bn_write_chunks(radix, p, X, e, B, pad);
+    return 0;
+  }
 
-  if (bn_cmp_sdbl(X, 0) != 0)
-    BN_CHECK(bn_write_hlp(radix, p, X));
+  bn_init(&Q, &R, NULL);
 
-  if (r < 10)
-    *(*p)++ = (char)(r + 0x30);
-  else
-    *(*p)++ = (char)(r + 0x37);
+  /* X = Q * P[i] + R, where R has e * 2^i digits */
+  BN_CHECK(bn_div(X, &P[i], &Q, &R));
+  BN_CHECK(bn_write_dc(radix, p, &Q, e, B, P, i - 1,
+                       pad ? pad - (e << i) : 0));
+  BN_CHECK(bn_write_dc(radix, p, &R, e, B, P, i - 1, e << i));
 
 cleanup:
 
+  bn_zfree(&Q, &R, NULL);
+
   return ret;
 }
 
@@ -348,9 +686,10 @@ cleanup:
 int bn_write_string(int radix, char *s, int *slen, const BIGNUM *X) {
   BN_REQUIRE(X, "X is null");
 
-  int ret = 0, n;
+  int ret = 0, i, n, e, np, msb;
   char *p;
-  BIGNUM T;
+  bn_uint_t B;
+  BIGNUM T, P[BN_RADIX_POWS];
 
   if (radix < 2 || radix > 16)
     return BN_ERR_BAD_INPUT_DATA;
@@ -368,13 +707,13 @@ int bn_write_string(int radix, char *s, int *slen, const BIGNUM *X) {
   }
 
   p = s;
-  bn_init(&T, NULL);
 
   if (X->s == -1)
     *p++ = '-';
 
   if (radix == 16) {
-    int c, i, j, k;
+    static const char digits[] = "0123456789ABCDEF";
+    int c, j, k;
 
     for (i = X->n - 1, k = 0; i >= 0; i--) {
       for (j = WORD_SIZE - 1; j >= 0; j--) {
@@ -383,21 +722,51 @@ int bn_write_string(int radix, char *s, int *slen, const BIGNUM *X) {
         if (c == 0 && k == 0 && (i + j) != 0)
           continue;
 
-        p += sprintf(p, "%02X", c);
+        *p++ = digits[c >> 4];
+        *p++ = digits[c & 0x0F];
         k = 1;
       }
     }
-  } else {
-    BN_CHECK(bn_assign(&T, X));
-    BN_CHECK(bn_write_hlp(radix, &p, &T));
+
+    *p++ = '\0';
+    *slen = p - s;
+
+    return 0;
+  }
+
+  bn_init(&T, NULL);
+  for (i = 0; i < BN_RADIX_POWS; ++i)
+    bn_init(&P[i], NULL);
+
+  bn_radix_chunk(radix, &e, &B);
+  msb = bn_msb(X);
+
+  BN_CHECK(bn_assign(&T, X));
+  T.s = 1;
+  BN_CHECK(bn_from_udbl(&P[0], B));
+
+  /* The largest power P[np] <= X, past the size of the chunked
+     conversion; P[np + 1] is only squared when it may still fit */
+  np = -1;
+  if (BN_BITS_TO_LIMBS(msb) > BN_RADIX_DC_LIMBS) {
+    for (np = 0; np < BN_RADIX_POWS - 1 && 2 * bn_msb(&P[np]) - 2 < msb;
+         ++np) {
+      BN_CHECK(bn_radix_pows(P + np, 1));
+      if (bn_cmp_abs(&P[np + 1], &T) > 0)
+        break;
+    }
   }
 
+  BN_CHECK(bn_write_dc(radix, &p, &T, e, B, P, np, 0));
+
   *p++ = '\0';
   *slen = p - s;
 
 cleanup:
 
   bn_zfree(&T, NULL);
+  for (i = 0; i < BN_RADIX_POWS; ++i)
+    bn_zfree(&P[i], NULL);
 
   return (ret);
 }
@@ -485,9 +854,13 @@ cleanup:
 int bn_msb(const BIGNUM *X) {
   BN_REQUIRE(X, "X is null");
 
+/* Note: unsigned long is only 32 bits wide on LLP64 (Windows) targets,
+   so pick the builtin for the limb type rather than clzl */
 #if defined(__has_builtin)
-#if (WORD_SIZE == 4) && __has_builtin(__builtin_clzl)
-#define _bn_uint_clzl __builtin_clzl
+#if (WORD_SIZE == 4) && __has_builtin(__builtin_clz)
+#define _bn_uint_clzl __builtin_clz
+#elif (WORD_SIZE == 8) && __has_builtin(__builtin_clzll)
+#define _bn_uint_clzl __builtin_clzll
 #endif
 #endif
 
@@ -501,6 +874,9 @@ int bn_msb(const BIGNUM *X) {
       break;
   }
 
+  if (X->p[i] == 0)
+    return 0;
+
 #if defined(_bn_uint_clzl)
   j = _bn_uint_clzl(X->p[i]);
 #else
@@ -520,8 +896,10 @@ int bn_lsb(const BIGNUM *X) {
   BN_REQUIRE(X, "X is null");
 
 #if defined(__has_builtin)
-#if (WORD_SIZE == 4) && __has_builtin(__builtin_ctzl)
-#define _bn_uint_ctzl __builtin_ctzl
+#if (WORD_SIZE == 4) && __has_builtin(__builtin_ctz)
+#define _bn_uint_ctzl __builtin_ctz
+#elif (WORD_SIZE == 8) && __has_builtin(__builtin_ctzll)
+#define _bn_uint_ctzl __builtin_ctzll
 #endif
 #endif
 
@@ -868,9 +1246,10 @@ int bn_add_sdbl(BIGNUM *A, const bn_sdbl_t b, BIGNUM *X) {
   BN_REQUIRE(X, "X is null");
 
   int ret = 0;
+  bn_uint_t BP[sizeof(bn_sdbl_t) / WORD_SIZE];
   BIGNUM B;
 
-  bn_init(&B, NULL);
+  bn_init_borrowed(&B, BP, sizeof(BP) / sizeof(*BP));
   BN_CHECK(bn_from_sdbl(&B, b));
 
   ret = bn_add(A, &B, X);
@@ -888,9 +1267,10 @@ int bn_sub_sdbl(BIGNUM *A, const bn_sdbl_t b, BIGNUM *X) {
   BN_REQUIRE(X, "X is null");
 
   int ret = 0;
+  bn_uint_t BP[sizeof(bn_sdbl_t) / WORD_SIZE];
   BIGNUM B;
 
-  bn_init(&B, NULL);
+  bn_init_borrowed(&B, BP, sizeof(BP) / sizeof(*BP));
   BN_CHECK(bn_from_sdbl(&B, b));
 
   ret = bn_sub(A, &B, X);
@@ -959,7 +1339,7 @@ int bn_rshift(BIGNUM *X, const int count) {
   c1 = count & (BIW - 1);
 
   if (c0 > n || (c0 == n && c1 > 0)) {
-    memset(X, 0, n * WORD_SIZE);
+    memset(X->p, 0, X->n * WORD_SIZE);
     return 0;
   }
 
@@ -985,30 +1365,116 @@ int bn_rshift(BIGNUM *X, const int count) {
   return 0;
 }
 
-#include <limits.h>
-// TODO: Fix Karatsuba multiplication
-// #define BN_KARATSUBA_CUTOFF 80
-// #define BN_KARATSUBA_SQUARE_CUTOFF 100
-#define BN_KARATSUBA_CUTOFF INT_MAX
-#define BN_KARATSUBA_SQUARE_CUTOFF INT_MAX
+/* Operand sizes (in limbs) from which the Karatsuba routines are used
+   instead of the schoolbook routines below. The defaults were measured
+   with 32-bit and 64-bit limbs on x86_64 at -O2 (see bn_mul_hlp); both
+   can be overridden at compile time. */
+#if (WORD_SIZE == 8)
+#ifndef BN_KARATSUBA_CUTOFF
+#define BN_KARATSUBA_CUTOFF 40
+#endif
+#ifndef BN_KARATSUBA_SQUARE_CUTOFF
+#define BN_KARATSUBA_SQUARE_CUTOFF 96
+#endif
+#else
+#ifndef BN_KARATSUBA_CUTOFF
+#define BN_KARATSUBA_CUTOFF 32
+#endif
+#ifndef BN_KARATSUBA_SQUARE_CUTOFF
+#define BN_KARATSUBA_SQUARE_CUTOFF 64
+#endif
+#endif
+
+#if BN_KARATSUBA_CUTOFF < 2 || BN_KARATSUBA_SQUARE_CUTOFF < 2
+#error "Karatsuba cutoffs must be at least 2 limbs"
+#endif
+
+/* Multiply-accumulate one limb: (c, *d) = *s * b + c + *d
 
+   This can not overflow the double word since
+   (2^BIW - 1)^2 + 2 * (2^BIW - 1) = 2^(2 * BIW) - 1 */
 #define MLAC                                                                   \
-  r = *(s++) * (bn_udbl_t)b;                                                   \
-  r0 = r;                                                                      \
-  r1 = r >> BIW;                                                               \
-  r0 += c;                                                                     \
-  r1 += (r0 < c);                                                              \
-  r0 += *d;                                                                    \
-  r1 += (r0 < *d);                                                             \
-  c = r1;                                                                      \
-  *(d++) = r0;
+  r = *(s++) * (bn_udbl_t)b + c + *d;                                          \
+  c = (bn_uint_t)(r >> BIW);                                                   \
+  *(d++) = (bn_uint_t)r;
 
-static inline void bn_mul1_hlp(int i, bn_uint_t *s, bn_uint_t *d, bn_uint_t b) {
+#if defined(BN_MULX_ADX)
+/* Returns 1 if the CPU supports BMI2 (mulx) and ADX (adcx/adox) */
+static int bn_cpu_has_adx(void) {
+  static volatile int has_adx = -1;
+  unsigned int eax, ebx, ecx, edx;
+
+  if (has_adx != -1)
+    return has_adx;
+
+  has_adx = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+            (ebx & (1 << 8)) && (ebx & (1 << 19));
+
+  return has_adx;
+}
+
+/* d[0..4n) += s[0..4n) * b, returns the carry limb
+
+   mulx leaves the flags untouched, so the high halves of the
+   products are added on the CF chain (adcx) and the limbs of d
+   on the OF chain (adox), with two independent carry chains in
+   flight; the loop is closed with lea/jrcxz for the same reason. */
+static bn_uint_t bn_mul1_adx(size_t n, const bn_uint_t *s, bn_uint_t *d,
+                             bn_uint_t b) {
+  bn_uint_t c = 0, lo, hi, z;
+
+  __asm__ volatile("xorl %k[lo], %k[lo]\n\t"
+                   "movq $0, %[z]\n\t"
+                   "1:\n\t"
+                   "mulxq 0(%[s]), %[lo], %[hi]\n\t"
+                   "adcxq %[c], %[lo]\n\t"
+                   "adoxq 0(%[d]), %[lo]\n\t"
+                   "movq %[lo], 0(%[d])\n\t"
+                   "mulxq 8(%[s]), %[lo], %[c]\n\t"
+                   "adcxq %[hi], %[lo]\n\t"
+                   "adoxq 8(%[d]), %[lo]\n\t"
+                   "movq %[lo], 8(%[d])\n\t"
+                   "mulxq 16(%[s]), %[lo], %[hi]\n\t"
+                   "adcxq %[c], %[lo]\n\t"
+                   "adoxq 16(%[d]), %[lo]\n\t"
+                   "movq %[lo], 16(%[d])\n\t"
+                   "mulxq 24(%[s]), %[lo], %[c]\n\t"
+                   "adcxq %[hi], %[lo]\n\t"
+                   "adoxq 24(%[d]), %[lo]\n\t"
+                   "movq %[lo], 24(%[d])\n\t"
+                   "leaq 32(%[s]), %[s]\n\t"
+                   "leaq 32(%[d]), %[d]\n\t"
+                   "leaq -1(%[n]), %[n]\n\t"
+                   "jrcxz 2f\n\t"
+                   "jmp 1b\n\t"
+                   "2:\n\t"
+                   "adcxq %[z], %[c]\n\t"
+                   "adoxq %[z], %[c]\n\t"
+                   : [s] "+r"(s), [d] "+r"(d), [n] "+c"(n), [c] "+r"(c),
+                     [lo] "=&r"(lo), [hi] "=&r"(hi), [z] "=&r"(z)
+                   : "d"(b)
+                   : "cc", "memory");
+
+  return c;
+}
+#endif
+
+/* d[0..i) += s[0..i) * b, returns the carry limb */
+static inline bn_uint_t bn_mul1_row(int i, const bn_uint_t *s, bn_uint_t *d,
+                                    bn_uint_t b) {
   bn_uint_t c = 0; /* carry */
 
+#if defined(BN_MULX_ADX)
+  if (i >= 4 && bn_cpu_has_adx()) {
+    c = bn_mul1_adx(i >> 2, s, d, b);
+    s += i & ~3;
+    d += i & ~3;
+    i &= 3;
+  }
+#endif
+
   for (; i >= 16; i -= 16) {
     bn_udbl_t r;
-    bn_uint_t r0, r1;
     MLAC MLAC
 	MLAC MLAC
 	MLAC MLAC
@@ -1021,7 +1487,6 @@ static inline void bn_mul1_hlp(int i, bn_uint_t *s, bn_uint_t *d, bn_uint_t b) {
 
   for (; i >= 8; i -= 8) {
     bn_udbl_t r;
-    bn_uint_t r0, r1;
     MLAC MLAC
 	MLAC MLAC
 	MLAC MLAC
@@ -1030,10 +1495,18 @@ static inline void bn_mul1_hlp(int i, bn_uint_t *s, bn_uint_t *d, bn_uint_t b) {
 
   for (; i > 0; i--) {
     bn_udbl_t r;
-    bn_uint_t r0, r1;
     MLAC
   }
 
+  return c;
+}
+
+/* d += s[0..i) * b, propagating the carry past d[i] */
+static inline void bn_mul1_hlp(int i, bn_uint_t *s, bn_uint_t *d, bn_uint_t b) {
+  bn_uint_t c = bn_mul1_row(i, s, d, b);
+
+  d += i;
+
   do {
     *d += c;
     c = (*d < c);
@@ -1041,174 +1514,380 @@ static inline void bn_mul1_hlp(int i, bn_uint_t *s, bn_uint_t *d, bn_uint_t b) {
   } while (c != 0);
 }
 
-/* Pen-and-paper multiplication [HAC 14.12] */
-static int bn_mul1(BIGNUM *A, BIGNUM *B, BIGNUM *X) {
-  int ret = 0, i, j;
+/* d[0..n) = a[0..n) + b[0..n), returns the carry out */
+static bn_uint_t bn_add_n_hlp(int n, const bn_uint_t *a, const bn_uint_t *b,
+                              bn_uint_t *d) {
+  int i;
+  bn_uint_t c, t;
 
-  for (i = (int)A->n - 1; i >= 0; i--)
-    if (A->p[i] != 0)
-      break;
+  for (i = c = 0; i < n; ++i) {
+    t = a[i] + c;
+    c = (t < c);
+    t += b[i];
+    c += (t < b[i]);
+    d[i] = t;
+  }
 
-  for (j = (int)B->n - 1; j >= 0; j--)
-    if (B->p[j] != 0)
-      break;
+  return c;
+}
 
-  BN_CHECK(bn_grow(X, i + j + 2));
-  BN_CHECK(bn_from_udbl(X, 0));
+/* d[0..n) = a[0..n) - b[0..n), returns the borrow out */
+static bn_uint_t bn_sub_n_hlp(int n, const bn_uint_t *a, const bn_uint_t *b,
+                              bn_uint_t *d) {
+  int i;
+  bn_uint_t c, t, z;
 
-  for (i++; j >= 0; j--)
-    bn_mul1_hlp(i, A->p, X->p + j, B->p[j]);
+  for (i = c = 0; i < n; ++i) {
+    z = (a[i] < c);
+    t = a[i] - c;
+    c = (t < b[i]) + z;
+    d[i] = t - b[i];
+  }
 
-cleanup:
+  return c;
+}
 
-  return ret;
+/* d += s[0..n), propagating the carry; d must be large
+   enough to hold the result */
+static void bn_add_into_hlp(int n, const bn_uint_t *s, bn_uint_t *d) {
+  bn_uint_t c;
+
+  c = bn_add_n_hlp(n, d, s, d);
+
+  for (d += n; c != 0; ++d) {
+    *d += c;
+    c = (*d < c);
+  }
 }
 
-static int bn_mul_hlp(BIGNUM *A, BIGNUM *B, BIGNUM *X, int alen, int blen);
+/* d[0..h) = abs(x[0..h) - y[0..m)) where m <= h <= m + 1,
+   returns 1 if x < y and 0 otherwise */
+static int bn_abs_diff_hlp(bn_uint_t *d, const bn_uint_t *x, int h,
+                           const bn_uint_t *y, int m) {
+  int i, neg = 0;
 
-/* Karatsuba multiplication using three half-size multiplications
+  if (h == m || x[m] == 0) {
+    for (i = m - 1; i >= 0; --i) {
+      if (x[i] != y[i]) {
+        neg = (x[i] < y[i]);
+        break;
+      }
+    }
+  }
 
-   Let R represent the radix (i.e. 2**BIW) and let n represent
-   half the number of limbs/digits/words in min(A, B).
+  if (neg) {
+    bn_sub_n_hlp(m, y, x, d);
+    if (h > m)
+      d[m] = 0;
+  } else {
+    bn_uint_t c = bn_sub_n_hlp(m, x, y, d);
+    if (h > m)
+      d[m] = x[m] - c;
+  }
 
-   A and B can be represented as:
-   A = A1 * R**n + A0
-   B = B1 * R**n + B0
+  return neg;
+}
 
-   Then,
-   A * B =>
-   A1B1 * R**2m + ((A1 + A0)(B1 + B0) - (A0B0 + A1B1)) * R**n + A0B0
-
-   Note: Since we only need to compute A0B0, A1B1 and
-   (A1 + A0)(B1 + B0) once each, the whole product can be computed
-   with only three half-size multiplications, saving 1/4th or 25%
-   of the single precision multiplications.
-
-   Note: This function can make a (recursive) call to itself
-   - We perform the 'single digit' multiplications by calling
-    back the generic multiply function, which can lead us back
-    into this function if a0, a1, b0 or b1 are above the cutoff.
-   - This 'divide-and-conquer' approach results in the famous
-    O(n**log(3)) or O(n**1.584) elementary operations, making
-    it asymptotically faster than the O(n**2) grade school
-	algorithm. */
-static int bn_mul2(BIGNUM *A, BIGNUM *B, BIGNUM *X) {
-  int ret = 0, alen, blen, a1, a0, b1, b0, R;
-  BIGNUM A1, A0, B1, B0, A1B1, A0B0, T;
+/* Schoolbook multiplication [HAC 14.12]: r[0..an+bn) = a * b
 
-  alen = A->n;
-  blen = B->n;
+   Row j only ever carries into r[j + an], which no earlier row has
+   touched, so the carry is stored rather than propagated and the
+   running time does not depend on the operand values. */
+static void bn_mul_basecase(bn_uint_t *r, const bn_uint_t *a, int an,
+                            const bn_uint_t *b, int bn) {
+  int j;
 
-  /* half the min # of limbs (we have ensured alen <= blen) */
-  R = alen >> 1;
+  memset(r, 0, an * WORD_SIZE);
 
-  a0 = R;
-  a1 = alen - R;
-  b0 = R;
-  b1 = blen - R;
+  for (j = 0; j < bn; ++j)
+    r[j + an] = bn_mul1_row(an, a, r + j, b[j]);
+}
 
-  bn_init(&A1, &A0, &B1, &B0, &A0B0, &A1B1, &T, NULL);
+/* Schoolbook squaring [HAC 14.16]: r[0..2n) = a * a
 
-  /* Allocate memory for temps */
-  BN_CHECK(bn_grow(&A0, a0));
-  BN_CHECK(bn_grow(&B0, b0));
-  BN_CHECK(bn_grow(&A1, a1));
-  BN_CHECK(bn_grow(&B1, b1));
+   Every cross product a[i]*a[j] with i != j appears twice in
+   the square, so only the products with i < j are computed and
+   the sum is doubled before adding the squares a[i]**2 on the
+   diagonal; this needs about half the limb multiplications. As in
+   bn_mul_basecase, row i only carries into the untouched r[n + i]. */
+static void bn_sqr_basecase(bn_uint_t *r, const bn_uint_t *a, int n) {
+  int i;
+  bn_udbl_t t;
+  bn_uint_t c, hi;
 
-  /* We have guaranteed that these temps are big enough,
-     so we populate directly using memcpy */
-  memcpy(A0.p, A->p, a0 * WORD_SIZE);
-  memcpy(B0.p, B->p, b0 * WORD_SIZE);
-  memcpy(A1.p, A->p + a0, a1 * WORD_SIZE);
-  memcpy(B1.p, B->p + b0, b1 * WORD_SIZE);
+  memset(r, 0, (2 * n) * WORD_SIZE);
 
-  /* Compute A0*B0 and A1*B1 */
-  BN_CHECK(bn_mul_hlp(&A0, &B0, &A0B0, a0, b0));
-  BN_CHECK(bn_mul_hlp(&A1, &B1, &A1B1, a1, b1));
+  for (i = 0; i < n - 1; ++i)
+    r[n + i] = bn_mul1_row(n - i - 1, a + i + 1, r + 2 * i + 1, a[i]);
 
-  /* A1 = A1 + A0 */
-  BN_CHECK(bn_add_abs(&A1, &A0, &A1));
-  /* B1 = B1 + B0 */
-  BN_CHECK(bn_add_abs(&B1, &B0, &B1));
+  for (i = c = 0; i < 2 * n; ++i) {
+    hi = r[i] >> (BIW - 1);
+    r[i] = (r[i] << 1) | c;
+    c = hi;
+  }
 
-  /* B1 = (A1 + A0)*(B1 + B0) */
-  BN_CHECK(bn_mul_hlp(&A1, &B1, &B1, A1.n, B1.n));
-  /* A1 = A1*B1 + A0*B0 */
-  BN_CHECK(bn_add_abs(&A1B1, &A0B0, &A1));
+  for (i = c = 0; i < n; ++i) {
+    t = a[i] * (bn_udbl_t)a[i] + r[2 * i] + c;
+    r[2 * i] = (bn_uint_t)t;
+    hi = (bn_uint_t)(t >> BIW);
 
-  /* T = (A1 + A0)*(B1 + B0) - (A1*B1 + A0*B0) */
-  BN_CHECK(bn_sub(&B1, &A1, &T));
+    r[2 * i + 1] += hi;
+    c = (r[2 * i + 1] < hi);
+  }
+}
 
-  /* T = ((A1 + A0)*(B1 + B0) - (A1*B1 + A0*B0)) << R */
-  BN_CHECK(bn_lshift(&T, R * BIW));
-  /* A1B1 = A1*B1 << 2R */
-  BN_CHECK(bn_lshift(&A1B1, (2 * R) * BIW));
+/* Karatsuba multiplication using three half-size multiplications
 
-  /* T = A0*B0 + T */
-  BN_CHECK(bn_add_abs(&A0B0, &T, &T));
-  /* X = A0*B0 + T + A1*B1 */
-  BN_CHECK(bn_add_abs(&T, &A1B1, X));
+   Let R represent the radix (i.e. 2**BIW) and split the n-limb
+   operands at m = floor(n/2) limbs, with h = n - m:
+   A = A1 * R**m + A0
+   B = B1 * R**m + B0
 
-cleanup:
+   Then,
+   A * B =>
+   A1B1 * R**2m + (A1B1 + A0B0 - (A1 - A0)(B1 - B0)) * R**m + A0B0
+
+   Note: Using the difference (A1 - A0)(B1 - B0) rather than the
+   sum (A1 + A0)(B1 + B0) keeps the middle product at h limbs
+   (the sum may carry into an extra limb); its sign is tracked
+   separately and all three products are computed on magnitudes.
+
+   Note: This function makes recursive calls to itself until the
+   operands drop below BN_KARATSUBA_CUTOFF limbs, resulting in the
+   famous O(n**log(3)) or O(n**1.584) elementary operations.
+
+   The temporaries of each level are carved out of ws, which must
+   hold at least bn_karatsuba_ws(n) limbs. */
+static void bn_kmul_hlp(bn_uint_t *r, const bn_uint_t *a, const bn_uint_t *b,
+                        int n, bn_uint_t *ws) {
+  int m, h, neg;
+  bn_uint_t *da, *db, *t, *u;
+
+  if (n < BN_KARATSUBA_CUTOFF) {
+    bn_mul_basecase(r, a, n, b, n);
+    return;
+  }
 
-  bn_init(&A1, &A0, &B1, &B0, &A0B0, &A1B1, &T, NULL);
+  m = n >> 1;
+  h = n - m;
 
-  return ret;
+  da = ws;
+  db = ws + h;
+  t = ws + 2 * h;
+  u = ws + 4 * h;
+
+  /* r = A1B1 * R**2m + A0B0 */
+  bn_kmul_hlp(r, a, b, m, ws);
+  bn_kmul_hlp(r + 2 * m, a + m, b + m, h, ws);
+
+  /* t = abs(A1 - A0) * abs(B1 - B0) */
+  neg = bn_abs_diff_hlp(da, a + m, h, a, m);
+  neg ^= bn_abs_diff_hlp(db, b + m, h, b, m);
+  bn_kmul_hlp(t, da, db, h, ws + 4 * h);
+
+  /* u = A1B1 + A0B0 - (A1 - A0)(B1 - B0) */
+  memcpy(u, r + 2 * m, (2 * h) * WORD_SIZE);
+  u[2 * h] = 0;
+  bn_add_into_hlp(2 * m, r, u);
+
+  if (neg)
+    bn_add_into_hlp(2 * h, t, u);
+  else
+    u[2 * h] -= bn_sub_n_hlp(2 * h, u, t, u);
+
+  bn_add_into_hlp(2 * h + 1, u, r + m);
 }
 
-/* Helper function for generic multiplication */
-static int bn_mul_hlp(BIGNUM *A, BIGNUM *B, BIGNUM *X, int alen, int blen) {
-  int ret = 0, i;
+/* Karatsuba squaring; same as bn_kmul_hlp with A = B, where
+   the middle term A1**2 + A0**2 - (A1 - A0)**2 is never negative */
+static void bn_ksqr_hlp(bn_uint_t *r, const bn_uint_t *a, int n,
+                        bn_uint_t *ws) {
+  int m, h;
+  bn_uint_t *da, *t, *u;
 
-  if (alen == 0 || blen == 0) {
-    BN_CHECK(bn_grow(X, alen + blen));
-    memset(X->p, 0, (alen + blen) * WORD_SIZE);
-    return 0;
+  if (n < BN_KARATSUBA_SQUARE_CUTOFF) {
+    bn_sqr_basecase(r, a, n);
+    return;
   }
 
-  /* Rearrange so that B is bigger in size than A */
-  if (alen > blen) {
-    BIGNUM *T = A;
-    A = B;
-    B = T;
+  m = n >> 1;
+  h = n - m;
 
-    i = alen;
-    alen = blen;
-    blen = i;
-  }
+  da = ws;
+  t = ws + h;
+  u = ws + 3 * h;
 
-  /* Check size requirements - use the Karatsuba method if the
-     smaller number is greater in size than BN_KARATSUBA_CUTOFF */
-  i = (A == B) ? BN_KARATSUBA_SQUARE_CUTOFF : BN_KARATSUBA_CUTOFF;
+  bn_ksqr_hlp(r, a, m, ws);
+  bn_ksqr_hlp(r + 2 * m, a + m, h, ws);
 
-  if (alen >= i)
-    /* Use Karatsuba multiplication */
-    return bn_mul2(A, B, X);
-  else
-    /* Use gradeschool multiplication */
-    return bn_mul1(A, B, X);
+  bn_abs_diff_hlp(da, a + m, h, a, m);
+  bn_ksqr_hlp(t, da, h, ws + 3 * h);
 
-cleanup:
+  memcpy(u, r + 2 * m, (2 * h) * WORD_SIZE);
+  u[2 * h] = 0;
+  bn_add_into_hlp(2 * m, r, u);
+  u[2 * h] -= bn_sub_n_hlp(2 * h, u, t, u);
 
-  return ret;
+  bn_add_into_hlp(2 * h + 1, u, r + m);
 }
 
-/* Signed multiplication: X = A * B */
-int bn_mul(BIGNUM *A, BIGNUM *B, BIGNUM *X) {
-  BN_REQUIRE(A, "A is null");
-  BN_REQUIRE(B, "B is null");
-  BN_REQUIRE(X, "X is null");
+/* Scratch limbs needed by bn_kmul_hlp and bn_ksqr_hlp for n-limb
+   operands with the given cutoff */
+static size_t bn_karatsuba_ws(int n, int cutoff) {
+  size_t h, w;
 
-  int ret = 0, alen, blen;
-  BIGNUM TA, TB;
+  if (n < cutoff)
+    return 0;
 
-  bn_init(&TA, &TB, NULL);
+  h = n - (n >> 1);
+  w = 4 * h + bn_karatsuba_ws(h, cutoff);
 
-  /* In any case A->n + B->n limbs will always be enough to
-     hold the result, but we keep two extra limbs to prevent
-     a buffer overflow in bn_mul1_hlp */
-  if (A->n + B->n + 2 >= BN_MAX_LIMBS)
-    return BN_ERR_NOT_ENOUGH_LIMBS;
+  return (w > 6 * h + 1) ? w : 6 * h + 1;
+}
+
+/* Unbalanced multiplication: r[0..an+bn) = a * b
+
+   If the smaller operand is above the cutoff, the larger operand
+   is cut into pieces of the size of the smaller one which are
+   multiplied with Karatsuba and accumulated into r. */
+static void bn_mul_limbs(bn_uint_t *r, const bn_uint_t *a, int an,
+                         const bn_uint_t *b, int bn, bn_uint_t *ws) {
+  int off;
+  bn_uint_t *t;
+
+  if (an > bn) {
+    const bn_uint_t *T = a;
+    a = b;
+    b = T;
+
+    off = an;
+    an = bn;
+    bn = off;
+  }
+
+  if (an < BN_KARATSUBA_CUTOFF) {
+    bn_mul_basecase(r, a, an, b, bn);
+    return;
+  }
+
+  if (an == bn) {
+    bn_kmul_hlp(r, a, b, an, ws);
+    return;
+  }
+
+  t = ws;
+  ws += 2 * an;
+
+  memset(r, 0, (an + bn) * WORD_SIZE);
+
+  for (off = 0; bn - off >= an; off += an) {
+    bn_kmul_hlp(t, a, b + off, an, ws);
+    bn_add_into_hlp(2 * an, t, r + off);
+  }
+
+  if (off < bn) {
+    bn_mul_limbs(t, a, an, b + off, bn - off, ws);
+    bn_add_into_hlp(an + bn - off, t, r + off);
+  }
+}
+
+/* Scratch limbs needed by bn_mul_limbs */
+static size_t bn_mul_limbs_ws(int an, int bn) {
+  size_t w, w1;
+
+  if (an > bn) {
+    int T = an;
+    an = bn;
+    bn = T;
+  }
+
+  if (an < BN_KARATSUBA_CUTOFF)
+    return 0;
+
+  w = bn_karatsuba_ws(an, BN_KARATSUBA_CUTOFF);
+
+  if (an == bn)
+    return w;
+
+  if (bn % an) {
+    w1 = bn_mul_limbs_ws(an, bn % an);
+    w = (w > w1) ? w : w1;
+  }
+
+  return 2 * an + w;
+}
+
+/* Helper function for generic multiplication
+
+   Dispatches to Karatsuba or schoolbook multiplication depending
+   on the operand sizes, and to the squaring routines if A == B.
+
+   The cutoffs were chosen by timing bn_mul on random operands of
+   12 to 384 limbs for a range of cutoffs: Karatsuba multiplication
+   breaks even with the schoolbook method at about 32 limbs (40 with
+   the mulx/adx kernel on 64-bit limbs). Schoolbook squaring already
+   needs only half the limb products, so Karatsuba squaring only pays
+   off from about 64 (resp. 96) limbs. */
+static int bn_mul_hlp(BIGNUM *A, BIGNUM *B, BIGNUM *X, int alen, int blen) {
+  int ret = 0, sqr;
+  size_t nws;
+  bn_uint_t *ws = NULL;
+
+  sqr = (A == B);
+
+  while (alen > 0 && A->p[alen - 1] == 0)
+    alen--;
+
+  while (blen > 0 && B->p[blen - 1] == 0)
+    blen--;
+
+  BN_CHECK(bn_grow(X, (alen + blen > 0) ? alen + blen : 1));
+  memset(X->p, 0, X->n * WORD_SIZE);
+
+  if (alen == 0 || blen == 0)
+    return 0;
+
+  if (sqr)
+    nws = bn_karatsuba_ws(alen, BN_KARATSUBA_SQUARE_CUTOFF);
+  else
+    nws = bn_mul_limbs_ws(alen, blen);
+
+  if (nws > 0 && (ws = malloc(nws * WORD_SIZE)) == NULL)
+    return BN_ERR_OUT_OF_MEMORY;
+
+  if (sqr)
+    bn_ksqr_hlp(X->p, A->p, alen, ws);
+  else
+    bn_mul_limbs(X->p, A->p, alen, B->p, blen, ws);
+
+  if (ws != NULL) {
+    zeroize(ws, nws * WORD_SIZE);
+    free(ws);
+  }
+
+cleanup:
+
+  return ret;
+}
+
+/* Signed multiplication: X = A * B */
+int bn_mul(BIGNUM *A, BIGNUM *B, BIGNUM *X) {
+  BN_REQUIRE(A, "A is null");
+  BN_REQUIRE(B, "B is null");
+  BN_REQUIRE(X, "X is null");
+
+  int ret = 0, alen, blen;
+  BIGNUM TA, TB;
+  bn_inline_t ta, tb;
+
+  bn_init_inline(&TA, ta);
+  bn_init_inline(&TB, tb);
+
+  /* In any case A->n + B->n limbs will always be enough to
+     hold the result, but we keep two extra limbs to prevent
+     a buffer overflow in bn_mul1_hlp */
+  if (A->n + B->n + 2 >= BN_MAX_LIMBS)
+    return BN_ERR_NOT_ENOUGH_LIMBS;
 
   if (bn_is_zero(A) || bn_is_zero(B))
     X->s = 1;
@@ -1217,6 +1896,9 @@ int bn_mul(BIGNUM *A, BIGNUM *B, BIGNUM *X) {
 
   if (X == A) {
     BN_CHECK(bn_assign(&TA, A));
+    /* Keep A == B for bn_mul_hlp to detect squaring */
+    if (B == A)
+      B = &TA;
     A = &TA;
   }
 
@@ -1243,9 +1925,10 @@ int bn_mul_sdbl(BIGNUM *A, const bn_sdbl_t b, BIGNUM *X) {
   BN_REQUIRE(X, "X is null");
 
   int ret = 0;
+  bn_uint_t BP[sizeof(bn_sdbl_t) / WORD_SIZE];
   BIGNUM B;
 
-  bn_init(&B, NULL);
+  bn_init_borrowed(&B, BP, sizeof(BP) / sizeof(*BP));
   BN_CHECK(bn_from_sdbl(&B, b));
 
   ret = bn_mul(A, &B, X);
@@ -1300,20 +1983,29 @@ cleanup:
   return ret;
 }
 
-/* Division: A = Q * B + R  [HAC 14.20] */
-int bn_div(BIGNUM *A, BIGNUM *B, BIGNUM *Q, BIGNUM *R) {
-  BN_REQUIRE(A, "A is null");
-  BN_REQUIRE(B, "B is null");
-  BN_REQUIRE(Q || R, "both Q and R are null");
+/* T = Y[0..n) * b, where T has at least n + 1 limbs */
+static void bn_mul_uint_hlp(BIGNUM *T, const bn_uint_t *Y, int n, bn_uint_t b) {
+  memset(T->p, 0, T->n * WORD_SIZE);
+  T->p[n] = bn_mul1_row(n, Y, T->p, b);
+  T->s = 1;
+}
+
+/* Division: A = Q * B + R  [HAC 14.20]
 
+   The temporaries are borrowed from ctx, or allocated on the heap
+   if ctx is NULL */
+static int bn_div_hlp(BIGNUM *A, BIGNUM *B, BIGNUM *Q, BIGNUM *R,
+                      BN_CTX *ctx) {
   int ret = 0, i, n, t, k;
+  size_t mark;
   BIGNUM X, Y, Z, T1, T2;
-  bn_uint_t TP2[3];
+  bn_uint_t TP2[3], YP2[2];
 
   if (bn_is_zero(B))
     return BN_ERR_DIVISION_BY_ZERO;
 
   bn_init(&X, &Y, &Z, &T1, NULL);
+  mark = bn_ctx_start(ctx);
 
   /* T2 is used for comparison and we will only ever use 3 limbs
      that are assigned explicitly, hence it is safe to use stack
@@ -1330,14 +2022,15 @@ int bn_div(BIGNUM *A, BIGNUM *B, BIGNUM *Q, BIGNUM *R) {
     return 0;
   }
 
+  BN_CHECK(bn_ctx_get(ctx, &X, A->n + 1));
+  BN_CHECK(bn_ctx_get(ctx, &Y, A->n + 1));
+  BN_CHECK(bn_ctx_get(ctx, &Z, A->n + 2));
+  BN_CHECK(bn_ctx_get(ctx, &T1, A->n + 2));
+
   BN_CHECK(bn_assign(&X, A));
   BN_CHECK(bn_assign(&Y, B));
   X.s = Y.s = 1;
 
-  BN_CHECK(bn_grow(&Z, A->n + 2));
-  BN_CHECK(bn_from_udbl(&Z, 0));
-  BN_CHECK(bn_grow(&T1, A->n + 2));
-
   k = bn_msb(&Y) % BIW;
   if (k < (int)BIW - 1) {
     k = BIW - 1 - k;
@@ -1347,8 +2040,11 @@ int bn_div(BIGNUM *A, BIGNUM *B, BIGNUM *Q, BIGNUM *R) {
     k = 0;
   }
 
-  n = X.n - 1;
-  t = Y.n - 1;
+  /* X and Y may have more limbs than their values need */
+  for (n = X.n - 1; n > 0 && X.p[n] == 0; --n)
+    ;
+  for (t = Y.n - 1; t > 0 && Y.p[t] == 0; --t)
+    ;
   BN_CHECK(bn_lshift(&Y, BIW * (n - t)));
 
   while (bn_cmp(&X, &Y) >= 0) {
@@ -1374,17 +2070,17 @@ int bn_div(BIGNUM *A, BIGNUM *B, BIGNUM *Q, BIGNUM *R) {
     T2.p[1] = (i < 1) ? 0 : X.p[i - 1];
     T2.p[2] = X.p[i];
 
+    YP2[0] = (t < 1) ? 0 : Y.p[t - 1];
+    YP2[1] = Y.p[t];
+
     Z.p[i - t - 1]++;
     do {
       Z.p[i - t - 1]--;
 
-      BN_CHECK(bn_from_udbl(&T1, 0));
-      T1.p[0] = (t < 1) ? 0 : Y.p[t - 1];
-      T1.p[1] = Y.p[t];
-      BN_CHECK(bn_mul_sdbl(&T1, Z.p[i - t - 1], &T1));
+      bn_mul_uint_hlp(&T1, YP2, 2, Z.p[i - t - 1]);
     } while (bn_cmp(&T1, &T2) > 0);
 
-    BN_CHECK(bn_mul_sdbl(&Y, Z.p[i - t - 1], &T1));
+    bn_mul_uint_hlp(&T1, Y.p, t + 1, Z.p[i - t - 1]);
     BN_CHECK(bn_lshift(&T1, BIW * (i - t - 1)));
     BN_CHECK(bn_sub(&X, &T1, &X));
 
@@ -1413,10 +2109,20 @@ int bn_div(BIGNUM *A, BIGNUM *B, BIGNUM *Q, BIGNUM *R) {
 cleanup:
 
   bn_zfree(&X, &Y, &Z, &T1, NULL);
+  bn_ctx_end(ctx, mark);
 
   return ret;
 }
 
+/* Division: A = Q * B + R */
+int bn_div(BIGNUM *A, BIGNUM *B, BIGNUM *Q, BIGNUM *R) {
+  BN_REQUIRE(A, "A is null");
+  BN_REQUIRE(B, "B is null");
+  BN_REQUIRE(Q || R, "both Q and R are null");
+
+  return bn_div_hlp(A, B, Q, R, NULL);
+}
+
 /* Division: A = Q * b + R */
 int bn_div_sdbl(BIGNUM *A, const bn_sdbl_t b, BIGNUM *Q, BIGNUM *R) {
   BN_REQUIRE(A, "X is null");
@@ -1424,9 +2130,10 @@ int bn_div_sdbl(BIGNUM *A, const bn_sdbl_t b, BIGNUM *Q, BIGNUM *R) {
   BN_REQUIRE(Q || R, "both Q and R are null");
 
   int ret = 0;
+  bn_uint_t BP[sizeof(bn_sdbl_t) / WORD_SIZE];
   BIGNUM B;
 
-  bn_init(&B, NULL);
+  bn_init_borrowed(&B, BP, sizeof(BP) / sizeof(*BP));
   BN_CHECK(bn_from_sdbl(&B, b));
 
   ret = bn_div(A, &B, Q, R);
@@ -1437,18 +2144,14 @@ cleanup:
   return ret;
 }
 
-/* Modulo: R = A (mod B) */
-int bn_mod(BIGNUM *A, BIGNUM *B, BIGNUM *R) {
-  BN_REQUIRE(A, "A is null");
-  BN_REQUIRE(B, "B is null");
-  BN_REQUIRE(R, "R is null");
-
+/* Modulo, with the temporaries of the division borrowed from ctx */
+static int bn_mod_hlp(BIGNUM *A, BIGNUM *B, BIGNUM *R, BN_CTX *ctx) {
   int ret = 0;
 
   if (bn_cmp_sdbl(B, 0) < 0)
     return BN_ERR_NEGATIVE_VALUE;
 
-  BN_CHECK(bn_div(A, B, NULL, R));
+  BN_CHECK(bn_div_hlp(A, B, NULL, R, ctx));
 
   while (bn_cmp_sdbl(R, 0) < 0)
     BN_CHECK(bn_add(R, B, R));
@@ -1461,6 +2164,15 @@ cleanup:
   return ret;
 }
 
+/* Modulo: R = A (mod B) */
+int bn_mod(BIGNUM *A, BIGNUM *B, BIGNUM *R) {
+  BN_REQUIRE(A, "A is null");
+  BN_REQUIRE(B, "B is null");
+  BN_REQUIRE(R, "R is null");
+
+  return bn_mod_hlp(A, B, R, NULL);
+}
+
 /* Integer modulo: r = A (mod b) */
 int bn_mod_uint(BIGNUM *A, bn_uint_t b, bn_uint_t *r) {
   BN_REQUIRE(A, "A is null");
@@ -1503,6 +2215,59 @@ int bn_mod_uint(BIGNUM *A, bn_uint_t b, bn_uint_t *r) {
   return 0;
 }
 
+/* y (mod b) for y < b * 2^BIH, with the quotient estimated from
+   inv = floor((2^BIW - 1) / b); the estimate is at most one less
+   than the quotient, which the masked subtraction corrects */
+static inline bn_uint_t bn_mod_uint_step(bn_uint_t y, bn_uint_t b,
+                                         bn_uint_t inv) {
+  bn_uint_t q = (bn_uint_t)(((bn_udbl_t)y * inv) >> BIW);
+
+  y -= q * b;
+  return y - (b & ((bn_uint_t)0 - (bn_uint_t)(y >= b)));
+}
+
+/* Integer modulo by several moduli: r[j] = A (mod b[j]), j < nb
+
+   The moduli must be at least 2 and less than 2^BIH, as for
+   bn_mod_uint. All of them are reduced in the same pass over the
+   limbs of A, with a multiplication by a precomputed reciprocal
+   instead of a division per half limb, and the residues of the
+   different moduli do not depend on each other, so that their
+   steps can overlap. */
+int bn_mod_uints(BIGNUM *A, const bn_uint_t *b, int nb, bn_uint_t *r) {
+  BN_REQUIRE(A, "A is null");
+  BN_REQUIRE(b, "b is null");
+  BN_REQUIRE(r, "r is null");
+
+  int i, j;
+  bn_uint_t x, inv[BN_MOD_UINTS_MAX];
+  const bn_uint_t lo = ((bn_uint_t)1 << BIH) - 1;
+
+  if (nb < 1 || nb > BN_MOD_UINTS_MAX)
+    return BN_ERR_BAD_INPUT_DATA;
+
+  for (j = 0; j < nb; ++j) {
+    if (b[j] == 0)
+      return BN_ERR_DIVISION_BY_ZERO;
+    if (b[j] < 2 || b[j] > lo)
+      return BN_ERR_BAD_INPUT_DATA;
+
+    inv[j] = ~(bn_uint_t)0 / b[j];
+    r[j] = 0;
+  }
+
+  for (i = (int)A->n - 1; i >= 0; --i) {
+    x = A->p[i];
+
+    for (j = 0; j < nb; ++j) {
+      r[j] = bn_mod_uint_step((r[j] << BIH) | (x >> BIH), b[j], inv[j]);
+      r[j] = bn_mod_uint_step((r[j] << BIH) | (x & lo), b[j], inv[j]);
+    }
+  }
+
+  return 0;
+}
+
 /* Greatest common divisor: G = gcd(A, B) [HAC 14.54] */
 int bn_gcd(BIGNUM *A, BIGNUM *B, BIGNUM *G) {
   BN_REQUIRE(A, "A is null");
@@ -1510,9 +2275,11 @@ int bn_gcd(BIGNUM *A, BIGNUM *B, BIGNUM *G) {
   BN_REQUIRE(G, "G is null");
 
   int ret = 0, l;
-  BIGNUM TG, TA, TB;
+  BIGNUM TA, TB;
+  bn_inline_t ta, tb;
 
-  bn_init(&TA, &TB, &TG, NULL);
+  bn_init_inline(&TA, ta);
+  bn_init_inline(&TB, tb);
 
   BN_CHECK(bn_assign(&TA, A));
   BN_CHECK(bn_assign(&TB, B));
@@ -1542,7 +2309,7 @@ int bn_gcd(BIGNUM *A, BIGNUM *B, BIGNUM *G) {
 
 cleanup:
 
-  bn_zfree(&TA, &TB, &TG, NULL);
+  bn_zfree(&TA, &TB, NULL);
 
   return ret;
 }
@@ -1555,11 +2322,22 @@ int bn_inv_mod(BIGNUM *A, BIGNUM *N, BIGNUM *X) {
 
   int ret = 0;
   BIGNUM G, TA, TU, U1, U2, TB, TV, V1, V2;
+  bn_inline_t ta, tu, u1, u2, tb, tv, v1, v2;
 
   if (bn_cmp_sdbl(N, 1) <= 0)
     return BN_ERR_BAD_INPUT_DATA;
 
-  bn_init(&TA, &TU, &U1, &U2, &G, &TB, &TV, &V1, &V2, NULL);
+  /* The temporaries change size at every step; up to 4096-bit
+     moduli they do so without the allocator */
+  bn_init(&G, NULL);
+  bn_init_inline(&TA, ta);
+  bn_init_inline(&TU, tu);
+  bn_init_inline(&U1, u1);
+  bn_init_inline(&U2, u2);
+  bn_init_inline(&TB, tb);
+  bn_init_inline(&TV, tv);
+  bn_init_inline(&V1, v1);
+  bn_init_inline(&V2, v2);
 
   BN_CHECK(bn_gcd(A, N, &G));
 
@@ -1690,8 +2468,98 @@ static void bn_montred(BIGNUM *A, BIGNUM *N, bn_uint_t mm, BIGNUM *T) {
   bn_montmul(A, &U, N, mm, T);
 }
 
-/* Sliding-window exponentiation: X = A^E (mod N) [HAC 14.85] */
-int bn_exp_mod(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X) {
+/* r[0..n] = t - N if t >= N and t otherwise, where t is the (n+1)-limb
+   value t[0..n) + top * R^n < 2N; the subtraction is always performed
+   and the result is selected with a mask, not a branch */
+static void bn_ct_sub_hlp(bn_uint_t *r, const bn_uint_t *t, bn_uint_t top,
+                          const bn_uint_t *N, int n) {
+  int i;
+  bn_uint_t b, mask;
+
+  b = bn_sub_n_hlp(n, t, N, r);
+
+  /* t < N iff the subtraction borrowed out of the top limb */
+  mask = (bn_uint_t)0 - (b & ~top & 1);
+
+  for (i = 0; i < n; ++i)
+    r[i] = (t[i] & mask) | (r[i] & ~mask);
+
+  r[n] = 0;
+}
+
+/* Montgomery reduction [HAC 14.32]: r[0..n] = t * R^-1 (mod N)
+
+   t[0..2n) is destroyed; the carry out of row i belongs to t[i + n]
+   together with the carry left over from the previous row. */
+static void bn_redc_hlp(bn_uint_t *r, bn_uint_t *t, const bn_uint_t *N, int n,
+                        bn_uint_t mm) {
+  int i;
+  bn_uint_t c, s, top = 0;
+
+  for (i = 0; i < n; ++i) {
+    c = bn_mul1_row(n, N, t + i, t[i] * mm);
+
+    s = t[i + n] + c;
+    c = (s < c);
+    s += top;
+    c += (s < top);
+    t[i + n] = s;
+    top = c;
+  }
+
+  bn_ct_sub_hlp(r, t + n, top, N, n);
+}
+
+/* Constant-time Montgomery multiplication: r[0..n] = a * b * R^-1 (mod N)
+
+   a and b are n limbs and must be less than N; r may alias a or b.
+   t must hold at least 2n + 2 limbs. This is the same interleaved
+   (CIOS) form as bn_montmul, with the carries kept in the two limbs
+   above the accumulator instead of being propagated. */
+static void bn_montmul_hlp(bn_uint_t *r, const bn_uint_t *a,
+                           const bn_uint_t *b, const bn_uint_t *N, int n,
+                           bn_uint_t mm, bn_uint_t *t) {
+  int i;
+  bn_uint_t c, *d = t;
+
+  memset(t, 0, (2 * n + 2) * WORD_SIZE);
+
+  for (i = 0; i < n; ++i, ++d) {
+    c = bn_mul1_row(n, b, d, a[i]);
+    d[n] += c;
+    d[n + 1] += (d[n] < c);
+
+    c = bn_mul1_row(n, N, d, d[0] * mm);
+    d[n] += c;
+    d[n + 1] += (d[n] < c);
+  }
+
+  bn_ct_sub_hlp(r, d, d[n], N, n);
+}
+
+/* Constant-time Montgomery squaring: r[0..n] = a * a * R^-1 (mod N)
+
+   The square is computed with bn_sqr_basecase, which needs about half
+   the limb products of bn_montmul_hlp, and then reduced; a must be
+   less than N, r may alias a and t must hold at least 2n limbs. */
+static void bn_montsqr_hlp(bn_uint_t *r, const bn_uint_t *a,
+                           const bn_uint_t *N, int n, bn_uint_t mm,
+                           bn_uint_t *t) {
+  bn_sqr_basecase(t, a, n);
+  bn_redc_hlp(r, t, N, n, mm);
+}
+
+/* Montgomery squaring: A = A * A * R^-1 (mod N) */
+static void bn_montsqr(BIGNUM *A, BIGNUM *N, bn_uint_t mm, BIGNUM *T) {
+  bn_montsqr_hlp(A->p, A->p, N->p, N->n, mm, T->p);
+}
+
+/* Sliding-window exponentiation: X = A^E (mod N) [HAC 14.85]
+
+   The window table and the other temporaries are borrowed from
+   ctx, or allocated on the heap if ctx is NULL */
+int bn_exp_mod_ctx(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X,
+                   BN_CTX *ctx) {
   BN_REQUIRE(X, "X is null");
   BN_REQUIRE(E, "E is null");
   BN_REQUIRE(N, "N is null");
@@ -1699,6 +2567,7 @@ int bn_exp_mod(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X) {
 
   int ret = 0, i, j, wsize, wbits;
   int bufsize, nblimbs, nbits;
+  size_t mark;
   bn_uint_t ei, mm, state;
   BIGNUM RR, T, W[64];
 
@@ -1709,20 +2578,21 @@ int bn_exp_mod(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X) {
   bn_init(&RR, &T, NULL);
   bn_montg_init(&mm, N);
   memset(W, 0, sizeof(W));
+  mark = bn_ctx_start(ctx);
 
   i = bn_msb(E);
   wsize = (i > 671) ? 6 : (i > 239) ? 5 : (i > 79) ? 4 : (i > 23) ? 3 : 1;
 
   j = N->n + 1;
   BN_CHECK(bn_grow(X, j));
-  BN_CHECK(bn_grow(&W[1], j));
-  BN_CHECK(bn_grow(&T, j * 2));
+  BN_CHECK(bn_ctx_get(ctx, &W[1], j));
+  BN_CHECK(bn_ctx_get(ctx, &T, j * 2));
 
   /* If 1st call, pre-compute R^2 (mod N) */
   if (_RR == NULL || _RR->p == NULL) {
     BN_CHECK(bn_from_udbl(&RR, 1));
     BN_CHECK(bn_lshift(&RR, N->n * 2 * BIW));
-    BN_CHECK(bn_mod(&RR, N, &RR));
+    BN_CHECK(bn_mod_hlp(&RR, N, &RR, ctx));
 
     if (_RR != NULL)
       memcpy(_RR, &RR, sizeof(BIGNUM));
@@ -1732,7 +2602,7 @@ int bn_exp_mod(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X) {
 
   /* W[1] = A * R^2 * R^-1 (mod N) = A * R (mod N) */
   if (bn_cmp(A, N) >= 0)
-    BN_CHECK(bn_mod(A, N, &W[1]));
+    BN_CHECK(bn_mod_hlp(A, N, &W[1], ctx));
   else
     BN_CHECK(bn_assign(&W[1], A));
 
@@ -1746,15 +2616,15 @@ int bn_exp_mod(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X) {
     /* W[1 << (wsize - 1)] = W[1] ^ (wsize - 1) */
     j = 1 << (wsize - 1);
 
-    BN_CHECK(bn_grow(&W[j], N->n + 1));
+    BN_CHECK(bn_ctx_get(ctx, &W[j], N->n + 1));
     BN_CHECK(bn_assign(&W[j], &W[1]));
 
     for (i = 0; i < wsize - 1; i++)
-      bn_montmul(&W[j], &W[j], N, mm, &T);
+      bn_montsqr(&W[j], N, mm, &T);
 
     /* W[i] = W[i - 1] * W[1] */
     for (i = j + 1; i < (1 << wsize); i++) {
-      BN_CHECK(bn_grow(&W[i], N->n + 1));
+      BN_CHECK(bn_ctx_get(ctx, &W[i], N->n + 1));
       BN_CHECK(bn_assign(&W[i], &W[i - 1]));
 
       bn_montmul(&W[i], &W[1], N, mm, &T);
@@ -1785,7 +2655,7 @@ int bn_exp_mod(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X) {
 
     if (ei == 0 && state == 1) {
       /* out of window, square X */
-      bn_montmul(X, X, N, mm, &T);
+      bn_montsqr(X, N, mm, &T);
       continue;
     }
 
@@ -1798,7 +2668,7 @@ int bn_exp_mod(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X) {
     if (nbits == wsize) {
       /* X = X^wsize R^-1 (mod N) */
       for (i = 0; i < wsize; i++)
-        bn_montmul(X, X, N, mm, &T);
+        bn_montsqr(X, N, mm, &T);
 
       /* X = X * W[wbits] R^-1 (mod N) */
       bn_montmul(X, &W[wbits], N, mm, &T);
@@ -1811,7 +2681,7 @@ int bn_exp_mod(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X) {
 
   /* process the remaining bits */
   for (i = 0; i < nbits; i++) {
-    bn_montmul(X, X, N, mm, &T);
+    bn_montsqr(X, N, mm, &T);
 
     wbits <<= 1;
 
@@ -1832,9 +2702,370 @@ cleanup:
   else
     bn_zfree(&W[1], &T, &RR, NULL);
 
+  bn_ctx_end(ctx, mark);
+
+  return ret;
+}
+
+/* Limbs of an arena for the window table and the other temporaries
+   of an exponentiation modulo an n-limb modulus (including those of
+   the divisions for RR and A mod N, if A is not much larger) */
+#define BN_EXP_MOD_LIMBS(n) (80 * ((n) + 2))
+
+/* Sliding-window exponentiation: X = A^E (mod N)
+
+   The temporaries come from one arena, so that the window table
+   is contiguous and costs a single allocation */
+int bn_exp_mod(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X) {
+  BN_REQUIRE(N, "N is null");
+
+  BN_CTX ctx;
+  int ret;
+
+  if ((ret = bn_ctx_init(&ctx, BN_EXP_MOD_LIMBS(N->n))) != 0)
+    return ret;
+
+  ret = bn_exp_mod_ctx(A, E, N, _RR, X, &ctx);
+  bn_ctx_free(&ctx);
+
+  return ret;
+}
+
+/* Scatter the n-limb value v into entry i of a table with tsize entries;
+   limb k of every entry is stored at tbl[k * tsize + i] so that the
+   entries are interleaved across cache lines */
+static void bn_scatter_hlp(bn_uint_t *tbl, const bn_uint_t *v, int n,
+                           int tsize, int i) {
+  int k;
+
+  for (k = 0; k < n; ++k)
+    tbl[k * tsize + i] = v[k];
+}
+
+/* Gather entry idx from a table written by bn_scatter_hlp in constant
+   time; every entry is read and all but entry idx are masked out */
+static void bn_gather_hlp(bn_uint_t *r, const bn_uint_t *tbl, int n,
+                          int tsize, bn_uint_t idx) {
+  int i, k;
+  bn_uint_t acc, mask[64];
+
+  /* mask[i] is all ones iff i == idx (both are less than 2^(BIW - 1)) */
+  for (i = 0; i < tsize; ++i)
+    mask[i] = (bn_uint_t)0 - ((((bn_uint_t)i ^ idx) - 1) >> (BIW - 1));
+
+  for (k = 0; k < n; ++k, tbl += tsize) {
+    for (i = 0, acc = 0; i < tsize; ++i)
+      acc |= tbl[i] & mask[i];
+    r[k] = acc;
+  }
+
+  zeroize(mask, sizeof(mask));
+}
+
+/* Get the w-bit window of E starting at bit pos */
+static bn_uint_t bn_get_window(const BIGNUM *E, int pos, int w) {
+  size_t i = pos / BIW;
+  int j = pos % BIW;
+  bn_uint_t v;
+
+  v = E->p[i] >> j;
+  if (j + w > (int)BIW && i + 1 < E->n)
+    v |= E->p[i + 1] << (BIW - j);
+
+  return v & (((bn_uint_t)1 << w) - 1);
+}
+
+/* Fixed-window exponentiation in constant time: X = A^E (mod N)
+
+   Every window of E costs exactly wsize Montgomery squarings and one
+   multiplication by a table entry (W[0] = R for an all-zero window),
+   and the entries are fetched with bn_gather_hlp, so neither the
+   sequence of operations nor the memory access pattern depends on
+   the bits of E or on A. Only the bit length of E and the modulus
+   dependent precomputations (R^2 mod N, A mod N) are not protected.
+
+   The table and the other temporaries are borrowed from ctx, or
+   allocated on the heap if ctx is NULL. */
+int bn_exp_mod_ct_ctx(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR,
+                      BIGNUM *X, BN_CTX *ctx) {
+  BN_REQUIRE(A, "A is null");
+  BN_REQUIRE(E, "E is null");
+  BN_REQUIRE(N, "N is null");
+  BN_REQUIRE(X, "X is null");
+
+  int ret = 0, i, n, nbits, wsize, tsize, pos;
+  size_t mark;
+  bn_uint_t mm, *tbl, *x, *w, *t;
+  BIGNUM RR, TA, WS;
+
+  if (bn_cmp_sdbl(N, 0) < 0 || (N->p[0] & 1u) == 0u)
+    return BN_ERR_BAD_INPUT_DATA;
+
+  if (bn_is_neg(E))
+    return BN_ERR_NEGATIVE_VALUE;
+
+  bn_init(&RR, &TA, &WS, NULL);
+  bn_montg_init(&mm, N);
+  mark = bn_ctx_start(ctx);
+
+  n = N->n;
+  nbits = bn_msb(E);
+  wsize = (nbits > 671)   ? 6
+          : (nbits > 239) ? 5
+          : (nbits > 79)  ? 4
+          : (nbits > 23)  ? 3
+                          : 1;
+  tsize = 1 << wsize;
+
+  /* If 1st call, pre-compute R^2 (mod N) */
+  if (_RR == NULL || _RR->p == NULL) {
+    BN_CHECK(bn_from_udbl(&RR, 1));
+    BN_CHECK(bn_lshift(&RR, n * 2 * BIW));
+    BN_CHECK(bn_mod_hlp(&RR, N, &RR, ctx));
+
+    if (_RR != NULL)
+      memcpy(_RR, &RR, sizeof(BIGNUM));
+  } else {
+    memcpy(&RR, _RR, sizeof(BIGNUM));
+  }
+
+  BN_CHECK(bn_ctx_get(ctx, &TA, n));
+  if (bn_cmp(A, N) >= 0 || bn_is_neg(A))
+    BN_CHECK(bn_mod_hlp(A, N, &TA, ctx));
+  else
+    BN_CHECK(bn_assign(&TA, A));
+  BN_CHECK(bn_grow(&TA, n));
+
+  /* Table, x, w (n + 1 limbs each) and t (2n + 2 limbs) */
+  BN_CHECK(bn_ctx_get_hlp(ctx, &WS, (size_t)tsize * n + 4 * (n + 1)));
+
+  tbl = WS.p;
+  x = tbl + (size_t)tsize * n;
+  w = x + n + 1;
+  t = w + n + 1;
+
+  /* w = R^2 (mod N), held in n limbs */
+  memcpy(w, RR.p, min(RR.n, (size_t)n) * WORD_SIZE);
+
+  /* W[0] = R^2 * R^-1 (mod N) = R (mod N) */
+  x[0] = 1;
+  bn_montmul_hlp(x, x, w, N->p, n, mm, t);
+  bn_scatter_hlp(tbl, x, n, tsize, 0);
+
+  /* W[1] = A * R^2 * R^-1 (mod N) = A * R (mod N) */
+  bn_montmul_hlp(w, TA.p, w, N->p, n, mm, t);
+  bn_scatter_hlp(tbl, w, n, tsize, 1);
+
+  /* W[i] = W[i - 1] * W[1] */
+  memcpy(x, w, n * WORD_SIZE);
+  for (i = 2; i < tsize; ++i) {
+    bn_montmul_hlp(x, x, w, N->p, n, mm, t);
+    bn_scatter_hlp(tbl, x, n, tsize, i);
+  }
+
+  /* X = W[top window], then for the remaining windows
+     X = X^(2^wsize) * W[window] */
+  pos = ((nbits + wsize - 1) / wsize) * wsize;
+
+  if (pos == 0) {
+    bn_gather_hlp(x, tbl, n, tsize, 0);
+  } else {
+    pos -= wsize;
+    bn_gather_hlp(x, tbl, n, tsize, bn_get_window(E, pos, wsize));
+  }
+
+  while (pos > 0) {
+    pos -= wsize;
+
+    for (i = 0; i < wsize; ++i)
+      bn_montsqr_hlp(x, x, N->p, n, mm, t);
+
+    bn_gather_hlp(w, tbl, n, tsize, bn_get_window(E, pos, wsize));
+    bn_montmul_hlp(x, x, w, N->p, n, mm, t);
+  }
+
+  /* X = A^E * R * R^-1 (mod N) = A^E (mod N) */
+  memset(w, 0, (n + 1) * WORD_SIZE);
+  w[0] = 1;
+  bn_montmul_hlp(x, x, w, N->p, n, mm, t);
+
+  BN_CHECK(bn_grow(X, n));
+  memset(X->p, 0, X->n * WORD_SIZE);
+  memcpy(X->p, x, n * WORD_SIZE);
+  X->s = 1;
+
+cleanup:
+
+  if (_RR != NULL)
+    bn_zfree(&TA, &WS, NULL);
+  else
+    bn_zfree(&TA, &WS, &RR, NULL);
+
+  bn_ctx_end(ctx, mark);
+
+  return ret;
+}
+
+/* Constant-time exponentiation: X = A^E (mod N) */
+int bn_exp_mod_ct(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X) {
+  BN_REQUIRE(N, "N is null");
+
+  BN_CTX ctx;
+  int ret;
+
+  if ((ret = bn_ctx_init(&ctx, BN_EXP_MOD_LIMBS(N->n))) != 0)
+    return ret;
+
+  ret = bn_exp_mod_ct_ctx(A, E, N, _RR, X, &ctx);
+  bn_ctx_free(&ctx);
+
+  return ret;
+}
+
+/* Precompute the reduction constants of the modulus N > 0
+
+   mu = floor(b^(2k) / N) costs one division; if N has no leading
+   zero limbs, R^2 = b^(2k) and RR = b^(2k) - mu * N follows from
+   it with a multiplication, otherwise it costs another division.
+   mctx keeps its own copy of N. */
+int bn_mod_ctx_init(BN_MOD_CTX *mctx, BIGNUM *N) {
+  BN_REQUIRE(mctx, "mctx is null");
+  BN_REQUIRE(N, "N is null");
+
+  int ret = 0;
+  BIGNUM T;
+  bn_inline_t t;
+
+  bn_init(&mctx->N, &mctx->MU, &mctx->RR, NULL);
+  bn_init_inline(&T, t);
+  mctx->mm = 0;
+  mctx->k = 0;
+
+  if (bn_cmp_sdbl(N, 0) <= 0)
+    return BN_ERR_BAD_INPUT_DATA;
+
+  mctx->k = BN_BITS_TO_LIMBS(bn_msb(N));
+
+  BN_CHECK(bn_assign(&mctx->N, N));
+
+  /* mu = floor(b^(2k) / N) */
+  BN_CHECK(bn_from_udbl(&T, 1));
+  BN_CHECK(bn_lshift(&T, mctx->k * 2 * BIW));
+  BN_CHECK(bn_div_hlp(&T, &mctx->N, &mctx->MU, NULL, NULL));
+
+  if (bn_is_even(N))
+    goto cleanup;
+
+  bn_montg_init(&mctx->mm, &mctx->N);
+
+  /* RR = R^2 (mod N) */
+  if (N->n == mctx->k) {
+    BN_CHECK(bn_mul(&mctx->MU, &mctx->N, &mctx->RR));
+    BN_CHECK(bn_sub(&T, &mctx->RR, &mctx->RR));
+  } else {
+    BN_CHECK(bn_from_udbl(&mctx->RR, 1));
+    BN_CHECK(bn_lshift(&mctx->RR, N->n * 2 * BIW));
+    BN_CHECK(bn_mod_hlp(&mctx->RR, &mctx->N, &mctx->RR, NULL));
+  }
+
+cleanup:
+
+  bn_zfree(&T, NULL);
+
+  if (ret != 0)
+    bn_mod_ctx_free(mctx);
+
+  return ret;
+}
+
+/* Zero and free the reduction constants */
+void bn_mod_ctx_free(BN_MOD_CTX *mctx) {
+  BN_REQUIRE(mctx, "mctx is null");
+
+  bn_zfree(&mctx->N, &mctx->MU, &mctx->RR, NULL);
+  mctx->mm = 0;
+  mctx->k = 0;
+}
+
+/* Barrett reduction [HAC 14.42]: R = A (mod N) for 0 <= A < b^(2k)
+
+   Two multiplications by mu and N take the place of the long
+   division of bn_mod; since b^(2k) <= N^2 * b^2, this covers the
+   product of any two residues. A negative or larger A is reduced
+   by division. The temporaries are borrowed from ctx, or allocated
+   on the heap if ctx is NULL. */
+static int bn_mod_barrett_hlp(BIGNUM *A, const BN_MOD_CTX *mctx, BIGNUM *R,
+                              BN_CTX *ctx) {
+  int ret = 0, k, an, mun, qn, q3n;
+  size_t mark, nws, nws1;
+  bn_uint_t *q, *t, *a, *ws;
+  BIGNUM WS;
+
+  k = (int)mctx->k;
+
+  for (an = A->n; an > 0 && A->p[an - 1] == 0; --an)
+    ;
+  for (mun = mctx->MU.n; mun > 0 && mctx->MU.p[mun - 1] == 0; --mun)
+    ;
+
+  if (an > 2 * k || (an > 0 && bn_is_neg(A)))
+    return bn_mod_hlp(A, (BIGNUM *)&mctx->N, R, ctx);
+
+  /* A < b^(k-1) <= N */
+  if (an < k) {
+    if ((ret = bn_assign(R, A)) == 0)
+      R->s = 1;
+    return ret;
+  }
+
+  bn_init(&WS, NULL);
+  mark = bn_ctx_start(ctx);
+
+  /* q1 = floor(A / b^(k-1)) has qn limbs and q3 = floor(q1 * mu /
+     b^(k+1)) has q3n >= qn limbs, since mu >= b^k */
+  qn = an - k + 1;
+  q3n = qn + mun - k - 1;
+  nws = bn_mul_limbs_ws(qn, mun);
+  nws1 = bn_mul_limbs_ws(q3n, k);
+  nws = (nws > nws1) ? nws : nws1;
+
+  /* q = q1 * mu, t = q3 * N, a = A (mod b^(k+1)) */
+  BN_CHECK(bn_ctx_get_hlp(ctx, &WS, (qn + mun) + (q3n + k) + (k + 1) + nws));
+  q = WS.p;
+  t = q + qn + mun;
+  a = t + q3n + k;
+  ws = a + k + 1;
+
+  bn_mul_limbs(q, A->p + k - 1, qn, mctx->MU.p, mun, ws);
+  bn_mul_limbs(t, q + k + 1, q3n, mctx->N.p, k, ws);
+  memcpy(a, A->p, min(an, k + 1) * WORD_SIZE);
+
+  /* R = A - q3 * N (mod b^(k+1)), which is less than 3N */
+  BN_CHECK(bn_grow(R, k + 1));
+  memset(R->p, 0, R->n * WORD_SIZE);
+  bn_sub_n_hlp(k + 1, a, t, R->p);
+  R->s = 1;
+
+  while (bn_cmp_abs(R, &mctx->N) >= 0)
+    bn_sub_hlp(k, mctx->N.p, R->p);
+
+cleanup:
+
+  bn_zfree(&WS, NULL);
+  bn_ctx_end(ctx, mark);
+
   return ret;
 }
 
+/* Barrett reduction: R = A (mod N) with the constants of mctx */
+int bn_mod_barrett(BIGNUM *A, const BN_MOD_CTX *mctx, BIGNUM *R) {
+  BN_REQUIRE(A, "A is null");
+  BN_REQUIRE(mctx, "mctx is null");
+  BN_REQUIRE(R, "R is null");
+
+  return bn_mod_barrett_hlp(A, mctx, R, NULL);
+}
+
 #define N_PRIMES 1024
 
 static const unsigned short primes[N_PRIMES] = {
@@ -1933,16 +3164,40 @@ static const unsigned short primes[N_PRIMES] = {
     8059u, 8069u, 8081u, 8087u, 8089u, 8093u, 8101u, 8111u, 8117u, 8123u, 8147u,
     8161u};
 
-/* Calculate the number of trial divisions that should be performed in
-   combination with the Miller-Rabin test, depending on the bit size */
-static int num_trial_divisions(int nbits) {
-  if (nbits <= 512)
-    return 128;
-  else if (nbits <= 1024)
-    return 256;
-  else if (nbits <= 2048)
-    return 512;
-  return N_PRIMES;
+/* The number of entries of primes[] to sieve nbits long candidates
+   with; only primes less than 2^(nbits - 1), i.e. less than every
+   candidate, are used, so that a zero residue always means that the
+   candidate is composite */
+static int num_sieve_primes(int nbits) {
+  int i;
+
+  if (nbits > 14)
+    return N_PRIMES;
+
+  for (i = 0; i < N_PRIMES && primes[i] < (1u << (nbits - 1)); ++i)
+    ;
+
+  return i;
+}
+
+/* The workers of a parallel prime search share the index of the
+   first one to find a prime, which is -1 while they are searching */
+#if defined(_WIN32)
+#define BN_PRIME_LOAD(w) InterlockedOr((w), 0)
+#define BN_PRIME_CLAIM(w, id) (InterlockedCompareExchange((w), (id), -1) == -1)
+#else
+#define BN_PRIME_LOAD(w) __atomic_load_n((w), __ATOMIC_ACQUIRE)
+static inline int bn_prime_claim(volatile long *winner, long id) {
+  long expected = -1;
+  return __atomic_compare_exchange_n(winner, &expected, id, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#define BN_PRIME_CLAIM(w, id) bn_prime_claim((w), (id))
+#endif
+
+/* Nonzero once another worker has found a prime */
+static inline int bn_prime_stopped(volatile long *winner) {
+  return winner != NULL && BN_PRIME_LOAD(winner) != -1;
 }
 
 /* Miller-Rabin probabilistic primality test [FIPS 186-5 B.3.1].
@@ -1953,13 +3208,13 @@ static int num_trial_divisions(int nbits) {
    Note: Always explicitly check for the return value of this
    function being either 0 or 1, since the the function can also
    return with error. */
-int bn_check_probable_prime(BIGNUM *W, int iter, f_rng_t f_rng, void *rng_ctx) {
-  BN_REQUIRE(W, "W is null");
-  BN_REQUIRE(f_rng, "f_rng is null");
-  BN_REQUIRE(rng_ctx, "rng_ctx is null");
-
-  BIGNUM Z, M, B, RR, T;
+static int bn_check_probable_prime_hlp(BIGNUM *W, int iter, f_rng_t f_rng,
+                                       void *rng_ctx, BN_CTX *ctx,
+                                       volatile long *winner) {
+  BIGNUM Z, M, B, T;
+  BN_MOD_CTX mctx;
   int ret = -1, a, i, j, wlen;
+  size_t mark;
 
   if (bn_cmp_udbl(W, 3) < 0)
     return 0;
@@ -1967,7 +3222,15 @@ int bn_check_probable_prime(BIGNUM *W, int iter, f_rng_t f_rng, void *rng_ctx) {
   if ((W->p[0] & 1u) == 0u)
     return 0;
 
-  bn_init(&Z, &M, &B, &RR, &T, NULL);
+  bn_init(&Z, &M, &B, &T, NULL);
+  mark = bn_ctx_start(ctx);
+
+  /* RR for the exponentiations and mu for the squarings */
+  BN_CHECK(bn_mod_ctx_init(&mctx, W));
+  BN_CHECK(bn_ctx_get(ctx, &Z, W->n));
+  BN_CHECK(bn_ctx_get(ctx, &M, W->n));
+  BN_CHECK(bn_ctx_get(ctx, &B, W->n));
+  BN_CHECK(bn_ctx_get(ctx, &T, 2 * W->n));
 
   BN_CHECK(bn_sub_sdbl(W, 1, &Z));
   BN_CHECK(bn_assign(&M, &Z));
@@ -1976,10 +3239,14 @@ int bn_check_probable_prime(BIGNUM *W, int iter, f_rng_t f_rng, void *rng_ctx) {
   a = bn_lsb(&M);
   BN_CHECK(bn_rshift(&M, a));
 
-  BN_CHECK(bn_grow(&B, W->n));
   wlen = bn_msb(W);
 
   for (i = 0; i < iter; ++i) {
+    if (bn_prime_stopped(winner)) {
+      ret = BN_ERR_CANCELLED;
+      goto cleanup;
+    }
+
     /* Pick a random 'B' such that len(B) == wlen and 1 < B < W-1 */
     do {
       if (f_rng(rng_ctx, (byte *)B.p, ceil_div(wlen, 8), NULL, 0) != SUCCESS) {
@@ -1997,8 +3264,8 @@ int bn_check_probable_prime(BIGNUM *W, int iter, f_rng_t f_rng, void *rng_ctx) {
       B.p[0] |= 2;
     } while (bn_cmp_abs(&B, &Z) >= 0);
 
-    /* B = B^M (mod W) */
-    BN_CHECK(bn_exp_mod(&B, &M, W, &RR, &B));
+    /* B = B^M (mod W); W may be a secret prime candidate */
+    BN_CHECK(bn_exp_mod_ct_ctx(&B, &M, W, &mctx.RR, &B, ctx));
 
     if (bn_cmp_udbl(&B, 1) == 0 || bn_cmp_abs(&B, &Z) == 0)
       continue;
@@ -2006,7 +3273,7 @@ int bn_check_probable_prime(BIGNUM *W, int iter, f_rng_t f_rng, void *rng_ctx) {
     for (j = 1; j < a; ++j) {
       /* B = B^2 (mod W) */
       BN_CHECK(bn_mul(&B, &B, &T));
-      BN_CHECK(bn_mod(&T, W, &B));
+      BN_CHECK(bn_mod_barrett_hlp(&T, &mctx, &B, ctx));
 
       /* Composite if B == 1 */
       if (bn_cmp_udbl(&B, 1) == 0)
@@ -2025,73 +3292,129 @@ int bn_check_probable_prime(BIGNUM *W, int iter, f_rng_t f_rng, void *rng_ctx) {
 
 cleanup:
 
-  bn_zfree(&Z, &M, &B, &RR, &T, NULL);
+  bn_zfree(&Z, &M, &B, &T, NULL);
+  bn_mod_ctx_free(&mctx);
+  bn_ctx_end(ctx, mark);
 
   return ret;
 }
 
-/* Check with small successive primes
+/* Miller-Rabin probabilistic primality test
 
-   Return values:
-   0: No prime factor found, proceed to test with Miller-Rabin
-   1: Number is certainly prime, no further tests required
-   2: Number is certainly non-prime
-   negative value: error */
-static int bn_trial_divisions(BIGNUM *X, int nrounds) {
-  BN_REQUIRE(X, "X is null");
-  BN_REQUIRE(X->n > 0, "X is empty");
+   Returns 0 if the number is COMPOSITE, 1 if it is PROBABLY_PRIME,
+   and a negative value upon error. */
+int bn_check_probable_prime(BIGNUM *W, int iter, f_rng_t f_rng, void *rng_ctx) {
+  BN_REQUIRE(W, "W is null");
+  BN_REQUIRE(f_rng, "f_rng is null");
+  BN_REQUIRE(rng_ctx, "rng_ctx is null");
 
-  int ret, i;
-  bn_uint_t r;
+  BN_CTX ctx;
+  int ret;
 
-  if (nrounds > N_PRIMES)
-    return BN_ERR_BAD_INPUT_DATA;
+  if ((ret = bn_ctx_init(&ctx, 0)) != 0)
+    return ret;
 
-  if ((X->p[0] & 1) == 0)
-    return BN_ERR_BAD_INPUT_DATA;
+  ret = bn_check_probable_prime_hlp(W, iter, f_rng, rng_ctx, &ctx, NULL);
+  bn_ctx_free(&ctx);
 
-  for (i = 0; i < nrounds; ++i) {
-    if (bn_cmp_udbl(X, primes[i]) == 0) {
-      /* Found a certain prime */
-      ret = 1;
-      goto cleanup;
-    }
+  return ret;
+}
 
-    BN_CHECK(bn_mod_uint(X, primes[i], &r));
-    if (r == 0) {
-      /* Found a prime factor */
-      ret = 2;
-      goto cleanup;
-    }
-  }
+/* Compute the residues of X modulo the odd primes primes[1..nsieve),
+   BN_MOD_UINTS_MAX primes per pass over X */
+static int bn_sieve_init(BIGNUM *X, unsigned short *mods, int nsieve) {
+  int ret = 0, i, j, nb;
+  bn_uint_t b[BN_MOD_UINTS_MAX], r[BN_MOD_UINTS_MAX];
 
-  ret = 0;
+  for (i = 1; i < nsieve; i += nb) {
+    nb = min(nsieve - i, BN_MOD_UINTS_MAX);
+
+    for (j = 0; j < nb; ++j)
+      b[j] = primes[i + j];
+
+    BN_CHECK(bn_mod_uints(X, b, nb, r));
+
+    for (j = 0; j < nb; ++j)
+      mods[i + j] = (unsigned short)r[j];
+  }
 
 cleanup:
 
   return ret;
 }
 
+/* Update the residues for the candidate X + 2 */
+static void bn_sieve_step(unsigned short *mods, int nsieve) {
+  int i;
+
+  for (i = 1; i < nsieve; ++i) {
+    mods[i] += 2;
+    if (mods[i] >= primes[i])
+      mods[i] -= primes[i];
+  }
+}
+
+/* Step the residues to the next candidate without a small factor,
+   returning the number of steps (by 2) taken */
+static int bn_sieve_next(unsigned short *mods, int nsieve) {
+  int i, steps = 0;
+
+  for (;;) {
+    for (i = 1; i < nsieve && mods[i] != 0; ++i)
+      ;
+
+    if (i == nsieve)
+      return steps;
+
+    bn_sieve_step(mods, nsieve);
+    steps++;
+  }
+}
+
 /* Generate a random pseudo-prime number [HAC 4.44].
 
-   Returns 0 on success. */
-int bn_generate_proabable_prime(BIGNUM *X, int nbits, f_rng_t f_rng,
-                                void *rng_ctx) {
-  BN_REQUIRE(X, "X is null");
-  BN_REQUIRE(f_rng, "f_rng is null");
-  BN_REQUIRE(rng_ctx, "rng_ctx is null");
+   Starting from one random nbits long odd number, the candidates are
+   stepped by 2 while a sieve over the residues modulo primes[] rejects
+   those with a small factor with word arithmetic only.
 
+   With a winner (see bn_generate_prime_parallel()), the search
+   gives up with BN_ERR_CANCELLED as soon as another worker has
+   found a prime, and a prime is only kept if this worker is the
+   first to claim it.
+
+   Returns 0 on success. */
+static int bn_generate_prime_hlp(BIGNUM *X, int nbits, f_rng_t f_rng,
+                                 void *rng_ctx, volatile long *winner,
+                                 long id) {
   BIGNUM TX;
-  int ret = 0, i;
+  BN_CTX ctx;
+  unsigned short mods[N_PRIMES];
+  int ret = 0, i, nsieve;
 
   if (nbits < 3)
     return BN_ERR_BAD_INPUT_DATA;
   if (nbits > BN_MAX_BITS)
     return BN_ERR_NOT_ENOUGH_LIMBS;
 
+  /* All Miller-Rabin temporaries come from one arena, so that
+     the candidate loop does not hit the allocator */
   bn_init(&TX, NULL);
+  if ((ret = bn_ctx_init(&ctx, 0)) != 0)
+    return ret;
   BN_CHECK(bn_grow(&TX, BN_BITS_TO_LIMBS(nbits)));
 
+  nsieve = num_sieve_primes(nbits);
+
+  /* Calculate the number of rounds of Miller-Rabin which gives
+     a false positive rate of 2^{-80} [HAC Table 4.4] */
+  int mr_rounds = (nbits >= 1300)  ? 2
+                  : (nbits >= 850) ? 3
+                  : (nbits >= 550) ? 5
+                  : (nbits >= 350) ? 8
+                  : (nbits >= 250) ? 12
+                  : (nbits >= 150) ? 18
+                                   : 27;
+
 generate:
   /* Generate an nbits long odd random number */
   if (f_rng(rng_ctx, (byte *)TX.p, ceil_div(nbits, 8), NULL, 0) != SUCCESS) {
@@ -2107,39 +3430,40 @@ generate:
 
   TX.p[0] |= 1;
 
-  int trial_rounds = num_trial_divisions(nbits);
-
-  /* Calculate the number of rounds of Miller-Rabin which gives
-     a false positive rate of 2^{-80} [HAC Table 4.4] */
-  int mr_rounds = (nbits >= 1300)  ? 2
-                  : (nbits >= 850) ? 3
-                  : (nbits >= 550) ? 5
-                  : (nbits >= 350) ? 8
-                  : (nbits >= 250) ? 12
-                  : (nbits >= 150) ? 18
-                                   : 27;
+  BN_CHECK(bn_sieve_init(&TX, mods, nsieve));
 
   for (;;) {
-    /* Test with small factors first */
-    if ((ret = bn_trial_divisions(&TX, trial_rounds)) == 1)
-      break;
-    if (ret < 0)
+    if (bn_prime_stopped(winner)) {
+      ret = BN_ERR_CANCELLED;
       goto cleanup;
-    if (ret == 2)
-      goto next;
+    }
+
+    /* Skip the candidates with a small factor */
+    BN_CHECK(bn_add_sdbl(&TX, 2 * bn_sieve_next(mods, nsieve), &TX));
+
+    /* Make sure the number is still nbits long */
+    if (bn_msb(&TX) != nbits)
+      goto generate;
+
+    /* Sieved with all primes below sqrt(TX), so certainly prime */
+    if (nbits <= 25)
+      break;
 
     /* Do multiple rounds of Miller-Rabin */
-    if ((ret = bn_check_probable_prime(&TX, mr_rounds, f_rng, rng_ctx)) == 1)
+    if ((ret = bn_check_probable_prime_hlp(&TX, mr_rounds, f_rng, rng_ctx,
+                                           &ctx, winner)) == 1)
       break;
     if (ret < 0)
       goto cleanup;
-  next:
+
+    bn_sieve_step(mods, nsieve);
     BN_CHECK(bn_add_sdbl(&TX, 2, &TX));
   }
 
-  /* Make sure the number is still nbits long */
-  if (bn_msb(&TX) != nbits)
-    goto generate;
+  if (winner != NULL && !BN_PRIME_CLAIM(winner, id)) {
+    ret = BN_ERR_CANCELLED;
+    goto cleanup;
+  }
 
   BN_CHECK(bn_assign(X, &TX));
 
@@ -2147,7 +3471,128 @@ generate:
 
 cleanup:
 
+  zeroize(mods, sizeof(mods));
   bn_zfree(&TX, NULL);
+  bn_ctx_free(&ctx);
+
+  return ret;
+}
+
+/* Generate a random pseudo-prime number [HAC 4.44].
+
+   Returns 0 on success. */
+int bn_generate_proabable_prime(BIGNUM *X, int nbits, f_rng_t f_rng,
+                                void *rng_ctx) {
+  BN_REQUIRE(X, "X is null");
+  BN_REQUIRE(f_rng, "f_rng is null");
+  BN_REQUIRE(rng_ctx, "rng_ctx is null");
+
+  return bn_generate_prime_hlp(X, nbits, f_rng, rng_ctx, NULL, 0);
+}
+
+/* A worker of a parallel prime search */
+typedef struct {
+  BIGNUM X;
+  int nbits;
+  f_rng_t f_rng;
+  void *rng_ctx;
+  volatile long *winner;
+  long id;
+  int ret;
+} bn_prime_worker;
+
+static void bn_prime_worker_run(bn_prime_worker *w) {
+  w->ret = bn_generate_prime_hlp(&w->X, w->nbits, w->f_rng, w->rng_ctx,
+                                 w->winner, w->id);
+}
+
+#if defined(_WIN32)
+static unsigned __stdcall bn_prime_thread(void *arg) {
+  bn_prime_worker_run((bn_prime_worker *)arg);
+  return 0;
+}
+#else
+static void *bn_prime_thread(void *arg) {
+  bn_prime_worker_run((bn_prime_worker *)arg);
+  return NULL;
+}
+#endif
+
+/* Generate a random pseudo-prime number with nthreads workers.
+
+   Each worker runs the sieve and Miller-Rabin search of
+   bn_generate_proabable_prime() from its own random start with its
+   own generator from rng_factory; the calling thread is worker 0.
+   The first worker to find a prime stops the others, which check
+   for it between candidates and between Miller-Rabin rounds.
+
+   If some of the threads cannot be started, the search goes on
+   with fewer workers.
+
+   Returns 0 on success. */
+int bn_generate_prime_parallel(BIGNUM *X, int nbits, int nthreads,
+                               const bn_rng_factory *rng_factory) {
+  BN_REQUIRE(X, "X is null");
+  BN_REQUIRE(rng_factory, "rng_factory is null");
+  BN_REQUIRE(rng_factory->f_rng, "f_rng is null");
+
+  bn_prime_worker w[BN_PRIME_MAX_THREADS];
+#if defined(_WIN32)
+  HANDLE th[BN_PRIME_MAX_THREADS];
+#else
+  pthread_t th[BN_PRIME_MAX_THREADS];
+#endif
+  volatile long winner = -1;
+  int ret = BN_ERR_INTERNAL_FAILURE, i, nctx, nspawned;
+
+  if (nthreads < 1 || nthreads > BN_PRIME_MAX_THREADS)
+    return BN_ERR_BAD_INPUT_DATA;
+
+  for (nctx = 0; nctx < nthreads; ++nctx) {
+    bn_init(&w[nctx].X, NULL);
+    w[nctx].nbits = nbits;
+    w[nctx].f_rng = rng_factory->f_rng;
+    w[nctx].winner = &winner;
+    w[nctx].id = nctx;
+    w[nctx].ret = BN_ERR_CANCELLED;
+    if ((w[nctx].rng_ctx = rng_factory->new_ctx(rng_factory->arg)) == NULL) {
+      bn_zfree(&w[nctx].X, NULL);
+      goto cleanup;
+    }
+  }
+
+  for (nspawned = 1; nspawned < nthreads; ++nspawned) {
+#if defined(_WIN32)
+    if ((th[nspawned] = (HANDLE)_beginthreadex(
+             NULL, 0, bn_prime_thread, &w[nspawned], 0, NULL)) == NULL)
+      break;
+#else
+    if (pthread_create(&th[nspawned], NULL, bn_prime_thread, &w[nspawned]))
+      break;
+#endif
+  }
+
+  bn_prime_worker_run(&w[0]);
+
+  for (i = 1; i < nspawned; ++i) {
+#if defined(_WIN32)
+    WaitForSingleObject(th[i], INFINITE);
+    CloseHandle(th[i]);
+#else
+    pthread_join(th[i], NULL);
+#endif
+  }
+
+  /* A worker only stops without a prime if it is cancelled or
+     fails, so with no winner worker 0 has failed */
+  ret = (winner >= 0) ? bn_assign(X, &w[winner].X) : w[0].ret;
+
+cleanup:
+
+  for (i = 0; i < nctx; ++i) {
+    rng_factory->free_ctx(w[i].rng_ctx);
+    bn_zfree(&w[i].X, NULL);
+  }
 
   return ret;
 }
@@ -2196,8 +3641,11 @@ static const bn_udbl_t gcd_tvec[N_GCD_TVEC][3] = {
 int bn_self_test(f_rng_t f_rng, void *rng_ctx, int verbose, FILE *fp) {
   int ret = 0, res;
   BIGNUM A, B, C, D, E, F, G, H, M, X, Y, Z;
+  BN_CTX ctx = {NULL, 0, 0};
+  BN_MOD_CTX mctx;
 
   bn_init(&A, &B, &C, &D, &E, &F, &G, &H, &M, NULL);
+  memset(&mctx, 0, sizeof(mctx));
 
   fp = (fp == NULL) ? stdout : fp;
 
@@ -2333,9 +3781,179 @@ int bn_self_test(f_rng_t f_rng, void *rng_ctx, int verbose, FILE *fp) {
   TEST_MSG(verbose, fp, 7, "bn_check_probable_prime", res == 0);
   bn_zfree(&X, NULL);
 
+  // Karatsuba multiplication and squaring
+  // (X*Y)/Y must give back X for unbalanced operands above the
+  // cutoff, and A*A (squaring) must agree with A*B when B == A
+  bn_init(&X, &Y, &Z, NULL);
+  BN_CHECK(bn_grow(&X, 4 * BN_KARATSUBA_SQUARE_CUTOFF + 3));
+  BN_CHECK(bn_grow(&Y, 10 * BN_KARATSUBA_CUTOFF + 1));
+  if (f_rng(rng_ctx, (byte *)X.p, X.n * WORD_SIZE, NULL, 0) != SUCCESS ||
+      f_rng(rng_ctx, (byte *)Y.p, Y.n * WORD_SIZE, NULL, 0) != SUCCESS) {
+    ret = BN_ERR_INTERNAL_FAILURE;
+    goto cleanup;
+  }
+  Y.p[Y.n - 1] |= 1;
+  BN_CHECK(bn_mul(&X, &Y, &Z));
+  BN_CHECK(bn_div(&Z, &Y, &A, &B));
+  res = (bn_cmp(&A, &X) == 0 && bn_is_zero(&B));
+  BN_CHECK(bn_assign(&A, &X));
+  BN_CHECK(bn_mul(&X, &X, &Y));
+  BN_CHECK(bn_mul(&X, &A, &Z));
+  res &= (bn_cmp(&Y, &Z) == 0);
+  TEST_MSG(verbose, fp, 8, "bn_mul (Karatsuba)", res);
+  bn_zfree(&X, &Y, &Z, NULL);
+
+  // Constant-time modular exponentiation
+  // Must agree with bn_exp_mod for a multi-window exponent
+  bn_init(&X, &Y, &Z, NULL);
+  BN_CHECK(bn_grow(&X, 2048 / BIW));
+  BN_CHECK(bn_grow(&Y, 2048 / BIW));
+  BN_CHECK(bn_grow(&Z, 2048 / BIW));
+  if (f_rng(rng_ctx, (byte *)X.p, X.n * WORD_SIZE, NULL, 0) != SUCCESS ||
+      f_rng(rng_ctx, (byte *)Y.p, Y.n * WORD_SIZE, NULL, 0) != SUCCESS ||
+      f_rng(rng_ctx, (byte *)Z.p, Z.n * WORD_SIZE, NULL, 0) != SUCCESS) {
+    ret = BN_ERR_INTERNAL_FAILURE;
+    goto cleanup;
+  }
+  Z.p[0] |= 1;
+  BN_CHECK(bn_exp_mod(&X, &Y, &Z, NULL, &A));
+  BN_CHECK(bn_exp_mod_ct(&X, &Y, &Z, NULL, &B));
+  res = (bn_cmp(&A, &B) == 0);
+  BN_CHECK(bn_exp_mod_ct(&H, &Y, &F, NULL, &B));
+  BN_CHECK(bn_exp_mod(&H, &Y, &F, NULL, &A));
+  res &= (bn_cmp(&A, &B) == 0);
+  TEST_MSG(verbose, fp, 9, "bn_exp_mod_ct", res);
+  bn_zfree(&X, &Y, &Z, NULL);
+
+  // Scratch arena
+  // The arena is too small for all temporaries, so some of them
+  // fall back to the heap; all must be given back afterwards
+  bn_init(&X, &Y, &Z, NULL);
+  BN_CHECK(bn_ctx_init(&ctx, 4 * F.n));
+  BN_CHECK(bn_exp_mod(&H, &G, &F, NULL, &X));
+  BN_CHECK(bn_exp_mod_ctx(&H, &G, &F, NULL, &Y, &ctx));
+  BN_CHECK(bn_exp_mod_ct_ctx(&H, &G, &F, NULL, &Z, &ctx));
+  res = (bn_cmp(&X, &Y) == 0 && bn_cmp(&X, &Z) == 0 && ctx.used == 0);
+  TEST_MSG(verbose, fp, 10, "bn_ctx", res);
+  bn_zfree(&X, &Y, &Z, NULL);
+
+  // Prime generation
+  // Covers both the sieve-only (nbits <= 25) and the Miller-Rabin path
+  res = 1;
+  bn_init(&X, NULL);
+  for (int nbits = 24; nbits <= 384; nbits += 120) {
+    BN_CHECK(bn_generate_proabable_prime(&X, nbits, f_rng, rng_ctx));
+    res &= (bn_msb(&X) == nbits &&
+            bn_check_probable_prime(&X, 27, f_rng, rng_ctx) == 1);
+    bn_zfree(&X, NULL);
+  }
+  TEST_MSG(verbose, fp, 11, "bn_generate_proabable_prime", res);
+
+  // Barrett reduction
+  // Must agree with bn_mod for products of residues and for
+  // smaller values, and RR with the one bn_exp_mod computes
+  bn_init(&X, &Y, &Z, NULL);
+  BN_CHECK(bn_mod_ctx_init(&mctx, &H));
+  BN_CHECK(bn_mul(&G, &F, &X));
+  BN_CHECK(bn_mod(&X, &H, &Y));
+  BN_CHECK(bn_mod_barrett(&X, &mctx, &Z));
+  res = (bn_cmp(&Y, &Z) == 0);
+  BN_CHECK(bn_mod(&A, &H, &Y));
+  BN_CHECK(bn_mod_barrett(&A, &mctx, &Z));
+  res &= (bn_cmp(&Y, &Z) == 0);
+  BN_CHECK(bn_exp_mod(&G, &C, &H, NULL, &Y));
+  BN_CHECK(bn_exp_mod(&G, &C, &H, &mctx.RR, &Z));
+  res &= (bn_cmp(&Y, &Z) == 0);
+  TEST_MSG(verbose, fp, 12, "bn_mod_barrett", res);
+  bn_zfree(&X, &Y, &Z, NULL);
+
+  // Multi-modulus residues
+  {
+    bn_uint_t b[BN_MOD_UINTS_MAX], r[BN_MOD_UINTS_MAX], rr;
+
+    for (int i = 0; i < BN_MOD_UINTS_MAX; ++i)
+      b[i] = 8161u - 6u * i;
+    b[0] = 2;
+    b[1] = 65535;
+
+    res = 1;
+    BN_CHECK(bn_mod_uints(&F, b, BN_MOD_UINTS_MAX, r));
+    for (int i = 0; i < BN_MOD_UINTS_MAX; ++i) {
+      BN_CHECK(bn_mod_uint(&F, b[i], &rr));
+      res &= (r[i] == rr);
+    }
+  }
+  TEST_MSG(verbose, fp, 13, "bn_mod_uints", res);
+
+  // Inline storage
+  // X must stay in buf up to BN_INLINE_LIMBS and move to the heap
+  // beyond; otherwise bn_zfree leaves it empty over buf again
+  {
+    bn_inline_t buf;
+
+    bn_init_inline(&X, buf);
+    BN_CHECK(bn_mul(&G, &F, &X));
+    res = (X.p == buf && (X.f & BN_FLAG_INLINE));
+    BN_CHECK(bn_mul(&G, &F, &Y));
+    res &= (bn_cmp(&X, &Y) == 0);
+    BN_CHECK(bn_lshift(&X, BN_INLINE_LIMBS * BIW));
+    BN_CHECK(bn_rshift(&X, BN_INLINE_LIMBS * BIW));
+    res &= (X.p != buf && bn_cmp(&X, &Y) == 0);
+    bn_zfree(&X, &Y, NULL);
+    res &= (X.p == NULL);
+
+    bn_init_inline(&X, buf);
+    bn_zfree(&X, NULL);
+    BN_CHECK(bn_from_udbl(&X, 1));
+    res &= (X.p == buf && X.n == sizeof(bn_udbl_t) / WORD_SIZE);
+    bn_zfree(&X, NULL);
+  }
+  TEST_MSG(verbose, fp, 14, "bn_init_inline", res);
+
+  // Radix conversion
+  // Round trip a number large enough to be split at the powers of
+  // the radix, and check the zero padding of the low halves on
+  // 10^400 - 1 and 10^400 + 1
+  {
+    char s[2 * BN_RADIX_DC_LIMBS * BIW + 2];
+    int slen, i;
+
+    bn_init(&X, &Y, NULL);
+    BN_CHECK(bn_grow(&X, 3 * BN_RADIX_DC_LIMBS / 2 + 5));
+    if (f_rng(rng_ctx, (byte *)X.p, X.n * WORD_SIZE, NULL, 0) != SUCCESS) {
+      ret = BN_ERR_INTERNAL_FAILURE;
+      goto cleanup;
+    }
+    X.s = -1;
+    for (i = 7, res = 1; i <= 16; i += 3) {
+      slen = sizeof(s);
+      BN_CHECK(bn_write_string(i, s, &slen, &X));
+      BN_CHECK(bn_read_string(i, s, &Y));
+      res &= (bn_cmp(&X, &Y) == 0);
+    }
+
+    memset(s, '0', 401);
+    s[0] = '1';
+    s[401] = '\0';
+    BN_CHECK(bn_read_string(10, s, &X));
+    BN_CHECK(bn_sub_sdbl(&X, 1, &Y));
+    slen = sizeof(s);
+    BN_CHECK(bn_write_string(10, s, &slen, &Y));
+    res &= (slen == 401 && strspn(s, "9") == 400);
+    BN_CHECK(bn_add_sdbl(&X, 1, &Y));
+    slen = sizeof(s);
+    BN_CHECK(bn_write_string(10, s, &slen, &Y));
+    res &= (slen == 402 && s[0] == '1' && strspn(s + 1, "0") == 399 &&
+            s[400] == '1');
+    bn_zfree(&X, &Y, NULL);
+  }
+  TEST_MSG(verbose, fp, 15, "bn_read_string/bn_write_string", res);
+
 cleanup:
 
   bn_zfree(&A, &B, &C, &D, &E, &F, &G, &H, &M, NULL);
+  bn_ctx_free(&ctx);
+  bn_mod_ctx_free(&mctx);
 
   return ret;
 }
@@ -19,7 +19,10 @@
 
 /* Defines for the word width depending upon the architecture. */
 #ifndef WORD_SIZE
-#if (defined(__GNUC__) || defined(_MSC_VER)) &&                                \
+#if defined(__GNUC__) && defined(__SIZEOF_INT128__) &&                        \
+    (defined(__x86_64__) || defined(__aarch64__) || defined(__powerpc64__))
+#define WORD_SIZE 8
+#elif (defined(__GNUC__) || defined(_MSC_VER)) &&                              \
     (defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__) ||         \
      defined(__powerpc64__))
 #define WORD_SIZE 4
@@ -34,10 +37,11 @@
 
 /* Here comes the compile-time specialization for how large the underlying array
  * size should be. */
-/* The choices are 1, 2 and 4 bytes in size with uint32, uint64 for
- * WORD_SIZE==4, as temporary. */
+/* The choices are 1, 2, 4 and 8 bytes in size with uint32, uint64 for
+ * WORD_SIZE==4, as temporary, and uint64, unsigned __int128 for
+ * WORD_SIZE==8 (64-bit GCC and Clang targets only). */
 #ifndef WORD_SIZE
-#error Failed to detect WORD_SIZE, must be explicitly defined as 1, 2, or 4
+#error Failed to detect WORD_SIZE, must be explicitly defined as 1, 2, 4 or 8
 #elif (WORD_SIZE == 1)
 /* Data type of array in structure */
 typedef uint8_t bn_uint_t; /* Unsigned*/
@@ -71,6 +75,18 @@ typedef int64_t bn_sdbl_t;
 #define BN_SPRINTF_FORMAT_STR "%.08x"
 #define BN_SSCANF_FORMAT_STR "%8x"
 #define BN_MAX_VAL ((bn_udbl_t)0xFFFFFFFF)
+#elif (WORD_SIZE == 8)
+#if !defined(__SIZEOF_INT128__)
+#error WORD_SIZE 8 requires compiler support for __int128
+#endif
+typedef uint64_t bn_uint_t;
+typedef int64_t bn_sint_t;
+__extension__ typedef unsigned __int128 bn_udbl_t;
+__extension__ typedef __int128 bn_sdbl_t;
+#define BN_MSB_MASK ((bn_udbl_t)(0x8000000000000000ULL))
+#define BN_SPRINTF_FORMAT_STR "%.016llx"
+#define BN_SSCANF_FORMAT_STR "%16llx"
+#define BN_MAX_VAL ((bn_udbl_t)0xFFFFFFFFFFFFFFFFULL)
 #endif
 
 typedef struct bignum_st {
@@ -80,6 +96,31 @@ typedef struct bignum_st {
   int f;        /* flags */
 } BIGNUM;
 
+/* Flags */
+#define BN_FLAG_BORROWED 0x01 /* limbs are not owned (BN_CTX or stack) */
+#define BN_FLAG_INLINE 0x02   /* limbs are a bn_inline_t buffer */
+
+/* Scratch arena for BIGNUM temporaries; limbs are handed out
+ * from the bottom up and given back in LIFO order */
+typedef struct bn_ctx_st {
+  bn_uint_t *p; /* pointer to the arena */
+  size_t size;  /* # of limbs in the arena */
+  size_t used;  /* # of limbs handed out */
+} BN_CTX;
+
+/* A modulus with the constants for repeated reductions by it:
+ * the Barrett constant mu = floor(b^(2k) / N), where b = 2^BIW and
+ * k is the # of significant limbs of N, and, if N is odd, the
+ * Montgomery constants mm and RR = R^2 (mod N), R = b^(N->n), which
+ * can be passed as the _RR argument of the bn_exp_mod* functions */
+typedef struct bn_mod_ctx_st {
+  BIGNUM N;     /* the modulus */
+  BIGNUM MU;    /* Barrett constant */
+  BIGNUM RR;    /* R^2 (mod N), empty if N is even */
+  bn_uint_t mm; /* -N^-1 (mod b), 0 if N is even */
+  size_t k;     /* # of significant limbs of N */
+} BN_MOD_CTX;
+
 /* Error codes */
 #define BN_ERR_INTERNAL_FAILURE                                                \
   -0x0001 /* Something went wrong, cleanup and exit */
@@ -92,12 +133,18 @@ typedef struct bignum_st {
                                            limbs*/
 #define BN_ERR_NEGATIVE_VALUE -0x0007 /* Negative nput arguments provided */
 #define BN_ERR_DIVISION_BY_ZERO -0x0008 /* Division by zero */
+#define BN_ERR_CANCELLED -0x0009 /* Stopped by another prime search worker */
 
 #define BN_MAX_LIMBS 1024
 #define BN_MAX_BITS (BN_MAX_LIMBS * WORD_SIZE << 3)
 #define BIW (WORD_SIZE << 3) /* bits in word */
 #define BIH (WORD_SIZE << 2) /* bits in half word */
 
+/* Default size of a BN_CTX arena, enough for the temporaries of
+ * a Miller-Rabin test or a modular exponentiation up to about
+ * half of BN_MAX_BITS */
+#define BN_CTX_DEFAULT_LIMBS (8 * BN_MAX_LIMBS)
+
 #define BN_CHECK(rv)                                                           \
   do {                                                                         \
     if ((ret = rv) != 0)                                                       \
@@ -119,14 +166,35 @@ typedef struct bignum_st {
 /* Get the number of bn_uint_t limbs from the number of words */
 #define BN_WORDS_TO_LIMBS(x) (((x) + WORD_SIZE - 1) / WORD_SIZE)
 
+/* Capacity of a bn_inline_t: 4096 bits, plus two limbs for the
+ * carries of sums and the extra limb of Montgomery products */
+#define BN_INLINE_LIMBS (BN_BITS_TO_LIMBS(4096) + 2)
+
+/* Inline limb storage for a BIGNUM temporary (see bn_init_inline) */
+typedef bn_uint_t bn_inline_t[BN_INLINE_LIMBS];
+
 /* Initialize one or multiple BIGNUM(s) */
 void bn_init(BIGNUM *X, ...);
+/* Initialize X over inline storage that it uses for up to
+ * BN_INLINE_LIMBS limbs before moving to the heap */
+void bn_init_inline(BIGNUM *X, bn_inline_t buf);
 /* Unallocate one or multiple BIGNUM(s) */
 void bn_zfree(BIGNUM *X, ...);
 /* Expand X to (at least) nlimbs */
 int bn_grow(BIGNUM *X, const size_t nlimbs);
 /* Shrink X as much as possible while keeping at least nlimbs */
 int bn_shrink(BIGNUM *X, const size_t nlimbs);
+
+/* Allocate a scratch arena of nlimbs (0 for the default) */
+int bn_ctx_init(BN_CTX *ctx, size_t nlimbs);
+/* Zero and free the scratch arena */
+void bn_ctx_free(BN_CTX *ctx);
+/* Get a mark to later give back everything borrowed after it */
+size_t bn_ctx_start(const BN_CTX *ctx);
+/* Borrow nlimbs zeroed limbs from the arena for an empty X */
+int bn_ctx_get(BN_CTX *ctx, BIGNUM *X, const size_t nlimbs);
+/* Zero and give back everything borrowed after mark */
+void bn_ctx_end(BN_CTX *ctx, size_t mark);
 /* Copy Y to X */
 int bn_assign(BIGNUM *X, const BIGNUM *Y);
 /* Copy udbl to the least significant limbs of X */
@@ -202,8 +270,26 @@ int bn_div_sdbl(BIGNUM *A, const bn_sdbl_t b, BIGNUM *Q, BIGNUM *R);
 int bn_mod(BIGNUM *A, BIGNUM *B, BIGNUM *R);
 /* Integer modulo: r = A (mod b) */
 int bn_mod_uint(BIGNUM *A, bn_uint_t b, bn_uint_t *r);
+/* Max # of moduli of bn_mod_uints */
+#define BN_MOD_UINTS_MAX 16
+/* Integer modulo by nb moduli in one pass: r[j] = A (mod b[j]) */
+int bn_mod_uints(BIGNUM *A, const bn_uint_t *b, int nb, bn_uint_t *r);
+/* Precompute the reduction constants of the modulus N */
+int bn_mod_ctx_init(BN_MOD_CTX *mctx, BIGNUM *N);
+/* Zero and free the reduction constants */
+void bn_mod_ctx_free(BN_MOD_CTX *mctx);
+/* Barrett reduction: R = A (mod N) with the constants of mctx */
+int bn_mod_barrett(BIGNUM *A, const BN_MOD_CTX *mctx, BIGNUM *R);
 /* Modular exponentiation: X = A^E (mod N) */
 int bn_exp_mod(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X);
+/* Constant-time modular exponentiation: X = A^E (mod N) */
+int bn_exp_mod_ct(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X);
+/* Modular exponentiation with temporaries from ctx */
+int bn_exp_mod_ctx(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR, BIGNUM *X,
+                   BN_CTX *ctx);
+/* Constant-time modular exponentiation with temporaries from ctx */
+int bn_exp_mod_ct_ctx(BIGNUM *A, BIGNUM *E, BIGNUM *N, BIGNUM *_RR,
+                      BIGNUM *X, BN_CTX *ctx);
 /* Greatest common divisor: G = gcd(A, B) */
 int bn_gcd(BIGNUM *A, BIGNUM *B, BIGNUM *G);
 /* Modular inverse: X = A^-1 mod N  */
@@ -218,6 +304,25 @@ int bn_check_probable_prime(BIGNUM *W, int iter, f_rng_t f_rng, void *rng_ctx);
 int bn_generate_proabable_prime(BIGNUM *X, int nbits, f_rng_t f_rng,
                                 void *rng_ctx);
 
+/* Max # of workers of a parallel prime search */
+#define BN_PRIME_MAX_THREADS 64
+
+/* Hands out one generator per prime search worker; new_ctx() is
+ * called from the calling thread and returns a context for f_rng
+ * (or NULL on failure), free_ctx() releases it afterwards */
+typedef struct bn_rng_factory_st {
+  f_rng_t f_rng;
+  void *(*new_ctx)(void *arg);
+  void (*free_ctx)(void *rng_ctx);
+  void *arg;
+} bn_rng_factory;
+
+/* Generate a probable prime with nthreads workers, each searching
+ * from its own random start with its own generator; the first prime
+ * found stops the others */
+int bn_generate_prime_parallel(BIGNUM *X, int nbits, int nthreads,
+                               const bn_rng_factory *rng_factory);
+
 /* Perform tests */
 int bn_self_test(f_rng_t f_rng, void *rng_ctx, int verbose, FILE *fp);
 
@@ -6,33 +6,64 @@
 
 #include "common/defs.h"
 
+#include <string.h>
+
+/* Make the compiler assume that the memory at ptr is read after the
+   barrier, so that the stores before it cannot be elided as dead;
+   this lets memset/memcpy use their full-width stores. */
+#if defined(__GNUC__) || defined(__clang__)
+#define XR_MEM_BARRIER(ptr) __asm__ __volatile__("" : : "r"(ptr) : "memory")
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define XR_MEM_BARRIER(ptr) _ReadWriteBarrier()
+#endif
+
 volatile void *xr_memset(volatile void *mem, int ch, size_t len) {
+#if defined(XR_MEM_BARRIER)
+  memset((void *)mem, ch, len);
+  XR_MEM_BARRIER(mem);
+#else
   volatile char *p;
 
   for (p = (volatile char *)mem; len; p[--len] = ch)
     ;
+#endif
   return mem;
 }
 
 volatile void *xr_memzero(volatile void *mem, size_t len) {
-  volatile char *p;
-
-  for (p = (volatile char *)mem; len; p[--len] = 0x00)
-    ;
+#if defined(_WIN32)
+  SecureZeroMemory((void *)mem, len);
+#elif (defined(__GLIBC__) &&                                                   \
+       (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 25))) ||        \
+    defined(__OpenBSD__) || defined(__FreeBSD__)
+  explicit_bzero((void *)mem, len);
+#else
+  xr_memset(mem, 0x00, len);
+#endif
   return mem;
 }
 
 volatile void *xr_memcpy(volatile void *dst, volatile void *src, size_t len) {
+#if defined(XR_MEM_BARRIER)
+  memcpy((void *)dst, (void *)src, len);
+  XR_MEM_BARRIER(dst);
+#else
   volatile char *cdst, *csrc;
 
   cdst = (volatile char *)dst;
   csrc = (volatile char *)src;
   while (len--)
     cdst[len] = csrc[len];
+#endif
   return dst;
 }
 
 volatile void *xr_memmove(volatile void *dst, volatile void *src, size_t len) {
+#if defined(XR_MEM_BARRIER)
+  memmove((void *)dst, (void *)src, len);
+  XR_MEM_BARRIER(dst);
+#else
   size_t i;
   volatile char *cdst, *csrc;
 
@@ -45,19 +76,31 @@ volatile void *xr_memmove(volatile void *dst, volatile void *src, size_t len) {
     while (len--)
       cdst[len] = csrc[len];
   }
+#endif
   return dst;
 }
 
-/* Returns zero if a[0:len-1] == b[0:len-1], otherwise non-zero. */
-unsigned int xr_memcmp(const void *a, const void *b, size_t len) {
-  unsigned int res = 0;
-  const char *pa, *pb;
+/* Returns zero if a[0:len-1] == b[0:len-1], otherwise non-zero.
 
-  pa = (const char *)a;
-  pb = (const char *)b;
-  for (; len; res |= pa[len] ^ pb[len], len--)
-    ;
-  return res;
+   Runs in time that depends only on len, comparing 16 bytes per
+   step (two 64-bit words) and then the remaining tail bytes. */
+unsigned int xr_memcmp(const void *a, const void *b, size_t len) {
+  const uint8_t *pa, *pb;
+  uint64_t wa0, wa1, wb0, wb1, res = 0;
+  size_t i = 0;
+
+  pa = (const uint8_t *)a;
+  pb = (const uint8_t *)b;
+  for (; len - i >= 16; i += 16) {
+    memcpy(&wa0, pa + i, 8);
+    memcpy(&wa1, pa + i + 8, 8);
+    memcpy(&wb0, pb + i, 8);
+    memcpy(&wb1, pb + i + 8, 8);
+    res |= (wa0 ^ wb0) | (wa1 ^ wb1);
+  }
+  for (; i < len; i++)
+    res |= pa[i] ^ pb[i];
+  return (unsigned int)(res | (res >> 32));
 }
 
 /* Returns zero if the strings are equal, otherwise non-zero.
@@ -47,18 +47,19 @@
 #define IN
 #define OUT
 
+#include <stddef.h>
 #include <stdint.h>
 
-typedef __int8 s8;
-typedef __int16 s16;
-typedef __int32 s32;
-typedef __int64 s64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
 
-typedef unsigned __int8 byte;
-typedef unsigned __int8 u8;
-typedef unsigned __int16 u16;
-typedef unsigned __int32 u32;
-typedef unsigned __int64 u64;
+typedef uint8_t byte;
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
 
 #define Ptrv(_ptr) ((void *)(_ptr))
 #define Ptr8(_ptr) ((u8 *)(_ptr))
@@ -84,6 +85,12 @@ typedef enum { false = 0, true } bool;
 
 typedef enum { SUCCESS = 0, FAILURE } status_t;
 
+/**
+ * Entropy source callback used by the DRBGs to reseed themselves;
+ * fills buf with len bytes of entropy and returns 0 on success.
+ */
+typedef int (*xr_entropy_cb_t)(void *ctx, uint8_t *buf, size_t len);
+
 #define ASSERT(stmt) Assert(stmt)
 
 #define NOP                                                                    \
@@ -99,22 +106,20 @@ typedef enum { SUCCESS = 0, FAILURE } status_t;
 #define zeroize(ptr, len) RtlSecureZeroMemory(ptr, len)
 #else
 /**
- * Provide a secure way to clear a block of memory by
- * declaring the pointer to memset volatile so that the
- * compiler must always dereference it, and therefore
- * cannot "optimize away" the call to memset.
+ * Use explicit_bzero() where the C library provides it, or
+ * otherwise a full-width memset followed by a compiler barrier
+ * so that the compiler cannot "optimize away" the stores
+ * (see xr_memzero() in crypto_mem.c).
  */
 #include <string.h>
-typedef void *(*memset_t)(void *_p, int _zv, size_t _nc);
-static volatile memset_t __memz = memset;
-#define zeroize(ptr, len) __memz(ptr, 0, len)
+#define zeroize(ptr, len) xr_memzero(ptr, len)
 #endif
 
 // The size of the memory to be copied must be a multiple of 32
 #define copy32(dst, src, size)                                                 \
   do {                                                                         \
-    volatile __int32 *d = (volatile __int32 *)(dst);                           \
-    volatile __int32 *s = (volatile __int32 *)(src);                           \
+    volatile int32_t *d = (volatile int32_t *)(dst);                           \
+    volatile int32_t *s = (volatile int32_t *)(src);                           \
     size_t c = (size / 4);                                                     \
     while (c--)                                                                \
       *d++ = *s++;                                                             \
@@ -122,8 +127,8 @@ static volatile memset_t __memz = memset;
 
 #define zcopy32(dst, src, size)                                                \
   do {                                                                         \
-    volatile __int32 *d = (volatile __int32 *)(dst);                           \
-    volatile __int32 *s = (volatile __int32 *)(src);                           \
+    volatile int32_t *d = (volatile int32_t *)(dst);                           \
+    volatile int32_t *s = (volatile int32_t *)(src);                           \
     size_t c = (size / 4);                                                     \
     while (c--) {                                                              \
       *d++ = *s;                                                               \
@@ -146,6 +151,7 @@ extern unsigned int xr_strcmp(const char *str, const char *x);
 #define BSWAP32(_x) bswap32(_x)
 #define BSWAP64(_x) bswap64(_x)
 
+#ifdef _WIN32
 #include <intrin.h>
 
 #pragma intrinsic(_rotl8, _rotl16, _rotr8, _rotr16)
@@ -159,5 +165,24 @@ extern unsigned int xr_strcmp(const char *str, const char *x);
 #define ROTR16(_x, _s) _rotr16((_x), (_s))
 #define ROTR32(_x, _s) _rotr((_x), (_s))
 #define ROTR64(_x, _s) _rotr64((_x), (_s))
+#else
+/* Compilers recognize these as rotate instructions; the
+   shift count _s must be in 1..(width - 1) */
+#define ROTL8(_x, _s) ((u8)(((u8)(_x) << (_s)) | ((u8)(_x) >> (8 - (_s)))))
+#define ROTL16(_x, _s)                                                         \
+  ((u16)(((u16)(_x) << (_s)) | ((u16)(_x) >> (16 - (_s)))))
+#define ROTL32(_x, _s)                                                         \
+  ((u32)(((u32)(_x) << (_s)) | ((u32)(_x) >> (32 - (_s)))))
+#define ROTL64(_x, _s)                                                         \
+  ((u64)(((u64)(_x) << (_s)) | ((u64)(_x) >> (64 - (_s)))))
+
+#define ROTR8(_x, _s) ((u8)(((u8)(_x) >> (_s)) | ((u8)(_x) << (8 - (_s)))))
+#define ROTR16(_x, _s)                                                         \
+  ((u16)(((u16)(_x) >> (_s)) | ((u16)(_x) << (16 - (_s)))))
+#define ROTR32(_x, _s)                                                         \
+  ((u32)(((u32)(_x) >> (_s)) | ((u32)(_x) << (32 - (_s)))))
+#define ROTR64(_x, _s)                                                         \
+  ((u64)(((u64)(_x) >> (_s)) | ((u64)(_x) << (64 - (_s)))))
+#endif
 
 #endif /* DEFS_H */
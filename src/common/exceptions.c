@@ -21,6 +21,17 @@
 #include <stdlib.h>
 #include <time.h>
 
+#if defined(_WIN32)
+#include <direct.h> // _mkdir
+#define XR_PATH_SEP "\\"
+#else
+#include <sys/stat.h> // mkdir
+#define XR_PATH_SEP "/"
+#endif
+
+/* The crash log, relative to the working directory */
+#define XR_LOG_DIR "logs"
+#define XR_LOG_PATH XR_LOG_DIR XR_PATH_SEP "crashdebug.log"
 
 #if defined(_MSC_VER)
 #include <intrin.h> // __fastfail
@@ -48,6 +59,29 @@ jmp_buf ex_buf;
 EXCEPTION ex = {
     .err_code = -1, .err_fatal = -1, .err_mswec = -1, .err_line = -1};
 
+/* Append a line for the error to the crash log, creating the log
+   directory in the working directory if need be */
+static void write_crash_log(ecode_t code, ecode_t mswec, ecode_t line) {
+  time_t _t = time(NULL);
+  struct tm _tm = *localtime(&_t);
+  FILE *_fpLog;
+
+#if defined(_WIN32)
+  _mkdir(XR_LOG_DIR);
+#else
+  mkdir(XR_LOG_DIR, 0755);
+#endif
+
+  if ((_fpLog = fopen(XR_LOG_PATH, "at"))) {
+    fprintf(
+        _fpLog,
+        "[%d %02d %02d %02d:%02d:%02d] [LINE %d] ERR 0x%X (WIN32 ERR 0x%X)\n",
+        _tm.tm_year + 1900, _tm.tm_mon + 1, _tm.tm_mday, _tm.tm_hour,
+        _tm.tm_min, _tm.tm_sec, line, code, mswec);
+    fclose(_fpLog);
+  }
+}
+
 const char *exception_message(ecode_t ecode) {
   switch (ecode) {
   case ERR_SUCCESS:
@@ -70,6 +104,8 @@ const char *exception_message(ecode_t ecode) {
     return ("Win32 API failure (check logs for debug info).");
   case ERR_WIN32_CNG:
     return ("Windows CNG failure (check logs for debug info).");
+  case ERR_GETRANDOM:
+    return ("getrandom() failure (check logs for debug info).");
   case ERR_ENTROPY_TOO_LOW:
     return ("Insufficient system entropy");
   case ERR_INIT_CHECKS_FAILED:
@@ -93,17 +129,7 @@ void handle_exception(ecode_t code, ecode_t fatal, ecode_t mswec, ecode_t line,
                       int verbose) {
   if (fatal) {
 #if !defined(XR_NO_CRASH_DUMP)
-    time_t _t = time(NULL);
-    struct tm _tm = *localtime(&_t);
-    FILE *_fpLog = fopen("logs\\crashdebug.log", "at");
-    if (_fpLog) {
-      fprintf(
-          _fpLog,
-          "[%d %02d %02d %02d:%02d:%02d] [LINE %d] ERR 0x%X (WIN32 ERR 0x%X)\n",
-          _tm.tm_year + 1900, _tm.tm_mon + 1, _tm.tm_mday, _tm.tm_hour,
-          _tm.tm_min, _tm.tm_sec, line, code, mswec);
-      fclose(_fpLog);
-    }
+    write_crash_log(code, mswec, line);
 #endif
     if (verbose) {
       fflush(NULL);
@@ -131,17 +157,7 @@ void clear_exception(EXCEPTION *pex) {
 void dump_log(ecode_t code, ecode_t fatal, ecode_t mswec, ecode_t line,
               int verbose) {
 #if !defined(XR_NO_CRASH_DUMP)
-  time_t _t = time(NULL);
-  struct tm _tm = *localtime(&_t);
-  FILE *_fpLog = fopen("logs\\crashdebug.log", "at");
-  if (_fpLog) {
-    fprintf(
-        _fpLog,
-        "[%d %02d %02d %02d:%02d:%02d] [LINE %d] ERR 0x%X (WIN32 ERR 0x%X)\n",
-        _tm.tm_year + 1900, _tm.tm_mon + 1, _tm.tm_mday, _tm.tm_hour,
-        _tm.tm_min, _tm.tm_sec, line, code, mswec);
-    fclose(_fpLog);
-  }
+  write_crash_log(code, mswec, line);
 #endif
   if (verbose) {
     fflush(NULL);
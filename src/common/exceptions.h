@@ -45,6 +45,9 @@ extern void kill(void);
 #define ERR_WIN32_WINAPI 0x31
 #define ERR_WIN32_CNG 0x32
 
+// Check debug logs for errno values
+#define ERR_GETRANDOM 0x41
+
 #define ERR_ENTROPY_TOO_LOW 0xE0
 #define ERR_INIT_CHECKS_FAILED 0xE1
 #define ERR_ASSERTION_FAILED 0xE2
@@ -0,0 +1,410 @@
+/**
+ * secure_alloc.c
+ *
+ * Locked, guarded and NUMA-placed allocations for secret state.
+ */
+
+#include "common/secure_alloc.h"
+#include "common/exceptions.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+/* "XRSA" */
+#define XR_SECURE_MAGIC 0x58525341u
+
+/* Nodes representable in the mbind() node mask */
+#define XR_NUMA_MAX_NODES 1024
+
+/* Linux MPOL_PREFERRED, without depending on the libnuma headers */
+#define XR_MPOL_PREFERRED 1
+
+/* Kept at the start of the header page, just below the data */
+typedef struct xr_secure_hdr {
+  uint32_t magic;
+  bool locked; /* The data pages are locked (or are large pages) */
+  bool large;  /* The mapping is backed by large pages */
+  uint8_t *base;
+  size_t map_len;
+  size_t data_len;
+} xr_secure_hdr;
+
+static size_t xr_page_size(void) {
+  static size_t page;
+
+  if (page == 0) {
+#if defined(_WIN32)
+    SYSTEM_INFO si;
+
+    GetSystemInfo(&si);
+    page = si.dwPageSize;
+#else
+    long n = sysconf(_SC_PAGESIZE);
+
+    page = n > 0 ? (size_t)n : 4096;
+#endif
+  }
+
+  return page;
+}
+
+/* The large page size, or 0 if the system has none to give */
+static size_t xr_large_page_size(void) {
+#if defined(_WIN32)
+  return GetLargePageMinimum();
+#elif defined(__linux__) && defined(MAP_HUGETLB)
+  static size_t huge = (size_t)-1;
+  unsigned long kb;
+  char line[128];
+  FILE *fp;
+
+  if (huge == (size_t)-1) {
+    huge = 0;
+    if ((fp = fopen("/proc/meminfo", "r")) != NULL) {
+      while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+          huge = (size_t)kb * 1024;
+          break;
+        }
+      }
+      fclose(fp);
+    }
+  }
+
+  return huge;
+#else
+  return 0;
+#endif
+}
+
+static inline size_t xr_round_up(size_t n, size_t to) {
+  return (n + to - 1) / to * to;
+}
+
+int xr_numa_node(void) {
+#if defined(_WIN32)
+  PROCESSOR_NUMBER pn;
+  USHORT node;
+
+  GetCurrentProcessorNumberEx(&pn);
+  return GetNumaProcessorNodeEx(&pn, &node) && node != 0xffff ? (int)node : 0;
+#elif defined(__linux__) && defined(SYS_getcpu)
+  unsigned int cpu, node;
+
+  return syscall(SYS_getcpu, &cpu, &node, NULL) == 0 ? (int)node : 0;
+#else
+  return 0;
+#endif
+}
+
+int xr_numa_nodes(void) {
+#if defined(_WIN32)
+  ULONG highest;
+
+  return GetNumaHighestNodeNumber(&highest) ? (int)highest + 1 : 1;
+#elif defined(__linux__)
+  /* The node topology does not change while we run */
+  static int nodes;
+  struct dirent *de;
+  unsigned int id;
+  char c;
+  DIR *dir;
+  int n = 0;
+
+  if (nodes == 0) {
+    if ((dir = opendir("/sys/devices/system/node")) != NULL) {
+      while ((de = readdir(dir)) != NULL)
+        if (sscanf(de->d_name, "node%u%c", &id, &c) == 1)
+          n++;
+      closedir(dir);
+    }
+    nodes = n > 0 ? n : 1;
+  }
+
+  return nodes;
+#else
+  return 1;
+#endif
+}
+
+#if defined(_WIN32)
+
+void *xr_secure_alloc(size_t size, int node, unsigned int flags) {
+  size_t page = xr_page_size(), huge, guard, data_len, map_len;
+  xr_secure_hdr hdr = {0};
+  uint8_t *hdr_page, *data;
+  DWORD old;
+
+  if (node < 0)
+    node = xr_numa_node();
+
+  data_len = xr_round_up(size ? size : 1, page);
+  hdr.base = NULL;
+
+  /* Large pages need SeLockMemoryPrivilege; they cannot be paged out
+     and cannot have their protection changed page by page */
+  if ((flags & XR_SECURE_LARGE_PAGES) && (huge = xr_large_page_size()) &&
+      data_len >= huge) {
+    map_len = xr_round_up(page + data_len, huge);
+    if ((hdr.base = (uint8_t *)VirtualAllocExNuma(
+             GetCurrentProcess(), NULL, map_len,
+             MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE,
+             (DWORD)node)) != NULL) {
+      hdr.large = hdr.locked = true;
+      hdr_page = hdr.base;
+    }
+  }
+
+  if (hdr.base == NULL) {
+    guard = (flags & XR_SECURE_GUARD) ? page : 0;
+    map_len = guard + page + data_len + guard;
+    if ((hdr.base = (uint8_t *)VirtualAllocExNuma(
+             GetCurrentProcess(), NULL, map_len, MEM_RESERVE | MEM_COMMIT,
+             PAGE_READWRITE, (DWORD)node)) == NULL)
+      return NULL;
+    hdr_page = hdr.base + guard;
+
+    if (guard && (!VirtualProtect(hdr.base, guard, PAGE_NOACCESS, &old) ||
+                  !VirtualProtect(hdr_page + page + data_len, guard,
+                                  PAGE_NOACCESS, &old))) {
+      VirtualFree(hdr.base, 0, MEM_RELEASE);
+      return NULL;
+    }
+  }
+
+  data = hdr_page + page;
+
+  if (!hdr.locked && (flags & (XR_SECURE_LOCK | XR_SECURE_TRY_LOCK))) {
+    hdr.locked = VirtualLock(data, data_len) != 0;
+    if (!hdr.locked && (flags & XR_SECURE_LOCK)) {
+      VirtualFree(hdr.base, 0, MEM_RELEASE);
+      return NULL;
+    }
+  }
+
+  hdr.magic = XR_SECURE_MAGIC;
+  hdr.map_len = map_len;
+  hdr.data_len = data_len;
+  memcpy(hdr_page, &hdr, sizeof(hdr));
+  if (!hdr.large)
+    VirtualProtect(hdr_page, page, PAGE_READONLY, &old);
+
+  return data;
+}
+
+#else
+
+/* Prefer the node for the pages of [p, p + len); must be called before
+   they are first touched. Best effort: a kernel without NUMA support or
+   a seccomp filter leaves the default (first touch) policy */
+static void xr_numa_bind(void *p, size_t len, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+  unsigned long mask[XR_NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+  const size_t bits = 8 * sizeof(unsigned long);
+
+  if (xr_numa_nodes() < 2 || node >= XR_NUMA_MAX_NODES)
+    return;
+
+  mask[(size_t)node / bits] |= 1UL << ((size_t)node % bits);
+  /* The kernel reads maxnode - 1 bits */
+  syscall(SYS_mbind, p, len, XR_MPOL_PREFERRED, mask,
+          (unsigned long)XR_NUMA_MAX_NODES + 1, 0);
+#else
+  (void)p;
+  (void)len;
+  (void)node;
+#endif
+}
+
+void *xr_secure_alloc(size_t size, int node, unsigned int flags) {
+  size_t page = xr_page_size(), huge, guard = 0, data_len, map_len;
+  xr_secure_hdr hdr = {0};
+  uint8_t *hdr_page, *data;
+  void *p = MAP_FAILED;
+
+  if (node < 0)
+    node = xr_numa_node();
+
+  data_len = xr_round_up(size ? size : 1, page);
+
+#if defined(MAP_HUGETLB)
+  /* Large pages cannot be swapped out and cannot be split for guard
+     pages; most systems reserve none, so fall through quietly */
+  if ((flags & XR_SECURE_LARGE_PAGES) && (huge = xr_large_page_size()) &&
+      data_len >= huge) {
+    map_len = xr_round_up(page + data_len, huge);
+    if ((p = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)) !=
+        MAP_FAILED)
+      hdr.large = hdr.locked = true;
+  }
+#else
+  (void)huge;
+#endif
+
+  if (p == MAP_FAILED) {
+    guard = (flags & XR_SECURE_GUARD) ? page : 0;
+    map_len = guard + page + data_len + guard;
+    if ((p = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+      return NULL;
+  }
+
+  hdr.base = (uint8_t *)p;
+  hdr_page = hdr.base + guard;
+  data = hdr_page + page;
+
+  xr_numa_bind(hdr.base, map_len, node);
+
+  if (guard && (mprotect(hdr.base, guard, PROT_NONE) != 0 ||
+                mprotect(data + data_len, guard, PROT_NONE) != 0)) {
+    munmap(hdr.base, map_len);
+    return NULL;
+  }
+
+#if defined(MADV_DONTDUMP)
+  madvise(data, data_len, MADV_DONTDUMP);
+#endif
+#if defined(MADV_HUGEPAGE)
+  /* Transparent huge pages for the aligned 2 MiB runs of the block */
+  if (!hdr.large && (flags & XR_SECURE_LARGE_PAGES))
+    madvise(data, data_len, MADV_HUGEPAGE);
+#endif
+
+  if (!hdr.locked && (flags & (XR_SECURE_LOCK | XR_SECURE_TRY_LOCK))) {
+    hdr.locked = mlock(data, data_len) == 0;
+    if (!hdr.locked && (flags & XR_SECURE_LOCK)) {
+      munmap(hdr.base, map_len);
+      return NULL;
+    }
+  }
+
+  hdr.magic = XR_SECURE_MAGIC;
+  hdr.map_len = map_len;
+  hdr.data_len = data_len;
+  memcpy(hdr_page, &hdr, sizeof(hdr));
+  if (!hdr.large)
+    mprotect(hdr_page, page, PROT_READ);
+
+  return data;
+}
+
+#endif /* _WIN32 */
+
+static const xr_secure_hdr *xr_secure_hdr_of(const void *p) {
+  const xr_secure_hdr *hdr =
+      (const xr_secure_hdr *)((const uint8_t *)p - xr_page_size());
+
+  /* A block not from xr_secure_alloc(), or a corrupted heap */
+  if (hdr->magic != XR_SECURE_MAGIC)
+    kill();
+  return hdr;
+}
+
+bool xr_secure_locked(const void *p) { return xr_secure_hdr_of(p)->locked; }
+
+void xr_secure_free(void *p) {
+  xr_secure_hdr hdr;
+
+  if (p == NULL)
+    return;
+
+  /* The header is unmapped with the block */
+  hdr = *xr_secure_hdr_of(p);
+
+  zeroize((uint8_t *)p, hdr.data_len);
+#if defined(_WIN32)
+  if (hdr.locked && !hdr.large)
+    VirtualUnlock(p, hdr.data_len);
+  VirtualFree(hdr.base, 0, MEM_RELEASE);
+#else
+  if (hdr.locked && !hdr.large)
+    munlock(p, hdr.data_len);
+  munmap(hdr.base, hdr.map_len);
+#endif
+}
+
+#if defined(XR_TESTS_SECURE_ALLOC)
+
+#include <stdio.h>
+
+int secure_alloc_run_test(void) {
+  static const size_t sizes[] = {0, 1, 384, 4096, 4097, 3 << 20};
+  static const unsigned int flags[] = {
+      XR_SECURE_LOCK | XR_SECURE_GUARD, XR_SECURE_TRY_LOCK,
+      XR_SECURE_TRY_LOCK | XR_SECURE_GUARD | XR_SECURE_LARGE_PAGES, 0};
+  size_t page = xr_page_size();
+  int node, fails = 0;
+  uint8_t *p;
+
+  printf("Running tests for common/secure_alloc.c\n");
+
+  node = xr_numa_node();
+  if (node < 0 || node >= xr_numa_nodes()) {
+    printf("  NUMA node %d of %d FAILED\n", node, xr_numa_nodes());
+    fails++;
+  }
+
+  for (size_t f = 0; f < count(flags); f++) {
+    for (size_t i = 0; i < count(sizes); i++) {
+      /* Locking 3 MiB may exceed RLIMIT_MEMLOCK */
+      if ((flags[f] & XR_SECURE_LOCK) && sizes[i] > page)
+        continue;
+
+      if ((p = (uint8_t *)xr_secure_alloc(sizes[i], XR_NUMA_NODE_LOCAL,
+                                          flags[f])) == NULL) {
+        printf("  Alloc %zu bytes (flags 0x%x) FAILED\n", sizes[i], flags[f]);
+        fails++;
+        continue;
+      }
+
+      /* Page-aligned, zeroed and writable up to the end */
+      for (size_t j = 0; j < sizes[i]; j++) {
+        if (p[j]) {
+          fails++;
+          break;
+        }
+        p[j] = (uint8_t)j;
+      }
+      if ((uintptr_t)p % page ||
+          ((flags[f] & XR_SECURE_LOCK) && !xr_secure_locked(p))) {
+        printf("  Alloc %zu bytes (flags 0x%x) FAILED\n", sizes[i], flags[f]);
+        fails++;
+      }
+      xr_secure_free(p);
+    }
+  }
+
+  /* On the other nodes, if there are any */
+  for (node = 0; node < xr_numa_nodes(); node++) {
+    if ((p = (uint8_t *)xr_secure_alloc(64, node, XR_SECURE_TRY_LOCK)) ==
+        NULL) {
+      printf("  Alloc on node %d FAILED\n", node);
+      fails++;
+      continue;
+    }
+    memset(p, 0xa5, 64);
+    xr_secure_free(p);
+  }
+
+  xr_secure_free(NULL);
+
+  printf("  %d NUMA node(s), local node %d: %s\n", xr_numa_nodes(),
+         xr_numa_node(), fails ? "FAILED" : "OK");
+  return fails;
+}
+
+#endif /* XR_TESTS_SECURE_ALLOC */
@@ -0,0 +1,88 @@
+/** @file secure_alloc.h
+ *  @brief Page-granular allocator for secret state: the pool, the
+ *         DRBG states and the generator objects.
+ *
+ *  Each block gets its own mapping, laid out as
+ *
+ *    [guard page] [header page] [data pages ...] [guard page]
+ *
+ *  The data pages are locked to physical memory and kept out of core
+ *  dumps, the guard pages fault on any access that runs off either end
+ *  of the block, and the header (read-only once written) records the
+ *  mapping for xr_secure_free(). The pages are placed on a NUMA node,
+ *  by default that of the calling CPU, so that a per-thread generator
+ *  created by a worker stays local to the socket it runs on.
+ *
+ *  Large pages are used on request where the system has them to give
+ *  (Linux hugetlbfs pages, Windows large pages with the "Lock pages in
+ *  memory" privilege); such blocks are locked by the system and have
+ *  no guard pages.
+ *
+ * LICENSE
+ * =======
+ *
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECURE_ALLOC_H
+#define SECURE_ALLOC_H
+
+#include "common/defs.h"
+
+/* Lock the data pages to physical memory; fail if they cannot be */
+#define XR_SECURE_LOCK 0x01
+/* Lock the data pages if the memory lock limit allows it */
+#define XR_SECURE_TRY_LOCK 0x02
+/* Surround the block with inaccessible guard pages */
+#define XR_SECURE_GUARD 0x04
+/* Back the block with large pages if possible (for big buffers) */
+#define XR_SECURE_LARGE_PAGES 0x08
+
+/* The node argument for the node of the calling CPU */
+#define XR_NUMA_NODE_LOCAL (-1)
+
+/** @brief  Allocate a zeroed block of memory for secrets.
+ *
+ *  @param size                         The size of the block in bytes.
+ *  @param node                         The NUMA node, or
+ *                                      XR_NUMA_NODE_LOCAL. The placement
+ *                                      is a preference, it does not fail
+ *                                      if the node has no free memory.
+ *  @param flags                        XR_SECURE_* flags.
+ *
+ *  @return  A page-aligned pointer to the block, or Null if the mapping
+ *           fails or the block cannot be locked with XR_SECURE_LOCK.
+ */
+void *xr_secure_alloc(size_t size, int node, unsigned int flags);
+
+/** @brief  Clear, unlock and unmap a block from xr_secure_alloc().
+ *
+ *  @param p                            The block (can be Null).
+ *
+ *  @return  Void.
+ */
+void xr_secure_free(void *p);
+
+/* Whether the data pages of a block are locked to physical memory */
+bool xr_secure_locked(const void *p);
+
+/* The NUMA node of the calling CPU (0 if unknown) */
+int xr_numa_node(void);
+
+/* The number of NUMA nodes (1 if unknown) */
+int xr_numa_nodes(void);
+
+#endif /* SECURE_ALLOC_H */
@@ -3,6 +3,18 @@
  * as specified in the 'Intel Advanced Encryption Standard (AES) Instruction
  * Set' White Paper by Shay Gueron.
  *
+ * Several implementations are compiled into the same object and the fastest
+ * one supported by the host is selected at runtime (CPUID on x86, HWCAP on
+ * AArch64):
+ *
+ *  - VAES-512 / VAES-256: 4 or 2 blocks per instruction for counter mode
+ *  - AES-NI: one block per instruction, 8 blocks in flight
+ *  - ARMv8 Crypto Extensions: AESE/AESMC, 4 blocks in flight
+ *  - A portable constant-time bitsliced implementation (no lookup tables)
+ *
+ * All implementations share the same key schedule layout, i.e. the round
+ * keys in FIPS-197 byte order.
+ *
  * LICENSE
  * =======
  *
@@ -23,8 +35,440 @@
  */
 
 #include "aes.h"
+#include "common/defs.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_IX86) ||              \
+    defined(__i386)
+#define AES_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define AES_ARMV8
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_AES
+#define HWCAP_AES (1 << 3)
+#endif
+#endif
+#endif
+
+typedef void (*aes256_expand_key_fn)(const aes256_key_t *, aes256_ks_t *);
+typedef void (*aes256_encr_block_fn)(const uint8_t *, uint8_t *,
+                                     const aes256_ks_t *);
+typedef void (*aes256_ctr_blocks_fn)(uint8_t *, uint8_t *, size_t,
+                                     const aes256_ks_t *);
+
+/* An AES-256 implementation */
+typedef struct _aes256_impl_t {
+  const char *name;
+  int (*supported)(void);
+  aes256_expand_key_fn expand_key;
+  aes256_encr_block_fn encr_block;
+  aes256_ctr_blocks_fn ctr_blocks;
+} aes256_impl_t;
+
+/*
+ * Constant-time bitsliced implementation
+ *
+ * Four blocks are processed at a time. The state is held in eight 64-bit
+ * planes where plane j holds bit j of every byte, with byte k of block b
+ * at bit position 4k + b. The S-box is computed as the GF(2^8) inverse
+ * followed by the affine map, so no memory lookups depend on secret data.
+ */
+
+typedef uint64_t aes_planes_t[8];
+
+/* Transpose an 8x8 bit matrix held in a 64-bit word (byte i = row i) */
+static inline uint64_t aes_bs_transpose8(uint64_t x) {
+  uint64_t t;
+  t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+  x ^= t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+  x ^= t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+  x ^= t ^ (t << 28);
+  return x;
+}
+
+static void aes_bs_load(aes_planes_t p, const uint8_t *in, size_t nblocks) {
+  uint64_t w;
+  uint32_t m, i, q, j;
+  memset(p, 0, sizeof(aes_planes_t));
+  for (m = 0; m < 8; m++) {
+    /* Gather the bytes at bit positions 8m..8m+7 */
+    w = 0;
+    for (i = 0; i < 8; i++) {
+      q = 8 * m + i;
+      if ((q & 3) < nblocks)
+        w |= (uint64_t)in[(q & 3) * AES_BLOCK_SIZE + (q >> 2)] << (8 * i);
+    }
+    w = aes_bs_transpose8(w);
+    for (j = 0; j < 8; j++)
+      p[j] |= ((w >> (8 * j)) & 0xff) << (8 * m);
+  }
+}
+
+static void aes_bs_store(uint8_t *out, const aes_planes_t p, size_t nblocks) {
+  uint64_t w;
+  uint32_t m, i, q, j;
+  for (m = 0; m < 8; m++) {
+    w = 0;
+    for (j = 0; j < 8; j++)
+      w |= ((p[j] >> (8 * m)) & 0xff) << (8 * j);
+    w = aes_bs_transpose8(w);
+    for (i = 0; i < 8; i++) {
+      q = 8 * m + i;
+      if ((q & 3) < nblocks)
+        out[(q & 3) * AES_BLOCK_SIZE + (q >> 2)] = (uint8_t)(w >> (8 * i));
+    }
+  }
+}
+
+/* Load one round key into all four block positions */
+static void aes_bs_load_rk(aes_planes_t p, const uint8_t *rk) {
+  uint32_t j, k;
+  memset(p, 0, sizeof(aes_planes_t));
+  for (k = 0; k < AES_BLOCK_SIZE; k++) {
+    for (j = 0; j < 8; j++)
+      p[j] |= (0ULL - ((rk[k] >> j) & 1U)) & (0xfULL << (4 * k));
+  }
+}
+
+/* r = a * b in GF(2^8) mod x^8 + x^4 + x^3 + x + 1 */
+static void aes_bs_gf_mul(aes_planes_t r, const aes_planes_t a,
+                          const aes_planes_t b) {
+  uint64_t t[15] = {0}, x[8], y[8];
+  int i, j;
+  memcpy(x, a, sizeof(x));
+  memcpy(y, b, sizeof(y));
+  for (i = 0; i < 8; i++) {
+    for (j = 0; j < 8; j++)
+      t[i + j] ^= x[i] & y[j];
+  }
+  for (i = 14; i >= 8; i--) {
+    t[i - 4] ^= t[i];
+    t[i - 5] ^= t[i];
+    t[i - 7] ^= t[i];
+    t[i - 8] ^= t[i];
+  }
+  memcpy(r, t, sizeof(aes_planes_t));
+}
+
+/* r = a^2; squaring is linear over GF(2) */
+static void aes_bs_gf_sqr(aes_planes_t r, const aes_planes_t a) {
+  const uint64_t a46 = a[4] ^ a[6], a57 = a[5] ^ a[7];
+  uint64_t r0 = a[0] ^ a46, r1 = a[7] ^ a46, r2 = a[1] ^ a[5],
+           r3 = a57 ^ a46, r4 = a[2] ^ a[4] ^ a[7], r5 = a[5] ^ a[6],
+           r6 = a[3] ^ a[5], r7 = a[6] ^ a[7];
+  r[0] = r0;
+  r[1] = r1;
+  r[2] = r2;
+  r[3] = r3;
+  r[4] = r4;
+  r[5] = r5;
+  r[6] = r6;
+  r[7] = r7;
+}
+
+static void aes_bs_sub_bytes(aes_planes_t p) {
+  aes_planes_t x2, x3, x12, x14, x15, t;
+  int i;
+
+  /* x^254 = x^-1 (and 0 -> 0) */
+  aes_bs_gf_sqr(x2, p);
+  aes_bs_gf_mul(x3, x2, p);
+  aes_bs_gf_sqr(t, x3);
+  aes_bs_gf_sqr(x12, t);
+  aes_bs_gf_mul(x15, x12, x3);
+  aes_bs_gf_mul(x14, x12, x2);
+  aes_bs_gf_sqr(t, x15);
+  aes_bs_gf_sqr(t, t);
+  aes_bs_gf_sqr(t, t);
+  aes_bs_gf_sqr(t, t);
+  aes_bs_gf_mul(t, t, x14);
+
+  /* Affine transformation with the constant 0x63 */
+  for (i = 0; i < 8; i++)
+    p[i] = t[i] ^ t[(i + 4) & 7] ^ t[(i + 5) & 7] ^ t[(i + 6) & 7] ^
+           t[(i + 7) & 7];
+  p[0] = ~p[0];
+  p[1] = ~p[1];
+  p[5] = ~p[5];
+  p[6] = ~p[6];
+}
+
+/* Row r of every column lives at bits 16c + 4r + b */
+#define AES_BS_ROW0 0x000f000f000f000fULL
+
+static void aes_bs_shift_rows(aes_planes_t p) {
+  uint64_t x;
+  int i;
+  for (i = 0; i < 8; i++) {
+    x = p[i];
+    p[i] = (x & AES_BS_ROW0) | ROTR64(x & (AES_BS_ROW0 << 4), 16) |
+           ROTR64(x & (AES_BS_ROW0 << 8), 32) |
+           ROTR64(x & (AES_BS_ROW0 << 12), 48);
+  }
+}
+
+/* Rotate the rows within each column; row r <- row r + n */
+#define AES_BS_ROT1(x)                                                         \
+  ((((x) >> 4) & 0x0fff0fff0fff0fffULL) | (((x) << 12) & 0xf000f000f000f000ULL))
+#define AES_BS_ROT2(x)                                                         \
+  ((((x) >> 8) & 0x00ff00ff00ff00ffULL) | (((x) << 8) & 0xff00ff00ff00ff00ULL))
+#define AES_BS_ROT3(x)                                                         \
+  ((((x) >> 12) & 0x000f000f000f000fULL) | (((x) << 4) & 0xfff0fff0fff0fff0ULL))
+
+static void aes_bs_mix_columns(aes_planes_t p) {
+  aes_planes_t a1, s;
+  uint64_t hi;
+  int i;
+
+  /* s = a ^ rot1(a), out = xtime(s) ^ rot1(a) ^ rot2(a) ^ rot3(a) */
+  for (i = 0; i < 8; i++) {
+    a1[i] = AES_BS_ROT1(p[i]);
+    s[i] = p[i] ^ a1[i];
+  }
+  hi = s[7];
+  for (i = 7; i > 0; i--)
+    s[i] = s[i - 1];
+  s[0] = hi;
+  s[1] ^= hi;
+  s[3] ^= hi;
+  s[4] ^= hi;
+  for (i = 0; i < 8; i++)
+    p[i] = s[i] ^ a1[i] ^ AES_BS_ROT2(p[i]) ^ AES_BS_ROT3(p[i]);
+}
+
+static void aes_bs_encrypt(aes_planes_t p,
+                           const aes_planes_t rk[AES256_ROUNDS + 1]) {
+  uint32_t r;
+  int i;
+  for (i = 0; i < 8; i++)
+    p[i] ^= rk[0][i];
+  for (r = 1; r <= AES256_ROUNDS; r++) {
+    aes_bs_sub_bytes(p);
+    aes_bs_shift_rows(p);
+    if (r != AES256_ROUNDS)
+      aes_bs_mix_columns(p);
+    for (i = 0; i < 8; i++)
+      p[i] ^= rk[r][i];
+  }
+}
+
+static void aes256_expand_key_ct(const aes256_key_t *key, aes256_ks_t *ks) {
+  static const uint8_t rcon[7] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40};
+  uint8_t *w = (uint8_t *)ks->rk;
+  uint8_t t[4];
+  aes_planes_t p;
+  uint32_t i, j;
 
-static inline void __attribute__((always_inline)) KEY_256_ASSIST_1(__m128i *temp1, __m128i *temp2) {
+  memcpy(w, key->k, AES256_KEY_SIZE);
+  for (i = 8; i < 4 * (AES256_ROUNDS + 1); i++) {
+    memcpy(t, w + 4 * (i - 1), 4);
+    if ((i & 7) == 0 || (i & 7) == 4) {
+      if ((i & 7) == 0) {
+        uint8_t u = t[0];
+        t[0] = t[1];
+        t[1] = t[2];
+        t[2] = t[3];
+        t[3] = u;
+      }
+      /* SubWord, using the bitsliced S-box on a single block */
+      memset(p, 0, sizeof(p));
+      for (j = 0; j < 4; j++) {
+        uint32_t b;
+        for (b = 0; b < 8; b++)
+          p[b] |= (uint64_t)((t[j] >> b) & 1) << (4 * j);
+      }
+      aes_bs_sub_bytes(p);
+      for (j = 0; j < 4; j++) {
+        uint32_t b;
+        t[j] = 0;
+        for (b = 0; b < 8; b++)
+          t[j] |= (uint8_t)(((p[b] >> (4 * j)) & 1) << b);
+      }
+      if ((i & 7) == 0)
+        t[0] ^= rcon[i / 8 - 1];
+    }
+    for (j = 0; j < 4; j++)
+      w[4 * i + j] = w[4 * (i - 8) + j] ^ t[j];
+  }
+
+  zeroize(t, sizeof(t));
+  zeroize((uint8_t *)p, sizeof(p));
+}
+
+static void aes_bs_load_ks(aes_planes_t rk[AES256_ROUNDS + 1],
+                           const aes256_ks_t *ks) {
+  uint32_t r;
+  for (r = 0; r <= AES256_ROUNDS; r++)
+    aes_bs_load_rk(rk[r], ks->rk[r]);
+}
+
+static void aes256_encr_block_ct(const uint8_t *pt, uint8_t *ct,
+                                 const aes256_ks_t *ks) {
+  aes_planes_t rk[AES256_ROUNDS + 1], p;
+
+  aes_bs_load_ks(rk, ks);
+  aes_bs_load(p, pt, 1);
+  aes_bs_encrypt(p, (const uint64_t(*)[8])rk);
+  aes_bs_store(ct, p, 1);
+
+  zeroize((uint8_t *)rk, sizeof(rk));
+  zeroize((uint8_t *)p, sizeof(p));
+}
+
+static inline void aes_ctr32_incr(uint8_t ctr[AES_BLOCK_SIZE]) {
+  uint32_t c = ((uint32_t)ctr[12] << 24) | ((uint32_t)ctr[13] << 16) |
+               ((uint32_t)ctr[14] << 8) | (uint32_t)ctr[15];
+  c++;
+  ctr[12] = (uint8_t)(c >> 24);
+  ctr[13] = (uint8_t)(c >> 16);
+  ctr[14] = (uint8_t)(c >> 8);
+  ctr[15] = (uint8_t)c;
+}
+
+static void aes256_ctr_blocks_ct(uint8_t ctr[AES_BLOCK_SIZE], uint8_t *out,
+                                 size_t nblocks, const aes256_ks_t *ks) {
+  aes_planes_t rk[AES256_ROUNDS + 1], p;
+  uint8_t b[4 * AES_BLOCK_SIZE];
+  size_t n, j;
+
+  aes_bs_load_ks(rk, ks);
+  while (nblocks) {
+    n = nblocks < 4 ? nblocks : 4;
+    for (j = 0; j < n; j++) {
+      aes_ctr32_incr(ctr);
+      memcpy(b + j * AES_BLOCK_SIZE, ctr, AES_BLOCK_SIZE);
+    }
+    aes_bs_load(p, b, n);
+    aes_bs_encrypt(p, (const uint64_t(*)[8])rk);
+    aes_bs_store(out, p, n);
+    out += n * AES_BLOCK_SIZE;
+    nblocks -= n;
+  }
+
+  zeroize((uint8_t *)rk, sizeof(rk));
+  zeroize((uint8_t *)p, sizeof(p));
+  zeroize(b, sizeof(b));
+}
+
+static int aes_ct_supported(void) { return 1; }
+
+static const aes256_impl_t aes256_impl_ct = {
+    "ct64", aes_ct_supported, aes256_expand_key_ct, aes256_encr_block_ct,
+    aes256_ctr_blocks_ct};
+
+#if defined(AES_X86)
+
+#define AESNI_TARGET __attribute__((target("aes,sse2,ssse3")))
+#define AVX_TARGET __attribute__((target("avx")))
+#define VAES256_TARGET __attribute__((target("vaes,avx2,aes")))
+#define VAES512_TARGET __attribute__((target("vaes,avx512f,avx512bw,aes")))
+
+#define CPU_AESNI (1 << 0)
+#define CPU_SSSE3 (1 << 1)
+#define CPU_AVX (1 << 2)
+#define CPU_AVX2 (1 << 3)
+#define CPU_AVX512 (1 << 4) /* AVX512F and AVX512BW */
+#define CPU_VAES (1 << 5)
+
+static int aes_cpu_features(void) {
+  static volatile int features = -1;
+  unsigned int eax, ebx, ecx, edx, xcr0_lo = 0, xcr0_hi = 0;
+  int f = 0;
+
+  if (features != -1)
+    return features;
+
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    if (ecx & (1 << 25))
+      f |= CPU_AESNI;
+    if (ecx & (1 << 9))
+      f |= CPU_SSSE3;
+    /* The OS must save the YMM/ZMM state for AVX to be usable */
+    if ((ecx & (1 << 27)) && (ecx & (1 << 28))) {
+      __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+      if ((xcr0_lo & 0x06) == 0x06)
+        f |= CPU_AVX;
+    }
+  }
+  if ((f & CPU_AVX) && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    if (ebx & (1 << 5))
+      f |= CPU_AVX2;
+    if ((ebx & (1 << 16)) && (ebx & (1U << 30)) && (xcr0_lo & 0xe6) == 0xe6)
+      f |= CPU_AVX512;
+    if (ecx & (1 << 9))
+      f |= CPU_VAES;
+  }
+
+  features = f;
+  return f;
+}
+
+static AVX_TARGET void aes_zeroall_avx(void) { _mm256_zeroall(); }
+
+/* vzeroall does not touch zmm16-31 */
+static __attribute__((target("avx512f"))) void aes_zero_zmm_hi(void) {
+#if defined(__x86_64__) || defined(_M_X64)
+  __asm__ volatile("vpxord %%zmm16, %%zmm16, %%zmm16\n\t"
+                   "vpxord %%zmm17, %%zmm17, %%zmm17\n\t"
+                   "vpxord %%zmm18, %%zmm18, %%zmm18\n\t"
+                   "vpxord %%zmm19, %%zmm19, %%zmm19\n\t"
+                   "vpxord %%zmm20, %%zmm20, %%zmm20\n\t"
+                   "vpxord %%zmm21, %%zmm21, %%zmm21\n\t"
+                   "vpxord %%zmm22, %%zmm22, %%zmm22\n\t"
+                   "vpxord %%zmm23, %%zmm23, %%zmm23\n\t"
+                   "vpxord %%zmm24, %%zmm24, %%zmm24\n\t"
+                   "vpxord %%zmm25, %%zmm25, %%zmm25\n\t"
+                   "vpxord %%zmm26, %%zmm26, %%zmm26\n\t"
+                   "vpxord %%zmm27, %%zmm27, %%zmm27\n\t"
+                   "vpxord %%zmm28, %%zmm28, %%zmm28\n\t"
+                   "vpxord %%zmm29, %%zmm29, %%zmm29\n\t"
+                   "vpxord %%zmm30, %%zmm30, %%zmm30\n\t"
+                   "vpxord %%zmm31, %%zmm31, %%zmm31" ::
+                       : "xmm16", "xmm17", "xmm18", "xmm19", "xmm20", "xmm21",
+                         "xmm22", "xmm23", "xmm24", "xmm25", "xmm26", "xmm27",
+                         "xmm28", "xmm29", "xmm30", "xmm31");
+#endif
+}
+
+/* Clear the vector registers so that no key material is left behind */
+static void aes_wipe_regs(void) {
+  if (aes_cpu_features() & CPU_AVX) {
+    aes_zeroall_avx();
+  } else {
+    __asm__ volatile("pxor %%xmm0, %%xmm0\n\t"
+                     "pxor %%xmm1, %%xmm1\n\t"
+                     "pxor %%xmm2, %%xmm2\n\t"
+                     "pxor %%xmm3, %%xmm3\n\t"
+                     "pxor %%xmm4, %%xmm4\n\t"
+                     "pxor %%xmm5, %%xmm5\n\t"
+                     "pxor %%xmm6, %%xmm6\n\t"
+                     "pxor %%xmm7, %%xmm7" ::
+                         : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",
+                           "xmm6", "xmm7");
+#if defined(__x86_64__) || defined(_M_X64)
+    __asm__ volatile("pxor %%xmm8, %%xmm8\n\t"
+                     "pxor %%xmm9, %%xmm9\n\t"
+                     "pxor %%xmm10, %%xmm10\n\t"
+                     "pxor %%xmm11, %%xmm11\n\t"
+                     "pxor %%xmm12, %%xmm12\n\t"
+                     "pxor %%xmm13, %%xmm13\n\t"
+                     "pxor %%xmm14, %%xmm14\n\t"
+                     "pxor %%xmm15, %%xmm15" ::
+                         : "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13",
+                           "xmm14", "xmm15");
+#endif
+  }
+}
+
+static inline void AESNI_TARGET __attribute__((always_inline))
+KEY_256_ASSIST_1(__m128i *temp1, __m128i *temp2) {
   __m128i temp4;
   *temp2 = _mm_shuffle_epi32(*temp2, 0xff);
   temp4 = _mm_slli_si128(*temp1, 0x4);
@@ -36,7 +480,8 @@ static inline void __attribute__((always_inline)) KEY_256_ASSIST_1(__m128i *temp
   *temp1 = _mm_xor_si128(*temp1, *temp2);
 }
 
-static inline void __attribute__((always_inline)) KEY_256_ASSIST_2(__m128i *temp1, __m128i *temp3) {
+static inline void AESNI_TARGET __attribute__((always_inline))
+KEY_256_ASSIST_2(__m128i *temp1, __m128i *temp3) {
   __m128i temp2, temp4;
   temp4 = _mm_aeskeygenassist_si128(*temp1, 0x0);
   temp2 = _mm_shuffle_epi32(temp4, 0xaa);
@@ -49,7 +494,8 @@ static inline void __attribute__((always_inline)) KEY_256_ASSIST_2(__m128i *temp
   *temp3 = _mm_xor_si128(*temp3, temp2);
 }
 
-void aes256_expand_key(const aes256_key_t *key, aes256_ks_t *ks) {
+static AESNI_TARGET void aes256_expand_key_aesni(const aes256_key_t *key,
+                                                 aes256_ks_t *ks) {
   const uint8_t *k = (const uint8_t *)key->k;
   __m128i temp1, temp2, temp3;
   __m128i *Key_Schedule = (__m128i *)ks->rk;
@@ -90,18 +536,19 @@ void aes256_expand_key(const aes256_key_t *key, aes256_ks_t *ks) {
   temp2 = _mm_aeskeygenassist_si128(temp3, 0x40);
   KEY_256_ASSIST_1(&temp1, &temp2);
   Key_Schedule[14] = temp1;
-  _mm256_zeroall();
+  aes_wipe_regs();
 }
 
 #define LOAD128(x) _mm_loadu_si128(x)
 #define STORE128(x, y) _mm_storeu_si128(x, y)
 #define XOR128(x, y) _mm_xor_si128(x, y)
-#define ZEROALL256 _mm256_zeroall
 
 #define AESENC(x, y) _mm_aesenc_si128(x, y)
 #define AESENCLAST(x, y) _mm_aesenclast_si128(x, y)
 
-void aes256_encr_block(const uint8_t *pt, uint8_t *ct, const aes256_ks_t *ks) {
+static AESNI_TARGET void aes256_encr_block_aesni(const uint8_t *pt,
+                                                 uint8_t *ct,
+                                                 const aes256_ks_t *ks) {
   const __m128i *rk = (const __m128i *)ks->rk;
   __m128i tmp;
   uint32_t i;
@@ -112,5 +559,401 @@ void aes256_encr_block(const uint8_t *pt, uint8_t *ct, const aes256_ks_t *ks) {
   }
   tmp = AESENCLAST(tmp, rk[i]);
   STORE128((__m128i *)ct, tmp);
-  ZEROALL256();
+  aes_wipe_regs();
+}
+
+/* Byte shuffle mask that swaps the endianness of the last 32-bit word of
+   a 128-bit block, so that the big-endian counter in the last four bytes
+   of V can be incremented with a 32-bit lane addition (and back). */
+#define BSWAP_CTR32_MASK                                                       \
+  _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 15, 14, 13, 12)
+
+#define SHUFFLE128(x, m) _mm_shuffle_epi8(x, m)
+#define ADD32(x, y) _mm_add_epi32(x, y)
+#define CTR32(n) _mm_setr_epi32(0, 0, 0, n)
+
+/* Encrypt N interleaved counter blocks B[0..N-1] in place */
+#define AES256_ENC_BLOCKS(B, N, rk, ENC, ENCLAST, XOR)                         \
+  do {                                                                         \
+    uint32_t _r, _j;                                                           \
+    for (_j = 0; _j < (N); _j++)                                               \
+      B[_j] = XOR(B[_j], rk[0]);                                               \
+    for (_r = 1; _r < AES256_ROUNDS; _r++) {                                   \
+      for (_j = 0; _j < (N); _j++)                                             \
+        B[_j] = ENC(B[_j], rk[_r]);                                            \
+    }                                                                          \
+    for (_j = 0; _j < (N); _j++)                                               \
+      B[_j] = ENCLAST(B[_j], rk[_r]);                                          \
+  } while (0)
+
+static AESNI_TARGET void aes256_ctr_blocks_aesni(uint8_t ctr[AES_BLOCK_SIZE],
+                                                 uint8_t *out, size_t nblocks,
+                                                 const aes256_ks_t *ks) {
+  const __m128i *rk = (const __m128i *)ks->rk;
+  const __m128i mask = BSWAP_CTR32_MASK;
+  __m128i c, b[8];
+  uint32_t j;
+
+  /* Keep the counter with its last word in host order */
+  c = SHUFFLE128(LOAD128((const __m128i *)ctr), mask);
+
+  /* 8 blocks at a time to keep the AES pipeline full */
+  while (nblocks >= 8) {
+    for (j = 0; j < 8; j++)
+      b[j] = SHUFFLE128(ADD32(c, CTR32(j + 1)), mask);
+    c = ADD32(c, CTR32(8));
+
+    AES256_ENC_BLOCKS(b, 8, rk, AESENC, AESENCLAST, XOR128);
+
+    for (j = 0; j < 8; j++)
+      STORE128((__m128i *)(out + j * AES_BLOCK_SIZE), b[j]);
+    out += 8 * AES_BLOCK_SIZE;
+    nblocks -= 8;
+  }
+
+  if (nblocks >= 4) {
+    for (j = 0; j < 4; j++)
+      b[j] = SHUFFLE128(ADD32(c, CTR32(j + 1)), mask);
+    c = ADD32(c, CTR32(4));
+
+    AES256_ENC_BLOCKS(b, 4, rk, AESENC, AESENCLAST, XOR128);
+
+    for (j = 0; j < 4; j++)
+      STORE128((__m128i *)(out + j * AES_BLOCK_SIZE), b[j]);
+    out += 4 * AES_BLOCK_SIZE;
+    nblocks -= 4;
+  }
+
+  while (nblocks--) {
+    c = ADD32(c, CTR32(1));
+    b[0] = SHUFFLE128(c, mask);
+
+    AES256_ENC_BLOCKS(b, 1, rk, AESENC, AESENCLAST, XOR128);
+
+    STORE128((__m128i *)out, b[0]);
+    out += AES_BLOCK_SIZE;
+  }
+
+  STORE128((__m128i *)ctr, SHUFFLE128(c, mask));
+  aes_wipe_regs();
+}
+
+#define AESENC256(x, y) _mm256_aesenc_epi128(x, y)
+#define AESENCLAST256(x, y) _mm256_aesenclast_epi128(x, y)
+#define XOR256(x, y) _mm256_xor_si256(x, y)
+
+/* VAES-256: two blocks per register, 16 blocks in flight */
+static VAES256_TARGET void
+aes256_ctr_blocks_vaes256(uint8_t ctr[AES_BLOCK_SIZE], uint8_t *out,
+                          size_t nblocks, const aes256_ks_t *ks) {
+  const __m128i mask = BSWAP_CTR32_MASK;
+  const __m256i mask2 = _mm256_broadcastsi128_si256(mask);
+  const __m256i step2 = _mm256_broadcastsi128_si256(CTR32(2));
+  __m256i rk[AES256_ROUNDS + 1], c2, b[8];
+  __m128i c;
+  uint32_t j;
+
+  if (nblocks >= 16) {
+    for (j = 0; j <= AES256_ROUNDS; j++)
+      rk[j] = _mm256_broadcastsi128_si256(LOAD128((const __m128i *)ks->rk[j]));
+
+    c = SHUFFLE128(LOAD128((const __m128i *)ctr), mask);
+    c2 = _mm256_add_epi32(_mm256_broadcastsi128_si256(c),
+                          _mm256_setr_epi32(0, 0, 0, 1, 0, 0, 0, 2));
+
+    while (nblocks >= 16) {
+      for (j = 0; j < 8; j++) {
+        b[j] = _mm256_shuffle_epi8(c2, mask2);
+        c2 = _mm256_add_epi32(c2, step2);
+      }
+
+      AES256_ENC_BLOCKS(b, 8, rk, AESENC256, AESENCLAST256, XOR256);
+
+      for (j = 0; j < 8; j++)
+        _mm256_storeu_si256((__m256i *)(out + j * 2 * AES_BLOCK_SIZE), b[j]);
+      out += 16 * AES_BLOCK_SIZE;
+      nblocks -= 16;
+    }
+
+    /* The last counter used is in the high lane of c2 - step2 */
+    c2 = _mm256_sub_epi32(c2, step2);
+    c = _mm256_extracti128_si256(c2, 1);
+    STORE128((__m128i *)ctr, SHUFFLE128(c, mask));
+  }
+
+  aes256_ctr_blocks_aesni(ctr, out, nblocks, ks);
+}
+
+#define AESENC512(x, y) _mm512_aesenc_epi128(x, y)
+#define AESENCLAST512(x, y) _mm512_aesenclast_epi128(x, y)
+#define XOR512(x, y) _mm512_xor_si512(x, y)
+
+/* VAES-512: four blocks per register, 32 blocks in flight */
+static VAES512_TARGET void
+aes256_ctr_blocks_vaes512(uint8_t ctr[AES_BLOCK_SIZE], uint8_t *out,
+                          size_t nblocks, const aes256_ks_t *ks) {
+  const __m128i mask = BSWAP_CTR32_MASK;
+  const __m512i mask4 = _mm512_broadcast_i32x4(mask);
+  const __m512i step4 = _mm512_broadcast_i32x4(CTR32(4));
+  __m512i rk[AES256_ROUNDS + 1], c4, b[8];
+  __m128i c;
+  uint32_t j;
+
+  if (nblocks >= 32) {
+    for (j = 0; j <= AES256_ROUNDS; j++)
+      rk[j] = _mm512_broadcast_i32x4(LOAD128((const __m128i *)ks->rk[j]));
+
+    c = SHUFFLE128(LOAD128((const __m128i *)ctr), mask);
+    c4 = _mm512_add_epi32(_mm512_broadcast_i32x4(c),
+                          _mm512_setr_epi32(0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 3,
+                                            0, 0, 0, 4));
+
+    while (nblocks >= 32) {
+      for (j = 0; j < 8; j++) {
+        b[j] = _mm512_shuffle_epi8(c4, mask4);
+        c4 = _mm512_add_epi32(c4, step4);
+      }
+
+      AES256_ENC_BLOCKS(b, 8, rk, AESENC512, AESENCLAST512, XOR512);
+
+      for (j = 0; j < 8; j++)
+        _mm512_storeu_si512((void *)(out + j * 4 * AES_BLOCK_SIZE), b[j]);
+      out += 32 * AES_BLOCK_SIZE;
+      nblocks -= 32;
+    }
+
+    /* The last counter used is in the top lane of c4 - step4 */
+    c4 = _mm512_sub_epi32(c4, step4);
+    c = _mm512_extracti32x4_epi32(c4, 3);
+    STORE128((__m128i *)ctr, SHUFFLE128(c, mask));
+    aes_zero_zmm_hi();
+  }
+
+  aes256_ctr_blocks_aesni(ctr, out, nblocks, ks);
+}
+
+static int aes_aesni_supported(void) {
+  int f = aes_cpu_features();
+  return (f & CPU_AESNI) && (f & CPU_SSSE3);
+}
+
+static int aes_vaes256_supported(void) {
+  int f = aes_cpu_features();
+  return aes_aesni_supported() && (f & CPU_AVX2) && (f & CPU_VAES);
+}
+
+static int aes_vaes512_supported(void) {
+  int f = aes_cpu_features();
+  return aes_vaes256_supported() && (f & CPU_AVX512);
+}
+
+static const aes256_impl_t aes256_impl_aesni = {
+    "aesni", aes_aesni_supported, aes256_expand_key_aesni,
+    aes256_encr_block_aesni, aes256_ctr_blocks_aesni};
+
+static const aes256_impl_t aes256_impl_vaes256 = {
+    "vaes256", aes_vaes256_supported, aes256_expand_key_aesni,
+    aes256_encr_block_aesni, aes256_ctr_blocks_vaes256};
+
+static const aes256_impl_t aes256_impl_vaes512 = {
+    "vaes512", aes_vaes512_supported, aes256_expand_key_aesni,
+    aes256_encr_block_aesni, aes256_ctr_blocks_vaes512};
+
+#endif /* AES_X86 */
+
+#if defined(AES_ARMV8)
+
+#if defined(__clang__)
+#define ARMV8_CE_TARGET __attribute__((target("aes")))
+#else
+#define ARMV8_CE_TARGET __attribute__((target("+crypto")))
+#endif
+
+/* AESE does AddRoundKey + SubBytes + ShiftRows, AESMC does MixColumns */
+#define ARMV8_ENC(x, k) vaesmcq_u8(vaeseq_u8(x, k))
+#define ARMV8_ENCLAST(x, k) vaeseq_u8(x, k)
+
+static ARMV8_CE_TARGET void aes256_encr_block_armv8(const uint8_t *pt,
+                                                    uint8_t *ct,
+                                                    const aes256_ks_t *ks) {
+  uint8x16_t b = vld1q_u8(pt);
+  uint32_t i;
+  for (i = 0; i < AES256_ROUNDS - 1; i++)
+    b = ARMV8_ENC(b, vld1q_u8(ks->rk[i]));
+  b = ARMV8_ENCLAST(b, vld1q_u8(ks->rk[i]));
+  b = veorq_u8(b, vld1q_u8(ks->rk[i + 1]));
+  vst1q_u8(ct, b);
+}
+
+static ARMV8_CE_TARGET void aes256_ctr_blocks_armv8(uint8_t ctr[AES_BLOCK_SIZE],
+                                                    uint8_t *out,
+                                                    size_t nblocks,
+                                                    const aes256_ks_t *ks) {
+  const uint32x4_t one = {0, 0, 0, 1};
+  uint8x16_t rk[AES256_ROUNDS + 1], b[4];
+  uint32x4_t c;
+  uint32_t i, j, n;
+
+  for (i = 0; i <= AES256_ROUNDS; i++)
+    rk[i] = vld1q_u8(ks->rk[i]);
+
+  /* Byte-reverse each word so the last one can be incremented in place */
+  c = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(ctr)));
+
+  while (nblocks) {
+    n = nblocks < 4 ? (uint32_t)nblocks : 4;
+    for (j = 0; j < n; j++) {
+      c = vaddq_u32(c, one);
+      b[j] = vrev32q_u8(vreinterpretq_u8_u32(c));
+    }
+    for (i = 0; i < AES256_ROUNDS - 1; i++) {
+      for (j = 0; j < n; j++)
+        b[j] = ARMV8_ENC(b[j], rk[i]);
+    }
+    for (j = 0; j < n; j++) {
+      b[j] = veorq_u8(ARMV8_ENCLAST(b[j], rk[i]), rk[i + 1]);
+      vst1q_u8(out + j * AES_BLOCK_SIZE, b[j]);
+    }
+    out += n * AES_BLOCK_SIZE;
+    nblocks -= n;
+  }
+
+  vst1q_u8(ctr, vrev32q_u8(vreinterpretq_u8_u32(c)));
+}
+
+static int aes_armv8_supported(void) {
+#if defined(__linux__)
+  return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(_WIN32)
+  return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE);
+#elif defined(__APPLE__)
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/* The key expansion is not performance critical, so the portable one is
+   used; the round keys are in the same byte order. */
+static const aes256_impl_t aes256_impl_armv8 = {
+    "armv8", aes_armv8_supported, aes256_expand_key_ct,
+    aes256_encr_block_armv8, aes256_ctr_blocks_armv8};
+
+#endif /* AES_ARMV8 */
+
+/* In order of preference */
+static const aes256_impl_t *const aes256_impls[] = {
+#if defined(AES_X86)
+    &aes256_impl_vaes512,
+    &aes256_impl_vaes256,
+    &aes256_impl_aesni,
+#endif
+#if defined(AES_ARMV8)
+    &aes256_impl_armv8,
+#endif
+    &aes256_impl_ct,
+};
+
+#define AES256_NIMPLS (sizeof(aes256_impls) / sizeof(aes256_impls[0]))
+
+static const aes256_impl_t *volatile aes256_impl = NULL;
+
+static const aes256_impl_t *aes256_get_impl(void) {
+  const aes256_impl_t *impl = aes256_impl;
+  size_t i;
+
+  if (impl != NULL)
+    return impl;
+
+  for (i = 0; i < AES256_NIMPLS; i++) {
+    if (aes256_impls[i]->supported()) {
+      impl = aes256_impls[i];
+      break;
+    }
+  }
+  aes256_impl = impl;
+  return impl;
+}
+
+const char *aes256_impl_name(void) { return aes256_get_impl()->name; }
+
+int aes256_has_hw(void) { return aes256_get_impl() != &aes256_impl_ct; }
+
+void aes256_expand_key(const aes256_key_t *key, aes256_ks_t *ks) {
+  aes256_get_impl()->expand_key(key, ks);
+}
+
+void aes256_encr_block(const uint8_t *pt, uint8_t *ct, const aes256_ks_t *ks) {
+  aes256_get_impl()->encr_block(pt, ct, ks);
+}
+
+void aes256_ctr_blocks(uint8_t ctr[AES_BLOCK_SIZE], uint8_t *out,
+                       size_t nblocks, const aes256_ks_t *ks) {
+  aes256_get_impl()->ctr_blocks(ctr, out, nblocks, ks);
+}
+
+#if defined(XR_TESTS_AES)
+#include <stdio.h>
+
+/* Check every implementation supported by the host against the FIPS-197
+   C.3 vector and against each other in counter mode. */
+int aes256_run_test(void) {
+  static const uint8_t pt[AES_BLOCK_SIZE] = {
+      0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+      0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+  static const uint8_t ct[AES_BLOCK_SIZE] = {
+      0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf,
+      0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89};
+  aes256_key_t key;
+  aes256_ks_t ks;
+  uint8_t out[AES_BLOCK_SIZE], ctr[AES_BLOCK_SIZE], ref_ctr[AES_BLOCK_SIZE];
+  uint8_t ks_out[67 * AES_BLOCK_SIZE], ref_out[67 * AES_BLOCK_SIZE];
+  size_t i, n;
+  int ret = 0;
+
+  for (i = 0; i < AES256_KEY_SIZE; i++)
+    key.k[i] = (uint8_t)i;
+
+  printf("Running tests for crypto/aes.c (selected: %s)\n",
+         aes256_impl_name());
+
+  for (i = 0; i < AES256_NIMPLS; i++) {
+    const aes256_impl_t *impl = aes256_impls[i];
+    if (!impl->supported())
+      continue;
+
+    impl->expand_key(&key, &ks);
+    impl->encr_block(pt, out, &ks);
+    if (memcmp(out, ct, AES_BLOCK_SIZE)) {
+      printf("  %s: FIPS-197 vector FAILED\n", impl->name);
+      ret = 1;
+      continue;
+    }
+
+    /* Counter mode across a 32-bit counter wrap, against the block cipher */
+    for (n = 0; n <= 67; n += (n < 9) ? 1 : 29) {
+      size_t j;
+      memset(ctr, 0xa5, sizeof(ctr));
+      ctr[12] = ctr[13] = ctr[14] = 0xff;
+      ctr[15] = 0xf0;
+      memcpy(ref_ctr, ctr, sizeof(ctr));
+      for (j = 0; j < n; j++) {
+        aes_ctr32_incr(ref_ctr);
+        aes256_encr_block_ct(ref_ctr, ref_out + j * AES_BLOCK_SIZE, &ks);
+      }
+      impl->ctr_blocks(ctr, ks_out, n, &ks);
+      if (memcmp(ks_out, ref_out, n * AES_BLOCK_SIZE) ||
+          memcmp(ctr, ref_ctr, sizeof(ctr))) {
+        printf("  %s: CTR test (%zu blocks) FAILED\n", impl->name, n);
+        ret = 1;
+        break;
+      }
+    }
+    if (n > 67)
+      printf("  %s: OK\n", impl->name);
+  }
+
+  zeroize((uint8_t *)&ks, sizeof(ks));
+  return ret;
 }
+#endif /* XR_TESTS_AES */
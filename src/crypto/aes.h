@@ -4,6 +4,10 @@
  *  Defines, typedefs and function prototypes for AES256
  *  key expansion and block encryption.
  *
+ *  The implementation (VAES, AES-NI, ARMv8 Crypto Extensions
+ *  or a portable constant-time fallback) is selected once at
+ *  runtime based on the features of the host CPU.
+ *
  *  @author Vibhav Tiwari [vibhav950 on GitHub]
  *
  * LICENSE
@@ -28,7 +32,7 @@
 #ifndef AES256_H
 #define AES256_H
 
-#include <immintrin.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define ALIGN16 __attribute__((aligned(16)))
@@ -45,11 +49,11 @@ typedef ALIGN16 struct _aes256_key_t {
 } aes256_key_t;
 
 /**
- * The AES-256 key schedule holds the expanded round keys;
- * Must be 16-bytes aligned.
+ * The AES-256 key schedule holds the expanded round keys
+ * in FIPS-197 byte order; Must be 16-bytes aligned.
  */
 typedef ALIGN16 struct _aes256_ks_t {
-  __m128i rk[AES256_ROUNDS + 1];
+  uint8_t rk[AES256_ROUNDS + 1][AES_BLOCK_SIZE];
 } aes256_ks_t;
 
 /** @brief  Expand the cipher key into a key schedule
@@ -72,4 +76,38 @@ void aes256_expand_key(const aes256_key_t *key, aes256_ks_t *ks);
  */
 void aes256_encr_block(const uint8_t *pt, uint8_t *ct, const aes256_ks_t *ks);
 
+/** @brief  Generate @p nblocks of counter mode keystream.
+ *
+ *  For each block the last 32 bits of @p ctr (big-endian) are
+ *  incremented modulo 2^32 and the counter is then encrypted,
+ *  i.e. out[i] = Enc(ctr + i + 1, ks). Several blocks are kept
+ *  in flight at a time to make use of the AES pipeline (up to
+ *  32 blocks with VAES-512).
+ *
+ *  @param ctr                          The 128-bit counter block;
+ *                                      updated to the last counter used.
+ *  @param out                          The output buffer, at least
+ *                                      @p nblocks * AES_BLOCK_SIZE bytes.
+ *  @param nblocks                      The number of blocks to generate.
+ *  @param ks                           The expanded key schedule.
+ *
+ *  @return  Void.
+ */
+void aes256_ctr_blocks(uint8_t ctr[AES_BLOCK_SIZE], uint8_t *out,
+                       size_t nblocks, const aes256_ks_t *ks);
+
+/** @brief  Get the name of the AES-256 implementation selected
+ *          for the host CPU.
+ *
+ *  @return  One of "vaes512", "vaes256", "aesni", "armv8" or "ct64".
+ */
+const char *aes256_impl_name(void);
+
+/** @brief  Check whether the selected AES-256 implementation uses
+ *          AES instructions (anything but the constant-time "ct64").
+ *
+ *  @return  1 if it does, 0 otherwise.
+ */
+int aes256_has_hw(void);
+
 #endif /* AES256_H */
@@ -0,0 +1,550 @@
+/**
+ * chacha20.c - The ChaCha20 block function (RFC 8439) for generating
+ * keystream, several blocks at a time.
+ *
+ * The SIMD implementations keep the same state word of 4 (SSE2, NEON)
+ * or 8 (AVX2) consecutive blocks in the lanes of one register, so the
+ * rounds of all the blocks run in lockstep; the blocks only differ in
+ * their counter word. The lanes are transposed back into blocks when
+ * the keystream is stored. The fastest one supported by the host is
+ * selected at runtime.
+ *
+ * LICENSE
+ * =======
+ *
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "chacha20.h"
+#include "common/defs.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_IX86) ||              \
+    defined(__i386)
+#define CHACHA_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define CHACHA_NEON
+#include <arm_neon.h>
+#endif
+
+/* Process nblocks blocks of the input state; state[12] is the counter */
+typedef void (*chacha20_blocks_fn)(const uint32_t state[16], uint8_t *out,
+                                   size_t nblocks);
+
+/* A ChaCha20 implementation */
+typedef struct _chacha20_impl_t {
+  const char *name;
+  int (*supported)(void);
+  chacha20_blocks_fn blocks;
+} chacha20_impl_t;
+
+static inline uint32_t load32_le(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static inline void store32_le(uint8_t *p, uint32_t x) {
+  p[0] = (uint8_t)x;
+  p[1] = (uint8_t)(x >> 8);
+  p[2] = (uint8_t)(x >> 16);
+  p[3] = (uint8_t)(x >> 24);
+}
+
+/*
+ * Portable implementation
+ */
+
+#define CHACHA_QR(a, b, c, d)                                                  \
+  do {                                                                         \
+    a += b;                                                                    \
+    d = ROTL32(d ^ a, 16);                                                     \
+    c += d;                                                                    \
+    b = ROTL32(b ^ c, 12);                                                     \
+    a += b;                                                                    \
+    d = ROTL32(d ^ a, 8);                                                      \
+    c += d;                                                                    \
+    b = ROTL32(b ^ c, 7);                                                      \
+  } while (0)
+
+static void chacha20_blocks_ref(const uint32_t state[16], uint8_t *out,
+                                size_t nblocks) {
+  uint32_t x[16];
+  uint32_t ctr = state[12];
+  int i;
+
+  while (nblocks--) {
+    memcpy(x, state, sizeof(x));
+    x[12] = ctr;
+
+    for (i = 0; i < 10; i++) {
+      /* Column rounds */
+      CHACHA_QR(x[0], x[4], x[8], x[12]);
+      CHACHA_QR(x[1], x[5], x[9], x[13]);
+      CHACHA_QR(x[2], x[6], x[10], x[14]);
+      CHACHA_QR(x[3], x[7], x[11], x[15]);
+      /* Diagonal rounds */
+      CHACHA_QR(x[0], x[5], x[10], x[15]);
+      CHACHA_QR(x[1], x[6], x[11], x[12]);
+      CHACHA_QR(x[2], x[7], x[8], x[13]);
+      CHACHA_QR(x[3], x[4], x[9], x[14]);
+    }
+
+    for (i = 0; i < 16; i++)
+      store32_le(out + 4 * i, x[i] + (i == 12 ? ctr : state[i]));
+
+    out += CHACHA20_BLOCK_SIZE;
+    ctr++;
+  }
+
+  zeroize((uint8_t *)x, sizeof(x));
+}
+
+static int chacha_ref_supported(void) { return 1; }
+
+static const chacha20_impl_t chacha20_impl_ref = {
+    "portable", chacha_ref_supported, chacha20_blocks_ref};
+
+/*
+ * The double round over the vector state v[16], shared by the SIMD
+ * implementations through the ADD, XOR and ROTn macros.
+ */
+#define CHACHA_VQR(a, b, c, d)                                                 \
+  do {                                                                         \
+    a = ADD(a, b);                                                             \
+    d = ROT16(XOR(d, a));                                                      \
+    c = ADD(c, d);                                                             \
+    b = ROT12(XOR(b, c));                                                      \
+    a = ADD(a, b);                                                             \
+    d = ROT8(XOR(d, a));                                                       \
+    c = ADD(c, d);                                                             \
+    b = ROT7(XOR(b, c));                                                       \
+  } while (0)
+
+#define CHACHA_VDOUBLEROUND(v)                                                 \
+  do {                                                                         \
+    CHACHA_VQR(v[0], v[4], v[8], v[12]);                                       \
+    CHACHA_VQR(v[1], v[5], v[9], v[13]);                                       \
+    CHACHA_VQR(v[2], v[6], v[10], v[14]);                                      \
+    CHACHA_VQR(v[3], v[7], v[11], v[15]);                                      \
+    CHACHA_VQR(v[0], v[5], v[10], v[15]);                                      \
+    CHACHA_VQR(v[1], v[6], v[11], v[12]);                                      \
+    CHACHA_VQR(v[2], v[7], v[8], v[13]);                                       \
+    CHACHA_VQR(v[3], v[4], v[9], v[14]);                                       \
+  } while (0)
+
+#if defined(CHACHA_X86)
+
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+static int chacha_cpu_avx2(void) {
+  static volatile int supported = -1;
+  unsigned int eax, ebx, ecx, edx, xcr0_lo = 0, xcr0_hi = 0;
+  int f = 0;
+
+  if (supported != -1)
+    return supported;
+
+  /* The OS must save the YMM state for AVX2 to be usable */
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 27)) &&
+      (ecx & (1 << 28))) {
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x06) == 0x06 &&
+        __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1 << 5)))
+      f = 1;
+  }
+
+  supported = f;
+  return f;
+}
+
+static int chacha_cpu_sse2(void) {
+  unsigned int eax, ebx, ecx, edx;
+  return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & (1 << 26));
+}
+
+/* SSE2: 4 blocks per iteration */
+
+#define ADD(a, b) _mm_add_epi32(a, b)
+#define XOR(a, b) _mm_xor_si128(a, b)
+#define ROTV(x, n) _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n))
+#define ROT16(x) ROTV(x, 16)
+#define ROT12(x) ROTV(x, 12)
+#define ROT8(x) ROTV(x, 8)
+#define ROT7(x) ROTV(x, 7)
+
+/* Transpose words a..d of 4 blocks into 16 bytes of each block */
+#define SSE2_TRANSPOSE(a, b, c, d)                                             \
+  do {                                                                         \
+    __m128i t0 = _mm_unpacklo_epi32(a, b), t1 = _mm_unpackhi_epi32(a, b);      \
+    __m128i t2 = _mm_unpacklo_epi32(c, d), t3 = _mm_unpackhi_epi32(c, d);      \
+    a = _mm_unpacklo_epi64(t0, t2);                                            \
+    b = _mm_unpackhi_epi64(t0, t2);                                            \
+    c = _mm_unpacklo_epi64(t1, t3);                                            \
+    d = _mm_unpackhi_epi64(t1, t3);                                            \
+  } while (0)
+
+static SSE2_TARGET void chacha20_blocks_sse2(const uint32_t state[16],
+                                             uint8_t *out, size_t nblocks) {
+  const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+  __m128i s[16], v[16];
+  uint32_t st[16];
+  int i;
+
+  memcpy(st, state, sizeof(st));
+
+  while (nblocks >= 4) {
+    for (i = 0; i < 16; i++)
+      s[i] = _mm_set1_epi32((int)st[i]);
+    s[12] = _mm_add_epi32(s[12], lanes);
+
+    memcpy(v, s, sizeof(v));
+    for (i = 0; i < 10; i++)
+      CHACHA_VDOUBLEROUND(v);
+    for (i = 0; i < 16; i++)
+      v[i] = _mm_add_epi32(v[i], s[i]);
+
+    /* v[4k + j] now holds bytes 16k..16k+15 of block j */
+    for (i = 0; i < 16; i += 4)
+      SSE2_TRANSPOSE(v[i], v[i + 1], v[i + 2], v[i + 3]);
+    for (i = 0; i < 16; i++)
+      _mm_storeu_si128((__m128i *)(out + 64 * (i & 3) + 16 * (i >> 2)), v[i]);
+
+    out += 4 * CHACHA20_BLOCK_SIZE;
+    nblocks -= 4;
+    st[12] += 4;
+  }
+
+  if (nblocks)
+    chacha20_blocks_ref(st, out, nblocks);
+
+  zeroize((uint8_t *)v, sizeof(v));
+  zeroize((uint8_t *)s, sizeof(s));
+  zeroize((uint8_t *)st, sizeof(st));
+}
+
+#undef ADD
+#undef XOR
+#undef ROTV
+#undef ROT16
+#undef ROT12
+#undef ROT8
+#undef ROT7
+
+/* AVX2: 8 blocks per iteration */
+
+#define ADD(a, b) _mm256_add_epi32(a, b)
+#define XOR(a, b) _mm256_xor_si256(a, b)
+#define ROTV(x, n)                                                             \
+  _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n))
+#define ROT16(x) _mm256_shuffle_epi8(x, rot16)
+#define ROT12(x) ROTV(x, 12)
+#define ROT8(x) _mm256_shuffle_epi8(x, rot8)
+#define ROT7(x) ROTV(x, 7)
+
+/* Transpose words a..d of 8 blocks; the low half of the k-th result
+   holds 16 bytes of block k, the high half those of block k + 4 */
+#define AVX2_TRANSPOSE(a, b, c, d)                                             \
+  do {                                                                         \
+    __m256i t0 = _mm256_unpacklo_epi32(a, b);                                  \
+    __m256i t1 = _mm256_unpackhi_epi32(a, b);                                  \
+    __m256i t2 = _mm256_unpacklo_epi32(c, d);                                  \
+    __m256i t3 = _mm256_unpackhi_epi32(c, d);                                  \
+    a = _mm256_unpacklo_epi64(t0, t2);                                         \
+    b = _mm256_unpackhi_epi64(t0, t2);                                         \
+    c = _mm256_unpacklo_epi64(t1, t3);                                         \
+    d = _mm256_unpackhi_epi64(t1, t3);                                         \
+  } while (0)
+
+static AVX2_TARGET void chacha20_blocks_avx2(const uint32_t state[16],
+                                             uint8_t *out, size_t nblocks) {
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i rot16 =
+      _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, 2,
+                       3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+  const __m256i rot8 =
+      _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14, 3,
+                       0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+  __m256i s[16], v[16];
+  uint32_t st[16];
+  int i, k;
+
+  memcpy(st, state, sizeof(st));
+
+  while (nblocks >= 8) {
+    for (i = 0; i < 16; i++)
+      s[i] = _mm256_set1_epi32((int)st[i]);
+    s[12] = _mm256_add_epi32(s[12], lanes);
+
+    memcpy(v, s, sizeof(v));
+    for (i = 0; i < 10; i++)
+      CHACHA_VDOUBLEROUND(v);
+    for (i = 0; i < 16; i++)
+      v[i] = _mm256_add_epi32(v[i], s[i]);
+
+    for (i = 0; i < 16; i += 4)
+      AVX2_TRANSPOSE(v[i], v[i + 1], v[i + 2], v[i + 3]);
+
+    /* Block k is the low (k < 4) or high (k >= 4) halves of v[k & 3],
+       v[4 + (k & 3)], v[8 + (k & 3)] and v[12 + (k & 3)] */
+    for (k = 0; k < 4; k++) {
+      _mm256_storeu_si256((__m256i *)(out + 64 * k),
+                          _mm256_permute2x128_si256(v[k], v[4 + k], 0x20));
+      _mm256_storeu_si256((__m256i *)(out + 64 * k + 32),
+                          _mm256_permute2x128_si256(v[8 + k], v[12 + k], 0x20));
+      _mm256_storeu_si256((__m256i *)(out + 64 * (k + 4)),
+                          _mm256_permute2x128_si256(v[k], v[4 + k], 0x31));
+      _mm256_storeu_si256((__m256i *)(out + 64 * (k + 4) + 32),
+                          _mm256_permute2x128_si256(v[8 + k], v[12 + k], 0x31));
+    }
+
+    out += 8 * CHACHA20_BLOCK_SIZE;
+    nblocks -= 8;
+    st[12] += 8;
+  }
+
+  zeroize((uint8_t *)v, sizeof(v));
+  zeroize((uint8_t *)s, sizeof(s));
+  _mm256_zeroall();
+
+  if (nblocks >= 4) {
+    chacha20_blocks_sse2(st, out, nblocks);
+  } else if (nblocks) {
+    chacha20_blocks_ref(st, out, nblocks);
+  }
+
+  zeroize((uint8_t *)st, sizeof(st));
+}
+
+#undef ADD
+#undef XOR
+#undef ROTV
+#undef ROT16
+#undef ROT12
+#undef ROT8
+#undef ROT7
+
+static const chacha20_impl_t chacha20_impl_sse2 = {
+    "sse2", chacha_cpu_sse2, chacha20_blocks_sse2};
+
+static const chacha20_impl_t chacha20_impl_avx2 = {
+    "avx2", chacha_cpu_avx2, chacha20_blocks_avx2};
+
+#endif /* CHACHA_X86 */
+
+#if defined(CHACHA_NEON)
+
+/* NEON: 4 blocks per iteration */
+
+#define ADD(a, b) vaddq_u32(a, b)
+#define XOR(a, b) veorq_u32(a, b)
+#define ROTV(x, n) vsriq_n_u32(vshlq_n_u32(x, n), x, 32 - n)
+#define ROT16(x) vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(x)))
+#define ROT12(x) ROTV(x, 12)
+#define ROT8(x) ROTV(x, 8)
+#define ROT7(x) ROTV(x, 7)
+
+/* Transpose words a..d of 4 blocks into 16 bytes of each block */
+#define NEON_TRANSPOSE(a, b, c, d)                                             \
+  do {                                                                         \
+    uint32x4x2_t t0 = vtrnq_u32(a, b), t1 = vtrnq_u32(c, d);                   \
+    a = vcombine_u32(vget_low_u32(t0.val[0]), vget_low_u32(t1.val[0]));        \
+    b = vcombine_u32(vget_low_u32(t0.val[1]), vget_low_u32(t1.val[1]));        \
+    c = vcombine_u32(vget_high_u32(t0.val[0]), vget_high_u32(t1.val[0]));      \
+    d = vcombine_u32(vget_high_u32(t0.val[1]), vget_high_u32(t1.val[1]));      \
+  } while (0)
+
+static void chacha20_blocks_neon(const uint32_t state[16], uint8_t *out,
+                                 size_t nblocks) {
+  const uint32_t lane_init[4] = {0, 1, 2, 3};
+  const uint32x4_t lanes = vld1q_u32(lane_init);
+  uint32x4_t s[16], v[16];
+  uint32_t st[16];
+  int i;
+
+  memcpy(st, state, sizeof(st));
+
+  while (nblocks >= 4) {
+    for (i = 0; i < 16; i++)
+      s[i] = vdupq_n_u32(st[i]);
+    s[12] = vaddq_u32(s[12], lanes);
+
+    memcpy(v, s, sizeof(v));
+    for (i = 0; i < 10; i++)
+      CHACHA_VDOUBLEROUND(v);
+    for (i = 0; i < 16; i++)
+      v[i] = vaddq_u32(v[i], s[i]);
+
+    for (i = 0; i < 16; i += 4)
+      NEON_TRANSPOSE(v[i], v[i + 1], v[i + 2], v[i + 3]);
+    for (i = 0; i < 16; i++)
+      vst1q_u8(out + 64 * (i & 3) + 16 * (i >> 2), vreinterpretq_u8_u32(v[i]));
+
+    out += 4 * CHACHA20_BLOCK_SIZE;
+    nblocks -= 4;
+    st[12] += 4;
+  }
+
+  if (nblocks)
+    chacha20_blocks_ref(st, out, nblocks);
+
+  zeroize((uint8_t *)v, sizeof(v));
+  zeroize((uint8_t *)s, sizeof(s));
+  zeroize((uint8_t *)st, sizeof(st));
+}
+
+#undef ADD
+#undef XOR
+#undef ROTV
+#undef ROT16
+#undef ROT12
+#undef ROT8
+#undef ROT7
+
+/* Advanced SIMD is mandatory on AArch64 */
+static int chacha_neon_supported(void) { return 1; }
+
+static const chacha20_impl_t chacha20_impl_neon = {
+    "neon", chacha_neon_supported, chacha20_blocks_neon};
+
+#endif /* CHACHA_NEON */
+
+/* In order of preference */
+static const chacha20_impl_t *const chacha20_impls[] = {
+#if defined(CHACHA_X86)
+    &chacha20_impl_avx2,
+    &chacha20_impl_sse2,
+#endif
+#if defined(CHACHA_NEON)
+    &chacha20_impl_neon,
+#endif
+    &chacha20_impl_ref,
+};
+
+#define CHACHA20_NIMPLS (sizeof(chacha20_impls) / sizeof(chacha20_impls[0]))
+
+static const chacha20_impl_t *volatile chacha20_impl = NULL;
+
+static const chacha20_impl_t *chacha20_get_impl(void) {
+  const chacha20_impl_t *impl = chacha20_impl;
+  size_t i;
+
+  if (impl != NULL)
+    return impl;
+
+  for (i = 0; i < CHACHA20_NIMPLS; i++) {
+    if (chacha20_impls[i]->supported()) {
+      impl = chacha20_impls[i];
+      break;
+    }
+  }
+  chacha20_impl = impl;
+  return impl;
+}
+
+const char *chacha20_impl_name(void) { return chacha20_get_impl()->name; }
+
+/* Set up the input state; "expand 32-byte k" followed by the key, the
+   counter and the nonce */
+static void chacha20_setup(uint32_t state[16],
+                           const uint8_t key[CHACHA20_KEY_SIZE],
+                           const uint8_t nonce[CHACHA20_NONCE_SIZE],
+                           uint32_t counter) {
+  int i;
+
+  state[0] = 0x61707865;
+  state[1] = 0x3320646e;
+  state[2] = 0x79622d32;
+  state[3] = 0x6b206574;
+  for (i = 0; i < 8; i++)
+    state[4 + i] = load32_le(key + 4 * i);
+  state[12] = counter;
+  for (i = 0; i < 3; i++)
+    state[13 + i] = load32_le(nonce + 4 * i);
+}
+
+void chacha20_blocks(const uint8_t key[CHACHA20_KEY_SIZE],
+                     const uint8_t nonce[CHACHA20_NONCE_SIZE],
+                     uint32_t counter, uint8_t *out, size_t nblocks) {
+  uint32_t state[16];
+
+  chacha20_setup(state, key, nonce, counter);
+  chacha20_get_impl()->blocks(state, out, nblocks);
+
+  zeroize((uint8_t *)state, sizeof(state));
+}
+
+#if defined(XR_TESTS_CHACHA20)
+#include <stdio.h>
+
+/* Check every implementation supported by the host against the RFC 8439
+   2.3.2 vector and against the portable one for every block count up
+   to a few kernel calls, across a 32-bit counter wrap. */
+int chacha20_run_test(void) {
+  static const uint8_t nonce[CHACHA20_NONCE_SIZE] = {
+      0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x4a, 0x00, 0x00, 0x00, 0x00};
+  static const uint8_t block[CHACHA20_BLOCK_SIZE] = {
+      0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd,
+      0x1f, 0xa3, 0x20, 0x71, 0xc4, 0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0,
+      0x68, 0x03, 0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e, 0xd2,
+      0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05,
+      0xd9, 0x8b, 0x02, 0xa2, 0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e,
+      0xb9, 0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e};
+  static uint8_t out[27 * CHACHA20_BLOCK_SIZE], ref[27 * CHACHA20_BLOCK_SIZE];
+  uint8_t key[CHACHA20_KEY_SIZE];
+  uint32_t state[16];
+  size_t i, n;
+  int ret = 0;
+
+  for (i = 0; i < CHACHA20_KEY_SIZE; i++)
+    key[i] = (uint8_t)i;
+
+  printf("Running tests for crypto/chacha20.c (selected: %s)\n",
+         chacha20_impl_name());
+
+  for (i = 0; i < CHACHA20_NIMPLS; i++) {
+    const chacha20_impl_t *impl = chacha20_impls[i];
+    if (!impl->supported())
+      continue;
+
+    chacha20_setup(state, key, nonce, 1);
+    impl->blocks(state, out, 1);
+    if (memcmp(out, block, CHACHA20_BLOCK_SIZE)) {
+      printf("  %s: RFC 8439 vector FAILED\n", impl->name);
+      ret = 1;
+      continue;
+    }
+
+    for (n = 0; n <= 27; n++) {
+      chacha20_setup(state, key, nonce, 0xfffffff5u);
+      chacha20_blocks_ref(state, ref, n);
+      impl->blocks(state, out, n);
+      if (memcmp(out, ref, n * CHACHA20_BLOCK_SIZE)) {
+        printf("  %s: %zu blocks FAILED\n", impl->name, n);
+        ret = 1;
+        break;
+      }
+    }
+    if (n > 27)
+      printf("  %s: OK\n", impl->name);
+  }
+
+  return ret;
+}
+#endif /* XR_TESTS_CHACHA20 */
@@ -0,0 +1,56 @@
+/**
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHACHA20_H
+#define CHACHA20_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHACHA20_KEY_SIZE 32U
+#define CHACHA20_NONCE_SIZE 12U
+#define CHACHA20_BLOCK_SIZE 64U
+
+/** @brief  Generate @p nblocks of ChaCha20 keystream (RFC 8439).
+ *
+ *  Block i is the ChaCha20 block function of @p key, @p nonce and
+ *  the 32-bit block counter @p counter + i (modulo 2^32). Up to 8
+ *  blocks are computed per kernel call with AVX2 (4 with SSE2 or
+ *  NEON).
+ *
+ *  @param key                          The 256-bit key.
+ *  @param nonce                        The 96-bit nonce.
+ *  @param counter                      The counter of the first block.
+ *  @param out                          The output buffer, at least
+ *                                      @p nblocks * CHACHA20_BLOCK_SIZE
+ *                                      bytes.
+ *  @param nblocks                      The number of blocks to generate.
+ *
+ *  @return  Void.
+ */
+void chacha20_blocks(const uint8_t key[CHACHA20_KEY_SIZE],
+                     const uint8_t nonce[CHACHA20_NONCE_SIZE],
+                     uint32_t counter, uint8_t *out, size_t nblocks);
+
+/** @brief  Get the name of the ChaCha20 implementation selected
+ *          for the host CPU.
+ *
+ *  @return  One of "avx2", "sse2", "neon" or "portable".
+ */
+const char *chacha20_impl_name(void);
+
+#endif /* CHACHA20_H */
@@ -72,8 +72,31 @@ static const uint32_t crc32_lookup[256] = {
 #define UPDC32(octet, crc)                                                     \
   (crc32_lookup[((crc >> 24) ^ (octet)) & 0xff] ^ ((crc) << 8))
 
+/* Incremental CRC-32 state */
+typedef struct {
+  uint32_t crc; /* Running CRC register (not yet inverted) */
+} crc32_ctx;
+
+/**
+ * Calculate the CRC-32 checksum of len bytes at str; equivalent to
+ * crc32_init(), crc32_update() and crc32_final() over the same bytes.
+ */
 uint32_t crc32(const uint8_t *str, size_t len);
 
+/* Start a new incremental CRC-32 computation */
+void crc32_init(crc32_ctx *ctx);
+
+/* Feed the next len bytes of the message (of any length) */
+void crc32_update(crc32_ctx *ctx, const uint8_t *buf, size_t len);
+
+/* Get the CRC-32 checksum of all the bytes fed so far; the context
+   is left untouched so that it can be updated further */
+uint32_t crc32_final(const crc32_ctx *ctx);
+
+/* Get the name of the implementation selected for the host CPU,
+   one of "pclmul" or "slicing-by-8" */
+const char *crc32_impl_name(void);
+
 void crc32_self_test(void);
 
 #endif /* CRC_H */
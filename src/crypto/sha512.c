@@ -0,0 +1,405 @@
+/**
+ * sha512.c - Multi-buffer SHA-512 (FIPS 180-4) for hashing several
+ * independent messages of the same length at once.
+ *
+ * The AVX2 implementation keeps one message per 64-bit lane of a 256-bit
+ * register, so all four compressions run in lockstep with the same
+ * instruction stream. Messages are transposed into lanes one word at a
+ * time while loading, so no separate transposition pass is needed.
+ *
+ * The portable implementation hashes the messages one after the other.
+ *
+ * LICENSE
+ * =======
+ *
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "sha512.h"
+#include "common/defs.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SHA512_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static const uint64_t sha512_k[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+    0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+    0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+    0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+    0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+    0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+    0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+    0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+    0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+    0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+    0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+    0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+    0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+    0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+    0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+    0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+    0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+    0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+    0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+    0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+    0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL};
+
+static const uint64_t sha512_iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL,
+    0xa54ff53a5f1d36f1ULL, 0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL};
+
+static inline uint64_t sha512_load64_be(const uint8_t *p) {
+  return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+         ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+         ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+         ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+}
+
+static inline void sha512_store64_be(uint8_t *p, uint64_t x) {
+  p[0] = (uint8_t)(x >> 56);
+  p[1] = (uint8_t)(x >> 48);
+  p[2] = (uint8_t)(x >> 40);
+  p[3] = (uint8_t)(x >> 32);
+  p[4] = (uint8_t)(x >> 24);
+  p[5] = (uint8_t)(x >> 16);
+  p[6] = (uint8_t)(x >> 8);
+  p[7] = (uint8_t)x;
+}
+
+/* Build the one or two final (padded) blocks of a len byte message
+   in pad and return the number of blocks. */
+static size_t sha512_pad(uint8_t pad[2 * SHA512_X4_BLOCK_SIZE],
+                         const uint8_t *in, size_t len) {
+  size_t rem = len % SHA512_X4_BLOCK_SIZE;
+  size_t nblocks = (rem + 17 > SHA512_X4_BLOCK_SIZE) ? 2 : 1;
+  uint8_t *end = pad + nblocks * SHA512_X4_BLOCK_SIZE;
+
+  memset(pad, 0, nblocks * SHA512_X4_BLOCK_SIZE);
+  memcpy(pad, in + len - rem, rem);
+  pad[rem] = 0x80;
+  /* 128-bit big-endian bit length; the upper half is always zero here */
+  sha512_store64_be(end - 8, (uint64_t)len << 3);
+  sha512_store64_be(end - 16, (uint64_t)len >> 61);
+  return nblocks;
+}
+
+#define SHA512_CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define SHA512_MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define SHA512_S0(x) (ROTR64(x, 28) ^ ROTR64(x, 34) ^ ROTR64(x, 39))
+#define SHA512_S1(x) (ROTR64(x, 14) ^ ROTR64(x, 18) ^ ROTR64(x, 41))
+#define SHA512_s0(x) (ROTR64(x, 1) ^ ROTR64(x, 8) ^ ((x) >> 7))
+#define SHA512_s1(x) (ROTR64(x, 19) ^ ROTR64(x, 61) ^ ((x) >> 6))
+
+static void sha512_compress_portable(uint64_t H[8], const uint8_t *blk) {
+  uint64_t W[80], S[8], T1, T2;
+  int t;
+
+  for (t = 0; t < 16; t++)
+    W[t] = sha512_load64_be(blk + 8 * t);
+  for (; t < 80; t++)
+    W[t] = SHA512_s1(W[t - 2]) + W[t - 7] + SHA512_s0(W[t - 15]) + W[t - 16];
+
+  memcpy(S, H, sizeof(S));
+  for (t = 0; t < 80; t++) {
+    T1 = S[7] + SHA512_S1(S[4]) + SHA512_CH(S[4], S[5], S[6]) + sha512_k[t] +
+         W[t];
+    T2 = SHA512_S0(S[0]) + SHA512_MAJ(S[0], S[1], S[2]);
+    S[7] = S[6];
+    S[6] = S[5];
+    S[5] = S[4];
+    S[4] = S[3] + T1;
+    S[3] = S[2];
+    S[2] = S[1];
+    S[1] = S[0];
+    S[0] = T1 + T2;
+  }
+  for (t = 0; t < 8; t++)
+    H[t] += S[t];
+
+  zeroize((uint8_t *)W, sizeof(W));
+  zeroize((uint8_t *)S, sizeof(S));
+}
+
+void sha512(const uint8_t *in, size_t len, uint8_t out[SHA512_X4_DIGEST_SIZE]) {
+  uint8_t pad[2 * SHA512_X4_BLOCK_SIZE];
+  uint64_t H[8];
+  size_t i, nblocks;
+
+  memcpy(H, sha512_iv, sizeof(H));
+  for (i = 0; i + SHA512_X4_BLOCK_SIZE <= len; i += SHA512_X4_BLOCK_SIZE)
+    sha512_compress_portable(H, in + i);
+  nblocks = sha512_pad(pad, in, len);
+  for (i = 0; i < nblocks; i++)
+    sha512_compress_portable(H, pad + i * SHA512_X4_BLOCK_SIZE);
+  for (i = 0; i < 8; i++)
+    sha512_store64_be(out + 8 * i, H[i]);
+
+  zeroize(pad, sizeof(pad));
+  zeroize((uint8_t *)H, sizeof(H));
+}
+
+static void sha512_x4_portable(const uint8_t *const in[SHA512_X4_LANES],
+                               size_t len,
+                               uint8_t *const out[SHA512_X4_LANES]) {
+  for (size_t j = 0; j < SHA512_X4_LANES; j++)
+    sha512(in[j], len, out[j]);
+}
+
+#if defined(SHA512_X86)
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+static int sha512_avx2_supported(void) {
+  static volatile int supported = -1;
+  unsigned int eax, ebx, ecx, edx, xcr0_lo, xcr0_hi;
+  int f = 0;
+
+  if (supported != -1)
+    return supported;
+
+  /* The OS must save the YMM state for AVX2 to be usable */
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 27)) &&
+      (ecx & (1 << 28))) {
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x06) == 0x06 &&
+        __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1 << 5)))
+      f = 1;
+  }
+
+  supported = f;
+  return f;
+}
+
+#define V_ADD(a, b) _mm256_add_epi64((a), (b))
+#define V_XOR(a, b) _mm256_xor_si256((a), (b))
+#define V_ROTR(x, n)                                                           \
+  _mm256_or_si256(_mm256_srli_epi64((x), (n)), _mm256_slli_epi64((x), 64 - (n)))
+#define V_S0(x) V_XOR(V_XOR(V_ROTR(x, 28), V_ROTR(x, 34)), V_ROTR(x, 39))
+#define V_S1(x) V_XOR(V_XOR(V_ROTR(x, 14), V_ROTR(x, 18)), V_ROTR(x, 41))
+#define V_s0(x) V_XOR(V_XOR(V_ROTR(x, 1), V_ROTR(x, 8)), _mm256_srli_epi64(x, 7))
+#define V_s1(x)                                                                \
+  V_XOR(V_XOR(V_ROTR(x, 19), V_ROTR(x, 61)), _mm256_srli_epi64(x, 6))
+#define V_CH(x, y, z)                                                          \
+  V_XOR(_mm256_and_si256((x), (y)), _mm256_andnot_si256((x), (z)))
+#define V_MAJ(x, y, z)                                                         \
+  _mm256_or_si256(_mm256_and_si256((x), (y)),                                  \
+                  _mm256_and_si256((z), _mm256_or_si256((x), (y))))
+
+/* One round; the working variables are rotated by renaming them
+   in the caller instead of moving them around. */
+#define V_ROUND(a, b, c, d, e, f, g, h, t)                                     \
+  do {                                                                         \
+    __m256i T1 =                                                               \
+        V_ADD(V_ADD(V_ADD(h, V_S1(e)), V_CH(e, f, g)),                         \
+              V_ADD(_mm256_set1_epi64x((long long)sha512_k[t]), W[(t) & 15])); \
+    d = V_ADD(d, T1);                                                          \
+    h = V_ADD(T1, V_ADD(V_S0(a), V_MAJ(a, b, c)));                             \
+  } while (0)
+
+/* Compress one block of each lane, the message schedule is kept in a
+   16 word circular buffer. */
+static inline AVX2_TARGET __attribute__((always_inline)) void
+sha512_compress_avx2(__m256i H[8], const uint8_t *const blk[SHA512_X4_LANES]) {
+  __m256i W[16];
+  __m256i a, b, c, d, e, f, g, h;
+  int t;
+
+  for (t = 0; t < 16; t++)
+    W[t] = _mm256_set_epi64x((long long)sha512_load64_be(blk[3] + 8 * t),
+                             (long long)sha512_load64_be(blk[2] + 8 * t),
+                             (long long)sha512_load64_be(blk[1] + 8 * t),
+                             (long long)sha512_load64_be(blk[0] + 8 * t));
+
+  a = H[0], b = H[1], c = H[2], d = H[3];
+  e = H[4], f = H[5], g = H[6], h = H[7];
+  for (t = 0; t < 80; t += 8) {
+    /* W[t - 16..t - 9] are no longer needed, expand W[t..t + 7] over them */
+    if (t >= 16) {
+      int i;
+      for (i = t; i < t + 8; i++)
+        W[i & 15] = V_ADD(V_ADD(W[i & 15], V_s1(W[(i - 2) & 15])),
+                          V_ADD(W[(i - 7) & 15], V_s0(W[(i - 15) & 15])));
+    }
+    V_ROUND(a, b, c, d, e, f, g, h, t + 0);
+    V_ROUND(h, a, b, c, d, e, f, g, t + 1);
+    V_ROUND(g, h, a, b, c, d, e, f, t + 2);
+    V_ROUND(f, g, h, a, b, c, d, e, t + 3);
+    V_ROUND(e, f, g, h, a, b, c, d, t + 4);
+    V_ROUND(d, e, f, g, h, a, b, c, t + 5);
+    V_ROUND(c, d, e, f, g, h, a, b, t + 6);
+    V_ROUND(b, c, d, e, f, g, h, a, t + 7);
+  }
+  H[0] = V_ADD(H[0], a), H[1] = V_ADD(H[1], b);
+  H[2] = V_ADD(H[2], c), H[3] = V_ADD(H[3], d);
+  H[4] = V_ADD(H[4], e), H[5] = V_ADD(H[5], f);
+  H[6] = V_ADD(H[6], g), H[7] = V_ADD(H[7], h);
+}
+
+static AVX2_TARGET void
+sha512_x4_avx2(const uint8_t *const in[SHA512_X4_LANES], size_t len,
+               uint8_t *const out[SHA512_X4_LANES]) {
+  uint8_t pad[SHA512_X4_LANES][2 * SHA512_X4_BLOCK_SIZE];
+  uint64_t digest[8][SHA512_X4_LANES];
+  const uint8_t *blk[SHA512_X4_LANES];
+  __m256i H[8];
+  size_t i, j, nblocks = 0;
+
+  for (i = 0; i < 8; i++)
+    H[i] = _mm256_set1_epi64x((long long)sha512_iv[i]);
+
+  for (i = 0; i + SHA512_X4_BLOCK_SIZE <= len; i += SHA512_X4_BLOCK_SIZE) {
+    for (j = 0; j < SHA512_X4_LANES; j++)
+      blk[j] = in[j] + i;
+    sha512_compress_avx2(H, blk);
+  }
+
+  /* All lanes have the same length, hence the same number of final blocks */
+  for (j = 0; j < SHA512_X4_LANES; j++)
+    nblocks = sha512_pad(pad[j], in[j], len);
+  for (i = 0; i < nblocks; i++) {
+    for (j = 0; j < SHA512_X4_LANES; j++)
+      blk[j] = pad[j] + i * SHA512_X4_BLOCK_SIZE;
+    sha512_compress_avx2(H, blk);
+  }
+
+  for (i = 0; i < 8; i++)
+    _mm256_storeu_si256((__m256i *)digest[i], H[i]);
+  for (j = 0; j < SHA512_X4_LANES; j++)
+    for (i = 0; i < 8; i++)
+      sha512_store64_be(out[j] + 8 * i, digest[i][j]);
+
+  /* Clear the vector registers and the stack copies of the state */
+  _mm256_zeroall();
+  zeroize((uint8_t *)pad, sizeof(pad));
+  zeroize((uint8_t *)digest, sizeof(digest));
+  zeroize((uint8_t *)H, sizeof(H));
+}
+
+#endif /* SHA512_X86 */
+
+int sha512_x4_accelerated(void) {
+#if defined(SHA512_X86)
+  return sha512_avx2_supported();
+#else
+  return 0;
+#endif
+}
+
+const char *sha512_x4_impl_name(void) {
+  return sha512_x4_accelerated() ? "avx2" : "portable";
+}
+
+void sha512_x4(const uint8_t *const in[SHA512_X4_LANES], size_t len,
+               uint8_t *const out[SHA512_X4_LANES]) {
+#if defined(SHA512_X86)
+  if (sha512_avx2_supported()) {
+    sha512_x4_avx2(in, len, out);
+    return;
+  }
+#endif
+  sha512_x4_portable(in, len, out);
+}
+
+#if defined(XR_TESTS_SHA512)
+#include <stdio.h>
+
+/* Check the FIPS 180-4 example vectors (one and two final blocks) and
+   the vector implementation against the portable one for every message
+   length up to three blocks. */
+int sha512_run_test(void) {
+  static const char *msgs[2] = {
+      "abc", "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+             "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"};
+  static const uint8_t md[2][SHA512_X4_DIGEST_SIZE] = {
+      {0xdd, 0xaf, 0x35, 0xa1, 0x93, 0x61, 0x7a, 0xba, 0xcc, 0x41, 0x73,
+       0x49, 0xae, 0x20, 0x41, 0x31, 0x12, 0xe6, 0xfa, 0x4e, 0x89, 0xa9,
+       0x7e, 0xa2, 0x0a, 0x9e, 0xee, 0xe6, 0x4b, 0x55, 0xd3, 0x9a, 0x21,
+       0x92, 0x99, 0x2a, 0x27, 0x4f, 0xc1, 0xa8, 0x36, 0xba, 0x3c, 0x23,
+       0xa3, 0xfe, 0xeb, 0xbd, 0x45, 0x4d, 0x44, 0x23, 0x64, 0x3c, 0xe8,
+       0x0e, 0x2a, 0x9a, 0xc9, 0x4f, 0xa5, 0x4c, 0xa4, 0x9f},
+      {0x8e, 0x95, 0x9b, 0x75, 0xda, 0xe3, 0x13, 0xda, 0x8c, 0xf4, 0xf7,
+       0x28, 0x14, 0xfc, 0x14, 0x3f, 0x8f, 0x77, 0x79, 0xc6, 0xeb, 0x9f,
+       0x7f, 0xa1, 0x72, 0x99, 0xae, 0xad, 0xb6, 0x88, 0x90, 0x18, 0x50,
+       0x1d, 0x28, 0x9e, 0x49, 0x00, 0xf7, 0xe4, 0x33, 0x1b, 0x99, 0xde,
+       0xc4, 0xb5, 0x43, 0x3a, 0xc7, 0xd3, 0x29, 0xee, 0xb6, 0xdd, 0x26,
+       0x54, 0x5e, 0x96, 0xe5, 0x5b, 0x87, 0x4b, 0xe9, 0x09}};
+  uint8_t buf[SHA512_X4_LANES][3 * SHA512_X4_BLOCK_SIZE];
+  uint8_t dig[SHA512_X4_LANES][SHA512_X4_DIGEST_SIZE];
+  uint8_t ref[SHA512_X4_LANES][SHA512_X4_DIGEST_SIZE];
+  const uint8_t *in[SHA512_X4_LANES];
+  uint8_t *out[SHA512_X4_LANES], *ref_out[SHA512_X4_LANES];
+  size_t i, j, len;
+  int ret = 0;
+
+  printf("Running tests for crypto/sha512.c (selected: %s)\n",
+         sha512_x4_impl_name());
+
+  for (j = 0; j < SHA512_X4_LANES; j++) {
+    in[j] = buf[j];
+    out[j] = dig[j];
+    ref_out[j] = ref[j];
+  }
+
+  for (i = 0; i < 2; i++) {
+    len = strlen(msgs[i]);
+    for (j = 0; j < SHA512_X4_LANES; j++)
+      memcpy(buf[j], msgs[i], len);
+    sha512_x4(in, len, out);
+    for (j = 0; j < SHA512_X4_LANES; j++) {
+      if (memcmp(dig[j], md[i], SHA512_X4_DIGEST_SIZE)) {
+        printf("  FIPS 180-4 vector %zu, lane %zu FAILED\n", i + 1, j);
+        ret = 1;
+      }
+    }
+    sha512((const uint8_t *)msgs[i], len, dig[0]);
+    if (memcmp(dig[0], md[i], SHA512_X4_DIGEST_SIZE)) {
+      printf("  FIPS 180-4 vector %zu, single message FAILED\n", i + 1);
+      ret = 1;
+    }
+  }
+
+  /* Distinct messages in each lane */
+  for (j = 0; j < SHA512_X4_LANES; j++)
+    for (i = 0; i < sizeof(buf[j]); i++)
+      buf[j][i] = (uint8_t)(i * 7 + j * 61 + (i >> 5));
+
+  for (len = 0; len <= sizeof(buf[0]); len++) {
+    sha512_x4(in, len, out);
+    sha512_x4_portable(in, len, ref_out);
+    if (memcmp(dig, ref, sizeof(dig))) {
+      printf("  %s: %zu byte messages FAILED\n", sha512_x4_impl_name(), len);
+      ret = 1;
+      break;
+    }
+  }
+
+  if (!ret)
+    printf("  %s: OK\n", sha512_x4_impl_name());
+  return ret;
+}
+#endif /* XR_TESTS_SHA512 */
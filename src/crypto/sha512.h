@@ -0,0 +1,88 @@
+/** @file sha512.h
+ *  @brief Multi-buffer SHA-512
+ *
+ *  Function prototypes for hashing four equal-length messages
+ *  at once with SHA-512 (FIPS 180-4), and a single message with
+ *  the portable implementation.
+ *
+ *  The implementation (AVX2 with one message per 64-bit lane,
+ *  or a portable one message at a time fallback) is selected
+ *  once at runtime based on the features of the host CPU.
+ *
+ *  @author Vibhav Tiwari [vibhav950 on GitHub]
+ *
+ * LICENSE
+ * =======
+ *
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHA512_H
+#define SHA512_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA512_X4_LANES 4U
+#define SHA512_X4_BLOCK_SIZE 128U
+#define SHA512_X4_DIGEST_SIZE 64U
+
+/** @brief  Compute the SHA-512 digests of four messages of the
+ *          same length.
+ *
+ *  @param in                           The four input messages, each
+ *                                      @p len bytes long.
+ *  @param len                          The length of each message in bytes.
+ *  @param out                          The four output buffers, each
+ *                                      SHA512_X4_DIGEST_SIZE bytes long;
+ *                                      out[i] = SHA-512(in[i]).
+ *
+ *  @return  Void.
+ */
+void sha512_x4(const uint8_t *const in[SHA512_X4_LANES], size_t len,
+               uint8_t *const out[SHA512_X4_LANES]);
+
+/** @brief  Compute the SHA-512 digest of a message.
+ *
+ *  Unlike the OpenSSL one-shot SHA512(), this has no library or
+ *  provider initialization to pay for on its first call, which is
+ *  why the RNG pool uses it.
+ *
+ *  @param in                           The message.
+ *  @param len                          The length of the message in bytes.
+ *  @param out                          The digest, SHA512_X4_DIGEST_SIZE
+ *                                      bytes long.
+ *
+ *  @return  Void.
+ */
+void sha512(const uint8_t *in, size_t len, uint8_t out[SHA512_X4_DIGEST_SIZE]);
+
+/** @brief  Check whether @p sha512_x4 hashes the four messages in
+ *          parallel on the host CPU; if not, it is no faster than
+ *          four calls to any other SHA-512 implementation.
+ *
+ *  @return  1 if a vector implementation was selected, 0 otherwise.
+ */
+int sha512_x4_accelerated(void);
+
+/** @brief  Get the name of the multi-buffer SHA-512 implementation
+ *          selected for the host CPU.
+ *
+ *  @return  One of "avx2" or "portable".
+ */
+const char *sha512_x4_impl_name(void);
+
+#endif /* SHA512_H */
@@ -58,168 +58,6 @@ static inline void le64_to_ptr(uint8_t *p, const uint64_t value)
 /* state[x + y*5] */
 #define A(x, y) (x + 5 * y)
 
-static inline void keccakp_theta(uint64_t s[25])
-{
-	uint64_t C[5], D[5];
-
-	/* Step 1 */
-	C[0] = s[A(0, 0)] ^ s[A(0, 1)] ^ s[A(0, 2)] ^ s[A(0, 3)] ^ s[A(0, 4)];
-	C[1] = s[A(1, 0)] ^ s[A(1, 1)] ^ s[A(1, 2)] ^ s[A(1, 3)] ^ s[A(1, 4)];
-	C[2] = s[A(2, 0)] ^ s[A(2, 1)] ^ s[A(2, 2)] ^ s[A(2, 3)] ^ s[A(2, 4)];
-	C[3] = s[A(3, 0)] ^ s[A(3, 1)] ^ s[A(3, 2)] ^ s[A(3, 3)] ^ s[A(3, 4)];
-	C[4] = s[A(4, 0)] ^ s[A(4, 1)] ^ s[A(4, 2)] ^ s[A(4, 3)] ^ s[A(4, 4)];
-
-	/* Step 2 */
-	D[0] = C[4] ^ rol64(C[1], 1);
-	D[1] = C[0] ^ rol64(C[2], 1);
-	D[2] = C[1] ^ rol64(C[3], 1);
-	D[3] = C[2] ^ rol64(C[4], 1);
-	D[4] = C[3] ^ rol64(C[0], 1);
-
-	/* Step 3 */
-	s[A(0, 0)] ^= D[0];
-	s[A(1, 0)] ^= D[1];
-	s[A(2, 0)] ^= D[2];
-	s[A(3, 0)] ^= D[3];
-	s[A(4, 0)] ^= D[4];
-
-	s[A(0, 1)] ^= D[0];
-	s[A(1, 1)] ^= D[1];
-	s[A(2, 1)] ^= D[2];
-	s[A(3, 1)] ^= D[3];
-	s[A(4, 1)] ^= D[4];
-
-	s[A(0, 2)] ^= D[0];
-	s[A(1, 2)] ^= D[1];
-	s[A(2, 2)] ^= D[2];
-	s[A(3, 2)] ^= D[3];
-	s[A(4, 2)] ^= D[4];
-
-	s[A(0, 3)] ^= D[0];
-	s[A(1, 3)] ^= D[1];
-	s[A(2, 3)] ^= D[2];
-	s[A(3, 3)] ^= D[3];
-	s[A(4, 3)] ^= D[4];
-
-	s[A(0, 4)] ^= D[0];
-	s[A(1, 4)] ^= D[1];
-	s[A(2, 4)] ^= D[2];
-	s[A(3, 4)] ^= D[3];
-	s[A(4, 4)] ^= D[4];
-}
-
-static inline void keccakp_rho(uint64_t s[25])
-{
-	/* Step 1 */
-	/* s[A(0, 0)] = s[A(0, 0)]; */
-
-#define RHO_ROL(t)	(((t + 1) * (t + 2) / 2) % 64)
-	/* Step 3 */
-	s[A(1, 0)] = rol64(s[A(1, 0)], RHO_ROL(0));
-	s[A(0, 2)] = rol64(s[A(0, 2)], RHO_ROL(1));
-	s[A(2, 1)] = rol64(s[A(2, 1)], RHO_ROL(2));
-	s[A(1, 2)] = rol64(s[A(1, 2)], RHO_ROL(3));
-	s[A(2, 3)] = rol64(s[A(2, 3)], RHO_ROL(4));
-	s[A(3, 3)] = rol64(s[A(3, 3)], RHO_ROL(5));
-	s[A(3, 0)] = rol64(s[A(3, 0)], RHO_ROL(6));
-	s[A(0, 1)] = rol64(s[A(0, 1)], RHO_ROL(7));
-	s[A(1, 3)] = rol64(s[A(1, 3)], RHO_ROL(8));
-	s[A(3, 1)] = rol64(s[A(3, 1)], RHO_ROL(9));
-	s[A(1, 4)] = rol64(s[A(1, 4)], RHO_ROL(10));
-	s[A(4, 4)] = rol64(s[A(4, 4)], RHO_ROL(11));
-	s[A(4, 0)] = rol64(s[A(4, 0)], RHO_ROL(12));
-	s[A(0, 3)] = rol64(s[A(0, 3)], RHO_ROL(13));
-	s[A(3, 4)] = rol64(s[A(3, 4)], RHO_ROL(14));
-	s[A(4, 3)] = rol64(s[A(4, 3)], RHO_ROL(15));
-	s[A(3, 2)] = rol64(s[A(3, 2)], RHO_ROL(16));
-	s[A(2, 2)] = rol64(s[A(2, 2)], RHO_ROL(17));
-	s[A(2, 0)] = rol64(s[A(2, 0)], RHO_ROL(18));
-	s[A(0, 4)] = rol64(s[A(0, 4)], RHO_ROL(19));
-	s[A(4, 2)] = rol64(s[A(4, 2)], RHO_ROL(20));
-	s[A(2, 4)] = rol64(s[A(2, 4)], RHO_ROL(21));
-	s[A(4, 1)] = rol64(s[A(4, 1)], RHO_ROL(22));
-	s[A(1, 1)] = rol64(s[A(1, 1)], RHO_ROL(23));
-}
-
-static inline void keccakp_pi(uint64_t s[25])
-{
-	uint64_t t = s[A(4, 4)];
-
-	/* Step 1 */
-	/* s[A(0, 0)] = s[A(0, 0)]; */
-	s[A(4, 4)] = s[A(1, 4)];
-	s[A(1, 4)] = s[A(3, 1)];
-	s[A(3, 1)] = s[A(1, 3)];
-	s[A(1, 3)] = s[A(0, 1)];
-	s[A(0, 1)] = s[A(3, 0)];
-	s[A(3, 0)] = s[A(3, 3)];
-	s[A(3, 3)] = s[A(2, 3)];
-	s[A(2, 3)] = s[A(1, 2)];
-	s[A(1, 2)] = s[A(2, 1)];
-	s[A(2, 1)] = s[A(0, 2)];
-	s[A(0, 2)] = s[A(1, 0)];
-	s[A(1, 0)] = s[A(1, 1)];
-	s[A(1, 1)] = s[A(4, 1)];
-	s[A(4, 1)] = s[A(2, 4)];
-	s[A(2, 4)] = s[A(4, 2)];
-	s[A(4, 2)] = s[A(0, 4)];
-	s[A(0, 4)] = s[A(2, 0)];
-	s[A(2, 0)] = s[A(2, 2)];
-	s[A(2, 2)] = s[A(3, 2)];
-	s[A(3, 2)] = s[A(4, 3)];
-	s[A(4, 3)] = s[A(3, 4)];
-	s[A(3, 4)] = s[A(0, 3)];
-	s[A(0, 3)] = s[A(4, 0)];
-	s[A(4, 0)] = t;
-}
-
-static inline void keccakp_chi(uint64_t s[25])
-{
-	uint64_t t0[5], t1[5];
-
-	t0[0] = s[A(0, 0)];
-	t0[1] = s[A(0, 1)];
-	t0[2] = s[A(0, 2)];
-	t0[3] = s[A(0, 3)];
-	t0[4] = s[A(0, 4)];
-
-	t1[0] = s[A(1, 0)];
-	t1[1] = s[A(1, 1)];
-	t1[2] = s[A(1, 2)];
-	t1[3] = s[A(1, 3)];
-	t1[4] = s[A(1, 4)];
-
-	s[A(0, 0)] ^= ~s[A(1, 0)] & s[A(2, 0)];
-	s[A(0, 1)] ^= ~s[A(1, 1)] & s[A(2, 1)];
-	s[A(0, 2)] ^= ~s[A(1, 2)] & s[A(2, 2)];
-	s[A(0, 3)] ^= ~s[A(1, 3)] & s[A(2, 3)];
-	s[A(0, 4)] ^= ~s[A(1, 4)] & s[A(2, 4)];
-
-	s[A(1, 0)] ^= ~s[A(2, 0)] & s[A(3, 0)];
-	s[A(1, 1)] ^= ~s[A(2, 1)] & s[A(3, 1)];
-	s[A(1, 2)] ^= ~s[A(2, 2)] & s[A(3, 2)];
-	s[A(1, 3)] ^= ~s[A(2, 3)] & s[A(3, 3)];
-	s[A(1, 4)] ^= ~s[A(2, 4)] & s[A(3, 4)];
-
-	s[A(2, 0)] ^= ~s[A(3, 0)] & s[A(4, 0)];
-	s[A(2, 1)] ^= ~s[A(3, 1)] & s[A(4, 1)];
-	s[A(2, 2)] ^= ~s[A(3, 2)] & s[A(4, 2)];
-	s[A(2, 3)] ^= ~s[A(3, 3)] & s[A(4, 3)];
-	s[A(2, 4)] ^= ~s[A(3, 4)] & s[A(4, 4)];
-
-	s[A(3, 0)] ^= ~s[A(4, 0)] & t0[0];
-	s[A(3, 1)] ^= ~s[A(4, 1)] & t0[1];
-	s[A(3, 2)] ^= ~s[A(4, 2)] & t0[2];
-	s[A(3, 3)] ^= ~s[A(4, 3)] & t0[3];
-	s[A(3, 4)] ^= ~s[A(4, 4)] & t0[4];
-
-	s[A(4, 0)] ^= ~t0[0] & t1[0];
-	s[A(4, 1)] ^= ~t0[1] & t1[1];
-	s[A(4, 2)] ^= ~t0[2] & t1[2];
-	s[A(4, 3)] ^= ~t0[3] & t1[3];
-	s[A(4, 4)] ^= ~t0[4] & t1[4];
-}
-
 static const uint64_t keccakp_iota_vals[] = {
 	0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL,
 	0x8000000080008000ULL, 0x000000000000808bULL, 0x0000000080000001ULL,
@@ -231,24 +69,129 @@ static const uint64_t keccakp_iota_vals[] = {
 	0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
 };
 
-static inline void keccakp_iota(uint64_t s[25], unsigned int round)
-{
-	s[0] ^= keccakp_iota_vals[round];
-}
-
-static inline void keccakp_1600(uint64_t s[25])
+/*
+ * One round of Keccak-p[1600] with theta, rho, pi, chi and iota fused
+ * and fully unrolled: the column parities C and theta effects D are
+ * kept in locals, rho and pi move each lane straight to its place in
+ * B, and chi writes B back to the state. The lane operations are the
+ * XOR, ROL and ANDN (~a & b) macros, so that the same round serves the
+ * scalar and the SIMD multi-state implementations.
+ */
+#define KECCAK_ROUND(s, rc)						\
+	do {								\
+		/* theta */						\
+		C0 = XOR(XOR(XOR(s[A(0, 0)], s[A(0, 1)]),		\
+			     XOR(s[A(0, 2)], s[A(0, 3)])), s[A(0, 4)]);	\
+		C1 = XOR(XOR(XOR(s[A(1, 0)], s[A(1, 1)]),		\
+			     XOR(s[A(1, 2)], s[A(1, 3)])), s[A(1, 4)]);	\
+		C2 = XOR(XOR(XOR(s[A(2, 0)], s[A(2, 1)]),		\
+			     XOR(s[A(2, 2)], s[A(2, 3)])), s[A(2, 4)]);	\
+		C3 = XOR(XOR(XOR(s[A(3, 0)], s[A(3, 1)]),		\
+			     XOR(s[A(3, 2)], s[A(3, 3)])), s[A(3, 4)]);	\
+		C4 = XOR(XOR(XOR(s[A(4, 0)], s[A(4, 1)]),		\
+			     XOR(s[A(4, 2)], s[A(4, 3)])), s[A(4, 4)]);	\
+		D0 = XOR(C4, ROL(C1, 1));				\
+		D1 = XOR(C0, ROL(C2, 1));				\
+		D2 = XOR(C1, ROL(C3, 1));				\
+		D3 = XOR(C2, ROL(C4, 1));				\
+		D4 = XOR(C3, ROL(C0, 1));				\
+		/* rho and pi */					\
+		B[A(0, 0)] = XOR(s[A(0, 0)], D0);			\
+		B[A(1, 0)] = ROL(XOR(s[A(1, 1)], D1), 44);		\
+		B[A(2, 0)] = ROL(XOR(s[A(2, 2)], D2), 43);		\
+		B[A(3, 0)] = ROL(XOR(s[A(3, 3)], D3), 21);		\
+		B[A(4, 0)] = ROL(XOR(s[A(4, 4)], D4), 14);		\
+		B[A(0, 1)] = ROL(XOR(s[A(3, 0)], D3), 28);		\
+		B[A(1, 1)] = ROL(XOR(s[A(4, 1)], D4), 20);		\
+		B[A(2, 1)] = ROL(XOR(s[A(0, 2)], D0), 3);		\
+		B[A(3, 1)] = ROL(XOR(s[A(1, 3)], D1), 45);		\
+		B[A(4, 1)] = ROL(XOR(s[A(2, 4)], D2), 61);		\
+		B[A(0, 2)] = ROL(XOR(s[A(1, 0)], D1), 1);		\
+		B[A(1, 2)] = ROL(XOR(s[A(2, 1)], D2), 6);		\
+		B[A(2, 2)] = ROL(XOR(s[A(3, 2)], D3), 25);		\
+		B[A(3, 2)] = ROL(XOR(s[A(4, 3)], D4), 8);		\
+		B[A(4, 2)] = ROL(XOR(s[A(0, 4)], D0), 18);		\
+		B[A(0, 3)] = ROL(XOR(s[A(4, 0)], D4), 27);		\
+		B[A(1, 3)] = ROL(XOR(s[A(0, 1)], D0), 36);		\
+		B[A(2, 3)] = ROL(XOR(s[A(1, 2)], D1), 10);		\
+		B[A(3, 3)] = ROL(XOR(s[A(2, 3)], D2), 15);		\
+		B[A(4, 3)] = ROL(XOR(s[A(3, 4)], D3), 56);		\
+		B[A(0, 4)] = ROL(XOR(s[A(2, 0)], D2), 62);		\
+		B[A(1, 4)] = ROL(XOR(s[A(3, 1)], D3), 55);		\
+		B[A(2, 4)] = ROL(XOR(s[A(4, 2)], D4), 39);		\
+		B[A(3, 4)] = ROL(XOR(s[A(0, 3)], D0), 41);		\
+		B[A(4, 4)] = ROL(XOR(s[A(1, 4)], D1), 2);		\
+		/* chi and iota */					\
+		s[A(0, 0)] = XOR(B[A(0, 0)],				\
+				  ANDN(B[A(1, 0)], B[A(2, 0)]));	\
+		s[A(1, 0)] = XOR(B[A(1, 0)],				\
+				  ANDN(B[A(2, 0)], B[A(3, 0)]));	\
+		s[A(2, 0)] = XOR(B[A(2, 0)],				\
+				  ANDN(B[A(3, 0)], B[A(4, 0)]));	\
+		s[A(3, 0)] = XOR(B[A(3, 0)],				\
+				  ANDN(B[A(4, 0)], B[A(0, 0)]));	\
+		s[A(4, 0)] = XOR(B[A(4, 0)],				\
+				  ANDN(B[A(0, 0)], B[A(1, 0)]));	\
+		s[A(0, 1)] = XOR(B[A(0, 1)],				\
+				  ANDN(B[A(1, 1)], B[A(2, 1)]));	\
+		s[A(1, 1)] = XOR(B[A(1, 1)],				\
+				  ANDN(B[A(2, 1)], B[A(3, 1)]));	\
+		s[A(2, 1)] = XOR(B[A(2, 1)],				\
+				  ANDN(B[A(3, 1)], B[A(4, 1)]));	\
+		s[A(3, 1)] = XOR(B[A(3, 1)],				\
+				  ANDN(B[A(4, 1)], B[A(0, 1)]));	\
+		s[A(4, 1)] = XOR(B[A(4, 1)],				\
+				  ANDN(B[A(0, 1)], B[A(1, 1)]));	\
+		s[A(0, 2)] = XOR(B[A(0, 2)],				\
+				  ANDN(B[A(1, 2)], B[A(2, 2)]));	\
+		s[A(1, 2)] = XOR(B[A(1, 2)],				\
+				  ANDN(B[A(2, 2)], B[A(3, 2)]));	\
+		s[A(2, 2)] = XOR(B[A(2, 2)],				\
+				  ANDN(B[A(3, 2)], B[A(4, 2)]));	\
+		s[A(3, 2)] = XOR(B[A(3, 2)],				\
+				  ANDN(B[A(4, 2)], B[A(0, 2)]));	\
+		s[A(4, 2)] = XOR(B[A(4, 2)],				\
+				  ANDN(B[A(0, 2)], B[A(1, 2)]));	\
+		s[A(0, 3)] = XOR(B[A(0, 3)],				\
+				  ANDN(B[A(1, 3)], B[A(2, 3)]));	\
+		s[A(1, 3)] = XOR(B[A(1, 3)],				\
+				  ANDN(B[A(2, 3)], B[A(3, 3)]));	\
+		s[A(2, 3)] = XOR(B[A(2, 3)],				\
+				  ANDN(B[A(3, 3)], B[A(4, 3)]));	\
+		s[A(3, 3)] = XOR(B[A(3, 3)],				\
+				  ANDN(B[A(4, 3)], B[A(0, 3)]));	\
+		s[A(4, 3)] = XOR(B[A(4, 3)],				\
+				  ANDN(B[A(0, 3)], B[A(1, 3)]));	\
+		s[A(0, 4)] = XOR(B[A(0, 4)],				\
+				  ANDN(B[A(1, 4)], B[A(2, 4)]));	\
+		s[A(1, 4)] = XOR(B[A(1, 4)],				\
+				  ANDN(B[A(2, 4)], B[A(3, 4)]));	\
+		s[A(2, 4)] = XOR(B[A(2, 4)],				\
+				  ANDN(B[A(3, 4)], B[A(4, 4)]));	\
+		s[A(3, 4)] = XOR(B[A(3, 4)],				\
+				  ANDN(B[A(4, 4)], B[A(0, 4)]));	\
+		s[A(4, 4)] = XOR(B[A(4, 4)],				\
+				  ANDN(B[A(0, 4)], B[A(1, 4)]));	\
+		s[0] = XOR(s[0], rc);					\
+	} while (0)
+
+#define XOR(a, b)	((a) ^ (b))
+#define ROL(a, n)	rol64(a, n)
+#define ANDN(a, b)	(~(a) & (b))
+
+static void keccakp_1600(uint64_t s[25])
 {
+	uint64_t B[25], C0, C1, C2, C3, C4, D0, D1, D2, D3, D4;
 	unsigned int round;
 
-	for (round = 0; round < 24; round++) {
-		keccakp_theta(s);
-		keccakp_rho(s);
-		keccakp_pi(s);
-		keccakp_chi(s);
-		keccakp_iota(s, round);
-	}
+	for (round = 0; round < 24; round++)
+		KECCAK_ROUND(s, keccakp_iota_vals[round]);
 }
 
+#undef XOR
+#undef ROL
+#undef ANDN
+
 /*********************************** SHA-3 ************************************/
 
 static inline void sha3_init(struct sha_ctx *ctx)
@@ -357,6 +300,192 @@ void sha3_final(struct sha_ctx *ctx, uint8_t *digest)
 	sha3_init(ctx);
 }
 
+/**************************** Multi-state SHA-3 ******************************/
+
+/*
+ * sha3_256_x4 hashes four messages of the same length. With AVX2 the
+ * four states are kept interleaved, lane i of s[w] holding word w of
+ * the state of message i, and permuted together by the same round as
+ * the scalar code; otherwise the messages are hashed one by one.
+ */
+
+static void sha3_256_x1(const uint8_t *in, size_t inlen, uint8_t *digest)
+{
+	HASH_CTX_ON_STACK(ctx);
+
+	sha3_256_init(&ctx);
+	sha3_update(&ctx, in, inlen);
+	sha3_final(&ctx, digest);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define SHA3_X4_AVX2
+
+static int sha3_avx2_supported(void)
+{
+	static volatile int supported = -1;
+	unsigned int eax, ebx, ecx, edx, xcr0_lo = 0, xcr0_hi = 0;
+	int f = 0;
+
+	if (supported != -1)
+		return supported;
+
+	/* The OS must save the YMM state for AVX2 to be usable */
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 27)) &&
+	    (ecx & (1 << 28))) {
+		__asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+		if ((xcr0_lo & 0x06) == 0x06 &&
+		    __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+		    (ebx & (1 << 5)))
+			f = 1;
+	}
+
+	supported = f;
+	return f;
+}
+
+#define XOR(a, b)	_mm256_xor_si256(a, b)
+#define ROL(a, n)	_mm256_or_si256(_mm256_slli_epi64(a, n),	\
+					_mm256_srli_epi64(a, 64 - (n)))
+#define ANDN(a, b)	_mm256_andnot_si256(a, b)
+
+/* XOR one block of each message into the interleaved states */
+static __attribute__((target("avx2"))) inline void
+sha3_fill_state_x4(__m256i s[25], const uint8_t *const blk[SHA3_X4_LANES])
+{
+	unsigned int i;
+
+	for (i = 0; i < SHA3_256_SIZE_BLOCK / 8; i++)
+		s[i] = XOR(s[i], _mm256_set_epi64x(
+			(long long)ptr_to_le64(blk[3] + 8 * i),
+			(long long)ptr_to_le64(blk[2] + 8 * i),
+			(long long)ptr_to_le64(blk[1] + 8 * i),
+			(long long)ptr_to_le64(blk[0] + 8 * i)));
+}
+
+static __attribute__((target("avx2"))) void keccakp_1600_x4(__m256i s[25])
+{
+	__m256i B[25], C0, C1, C2, C3, C4, D0, D1, D2, D3, D4;
+	unsigned int round;
+
+	for (round = 0; round < 24; round++)
+		KECCAK_ROUND(s, _mm256_set1_epi64x(
+				(long long)keccakp_iota_vals[round]));
+}
+
+#undef XOR
+#undef ROL
+#undef ANDN
+
+static __attribute__((target("avx2"))) void
+sha3_256_x4_avx2(const uint8_t *const in[SHA3_X4_LANES], size_t inlen,
+		 uint8_t *const digest[SHA3_X4_LANES])
+{
+	uint8_t partial[SHA3_X4_LANES][SHA3_256_SIZE_BLOCK];
+	const uint8_t *blk[SHA3_X4_LANES];
+	uint64_t lanes[SHA3_X4_LANES];
+	__m256i s[25];
+	size_t off = 0, rem;
+	unsigned int i, j;
+
+	for (i = 0; i < 25; i++)
+		s[i] = _mm256_setzero_si256();
+
+	/* Sponge absorbing phase */
+	for (; inlen - off >= SHA3_256_SIZE_BLOCK;
+	     off += SHA3_256_SIZE_BLOCK) {
+		for (j = 0; j < SHA3_X4_LANES; j++)
+			blk[j] = in[j] + off;
+		sha3_fill_state_x4(s, blk);
+		keccakp_1600_x4(s);
+	}
+
+	/* Final block with the SHA-3 suffix and padding, as sha3_final */
+	rem = inlen - off;
+	for (j = 0; j < SHA3_X4_LANES; j++) {
+		memcpy(partial[j], in[j] + off, rem);
+		memset(partial[j] + rem, 0, SHA3_256_SIZE_BLOCK - rem);
+		partial[j][rem] = 0x06;
+		partial[j][SHA3_256_SIZE_BLOCK - 1] |= 0x80;
+		blk[j] = partial[j];
+	}
+	sha3_fill_state_x4(s, blk);
+	keccakp_1600_x4(s);
+
+	/* Sponge squeeze phase */
+	for (i = 0; i < SHA3_256_SIZE_DIGEST / 8; i++) {
+		_mm256_storeu_si256((__m256i *)lanes, s[i]);
+		for (j = 0; j < SHA3_X4_LANES; j++)
+			le64_to_ptr(digest[j] + 8 * i, lanes[j]);
+	}
+
+	jent_memset_secure(partial, sizeof(partial));
+	jent_memset_secure(lanes, sizeof(lanes));
+	jent_memset_secure(s, sizeof(s));
+}
+#endif /* __x86_64__ || __i386__ */
+
+int sha3_256_x4_accelerated(void)
+{
+#ifdef SHA3_X4_AVX2
+	return sha3_avx2_supported();
+#else
+	return 0;
+#endif
+}
+
+void sha3_256_x4(const uint8_t *const in[SHA3_X4_LANES], size_t inlen,
+		 uint8_t *const digest[SHA3_X4_LANES])
+{
+	unsigned int i;
+
+#ifdef SHA3_X4_AVX2
+	if (sha3_avx2_supported()) {
+		sha3_256_x4_avx2(in, inlen, digest);
+		return;
+	}
+#endif
+
+	for (i = 0; i < SHA3_X4_LANES; i++)
+		sha3_256_x1(in[i], inlen, digest[i]);
+}
+
+/*
+ * The multi-state SHA-3 must match the scalar one for every message
+ * length around the block boundaries.
+ */
+static int sha3_x4_tester(void)
+{
+	static const size_t lens[] = { 0, 3, 135, 136, 137, 300 };
+	uint8_t msg[SHA3_X4_LANES][300];
+	uint8_t act[SHA3_X4_LANES][SHA3_256_SIZE_DIGEST];
+	uint8_t exp[SHA3_256_SIZE_DIGEST];
+	const uint8_t *in[SHA3_X4_LANES];
+	uint8_t *out[SHA3_X4_LANES];
+	unsigned int i, j, k;
+
+	for (j = 0; j < SHA3_X4_LANES; j++) {
+		for (k = 0; k < sizeof(msg[j]); k++)
+			msg[j][k] = (uint8_t)(k * 7 + j * 61 + 1);
+		in[j] = msg[j];
+		out[j] = act[j];
+	}
+
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		sha3_256_x4(in, lens[i], out);
+		for (j = 0; j < SHA3_X4_LANES; j++) {
+			sha3_256_x1(msg[j], lens[i], exp);
+			if (memcmp(exp, act[j], SHA3_256_SIZE_DIGEST))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
 int sha3_tester(void)
 {
 	HASH_CTX_ON_STACK(ctx);
@@ -379,7 +508,7 @@ int sha3_tester(void)
 			return 1;
 	}
 
-	return 0;
+	return sha3_x4_tester();
 }
 
 int sha3_alloc(void **hash_state)
@@ -51,6 +51,17 @@ int sha3_alloc(void **hash_state);
 void sha3_dealloc(void *hash_state);
 int sha3_tester(void);
 
+/*
+ * SHA3-256 of SHA3_X4_LANES messages of the same length at once;
+ * digest[i] = SHA3-256(in[i]). The states are permuted in parallel
+ * when sha3_256_x4_accelerated() returns 1 (AVX2), otherwise this is
+ * no faster than hashing the messages one by one.
+ */
+#define SHA3_X4_LANES		4
+void sha3_256_x4(const uint8_t *const in[SHA3_X4_LANES], size_t inlen,
+		 uint8_t *const digest[SHA3_X4_LANES]);
+int sha3_256_x4_accelerated(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,245 @@
+/**
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "chacha_drbg.h"
+#include <string.h>
+
+/* The nonce is always zero; every key is used for one batch only */
+static const uint8_t chacha_drbg_nonce[CHACHA20_NONCE_SIZE] = {0};
+
+status_t chacha_drbg_init(CHACHA_DRBG_STATE *state,
+                          const uint8_t entropy[CHACHA_DRBG_ENTROPY_LEN],
+                          const uint8_t *personalization_str,
+                          size_t personalization_str_len) {
+  if (personalization_str_len > CHACHA_DRBG_ENTROPY_LEN)
+    return FAILURE;
+
+  memcpy(state->K, entropy, CHACHA_DRBG_ENTROPY_LEN);
+  for (size_t i = 0; i < personalization_str_len; ++i)
+    state->K[i] ^= personalization_str[i];
+
+  zeroize(state->buf, CHACHA_DRBG_BUF_SIZE);
+  state->avail = 0;
+  state->reseed_counter = 1;
+  state->entropy_cb = NULL;
+  state->entropy_ctx = NULL;
+
+  return SUCCESS;
+}
+
+status_t chacha_drbg_update(CHACHA_DRBG_STATE *state,
+                            const uint8_t *provided_data, size_t data_len) {
+  uint8_t temp[CHACHA20_BLOCK_SIZE];
+
+  if (data_len > CHACHA_DRBG_ENTROPY_LEN)
+    return FAILURE;
+
+  /* The new key is the first block under the old key, plus the
+     provided_data */
+  chacha20_blocks(state->K, chacha_drbg_nonce, 0, temp, 1);
+  for (size_t i = 0; i < data_len; i++)
+    temp[i] ^= provided_data[i];
+  memcpy(state->K, temp, CHACHA_DRBG_ENTROPY_LEN);
+
+  /* The buffered keystream was derived from the old key */
+  zeroize(state->buf, CHACHA_DRBG_BUF_SIZE);
+  state->avail = 0;
+  state->reseed_counter++;
+
+  /* Destroy secrets */
+  zeroize(temp, sizeof(temp));
+  return SUCCESS;
+}
+
+status_t chacha_drbg_reseed(CHACHA_DRBG_STATE *state,
+                            const uint8_t entropy[CHACHA_DRBG_ENTROPY_LEN],
+                            const uint8_t *additional_input,
+                            size_t additional_input_len) {
+  uint8_t seed_material[CHACHA_DRBG_ENTROPY_LEN];
+
+  if (additional_input_len > CHACHA_DRBG_ENTROPY_LEN)
+    return FAILURE;
+
+  memcpy(seed_material, entropy, CHACHA_DRBG_ENTROPY_LEN);
+  for (size_t i = 0; i < additional_input_len; ++i)
+    seed_material[i] ^= additional_input[i];
+
+  chacha_drbg_update(state, seed_material, CHACHA_DRBG_ENTROPY_LEN);
+  state->reseed_counter = 1;
+
+  /* Destroy secrets */
+  zeroize(seed_material, CHACHA_DRBG_ENTROPY_LEN);
+  return SUCCESS;
+}
+
+void chacha_drbg_set_entropy_cb(CHACHA_DRBG_STATE *state,
+                                xr_entropy_cb_t entropy_cb, void *entropy_ctx) {
+  state->entropy_cb = entropy_cb;
+  state->entropy_ctx = entropy_ctx;
+}
+
+/* Refill the buffer with one kernel call; the first 32 bytes become
+   the next key and are wiped from the buffer */
+static void chacha_drbg_refill(CHACHA_DRBG_STATE *state) {
+  chacha20_blocks(state->K, chacha_drbg_nonce, 0, state->buf,
+                  CHACHA_DRBG_BUF_BLOCKS);
+  memcpy(state->K, state->buf, CHACHA_DRBG_ENTROPY_LEN);
+  zeroize(state->buf, CHACHA_DRBG_ENTROPY_LEN);
+  state->avail = CHACHA_DRBG_BUF_SIZE - CHACHA_DRBG_ENTROPY_LEN;
+  state->reseed_counter++;
+}
+
+/* Write nblocks blocks of keystream straight to out, then erase the
+   key with the block that follows them */
+static void chacha_drbg_direct(CHACHA_DRBG_STATE *state, uint8_t *out,
+                               size_t nblocks) {
+  uint8_t temp[CHACHA20_BLOCK_SIZE];
+
+  chacha20_blocks(state->K, chacha_drbg_nonce, 0, out, nblocks);
+  chacha20_blocks(state->K, chacha_drbg_nonce, (uint32_t)nblocks, temp, 1);
+  memcpy(state->K, temp, CHACHA_DRBG_ENTROPY_LEN);
+  state->reseed_counter++;
+
+  /* Destroy secrets */
+  zeroize(temp, sizeof(temp));
+}
+
+status_t chacha_drbg_generate(CHACHA_DRBG_STATE *state, uint8_t *out,
+                              size_t out_len) {
+  uint8_t entropy[CHACHA_DRBG_ENTROPY_LEN];
+  uint8_t *p;
+  size_t n;
+  status_t ret = SUCCESS;
+
+  while (out_len) {
+    /* Drain the buffered keystream first */
+    if (state->avail) {
+      n = min(out_len, state->avail);
+      p = state->buf + CHACHA_DRBG_BUF_SIZE - state->avail;
+      memcpy(out, p, n);
+      zeroize(p, n);
+      state->avail -= n;
+      out += n;
+      out_len -= n;
+      continue;
+    }
+
+    if (state->reseed_counter > CHACHA_DRBG_MAX_RESEED_CNT) {
+      if (!state->entropy_cb ||
+          state->entropy_cb(state->entropy_ctx, entropy, sizeof(entropy)) ||
+          SUCCESS != chacha_drbg_reseed(state, entropy, NULL, 0)) {
+        ret = FAILURE;
+        break;
+      }
+    }
+
+    if (out_len >= CHACHA_DRBG_BUF_SIZE) {
+      n = min(out_len, (size_t)CHACHA_DRBG_MAX_OUT_LEN) / CHACHA20_BLOCK_SIZE;
+      chacha_drbg_direct(state, out, n);
+      out += n * CHACHA20_BLOCK_SIZE;
+      out_len -= n * CHACHA20_BLOCK_SIZE;
+    } else {
+      chacha_drbg_refill(state);
+    }
+  }
+
+  zeroize(entropy, sizeof(entropy));
+  return ret;
+}
+
+void chacha_drbg_clear(CHACHA_DRBG_STATE *state) {
+  if (state == NULL)
+    return;
+  /* Clear the key and the buffered keystream to prevent leaks */
+  zeroize((uint8_t *)state, sizeof(CHACHA_DRBG_STATE));
+}
+
+#if defined(XR_TESTS_CHACHA_DRBG)
+#include <stdio.h>
+
+#define CHACHA_DRBG_TEST_LEN 3000
+
+/* Check the generator against the keystream it is built from, on both
+   the buffered and the direct path, and that reseeding takes effect */
+int chacha_drbg_run_test(void) {
+  static uint8_t ks[CHACHA_DRBG_TEST_LEN + 2 * CHACHA20_BLOCK_SIZE],
+      out[CHACHA_DRBG_TEST_LEN], out2[CHACHA_DRBG_TEST_LEN];
+  uint8_t seed[CHACHA_DRBG_ENTROPY_LEN], key[CHACHA20_KEY_SIZE];
+  CHACHA_DRBG_STATE state, state2;
+  size_t i, nblocks;
+  int ret = 0;
+
+  for (i = 0; i < CHACHA_DRBG_ENTROPY_LEN; i++)
+    seed[i] = (uint8_t)(i * 7 + 1);
+
+  printf("Running tests for rand/chacha_drbg.c\n");
+
+  /* Buffered: block 0 is the next key, the rest is served in order */
+  chacha_drbg_init(&state, seed, NULL, 0);
+  chacha20_blocks(seed, chacha_drbg_nonce, 0, ks, CHACHA_DRBG_BUF_BLOCKS);
+  memcpy(key, ks, CHACHA20_KEY_SIZE);
+  if (chacha_drbg_fetch(&state, out, 16) != SUCCESS ||
+      chacha_drbg_fetch(&state, out + 16, 100) != SUCCESS ||
+      memcmp(out, ks + CHACHA_DRBG_ENTROPY_LEN, 116) ||
+      memcmp(state.K, key, CHACHA20_KEY_SIZE) ||
+      state.avail != CHACHA_DRBG_BUF_SIZE - CHACHA_DRBG_ENTROPY_LEN - 116) {
+    printf("  Buffered: FAILED\n");
+    ret = 1;
+  } else {
+    printf("  Buffered: OK\n");
+  }
+
+  /* Direct: whole blocks go straight out, the block after them is the
+     next key and the tail comes from a refill under that key */
+  chacha_drbg_init(&state, seed, NULL, 0);
+  nblocks = CHACHA_DRBG_TEST_LEN / CHACHA20_BLOCK_SIZE;
+  chacha20_blocks(seed, chacha_drbg_nonce, 0, ks, nblocks + 1);
+  memcpy(key, ks + nblocks * CHACHA20_BLOCK_SIZE, CHACHA20_KEY_SIZE);
+  chacha20_blocks(key, chacha_drbg_nonce, 0, ks + nblocks * CHACHA20_BLOCK_SIZE,
+                  2);
+  if (chacha_drbg_generate(&state, out, CHACHA_DRBG_TEST_LEN) != SUCCESS ||
+      memcmp(out, ks, nblocks * CHACHA20_BLOCK_SIZE) ||
+      memcmp(out + nblocks * CHACHA20_BLOCK_SIZE,
+             ks + nblocks * CHACHA20_BLOCK_SIZE + CHACHA_DRBG_ENTROPY_LEN,
+             CHACHA_DRBG_TEST_LEN % CHACHA20_BLOCK_SIZE)) {
+    printf("  Direct: FAILED\n");
+    ret = 1;
+  } else {
+    printf("  Direct: OK\n");
+  }
+
+  /* Reseeding and the reseed limit must change the stream */
+  chacha_drbg_init(&state, seed, NULL, 0);
+  chacha_drbg_init(&state2, seed, NULL, 0);
+  chacha_drbg_set_entropy_cb(&state2, NULL, NULL);
+  state2.reseed_counter = CHACHA_DRBG_MAX_RESEED_CNT + 1;
+  if (chacha_drbg_generate(&state2, out2, 64) != FAILURE ||
+      chacha_drbg_reseed(&state2, seed, NULL, 0) != SUCCESS ||
+      chacha_drbg_generate(&state, out, 64) != SUCCESS ||
+      chacha_drbg_generate(&state2, out2, 64) != SUCCESS ||
+      !memcmp(out, out2, 64)) {
+    printf("  Reseed: FAILED\n");
+    ret = 1;
+  } else {
+    printf("  Reseed: OK\n");
+  }
+
+  chacha_drbg_clear(&state);
+  chacha_drbg_clear(&state2);
+  return ret;
+}
+#endif /* XR_TESTS_CHACHA_DRBG */
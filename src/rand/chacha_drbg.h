@@ -0,0 +1,181 @@
+/** @file chacha_drbg.h
+ *  @brief Function prototypes and macros for the ChaCha20
+ *         pseudorandom generator.
+ *
+ *  The generator runs ChaCha20 (RFC 8439) with a zero nonce and uses
+ *  "fast key erasure": every batch of keystream starts with a block
+ *  whose first 32 bytes replace the key, so the output already handed
+ *  out cannot be recovered from the state. Small requests are served
+ *  from a buffer of CHACHA_DRBG_BUF_SIZE bytes that is wiped as it is
+ *  consumed; large ones are written straight to the output.
+ *
+ *  Unlike the CTR_DRBG, it needs no AES hardware to be fast.
+ *
+ *  @author Vibhav Tiwari [vibhav950 on GitHub]
+ *
+ * LICENSE
+ * =======
+ *
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHACHA_DRBG_H
+#define CHACHA_DRBG_H
+
+#include "common/defs.h"
+#include "crypto/chacha20.h"
+#include <string.h>
+
+/* Seed length (a full ChaCha20 key) */
+#define CHACHA_DRBG_ENTROPY_LEN CHACHA20_KEY_SIZE
+
+/* Keystream blocks generated per buffer refill (one AVX2 kernel call) */
+#define CHACHA_DRBG_BUF_BLOCKS 8U
+#define CHACHA_DRBG_BUF_SIZE (CHACHA_DRBG_BUF_BLOCKS * CHACHA20_BLOCK_SIZE)
+
+/* Max keystream generated under one key; larger requests are split
+   and the key is erased between the parts */
+#define CHACHA_DRBG_MAX_OUT_LEN (1ULL << 16)
+
+/* Max number of keys derived before a reseed is required */
+#define CHACHA_DRBG_MAX_RESEED_CNT (1ULL << 48)
+
+/**
+ * This struct defines the internal state of the ChaCha20
+ * generator. Each thread should own its own context; a
+ * context must not be shared without locking.
+ */
+typedef struct _CHACHA_DRBG_STATE {
+  /* 256-bit ChaCha20 key */
+  uint8_t K[CHACHA_DRBG_ENTROPY_LEN];
+  /* Buffered keystream; the last avail bytes are unused */
+  uint8_t buf[CHACHA_DRBG_BUF_SIZE];
+  size_t avail;
+  /* Reseed counter (keys derived since the last reseed) */
+  uint64_t reseed_counter;
+  /* Entropy source for automatic reseeding (can be NULL) */
+  xr_entropy_cb_t entropy_cb;
+  void *entropy_ctx;
+} CHACHA_DRBG_STATE;
+
+/** @brief  Instantiate the generator and set up the
+ *          @p CHACHA_DRBG_STATE context.
+ *
+ *  @param state                        The context to initialize.
+ *  @param entropy                      The entropy from the noise source.
+ *  @param personalization_str          The personalization string from the
+ *                                      consuming application. Can be null.
+ *  @param personalization_str_len      The length of @p personalization_str
+ *                                      in bytes.
+ *
+ *  @return  FAILURE if @p personalization_str_len > CHACHA_DRBG_ENTROPY_LEN.
+ *  @return  SUCCESS otherwise.
+ */
+status_t chacha_drbg_init(CHACHA_DRBG_STATE *state,
+                          const uint8_t entropy[CHACHA_DRBG_ENTROPY_LEN],
+                          const uint8_t *personalization_str,
+                          size_t personalization_str_len);
+
+/** @brief  Mix @p provided_data into the key; the buffered keystream
+ *          is discarded.
+ *
+ *  @param state                        The context to update.
+ *  @param provided_data                The data to mix in. Can be null.
+ *  @param data_len                     The length of @p provided_data
+ *                                      in bytes.
+ *
+ *  @return  FAILURE if @p data_len > CHACHA_DRBG_ENTROPY_LEN.
+ *  @return  SUCCESS otherwise.
+ */
+status_t chacha_drbg_update(CHACHA_DRBG_STATE *state,
+                            const uint8_t *provided_data, size_t data_len);
+
+/** @brief  Reseed the generator with entropy from the noise source.
+ *
+ *  @param state                        The context to reseed.
+ *  @param entropy                      The entropy from the noise source.
+ *  @param additional_input             Additional data from the consuming
+ *                                      application. Can be null.
+ *  @param additional_input_len         The length of @p additional_input
+ *                                      in bytes.
+ *
+ *  @return  FAILURE if @p additional_input_len > CHACHA_DRBG_ENTROPY_LEN.
+ *  @return  SUCCESS otherwise.
+ */
+status_t chacha_drbg_reseed(CHACHA_DRBG_STATE *state,
+                            const uint8_t entropy[CHACHA_DRBG_ENTROPY_LEN],
+                            const uint8_t *additional_input,
+                            size_t additional_input_len);
+
+/** @brief  Register the entropy source used by @p chacha_drbg_generate
+ *          to reseed the generator when the reseed counter runs out.
+ *
+ *  @note   @p chacha_drbg_init clears the entropy source; call this
+ *          after instantiating the generator.
+ *
+ *  @param state                        The context.
+ *  @param entropy_cb                   The entropy source callback, asked
+ *                                      for CHACHA_DRBG_ENTROPY_LEN bytes at
+ *                                      a time. Can be NULL.
+ *  @param entropy_ctx                  The context passed to @p entropy_cb.
+ *
+ *  @return  Void.
+ */
+void chacha_drbg_set_entropy_cb(CHACHA_DRBG_STATE *state,
+                                xr_entropy_cb_t entropy_cb, void *entropy_ctx);
+
+/** @brief  Fill a buffer of any size with pseudorandom bytes.
+ *
+ *  @param state                        The context.
+ *  @param out                          The output buffer.
+ *  @param out_len                      The output length in bytes.
+ *
+ *  @return  FAILURE if a reseed is required and no entropy source is
+ *           registered, or the entropy source fails.
+ *  @return  SUCCESS otherwise.
+ */
+status_t chacha_drbg_generate(CHACHA_DRBG_STATE *state, uint8_t *out,
+                              size_t out_len);
+
+/** @brief  Fill a small buffer; the common case of a request that
+ *          fits in the buffered keystream is a single copy.
+ *
+ *  @return  As @p chacha_drbg_generate.
+ */
+static inline status_t chacha_drbg_fetch(CHACHA_DRBG_STATE *state,
+                                         uint8_t *out, size_t out_len) {
+  uint8_t *p;
+
+  if (out_len > state->avail)
+    return chacha_drbg_generate(state, out, out_len);
+
+  p = state->buf + CHACHA_DRBG_BUF_SIZE - state->avail;
+  memcpy(out, p, out_len);
+  zeroize(p, out_len);
+  state->avail -= out_len;
+  return SUCCESS;
+}
+
+/** @brief  Safely stop the instance of the generator
+ *          and clear the context.
+ *
+ *  @param state                        The context to clear.
+ *
+ *  @return  Void.
+ */
+void chacha_drbg_clear(CHACHA_DRBG_STATE *state);
+
+#endif /* CHACHA_DRBG_H */
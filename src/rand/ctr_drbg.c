@@ -19,12 +19,12 @@
 #include "common/endianness.h"
 #include <string.h>
 
-/* Add a 32-bit value to the last 4 bytes of the counter,
-   represented in big-endian format */
-#define CTR_DRBG_INCR32(x, n)                                                  \
-  do {                                                                         \
-    state->V.words[3] = BSWAP32(BSWAP32(state->V.words[3]) + n);               \
-  } while (0)
+#if defined(_WIN32)
+#include <process.h>
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 
 /* Section 10.2.1.3.1 */
 status_t ctr_drbg_init(CTR_DRBG_STATE *state,
@@ -45,6 +45,7 @@ status_t ctr_drbg_init(CTR_DRBG_STATE *state,
 
   /* keylen bits of zeros */
   memset(state->K.k, 0, AES256_KEY_SIZE);
+  aes256_expand_key(&state->K, &state->ks);
   /* blocklen bits of zeros */
   memset(state->V.bytes, 0, AES_BLOCK_SIZE);
 
@@ -52,6 +53,8 @@ status_t ctr_drbg_init(CTR_DRBG_STATE *state,
     return FAILURE;
 
   state->reseed_counter = 1;
+  state->entropy_cb = NULL;
+  state->entropy_ctx = NULL;
 
   /* Destroy secrets */
   zeroize(seed_material, CTR_DRBG_ENTROPY_LEN);
@@ -66,13 +69,9 @@ status_t ctr_drbg_update(CTR_DRBG_STATE *state, const uint8_t *provided_data,
   if (data_len > CTR_DRBG_ENTROPY_LEN)
     return FAILURE;
 
-  aes256_ks_t ks;
-  aes256_expand_key(&state->K, &ks);
-
-  for (size_t i = 0; i < CTR_DRBG_ENTROPY_LEN; i += AES_BLOCK_SIZE) {
-    CTR_DRBG_INCR32(state, 1); /* Increment counter */
-    aes256_encr_block(state->V.bytes, temp + i, &ks);
-  }
+  /* Increment the counter and encrypt, once per block */
+  aes256_ctr_blocks(state->V.bytes, temp,
+                    CTR_DRBG_ENTROPY_LEN / AES_BLOCK_SIZE, &state->ks);
 
   /* Add the provided_data */
   for (size_t i = 0; i < data_len; i++)
@@ -81,6 +80,9 @@ status_t ctr_drbg_update(CTR_DRBG_STATE *state, const uint8_t *provided_data,
   memcpy(state->K.k, temp, AES256_KEY_SIZE);
   memcpy(state->V.bytes, temp + AES256_KEY_SIZE, AES_BLOCK_SIZE);
 
+  /* K changed, so expand the new key schedule */
+  aes256_expand_key(&state->K, &state->ks);
+
   /* Destroy secrets */
   zeroize(temp, CTR_DRBG_ENTROPY_LEN);
   return SUCCESS;
@@ -131,23 +133,17 @@ status_t ctr_drbg_generate(CTR_DRBG_STATE *state, uint8_t *out, size_t out_len,
        ctr_drbg_update(state, additional_input, additional_input_len)))
     return FAILURE;
 
-  aes256_ks_t ks;
-  aes256_expand_key(&state->K, &ks);
-
   /* Generate (out_len / AES_BLOCK_SIZE) blocks */
-  while (out_len >= AES_BLOCK_SIZE) {
-    CTR_DRBG_INCR32(state, 1); /* Increment counter */
-    aes256_encr_block(state->V.bytes, out, &ks);
+  aes256_ctr_blocks(state->V.bytes, out, out_len / AES_BLOCK_SIZE, &state->ks);
+  out += out_len & ~(size_t)(AES_BLOCK_SIZE - 1);
+  out_len &= AES_BLOCK_SIZE - 1;
 
-    out += AES_BLOCK_SIZE;
-    out_len -= AES_BLOCK_SIZE;
-  }
   /* Generate (out_len % AES_BLOCK_SIZE) bytes */
   if (out_len) {
     uint8_t temp[AES_BLOCK_SIZE];
-    CTR_DRBG_INCR32(state, 1);
-    aes256_encr_block(state->V.bytes, temp, &ks);
+    aes256_ctr_blocks(state->V.bytes, temp, 1, &state->ks);
     memcpy(out, temp, out_len);
+    zeroize(temp, AES_BLOCK_SIZE);
   }
 
   /* Update for backtracking resistance */
@@ -159,252 +155,310 @@ status_t ctr_drbg_generate(CTR_DRBG_STATE *state, uint8_t *out, size_t out_len,
   return SUCCESS;
 }
 
-void ctr_drbg_clear(CTR_DRBG_STATE *state) {
-  if (state == NULL)
-    return;
-  /* Clear the state buffers to prevent leaks */
-  zeroize((uint8_t *)state, sizeof(CTR_DRBG_STATE));
+void ctr_drbg_set_entropy_cb(CTR_DRBG_STATE *state, xr_entropy_cb_t entropy_cb,
+                             void *entropy_ctx) {
+  state->entropy_cb = entropy_cb;
+  state->entropy_ctx = entropy_ctx;
 }
 
-#if defined(XR_TESTS_CTR_DRBG)
-#include <assert.h>
-#include <ctype.h>
-#include <stdio.h>
+status_t ctr_drbg_generate_bulk(CTR_DRBG_STATE *state, uint8_t *out,
+                                size_t out_len) {
+  uint8_t entropy[CTR_DRBG_ENTROPY_LEN];
+  size_t chunk;
+  status_t ret = SUCCESS;
+
+  while (out_len) {
+    if (state->reseed_counter > CTR_DRBG_MAX_RESEED_CNT) {
+      if (!state->entropy_cb ||
+          state->entropy_cb(state->entropy_ctx, entropy, sizeof(entropy)) ||
+          SUCCESS != ctr_drbg_reseed(state, entropy, NULL, 0)) {
+        ret = FAILURE;
+        break;
+      }
+    }
 
-static inline void skip_spaces(FILE *f) {
-  int ch;
+    chunk = min(out_len, CTR_DRBG_MAX_OUT_LEN);
+    if (SUCCESS != ctr_drbg_generate(state, out, chunk, NULL, 0)) {
+      ret = FAILURE;
+      break;
+    }
+    out += chunk;
+    out_len -= chunk;
+  }
 
-  while ((ch = fgetc(f)) != EOF && isspace(ch))
-    ;
-  if (ch != EOF)
-    ungetc(ch, f);
+  zeroize(entropy, sizeof(entropy));
+  return ret;
 }
 
-static int read_hex(FILE *f, uint8_t **val, const char *prefix,
-                    const unsigned int len) {
-  unsigned int i, value;
-  char buffer[2048];
+/* Add n to the counter block V, modulo 2^32 in its last 32 bits
+   (big-endian) as aes256_ctr_blocks counts */
+static void ctr_drbg_ctr_add(uint8_t ctr[AES_BLOCK_SIZE], size_t n) {
+  uint32_t c = ((uint32_t)ctr[12] << 24) | ((uint32_t)ctr[13] << 16) |
+               ((uint32_t)ctr[14] << 8) | (uint32_t)ctr[15];
+
+  c += (uint32_t)n;
+  ctr[12] = (uint8_t)(c >> 24);
+  ctr[13] = (uint8_t)(c >> 16);
+  ctr[14] = (uint8_t)(c >> 8);
+  ctr[15] = (uint8_t)c;
+}
 
-  skip_spaces(f);
-  fgets(buffer, strlen(prefix) + 1, f);
-  if (strcmp(buffer, prefix)) {
-    printf("Cant read \"%s\"\n", prefix);
-    return 1;
-  }
-  *val = (uint8_t *)malloc(len);
-  if (*val == NULL) {
-    printf("Out of memory\n");
-    exit(1);
-  }
-  for (i = 0; i < len; ++i) {
-    fscanf(f, "%02x", &value);
-    (*val)[i] = (uint8_t)value;
-  }
-  return 0;
+/* A worker of a parallel fill: nblocks blocks of keystream after
+   the first blocks */
+typedef struct {
+  const CTR_DRBG_STATE *state;
+  uint8_t *out;
+  size_t first;
+  size_t nblocks;
+} ctr_drbg_slice;
+
+static void ctr_drbg_slice_run(ctr_drbg_slice *w) {
+  uint8_t ctr[AES_BLOCK_SIZE];
+
+  memcpy(ctr, w->state->V.bytes, AES_BLOCK_SIZE);
+  ctr_drbg_ctr_add(ctr, w->first);
+  aes256_ctr_blocks(ctr, w->out, w->nblocks, &w->state->ks);
+  zeroize(ctr, AES_BLOCK_SIZE);
 }
 
-static int read_uint(FILE *f, unsigned int *val, const char *format,
-                     const char *name) {
-  skip_spaces(f);
-  if (!fscanf(f, format, val)) {
-    printf("Cant read \"%s\"\n", name);
-    return 1;
-  }
+#if defined(_WIN32)
+static unsigned __stdcall ctr_drbg_slice_thread(void *arg) {
+  ctr_drbg_slice_run((ctr_drbg_slice *)arg);
   return 0;
 }
+#else
+static void *ctr_drbg_slice_thread(void *arg) {
+  ctr_drbg_slice_run((ctr_drbg_slice *)arg);
+  return NULL;
+}
+#endif
+
+status_t ctr_drbg_generate_parallel(CTR_DRBG_STATE *state, uint8_t *out,
+                                    size_t out_len, int nthreads) {
+  ctr_drbg_slice w[CTR_DRBG_MAX_THREADS];
+#if defined(_WIN32)
+  HANDLE th[CTR_DRBG_MAX_THREADS];
+#else
+  pthread_t th[CTR_DRBG_MAX_THREADS];
+#endif
+  uint8_t entropy[CTR_DRBG_ENTROPY_LEN];
+  size_t nblocks, per, i;
+  int n, nspawned;
+  status_t ret = SUCCESS;
+
+  if (out_len > CTR_DRBG_MAX_PARALLEL_LEN || nthreads < 1 ||
+      nthreads > CTR_DRBG_MAX_THREADS)
+    return FAILURE;
 
-static int run_test_vecs(const char *filename) {
-  int rv;
-  FILE *f;
-  bool done;
-  unsigned int i;
-  unsigned int count, passed;
-  unsigned int entropy_input_length;
-  unsigned int nonce_length;
-  unsigned int personalization_string_length;
-  unsigned int additional_input_length;
-  unsigned int returned_bits_length;
-  uint8_t *entropy_input;
-  uint8_t *nonce;
-  uint8_t *personalization_string;
-  uint8_t *additional_input;
-  uint8_t *returned_bits;
-  uint8_t *generate_output;
-  CTR_DRBG_STATE state;
-  char buffer[1024];
+  if (state->reseed_counter > CTR_DRBG_MAX_RESEED_CNT) {
+    if (!state->entropy_cb ||
+        state->entropy_cb(state->entropy_ctx, entropy, sizeof(entropy)) ||
+        SUCCESS != ctr_drbg_reseed(state, entropy, NULL, 0))
+      ret = FAILURE;
+    zeroize(entropy, sizeof(entropy));
+    if (ret != SUCCESS)
+      return ret;
+  }
 
-  if (NULL == (f = fopen(filename, "r"))) {
-    printf("Cant open file %s\n", filename);
-    return 1;
+  /* Give each worker at least CTR_DRBG_MAX_OUT_LEN bytes; smaller
+     slices cost more to hand out than to generate */
+  nblocks = out_len / AES_BLOCK_SIZE;
+  per = CTR_DRBG_MAX_OUT_LEN / AES_BLOCK_SIZE;
+  if ((size_t)nthreads > nblocks / per)
+    nthreads = (nblocks / per > 0) ? (int)(nblocks / per) : 1;
+
+  per = (nblocks + nthreads - 1) / nthreads;
+  for (n = 0, i = 0; n < nthreads; ++n, i += per) {
+    w[n].state = state;
+    w[n].out = out + i * AES_BLOCK_SIZE;
+    w[n].first = i;
+    w[n].nblocks = (i < nblocks) ? min(per, nblocks - i) : 0;
   }
 
-  // Skip past the [AES-256 no df] line
-  count = 1;
-  while (!feof(f)) {
-    fgets(buffer, sizeof(buffer), f);
-    if (!strcmp(buffer, "[AES-256 no df]\n"))
+  /* The calling thread runs slice 0, and the slices of the
+     workers that fail to start */
+  for (nspawned = 1; nspawned < nthreads; ++nspawned) {
+#if defined(_WIN32)
+    if ((th[nspawned] = (HANDLE)_beginthreadex(
+             NULL, 0, ctr_drbg_slice_thread, &w[nspawned], 0, NULL)) == NULL)
+      break;
+#else
+    if (pthread_create(&th[nspawned], NULL, ctr_drbg_slice_thread,
+                       &w[nspawned]))
       break;
+#endif
   }
 
-  done = false;
-  passed = 0;
-  while (!feof(f)) {
-    fgets(buffer, sizeof(buffer), f);
-    if (!strcmp(buffer, "[PredictionResistance = False]")) {
-      printf("Error in parsing; the test vectors must be extracted from "
-             "drbgvectors_pr_false.zip\n");
-      rv = 1;
-      goto clean0;
-    }
+  ctr_drbg_slice_run(&w[0]);
+  for (n = nspawned; n < nthreads; ++n)
+    ctr_drbg_slice_run(&w[n]);
+
+  for (n = 1; n < nspawned; ++n) {
+#if defined(_WIN32)
+    WaitForSingleObject(th[n], INFINITE);
+    CloseHandle(th[n]);
+#else
+    pthread_join(th[n], NULL);
+#endif
+  }
 
-    // read length params and convert to bytes
-    if (read_uint(f, &entropy_input_length, "[EntropyInputLen = %u]",
-                  "EntropyInputLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    entropy_input_length >>= 3;
-    if (read_uint(f, &nonce_length, "[NonceLen = %u]", "NonceLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    nonce_length >>= 3;
-    if (read_uint(f, &personalization_string_length,
-                  "[PersonalizationStringLen = %u]",
-                  "PersonalizationStringLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    personalization_string_length >>= 3;
-    if (read_uint(f, &additional_input_length, "[AdditionalInputLen = %u]",
-                  "AdditionalInputLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    additional_input_length >>= 3;
-    if (read_uint(f, &returned_bits_length, "[ReturnedBitsLen = %u]",
-                  "ReturnedBitsLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    returned_bits_length >>= 3;
+  /* V ends up at the last counter used, as in ctr_drbg_generate */
+  ctr_drbg_ctr_add(state->V.bytes, nblocks);
+  out += nblocks * AES_BLOCK_SIZE;
+  out_len &= AES_BLOCK_SIZE - 1;
 
-    while (!feof(f)) {
-      skip_spaces(f);
-      fgets(buffer, sizeof(buffer), f);
-      if (!strcmp(buffer, "[AES-256 no df]\n")) // next set of tests
-        break;
-      if (feof(f)) { // end of tests
-        done = true;
-        break;
-      }
+  if (out_len) {
+    uint8_t temp[AES_BLOCK_SIZE];
+    aes256_ctr_blocks(state->V.bytes, temp, 1, &state->ks);
+    memcpy(out, temp, out_len);
+    zeroize(temp, AES_BLOCK_SIZE);
+  }
 
-      // init
-      if (read_hex(f, &entropy_input,
-                   "EntropyInput = ", entropy_input_length)) {
-        rv = 1;
-        goto clean0;
-      }
-      if (read_hex(f, &nonce, "Nonce = ", nonce_length)) {
-        rv = 1;
-        goto clean1;
-      }
-      if (read_hex(f, &personalization_string,
-                   "PersonalizationString = ", personalization_string_length)) {
-        rv = 1;
-        goto clean2;
-      }
-      assert(SUCCESS == ctr_drbg_init(&state, entropy_input,
-                                      personalization_string,
-                                      personalization_string_length));
-
-      free(entropy_input);
-      entropy_input = NULL;
-      // reseed
-      if (read_hex(f, &entropy_input,
-                   "EntropyInputReseed = ", entropy_input_length)) {
-        rv = 1;
-        goto clean3;
-      }
-      if (read_hex(f, &additional_input,
-                   "AdditionalInputReseed = ", additional_input_length)) {
-        rv = 1;
-        goto clean3;
-      }
-      assert(SUCCESS == ctr_drbg_reseed(&state, entropy_input, additional_input,
-                                        additional_input_length));
+  /* Update for backtracking resistance */
+  if (SUCCESS != ctr_drbg_update(state, NULL, 0))
+    return FAILURE;
 
-      // generate
-      if (NULL == (generate_output = (uint8_t *)malloc(returned_bits_length))) {
-        printf("Out of memory\n");
-        exit(1);
-      }
-      for (i = 0; i < 2; ++i) { // generate twice and overwrite the first output
-                                // with the second
-        if (read_hex(f, &additional_input,
-                     "AdditionalInput = ", additional_input_length)) {
-          rv = 1;
-          goto clean4;
-        }
-        if (additional_input_length == 0) {
-          free(additional_input);
-          additional_input = NULL;
-        }
-        assert(SUCCESS ==
-               ctr_drbg_generate(&state, generate_output, returned_bits_length,
-                                 additional_input, additional_input_length));
-        free(additional_input);
-        additional_input = NULL;
-      }
+  state->reseed_counter++;
 
-      // comapre result
-      if (read_hex(f, &returned_bits,
-                   "ReturnedBits = ", returned_bits_length)) {
-        rv = 1;
-        goto clean4;
-      }
-      if (!memcmp(generate_output, returned_bits, returned_bits_length)) {
-        passed++;
-        printf("Test #%-3d \x1B[92mPASS\x1B[0m\n", count);
-      } else {
-        printf("Test #%-3d \x1B[91mFAIL\x1B[0m\n", count);
-      }
-      free(entropy_input);
-      free(nonce);
-      free(personalization_string);
-      free(returned_bits);
-      free(generate_output);
-      count++;
-    }
-    if (done) {
-      count--;
-      printf("Total: %d, Passed: %d, Failed: %d\n", count, passed,
-             count - passed);
+  return SUCCESS;
+}
+
+void ctr_drbg_clear(CTR_DRBG_STATE *state) {
+  if (state == NULL)
+    return;
+  /* Clear the state buffers (and the key schedule) to prevent leaks */
+  zeroize((uint8_t *)state, sizeof(CTR_DRBG_STATE));
+}
+
+#if defined(XR_TESTS_CTR_DRBG)
+#include "drbg_kat.h"
+#include <stdio.h>
+
+/* Instantiate, reseed and generate twice as the vector says */
+static int ctr_drbg_kat(const drbg_kat *kat, uint8_t *out) {
+  CTR_DRBG_STATE state;
+  int i, rv = 1;
+
+  if (kat->entropy_len == CTR_DRBG_ENTROPY_LEN &&
+      SUCCESS == ctr_drbg_init(&state, kat->entropy, kat->pers,
+                               kat->pers_len) &&
+      SUCCESS == ctr_drbg_reseed(&state, kat->entropy_reseed,
+                                 kat->add_reseed, kat->add_len)) {
+    for (i = 0, rv = 0; i < 2 && !rv; ++i)
+      rv = (SUCCESS != ctr_drbg_generate(&state, out, kat->returned_len,
+                                         kat->add[i], kat->add_len));
+  }
+
+  ctr_drbg_clear(&state);
+  return rv;
+}
+
+static int test_entropy_cb(void *ctx, uint8_t *buf, size_t len) {
+  (*(int *)ctx)++;
+  memset(buf, 0x5a, len);
+  return 0;
+}
+
+/* The bulk output must match a sequence of CTR_DRBG_MAX_OUT_LEN requests,
+   with a reseed from the entropy source once the counter runs out. */
+static int run_bulk_test(void) {
+  const size_t len = 3 * CTR_DRBG_MAX_OUT_LEN + 17;
+  uint8_t entropy[CTR_DRBG_ENTROPY_LEN];
+  uint8_t *bulk, *ref;
+  CTR_DRBG_STATE s1, s2;
+  size_t off, n;
+  int calls = 0, rv = 1;
+
+  bulk = (uint8_t *)malloc(len);
+  ref = (uint8_t *)malloc(len);
+  if (!bulk || !ref)
+    goto cleanup;
+
+  memset(entropy, 0xa5, sizeof(entropy));
+  ctr_drbg_init(&s1, entropy, NULL, 0);
+  ctr_drbg_init(&s2, entropy, NULL, 0);
+  ctr_drbg_set_entropy_cb(&s1, test_entropy_cb, &calls);
+  s1.reseed_counter = s2.reseed_counter = CTR_DRBG_MAX_RESEED_CNT;
+
+  if (SUCCESS != ctr_drbg_generate_bulk(&s1, bulk, len))
+    goto cleanup;
+
+  memset(entropy, 0x5a, sizeof(entropy));
+  for (off = 0; off < len; off += n) {
+    if (s2.reseed_counter > CTR_DRBG_MAX_RESEED_CNT)
+      ctr_drbg_reseed(&s2, entropy, NULL, 0);
+    n = min(len - off, CTR_DRBG_MAX_OUT_LEN);
+    ctr_drbg_generate(&s2, ref + off, n, NULL, 0);
+  }
+
+  if (calls == 1 && !memcmp(bulk, ref, len))
+    rv = 0;
+  printf("Bulk generate %s\n",
+         rv ? "\x1B[91mFAIL\x1B[0m" : "\x1B[92mPASS\x1B[0m");
+
+cleanup:
+  ctr_drbg_clear(&s1);
+  ctr_drbg_clear(&s2);
+  free(bulk);
+  free(ref);
+  return rv;
+}
+
+/* The parallel fill must give the keystream of one serial request,
+   across the wrap of the 32-bit counter, and leave the same state */
+static int run_parallel_test(void) {
+  const size_t lens[] = {100, 5 * CTR_DRBG_MAX_OUT_LEN + 37};
+  uint8_t entropy[CTR_DRBG_ENTROPY_LEN], temp[AES_BLOCK_SIZE];
+  uint8_t *par, *ref;
+  CTR_DRBG_STATE s1, s2;
+  size_t i, nblocks;
+  int rv = 1;
+
+  par = (uint8_t *)malloc(lens[1]);
+  ref = (uint8_t *)malloc(lens[1]);
+  if (!par || !ref)
+    goto cleanup;
+
+  memset(entropy, 0x3c, sizeof(entropy));
+  for (i = 0, rv = 0; i < sizeof(lens) / sizeof(*lens); ++i) {
+    ctr_drbg_init(&s1, entropy, NULL, 0);
+    memset(s1.V.bytes + 12, 0xff, 3);
+    memcpy(&s2, &s1, sizeof(s1));
+
+    if (SUCCESS != ctr_drbg_generate_parallel(&s1, par, lens[i], 8)) {
+      rv = 1;
       break;
     }
+
+    nblocks = lens[i] / AES_BLOCK_SIZE;
+    aes256_ctr_blocks(s2.V.bytes, ref, nblocks, &s2.ks);
+    aes256_ctr_blocks(s2.V.bytes, temp, 1, &s2.ks);
+    memcpy(ref + nblocks * AES_BLOCK_SIZE, temp, lens[i] % AES_BLOCK_SIZE);
+    ctr_drbg_update(&s2, NULL, 0);
+    s2.reseed_counter++;
+
+    rv |= memcmp(par, ref, lens[i]) || memcmp(s1.V.bytes, s2.V.bytes,
+                                              AES_BLOCK_SIZE) ||
+          memcmp(s1.K.k, s2.K.k, AES256_KEY_SIZE) ||
+          s1.reseed_counter != s2.reseed_counter;
   }
-  rv = 0;
-  goto clean0;
-
-clean4:
-  free(generate_output);
-  free(additional_input);
-clean3:
-  free(personalization_string);
-clean2:
-  free(nonce);
-clean1:
-  free(entropy_input);
-clean0:
-  ctr_drbg_clear(&state);
-  fclose(f);
+  printf("Parallel generate %s\n",
+         rv ? "\x1B[91mFAIL\x1B[0m" : "\x1B[92mPASS\x1B[0m");
+
+cleanup:
+  ctr_drbg_clear(&s1);
+  ctr_drbg_clear(&s2);
+  free(par);
+  free(ref);
   return rv;
 }
 
 int ctr_drbg_run_test(void) {
+  int rv;
   // Run 'AES-256 no df' based tests
   printf("CTR_DRBG AES-256 no df no pr\n");
-  return run_test_vecs("test/CTR_DRBG.rsp");
+  rv = drbg_kat_run("test/CTR_DRBG.rsp", "AES-256 no df", ctr_drbg_kat);
+  return rv | run_bulk_test() | run_parallel_test();
 }
 
 #endif /* XR_TESTS_CTR_DRBG */
@@ -42,6 +42,14 @@
 #define CTR_DRBG_MAX_OUT_LEN (1ULL << 16)    /* Max output length */
 #define CTR_DRBG_MAX_RESEED_CNT (1ULL << 48) /* Max reseed count */
 
+/* Max output length of ctr_drbg_generate_parallel; half of the
+   2^32 counter blocks, so that the blocks of the closing update
+   cannot wrap around to the output */
+#define CTR_DRBG_MAX_PARALLEL_LEN (1ULL << 35)
+
+/* Max number of threads of ctr_drbg_generate_parallel */
+#define CTR_DRBG_MAX_THREADS 64
+
 /**
  * This struct defines the internal state of the
  * CTR_DRBG; See SP 800-90Ar1 Section 10.2.1.1.
@@ -54,8 +62,13 @@ typedef struct _CTR_DRBG_STATE {
   } V;
   /* 256-bit AES key */
   aes256_key_t K;
+  /* Key schedule expanded from K; updated whenever K changes */
+  aes256_ks_t ks;
   /* Reseed counter */
   uint64_t reseed_counter;
+  /* Entropy source for automatic reseeding (can be NULL) */
+  xr_entropy_cb_t entropy_cb;
+  void *entropy_ctx;
   /* Flags */
   uint8_t flags;
 } CTR_DRBG_STATE;
@@ -133,6 +146,68 @@ status_t ctr_drbg_generate(CTR_DRBG_STATE *state, uint8_t *out, size_t out_len,
                            const uint8_t *additional_input,
                            size_t additional_input_len);
 
+/** @brief  Register the entropy source used by @p ctr_drbg_generate_bulk
+ *          to reseed the CTR_DRBG when the reseed counter runs out.
+ *
+ *  @note   @p ctr_drbg_init clears the entropy source; call this after
+ *          instantiating the CTR_DRBG.
+ *
+ *  @param state                        The CTR_DRBG context.
+ *  @param entropy_cb                   The entropy source callback, asked
+ *                                      for CTR_DRBG_ENTROPY_LEN bytes at a
+ *                                      time. Can be NULL.
+ *  @param entropy_ctx                  The context passed to @p entropy_cb.
+ *
+ *  @return  Void.
+ */
+void ctr_drbg_set_entropy_cb(CTR_DRBG_STATE *state, xr_entropy_cb_t entropy_cb,
+                             void *entropy_ctx);
+
+/** @brief  Fill a buffer of any size with pseudorandom bytes.
+ *
+ *  The output is split into requests of at most CTR_DRBG_MAX_OUT_LEN
+ *  bytes, and the CTR_DRBG is reseeded from the registered entropy
+ *  source whenever the reseed counter reaches its limit.
+ *
+ *  @param state                        The CTR_DRBG context.
+ *  @param out                          The output buffer.
+ *  @param out_len                      The output length in bytes.
+ *
+ *  @return  FAILURE if a reseed is required and no entropy source is
+ *           registered, or the entropy source fails.
+ *  @return  SUCCESS otherwise.
+ */
+status_t ctr_drbg_generate_bulk(CTR_DRBG_STATE *state, uint8_t *out,
+                                size_t out_len);
+
+/** @brief  Fill a large buffer with one request, split across threads.
+ *
+ *  Keystream block i only depends on the key schedule and V + i, so
+ *  each thread generates its own range of counters into its own
+ *  slice of @p out; the key is only updated once, at the end. This is
+ *  the output ctr_drbg_generate would give if it took requests of
+ *  this size.
+ *
+ *  @note   A request of more than CTR_DRBG_MAX_OUT_LEN bytes exceeds
+ *          the per-request limit of SP 800-90Ar1 (Table 3); use
+ *          @p ctr_drbg_generate_bulk where the DRBG must conform.
+ *
+ *  @param state                        The CTR_DRBG context.
+ *  @param out                          The output buffer.
+ *  @param out_len                      The output length in bytes.
+ *  @param nthreads                     The number of threads, at most
+ *                                      CTR_DRBG_MAX_THREADS; fewer are
+ *                                      used for small requests.
+ *
+ *  @return  FAILURE if @p out_len > CTR_DRBG_MAX_PARALLEL_LEN or
+ *           @p nthreads is out of range.
+ *  @return  FAILURE if a reseed is required and no entropy source is
+ *           registered, or the entropy source fails.
+ *  @return  SUCCESS otherwise.
+ */
+status_t ctr_drbg_generate_parallel(CTR_DRBG_STATE *state, uint8_t *out,
+                                    size_t out_len, int nthreads);
+
 /** @brief  Safely stop the instance of the CTR_DRBG
  *          and release the context.
  *
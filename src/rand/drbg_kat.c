@@ -0,0 +1,482 @@
+/**
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "drbg_kat.h"
+
+#if defined(XR_TESTS_CTR_DRBG) || defined(XR_TESTS_HASH_DRBG) ||              \
+    defined(XR_TESTS_HMAC_DRBG)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <process.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* The fields of a vector, in file order */
+enum {
+  KAT_ENTROPY = 0,
+  KAT_NONCE,
+  KAT_PERS,
+  KAT_ENTROPY_RESEED,
+  KAT_ADD_RESEED,
+  KAT_ADD1,
+  KAT_ADD2,
+  KAT_RETURNED,
+  KAT_FIELDS
+};
+
+static const char *const kat_names[KAT_FIELDS] = {
+    "EntropyInput",          "Nonce",
+    "PersonalizationString", "EntropyInputReseed",
+    "AdditionalInputReseed", "AdditionalInput",
+    "AdditionalInput",       "ReturnedBits"};
+
+/* The group parameters giving the field lengths, in bits */
+static const char *const kat_params[] = {
+    "EntropyInputLen", "NonceLen", "PersonalizationStringLen",
+    "AdditionalInputLen", "ReturnedBitsLen"};
+
+/* A line of the file, or a hex field, in the mapped file */
+typedef struct {
+  const char *p;
+  size_t len;
+} kat_str;
+
+/* A vector as indexed; len[] holds the field lengths in bytes */
+typedef struct {
+  unsigned int count;
+  size_t len[KAT_FIELDS];
+  kat_str f[KAT_FIELDS];
+  int failed;
+} kat_vec;
+
+/* The vectors shared out between the workers */
+typedef struct {
+  kat_vec *v;
+  size_t nv;
+  size_t scratch; /* bytes of decoded fields and output of a vector */
+  drbg_kat_fn fn;
+  volatile long next;
+} kat_job;
+
+typedef struct {
+  const char *p;
+  size_t len;
+#if defined(_WIN32)
+  HANDLE file;
+  HANDLE map;
+#endif
+} kat_map;
+
+static int kat_map_file(kat_map *m, const char *filename) {
+#if defined(_WIN32)
+  LARGE_INTEGER size;
+
+  m->p = NULL;
+  m->map = NULL;
+  m->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (m->file == INVALID_HANDLE_VALUE)
+    return 1;
+
+  if (!GetFileSizeEx(m->file, &size) || size.QuadPart == 0 ||
+      (m->map = CreateFileMappingA(m->file, NULL, PAGE_READONLY, 0, 0,
+                                   NULL)) == NULL ||
+      (m->p = (const char *)MapViewOfFile(m->map, FILE_MAP_READ, 0, 0, 0)) ==
+          NULL) {
+    if (m->map != NULL)
+      CloseHandle(m->map);
+    CloseHandle(m->file);
+    return 1;
+  }
+
+  m->len = (size_t)size.QuadPart;
+  return 0;
+#else
+  struct stat st;
+  void *p;
+  int fd;
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return 1;
+
+  if (fstat(fd, &st) != 0 || st.st_size == 0 ||
+      (p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+          MAP_FAILED) {
+    close(fd);
+    return 1;
+  }
+
+  /* The mapping outlives the descriptor */
+  close(fd);
+  m->p = (const char *)p;
+  m->len = (size_t)st.st_size;
+  return 0;
+#endif
+}
+
+static void kat_unmap_file(kat_map *m) {
+#if defined(_WIN32)
+  UnmapViewOfFile(m->p);
+  CloseHandle(m->map);
+  CloseHandle(m->file);
+#else
+  munmap((void *)m->p, m->len);
+#endif
+}
+
+/* The next line at *pos, without the line ending and trailing spaces */
+static int kat_next_line(const kat_map *m, size_t *pos, kat_str *line) {
+  const char *e;
+
+  if (*pos >= m->len)
+    return 0;
+
+  line->p = m->p + *pos;
+  e = memchr(line->p, '\n', m->len - *pos);
+  line->len = (e != NULL) ? (size_t)(e - line->p) : m->len - *pos;
+  *pos += line->len + 1;
+
+  while (line->len > 0 && (line->p[line->len - 1] == '\r' ||
+                           line->p[line->len - 1] == ' '))
+    line->len--;
+
+  return 1;
+}
+
+static int kat_str_eq(const kat_str *s, const char *lit) {
+  size_t n = strlen(lit);
+
+  return s->len == n && !memcmp(s->p, lit, n);
+}
+
+/* Split "name = value" at the " = " */
+static int kat_split(const kat_str *line, kat_str *name, kat_str *value) {
+  const char *eq = memchr(line->p, '=', line->len);
+
+  if (eq == NULL || eq == line->p || eq[-1] != ' ')
+    return 0;
+
+  name->p = line->p;
+  name->len = (size_t)(eq - line->p) - 1;
+  value->p = eq + 1;
+  value->len = line->len - (size_t)(value->p - line->p);
+  if (value->len > 0 && value->p[0] == ' ') {
+    value->p++;
+    value->len--;
+  }
+
+  return 1;
+}
+
+static unsigned int kat_uint(const kat_str *s) {
+  unsigned int v = 0;
+  size_t i;
+
+  for (i = 0; i < s->len && s->p[i] >= '0' && s->p[i] <= '9'; ++i)
+    v = v * 10 + (unsigned int)(s->p[i] - '0');
+
+  return v;
+}
+
+/* Index the vectors of the section; the group lengths in bits are
+   kept in bits[] as they are read */
+static int kat_index(const kat_map *m, const char *section, kat_job *job) {
+  kat_str line, name, value;
+  kat_vec *v, *tmp;
+  size_t pos = 0, cap = 0, i, bits[5] = {0}, total;
+  int in_section = 0, nadd = 0;
+
+  job->v = NULL;
+  job->nv = 0;
+  job->scratch = 0;
+
+  while (kat_next_line(m, &pos, &line)) {
+    if (line.len == 0 || line.p[0] == '#')
+      continue;
+
+    if (line.p[0] == '[') {
+      line.len -= (line.p[line.len - 1] == ']') ? 2 : 1;
+      line.p++;
+
+      if (!kat_split(&line, &name, &value)) {
+        in_section = kat_str_eq(&line, section);
+        continue;
+      }
+
+      if (!in_section)
+        continue;
+
+      if (kat_str_eq(&name, "PredictionResistance") &&
+          !kat_str_eq(&value, "False")) {
+        printf("Error in parsing; the test vectors must be extracted from "
+               "drbgvectors_pr_false.zip\n");
+        return 1;
+      }
+
+      for (i = 0; i < sizeof(kat_params) / sizeof(*kat_params); ++i) {
+        if (kat_str_eq(&name, kat_params[i]))
+          bits[i] = kat_uint(&value);
+      }
+      continue;
+    }
+
+    if (!in_section || !kat_split(&line, &name, &value))
+      continue;
+
+    /* A vector starts at its COUNT */
+    if (kat_str_eq(&name, "COUNT")) {
+      if (job->nv == cap) {
+        cap = cap ? 2 * cap : 256;
+        if ((tmp = realloc(job->v, cap * sizeof(kat_vec))) == NULL) {
+          printf("Out of memory\n");
+          return 1;
+        }
+        job->v = tmp;
+      }
+
+      v = &job->v[job->nv++];
+      memset(v, 0, sizeof(kat_vec));
+      v->count = kat_uint(&value);
+      v->len[KAT_ENTROPY] = v->len[KAT_ENTROPY_RESEED] = bits[0] >> 3;
+      v->len[KAT_NONCE] = bits[1] >> 3;
+      v->len[KAT_PERS] = bits[2] >> 3;
+      v->len[KAT_ADD_RESEED] = v->len[KAT_ADD1] = v->len[KAT_ADD2] =
+          bits[3] >> 3;
+      v->len[KAT_RETURNED] = bits[4] >> 3;
+
+      /* The fields, plus the output of the DRBG */
+      for (i = 0, total = v->len[KAT_RETURNED]; i < KAT_FIELDS; ++i)
+        total += v->len[i];
+      if (total > job->scratch)
+        job->scratch = total;
+
+      nadd = 0;
+      continue;
+    }
+
+    if (job->nv == 0)
+      continue;
+
+    v = &job->v[job->nv - 1];
+    for (i = 0; i < KAT_FIELDS; ++i) {
+      if (!kat_str_eq(&name, kat_names[i]))
+        continue;
+
+      /* AdditionalInput is given once for each generate call */
+      if (i == KAT_ADD1 && (i += nadd++) > KAT_ADD2)
+        break;
+      v->f[i] = value;
+      break;
+    }
+  }
+
+  return 0;
+}
+
+static int kat_hex_digit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+/* Decode a field of len bytes; an empty field is Null */
+static int kat_hex(const kat_str *f, size_t len, uint8_t *out,
+                   const uint8_t **p) {
+  int hi, lo;
+  size_t i;
+
+  if (f->len != 2 * len)
+    return 1;
+
+  for (i = 0; i < len; ++i) {
+    if ((hi = kat_hex_digit(f->p[2 * i])) < 0 ||
+        (lo = kat_hex_digit(f->p[2 * i + 1])) < 0)
+      return 1;
+    out[i] = (uint8_t)((hi << 4) | lo);
+  }
+
+  *p = len ? out : NULL;
+  return 0;
+}
+
+/* Decode, run and check one vector; buf holds job->scratch bytes */
+static int kat_run_vec(const kat_job *job, const kat_vec *v, uint8_t *buf) {
+  const uint8_t **dst[KAT_FIELDS];
+  drbg_kat kat;
+  uint8_t *out;
+  int i;
+
+  kat.count = v->count;
+  kat.entropy_len = v->len[KAT_ENTROPY];
+  kat.nonce_len = v->len[KAT_NONCE];
+  kat.pers_len = v->len[KAT_PERS];
+  kat.add_len = v->len[KAT_ADD1];
+  kat.returned_len = v->len[KAT_RETURNED];
+
+  dst[KAT_ENTROPY] = &kat.entropy;
+  dst[KAT_NONCE] = &kat.nonce;
+  dst[KAT_PERS] = &kat.pers;
+  dst[KAT_ENTROPY_RESEED] = &kat.entropy_reseed;
+  dst[KAT_ADD_RESEED] = &kat.add_reseed;
+  dst[KAT_ADD1] = &kat.add[0];
+  dst[KAT_ADD2] = &kat.add[1];
+  dst[KAT_RETURNED] = &kat.returned;
+
+  for (i = 0; i < KAT_FIELDS; ++i) {
+    if (kat_hex(&v->f[i], v->len[i], buf, dst[i])) {
+      printf("Cant read \"%s\" of COUNT = %u\n", kat_names[i], v->count);
+      return 1;
+    }
+    buf += v->len[i];
+  }
+
+  out = buf;
+  return job->fn(&kat, out) != 0 || memcmp(out, kat.returned, kat.returned_len);
+}
+
+static void kat_worker(kat_job *job) {
+  uint8_t *buf;
+  long i;
+
+  if ((buf = malloc(job->scratch + 1)) == NULL)
+    return;
+
+  /* Claim the vectors one at a time */
+#if defined(_WIN32)
+  while ((i = InterlockedIncrement(&job->next) - 1) < (long)job->nv)
+#else
+  while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+         (long)job->nv)
+#endif
+    job->v[i].failed = kat_run_vec(job, &job->v[i], buf);
+
+  free(buf);
+}
+
+#if defined(_WIN32)
+static unsigned __stdcall kat_thread(void *arg) {
+  kat_worker((kat_job *)arg);
+  return 0;
+}
+#else
+static void *kat_thread(void *arg) {
+  kat_worker((kat_job *)arg);
+  return NULL;
+}
+#endif
+
+static int kat_nthreads(size_t nv) {
+  long n;
+#if defined(_WIN32)
+  SYSTEM_INFO si;
+
+  GetSystemInfo(&si);
+  n = (long)si.dwNumberOfProcessors;
+#else
+  n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+  if (n > DRBG_KAT_MAX_THREADS)
+    n = DRBG_KAT_MAX_THREADS;
+  if (n > (long)nv)
+    n = (long)nv;
+
+  return (n < 1) ? 1 : (int)n;
+}
+
+int drbg_kat_run(const char *filename, const char *section, drbg_kat_fn fn) {
+#if defined(_WIN32)
+  HANDLE th[DRBG_KAT_MAX_THREADS];
+#else
+  pthread_t th[DRBG_KAT_MAX_THREADS];
+#endif
+  kat_map m;
+  kat_job job;
+  size_t i, passed;
+  int rv, n, nspawned;
+
+  if (kat_map_file(&m, filename)) {
+    printf("Cant open file %s\n", filename);
+    return 1;
+  }
+
+  job.fn = fn;
+  job.next = 0;
+  if (kat_index(&m, section, &job)) {
+    rv = 1;
+    goto cleanup;
+  }
+
+  /* Workers that fail to start leave their share to the others;
+     the calling thread is one of them */
+  n = kat_nthreads(job.nv);
+  for (nspawned = 1; nspawned < n; ++nspawned) {
+#if defined(_WIN32)
+    if ((th[nspawned] = (HANDLE)_beginthreadex(NULL, 0, kat_thread, &job, 0,
+                                               NULL)) == NULL)
+      break;
+#else
+    if (pthread_create(&th[nspawned], NULL, kat_thread, &job))
+      break;
+#endif
+  }
+
+  kat_worker(&job);
+
+  for (n = 1; n < nspawned; ++n) {
+#if defined(_WIN32)
+    WaitForSingleObject(th[n], INFINITE);
+    CloseHandle(th[n]);
+#else
+    pthread_join(th[n], NULL);
+#endif
+  }
+
+  /* Nothing has run if no worker could allocate its buffer */
+  for (i = 0, passed = 0; i < job.nv; ++i) {
+    if (job.v[i].failed)
+      printf("Test #%-3zu (COUNT = %u) \x1B[91mFAIL\x1B[0m\n", i + 1,
+             job.v[i].count);
+    else
+      passed++;
+  }
+  if ((size_t)job.next < job.nv)
+    passed = 0;
+
+  printf("Total: %zu, Passed: %zu, Failed: %zu\n", job.nv, passed,
+         job.nv - passed);
+  rv = (job.nv == 0 || passed != job.nv);
+
+cleanup:
+  free(job.v);
+  kat_unmap_file(&m);
+  return rv;
+}
+#endif
@@ -0,0 +1,80 @@
+/** @file drbg_kat.h
+ *  @brief Known-answer tests of the DRBGs against the CAVP response
+ *         files (drbgvectors_pr_false.zip).
+ *
+ *  The response file is mapped into memory and indexed in a single
+ *  pass; the fields of a vector are hex strings left where they are
+ *  in the file, decoded only when the vector is run. The vectors are
+ *  then shared out between a pool of threads, one per online CPU.
+ *
+ *  Each DRBG provides a drbg_kat_fn that runs one vector: instantiate,
+ *  reseed and generate twice, as in SP 800-90A, section 11.3.
+ *
+ * LICENSE
+ * =======
+ *
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DRBG_KAT_H
+#define DRBG_KAT_H
+
+#include "common/defs.h"
+
+/* Max number of threads running the vectors */
+#define DRBG_KAT_MAX_THREADS 16
+
+/**
+ * A decoded test vector; the lengths are in bytes and are those of
+ * the group the vector belongs to, a field of length zero is Null.
+ */
+typedef struct drbg_kat {
+  unsigned int count;            /* COUNT of the vector in its group */
+  const uint8_t *entropy;        /* EntropyInput */
+  const uint8_t *nonce;          /* Nonce */
+  const uint8_t *pers;           /* PersonalizationString */
+  const uint8_t *entropy_reseed; /* EntropyInputReseed */
+  const uint8_t *add_reseed;     /* AdditionalInputReseed */
+  const uint8_t *add[2];         /* AdditionalInput of each generate call */
+  const uint8_t *returned;       /* ReturnedBits */
+  size_t entropy_len;
+  size_t nonce_len;
+  size_t pers_len;
+  size_t add_len;
+  size_t returned_len;
+} drbg_kat;
+
+/**
+ * Run the DRBG on one vector, writing the output of the second
+ * generate call (returned_len bytes) to out; called from several
+ * threads at once. Returns 0 on success.
+ */
+typedef int (*drbg_kat_fn)(const drbg_kat *kat, uint8_t *out);
+
+/** @brief  Run all the vectors of a section of a response file and
+ *          print the failures and the totals.
+ *
+ *  @param filename                     The response file.
+ *  @param section                      The section header without the
+ *                                      brackets, e.g. "SHA-512".
+ *  @param fn                           The DRBG under test.
+ *
+ *  @return  0 if the section has vectors and all of them pass.
+ *  @return  1 otherwise, or if the file cannot be read or parsed.
+ */
+int drbg_kat_run(const char *filename, const char *section, drbg_kat_fn fn);
+
+#endif /* DRBG_KAT_H */
@@ -16,6 +16,8 @@
  */
 
 #include "hash_drbg.h"
+#include "common/secure_alloc.h"
+#include "crypto/sha512.h"
 
 #include <string.h>
 
@@ -44,16 +46,14 @@ static inline void hash_drbg_add_int(uint8_t *V, const uint8_t *N, int len) {
 }
 
 /* The hash-based derivation function (10.3.1). */
-static int hash_drbg_df(const uint8_t *input, size_t input_len, uint8_t *output,
-                        size_t output_len) {
+static int hash_drbg_df(HASH_DRBG_STATE *state, const uint8_t *input,
+                        size_t input_len, uint8_t *output, size_t output_len) {
   int ret = ERR_HASH_DRBG_SUCCESS;
   int i, remaining;
   uint32_t output_len_bits;
   uint8_t counter;
   uint8_t output_len_bits_str[4];
   uint8_t md_value[EVP_MAX_MD_SIZE];
-  EVP_MD_CTX *md_ctx;
-  const EVP_MD *md = EVP_sha512();
 
   if (!input && input_len > 0) {
     ret = ERR_HASH_DRBG_NULL_PTR;
@@ -70,11 +70,6 @@ static int hash_drbg_df(const uint8_t *input, size_t input_len, uint8_t *output,
     goto cleanup;
   }
 
-  if (!(md_ctx = EVP_MD_CTX_new())) {
-    ret = ERR_HASH_DRBG_INTERNAL;
-    goto cleanup;
-  }
-
   output_len_bits = output_len << 3;
   /* output_len_bits as a big-endian 32-bit string */
   output_len_bits_str[0] = (uint8_t)((output_len_bits >> 24) & 0xff);
@@ -88,12 +83,16 @@ static int hash_drbg_df(const uint8_t *input, size_t input_len, uint8_t *output,
      output_len <= 255 * HASH_DBRG_SHA512_OUTLEN. */
   remaining = (int)output_len;
   for (;;) {
-    EVP_DigestInit_ex(md_ctx, md, NULL);
-    EVP_DigestUpdate(md_ctx, &counter, sizeof(counter));
-    EVP_DigestUpdate(md_ctx, output_len_bits_str, sizeof(output_len_bits_str));
-    EVP_DigestUpdate(md_ctx, input, input_len);
     /* Hash(counter || no_of_bits_to_return || input_string) */
-    EVP_DigestFinal_ex(md_ctx, md_value, NULL);
+    if (!EVP_DigestInit_ex(state->md_ctx, state->md, NULL) ||
+        !EVP_DigestUpdate(state->md_ctx, &counter, sizeof(counter)) ||
+        !EVP_DigestUpdate(state->md_ctx, output_len_bits_str,
+                          sizeof(output_len_bits_str)) ||
+        !EVP_DigestUpdate(state->md_ctx, input, input_len) ||
+        !EVP_DigestFinal_ex(state->md_ctx, md_value, NULL)) {
+      ret = ERR_HASH_DRBG_INTERNAL;
+      goto cleanup;
+    }
 
     if (remaining < HASH_DBRG_SHA512_OUTLEN) {
       memcpy(output + i, md_value, remaining);
@@ -106,19 +105,25 @@ static int hash_drbg_df(const uint8_t *input, size_t input_len, uint8_t *output,
     i += HASH_DBRG_SHA512_OUTLEN;
   }
 
-  EVP_MD_CTX_free(md_ctx);
-
 cleanup:
   zeroize(md_value, EVP_MAX_MD_SIZE);
   return ret;
 }
 
-/* Allocate a new HASH_DRBG_STATE. */
+/* Allocate a new HASH_DRBG_STATE, locked to physical memory (if the
+   lock limit allows) on the NUMA node of the calling thread. */
 HASH_DRBG_STATE *hash_drbg_new() {
   HASH_DRBG_STATE *state;
 
-  if (!(state = malloc(sizeof(HASH_DRBG_STATE))))
+  if (!(state = xr_secure_alloc(sizeof(HASH_DRBG_STATE), XR_NUMA_NODE_LOCAL,
+                                XR_SECURE_TRY_LOCK | XR_SECURE_GUARD)))
+    return NULL;
+  if (!(state->md = EVP_MD_fetch(NULL, "SHA512", NULL)) ||
+      !(state->md_ctx = EVP_MD_CTX_new())) {
+    EVP_MD_free(state->md);
+    xr_secure_free(state);
     return NULL;
+  }
   return state;
 }
 
@@ -127,9 +132,10 @@ void hash_drbg_clear(HASH_DRBG_STATE *state) {
   if (!state)
     return;
 
+  EVP_MD_CTX_free(state->md_ctx);
+  EVP_MD_free(state->md);
   /* Clear the state info to prevent leaks */
-  zeroize((uint8_t *)state, sizeof(HASH_DRBG_STATE));
-  free(state);
+  xr_secure_free(state);
 }
 
 /* Instantiate the HASH_DRBG state (10.1.1.2). */
@@ -185,12 +191,12 @@ int hash_drbg_init(HASH_DRBG_STATE *state, const uint8_t *entropy,
 
   memcpy(temp, entropy, entropy_len);
   temp += entropy_len;
-  mempcpy(temp, nonce, nonce_len);
+  memcpy(temp, nonce, nonce_len);
   temp += nonce_len;
   if (personalization_str_len)
     memcpy(temp, personalization_str, personalization_str_len);
 
-  if ((ret = hash_drbg_df(seed_material, seed_material_len, state->V,
+  if ((ret = hash_drbg_df(state, seed_material, seed_material_len, state->V,
                           HASH_DRBG_SEED_LEN))) {
     zeroize(seed_material, seed_material_len);
     free(seed_material);
@@ -209,7 +215,7 @@ int hash_drbg_init(HASH_DRBG_STATE *state, const uint8_t *entropy,
   temp++;
   memcpy(temp, state->V, HASH_DRBG_SEED_LEN);
 
-  if ((ret = hash_drbg_df(buf, (1 + HASH_DRBG_SEED_LEN), state->C,
+  if ((ret = hash_drbg_df(state, buf, (1 + HASH_DRBG_SEED_LEN), state->C,
                           HASH_DRBG_SEED_LEN))) {
     zeroize(buf, 1 + HASH_DRBG_SEED_LEN);
     free(buf);
@@ -220,6 +226,8 @@ int hash_drbg_init(HASH_DRBG_STATE *state, const uint8_t *entropy,
 
   state->reseed_counter = 1;
   state->flags = 0x01; /* Set init flag */
+  state->entropy_cb = NULL;
+  state->entropy_ctx = NULL;
 
 cleanup:
   return ret;
@@ -279,7 +287,7 @@ int hash_drbg_reseed(HASH_DRBG_STATE *state, const uint8_t *entropy,
   if (additional_input_len)
     memcpy(temp, additional_input, additional_input_len);
 
-  if ((ret = hash_drbg_df(seed_material, seed_material_len, state->V,
+  if ((ret = hash_drbg_df(state, seed_material, seed_material_len, state->V,
                           HASH_DRBG_SEED_LEN))) {
     zeroize(seed_material, seed_material_len);
     free(seed_material);
@@ -296,7 +304,7 @@ int hash_drbg_reseed(HASH_DRBG_STATE *state, const uint8_t *entropy,
   temp++;
   memcpy(temp, state->V, HASH_DRBG_SEED_LEN);
 
-  if ((ret = hash_drbg_df(buf, (1 + HASH_DRBG_SEED_LEN), state->C,
+  if ((ret = hash_drbg_df(state, buf, (1 + HASH_DRBG_SEED_LEN), state->C,
                           HASH_DRBG_SEED_LEN))) {
     zeroize(buf, 1 + HASH_DRBG_SEED_LEN);
     free(buf);
@@ -311,15 +319,19 @@ cleanup:
   return ret;
 }
 
+/* The hash generation function (10.1.1.4); data fits in a single SHA-512
+   block, so there is no common prefix state to reuse across blocks and
+   instead four consecutive values of data are hashed at once when the
+   multi-buffer SHA-512 is accelerated. */
 static int hash_drbg_hashgen(HASH_DRBG_STATE *state, uint8_t *output,
                              size_t output_len) {
   int ret = ERR_HASH_DRBG_SUCCESS;
-  int i, remaining;
+  int i, j, remaining;
   const uint8_t one = 1;
-  uint8_t data[HASH_DRBG_SEED_LEN];
+  uint8_t data[SHA512_X4_LANES][HASH_DRBG_SEED_LEN];
   uint8_t md_value[EVP_MAX_MD_SIZE];
-  EVP_MD_CTX *md_ctx;
-  const EVP_MD *md = EVP_sha512();
+  const uint8_t *in[SHA512_X4_LANES];
+  uint8_t *out[SHA512_X4_LANES];
 
   if (!HASH_DRBG_STATE_IS_INIT(state)) {
     ret = ERR_HASH_DRBG_NOT_INIT;
@@ -331,18 +343,38 @@ static int hash_drbg_hashgen(HASH_DRBG_STATE *state, uint8_t *output,
     goto cleanup;
   }
 
-  if (!(md_ctx = EVP_MD_CTX_new())) {
-    ret = ERR_HASH_DRBG_INTERNAL;
-    goto cleanup;
-  }
-
   i = 0;
-  memcpy(data, state->V, HASH_DRBG_SEED_LEN);
+  memcpy(data[0], state->V, HASH_DRBG_SEED_LEN);
   remaining = (int)output_len;
-  for (;;) {
-    EVP_DigestInit_ex(md_ctx, md, NULL);
-    EVP_DigestUpdate(md_ctx, data, HASH_DRBG_SEED_LEN);
-    EVP_DigestFinal_ex(md_ctx, md_value, NULL);
+
+  if (sha512_x4_accelerated()) {
+    for (j = 0; j < (int)SHA512_X4_LANES; j++)
+      in[j] = data[j];
+    while (remaining >= (int)(SHA512_X4_LANES * HASH_DBRG_SHA512_OUTLEN)) {
+      /* data[j] = (data + j) mod 2^seedlen */
+      for (j = 1; j < (int)SHA512_X4_LANES; j++) {
+        memcpy(data[j], data[j - 1], HASH_DRBG_SEED_LEN);
+        hash_drbg_add_int(data[j], &one, sizeof(one));
+      }
+      for (j = 0; j < (int)SHA512_X4_LANES; j++)
+        out[j] = output + i + j * HASH_DBRG_SHA512_OUTLEN;
+      sha512_x4(in, HASH_DRBG_SEED_LEN, out);
+
+      remaining -= SHA512_X4_LANES * HASH_DBRG_SHA512_OUTLEN;
+      i += SHA512_X4_LANES * HASH_DBRG_SHA512_OUTLEN;
+
+      memcpy(data[0], data[SHA512_X4_LANES - 1], HASH_DRBG_SEED_LEN);
+      hash_drbg_add_int(data[0], &one, sizeof(one));
+    }
+  }
+
+  while (remaining > 0) {
+    if (!EVP_DigestInit_ex(state->md_ctx, state->md, NULL) ||
+        !EVP_DigestUpdate(state->md_ctx, data[0], HASH_DRBG_SEED_LEN) ||
+        !EVP_DigestFinal_ex(state->md_ctx, md_value, NULL)) {
+      ret = ERR_HASH_DRBG_INTERNAL;
+      goto cleanup;
+    }
 
     if (remaining < HASH_DBRG_SHA512_OUTLEN) {
       memcpy(output + i, md_value, remaining);
@@ -354,13 +386,11 @@ static int hash_drbg_hashgen(HASH_DRBG_STATE *state, uint8_t *output,
     i += HASH_DBRG_SHA512_OUTLEN;
 
     /* data = (data + 1) mod 2^seedlen */
-    hash_drbg_add_int(data, &one, sizeof(one));
+    hash_drbg_add_int(data[0], &one, sizeof(one));
   }
 
-  EVP_MD_CTX_free(md_ctx);
-
 cleanup:
-  zeroize(data, HASH_DRBG_SEED_LEN);
+  zeroize((uint8_t *)data, sizeof(data));
   zeroize(md_value, EVP_MAX_MD_SIZE);
   return ret;
 }
@@ -374,12 +404,14 @@ int hash_drbg_generate(HASH_DRBG_STATE *state, uint8_t *output,
   uint8_t reseed_ctr[8];
   uint8_t md_value[EVP_MAX_MD_SIZE];
   EVP_MD_CTX *md_ctx;
-  const EVP_MD *md = EVP_sha512();
+  const EVP_MD *md;
 
   if (!HASH_DRBG_STATE_IS_INIT(state)) {
     ret = ERR_HASH_DRBG_NOT_INIT;
     goto cleanup;
   }
+  md_ctx = state->md_ctx;
+  md = state->md;
 
   /* Why even bother then? */
   if (!output && output_len > 0) {
@@ -409,31 +441,33 @@ int hash_drbg_generate(HASH_DRBG_STATE *state, uint8_t *output,
     goto cleanup;
   }
 
-  if (!(md_ctx = EVP_MD_CTX_new())) {
-    ret = ERR_HASH_DRBG_INTERNAL;
-    goto cleanup;
-  }
-
   if (additional_input_len) {
     prefix_byte = 0x02;
-    EVP_DigestInit_ex(md_ctx, md, NULL);
-    EVP_DigestUpdate(md_ctx, &prefix_byte, sizeof(prefix_byte));
-    EVP_DigestUpdate(md_ctx, state->V, HASH_DRBG_SEED_LEN);
-    EVP_DigestUpdate(md_ctx, additional_input, additional_input_len);
     /* w = Hash(0x02 || V || additional_input) */
-    EVP_DigestFinal_ex(md_ctx, md_value, NULL);
+    if (!EVP_DigestInit_ex(md_ctx, md, NULL) ||
+        !EVP_DigestUpdate(md_ctx, &prefix_byte, sizeof(prefix_byte)) ||
+        !EVP_DigestUpdate(md_ctx, state->V, HASH_DRBG_SEED_LEN) ||
+        !EVP_DigestUpdate(md_ctx, additional_input, additional_input_len) ||
+        !EVP_DigestFinal_ex(md_ctx, md_value, NULL)) {
+      ret = ERR_HASH_DRBG_INTERNAL;
+      goto cleanup;
+    }
     /* V = (V + w) mod 2^seedlen */
     hash_drbg_add_int(state->V, md_value, HASH_DBRG_SHA512_OUTLEN);
   }
 
-  hash_drbg_hashgen(state, output, output_len);
+  if ((ret = hash_drbg_hashgen(state, output, output_len)))
+    goto cleanup;
 
   prefix_byte = 0x03;
-  EVP_DigestInit_ex(md_ctx, md, NULL);
-  EVP_DigestUpdate(md_ctx, &prefix_byte, sizeof(prefix_byte));
-  EVP_DigestUpdate(md_ctx, state->V, HASH_DRBG_SEED_LEN);
   /* H = Hash(0x03 || V) */
-  EVP_DigestFinal(md_ctx, md_value, NULL);
+  if (!EVP_DigestInit_ex(md_ctx, md, NULL) ||
+      !EVP_DigestUpdate(md_ctx, &prefix_byte, sizeof(prefix_byte)) ||
+      !EVP_DigestUpdate(md_ctx, state->V, HASH_DRBG_SEED_LEN) ||
+      !EVP_DigestFinal_ex(md_ctx, md_value, NULL)) {
+    ret = ERR_HASH_DRBG_INTERNAL;
+    goto cleanup;
+  }
 
   reseed_ctr[0] = (uint8_t)((state->reseed_counter >> 56) & 0xff);
   reseed_ctr[1] = (uint8_t)((state->reseed_counter >> 48) & 0xff);
@@ -450,261 +484,88 @@ int hash_drbg_generate(HASH_DRBG_STATE *state, uint8_t *output,
   hash_drbg_add_int(state->V, reseed_ctr, sizeof(reseed_ctr));
   state->reseed_counter += 1;
 
-  EVP_MD_CTX_free(md_ctx);
-
 cleanup:
   zeroize(reseed_ctr, 8);
   zeroize(md_value, EVP_MAX_MD_SIZE);
   return ret;
 }
 
-#if defined(XR_TESTS_HASH_DRBG)
-#include <assert.h>
-#include <ctype.h>
-#include <stdio.h>
-
+void hash_drbg_set_entropy_cb(HASH_DRBG_STATE *state,
+                              xr_entropy_cb_t entropy_cb, void *entropy_ctx) {
+  state->entropy_cb = entropy_cb;
+  state->entropy_ctx = entropy_ctx;
+}
 
-static inline void skip_spaces(FILE *f) {
-  int ch;
+/* Generate output_len bytes in SP 800-90A sized requests, reseeding
+   from the registered entropy source when required. */
+int hash_drbg_generate_bulk(HASH_DRBG_STATE *state, uint8_t *output,
+                            size_t output_len) {
+  int ret = ERR_HASH_DRBG_SUCCESS;
+  uint8_t entropy[HASH_DRBG_MIN_ENTROPY_LEN];
+  size_t chunk;
 
-  while ((ch = fgetc(f)) != EOF && isspace(ch))
-    ;
-  if (ch != EOF)
-    ungetc(ch, f);
-}
+  if (!HASH_DRBG_STATE_IS_INIT(state))
+    return ERR_HASH_DRBG_NOT_INIT;
 
-static int read_hex(FILE *f, uint8_t **val, const char *prefix,
-                    const unsigned int len) {
-  unsigned int i, value;
-  char buffer[2048];
+  if (!output && output_len > 0)
+    return ERR_HASH_DRBG_NULL_PTR;
 
-  skip_spaces(f);
-  fgets(buffer, strlen(prefix) + 1, f);
-  if (strcmp(buffer, prefix)) {
-    printf("Cant read \"%s\"\n", prefix);
-    return 1;
-  }
-  *val = (uint8_t *)malloc(len);
-  if (*val == NULL) {
-    printf("Out of memory\n");
-    exit(1);
-  }
-  for (i = 0; i < len; ++i) {
-    fscanf(f, "%02x", &value);
-    (*val)[i] = (uint8_t)value;
+  while (output_len) {
+    chunk = min(output_len, HASH_DRBG_MAX_OUT_LEN);
+    ret = hash_drbg_generate(state, output, chunk, NULL, 0);
+    if (ret == ERR_HASH_DRBG_DO_RESEED && state->entropy_cb) {
+      if (state->entropy_cb(state->entropy_ctx, entropy, sizeof(entropy))) {
+        ret = ERR_HASH_DRBG_INTERNAL;
+        break;
+      }
+      if (ERR_HASH_DRBG_SUCCESS !=
+          (ret = hash_drbg_reseed(state, entropy, sizeof(entropy), NULL, 0)))
+        break;
+      continue;
+    }
+    if (ret != ERR_HASH_DRBG_SUCCESS)
+      break;
+    output += chunk;
+    output_len -= chunk;
   }
-  return 0;
-}
 
-static int read_uint(FILE *f, unsigned int *val, const char *format,
-                     const char *name) {
-  skip_spaces(f);
-  if (!fscanf(f, format, val)) {
-    printf("Cant read \"%s\"\n", name);
-    return 1;
-  }
-  return 0;
+  zeroize(entropy, sizeof(entropy));
+  return ret;
 }
 
-static int run_test_vecs(const char *filename) {
-  int rv;
-  FILE *f;
-  bool done;
-  unsigned int i;
-  unsigned int count, passed;
-  unsigned int entropy_input_length;
-  unsigned int nonce_length;
-  unsigned int personalization_string_length;
-  unsigned int additional_input_length;
-  unsigned int returned_bits_length;
-  uint8_t *entropy_input;
-  uint8_t *nonce;
-  uint8_t *personalization_string;
-  uint8_t *additional_input;
-  uint8_t *returned_bits;
-  uint8_t *generate_output;
-  HASH_DRBG_STATE *state;
-  char buffer[1024];
+#if defined(XR_TESTS_HASH_DRBG)
+#include "drbg_kat.h"
+#include <stdio.h>
 
-  if (NULL == (state = hash_drbg_new())) {
-    printf("Out of memory\n");
-    exit(1);
-  }
 
-  if (NULL == (f = fopen(filename, "r"))) {
-    printf("Cant open file %s\n", filename);
+/* Instantiate, reseed and generate twice as the vector says */
+static int hash_drbg_kat(const drbg_kat *kat, uint8_t *out) {
+  HASH_DRBG_STATE *state;
+  int i, rv = 1;
+
+  if (NULL == (state = hash_drbg_new()))
     return 1;
-  }
 
-  // Skip past the [SHA-512] line
-  count = 1;
-  while (!feof(f)) {
-    fgets(buffer, sizeof(buffer), f);
-    if (!strcmp(buffer, "[SHA-512]\n"))
-      break;
+  if (ERR_HASH_DRBG_SUCCESS ==
+          hash_drbg_init(state, kat->entropy, kat->entropy_len, kat->nonce,
+                         kat->nonce_len, kat->pers, kat->pers_len) &&
+      ERR_HASH_DRBG_SUCCESS ==
+          hash_drbg_reseed(state, kat->entropy_reseed, kat->entropy_len,
+                           kat->add_reseed, kat->add_len)) {
+    for (i = 0, rv = 0; i < 2 && !rv; ++i)
+      rv = (ERR_HASH_DRBG_SUCCESS !=
+            hash_drbg_generate(state, out, kat->returned_len, kat->add[i],
+                               kat->add_len));
   }
 
-  done = false;
-  passed = 0;
-  while (!feof(f)) {
-    fgets(buffer, sizeof(buffer), f);
-    if (!strcmp(buffer, "[PredictionResistance = False]")) {
-      printf("Error in parsing; the test vectors must be extracted from "
-             "drbgvectors_pr_false.zip\n");
-      rv = 1;
-      goto clean0;
-    }
-
-    // read length params and convert to bytes
-    if (read_uint(f, &entropy_input_length, "[EntropyInputLen = %u]",
-                  "EntropyInputLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    entropy_input_length >>= 3;
-    if (read_uint(f, &nonce_length, "[NonceLen = %u]", "NonceLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    nonce_length >>= 3;
-    if (read_uint(f, &personalization_string_length,
-                  "[PersonalizationStringLen = %u]",
-                  "PersonalizationStringLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    personalization_string_length >>= 3;
-    if (read_uint(f, &additional_input_length, "[AdditionalInputLen = %u]",
-                  "AdditionalInputLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    additional_input_length >>= 3;
-    if (read_uint(f, &returned_bits_length, "[ReturnedBitsLen = %u]",
-                  "ReturnedBitsLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    returned_bits_length >>= 3;
-
-    while (!feof(f)) {
-      skip_spaces(f);
-      fgets(buffer, sizeof(buffer), f);
-      if (!strcmp(buffer, "[SHA-512]\n")) // next set of tests
-        break;
-      if (!strcmp(buffer, "[SHA-512/224]\n")) { // end of 'SHA-512' based tests
-        done = true;
-        break;
-      }
-
-      // init
-      if (read_hex(f, &entropy_input,
-                   "EntropyInput = ", entropy_input_length)) {
-        rv = 1;
-        goto clean0;
-      }
-      if (read_hex(f, &nonce, "Nonce = ", nonce_length)) {
-        rv = 1;
-        goto clean1;
-      }
-      if (read_hex(f, &personalization_string,
-                   "PersonalizationString = ", personalization_string_length)) {
-        rv = 1;
-        goto clean2;
-      }
-      assert(ERR_HASH_DRBG_SUCCESS ==
-             hash_drbg_init(state, entropy_input, entropy_input_length, nonce,
-                            nonce_length, personalization_string,
-                            personalization_string_length));
-
-      free(entropy_input);
-      entropy_input = NULL;
-      // reseed
-      if (read_hex(f, &entropy_input,
-                   "EntropyInputReseed = ", entropy_input_length)) {
-        rv = 1;
-        goto clean3;
-      }
-      if (read_hex(f, &additional_input,
-                   "AdditionalInputReseed = ", additional_input_length)) {
-        rv = 1;
-        goto clean3;
-      }
-      assert(ERR_HASH_DRBG_SUCCESS ==
-             hash_drbg_reseed(state, entropy_input, entropy_input_length,
-                              additional_input, additional_input_length));
-
-      // generate
-      if (NULL == (generate_output = (uint8_t *)malloc(returned_bits_length))) {
-        printf("Out of memory\n");
-        exit(1);
-      }
-      for (i = 0; i < 2; ++i) { // generate twice and overwrite the first output
-                                // with the second
-        if (read_hex(f, &additional_input,
-                     "AdditionalInput = ", additional_input_length)) {
-          rv = 1;
-          goto clean4;
-        }
-        if (additional_input_length == 0) {
-          free(additional_input);
-          additional_input = NULL;
-        }
-        assert(ERR_HASH_DRBG_SUCCESS ==
-               hash_drbg_generate(state, generate_output, returned_bits_length,
-                                  additional_input, additional_input_length));
-        free(additional_input);
-        additional_input = NULL;
-      }
-
-      // comapre result
-      if (read_hex(f, &returned_bits,
-                   "ReturnedBits = ", returned_bits_length)) {
-        rv = 1;
-        goto clean4;
-      }
-      if (!memcmp(generate_output, returned_bits, returned_bits_length)) {
-        passed++;
-        printf("Test #%-3d \x1B[92mPASS\x1B[0m\n", count);
-      } else {
-        printf("Test #%-3d \x1B[91mFAIL\x1B[0m\n", count);
-      }
-      free(entropy_input);
-      free(nonce);
-      free(personalization_string);
-      free(returned_bits);
-      free(generate_output);
-      count++;
-    }
-    if (done) {
-      count--;
-      printf("Total: %d, Passed: %d, Failed: %d\n", count, passed,
-             count - passed);
-      break;
-    }
-  }
-  rv = 0;
-  goto clean0;
-
-clean4:
-  free(generate_output);
-  free(additional_input);
-clean3:
-  free(personalization_string);
-clean2:
-  free(nonce);
-clean1:
-  free(entropy_input);
-clean0:
   hash_drbg_clear(state);
-  fclose(f);
   return rv;
 }
 
 int hash_drbg_run_test(void) {
   // Run 'SHA-512' based tests
   printf("Hash_DRBG SHA-512 no pr\n");
-  return run_test_vecs("test/Hash_DRBG.rsp");
+  return drbg_kat_run("test/Hash_DRBG.rsp", "SHA-512", hash_drbg_kat);
 }
 
 #endif /* XR_TESTS_HASH_DRBG */
@@ -61,8 +61,14 @@ typedef struct _HASH_DRBG_STATE {
   uint8_t C[HASH_DRBG_SEED_LEN];
   /* 64-bit reseed counter */
   uint64_t reseed_counter;
+  /* Entropy source for automatic reseeding (can be Null) */
+  xr_entropy_cb_t entropy_cb;
+  void *entropy_ctx;
   /* Flags (usage specific) */
   uint8_t flags;
+  /* SHA-512 fetched once, and the digest context reused for every hash */
+  struct evp_md_st *md;
+  struct evp_md_ctx_st *md_ctx;
 } HASH_DRBG_STATE;
 
 #define ERR_HASH_DRBG_SUCCESS 0x00 /* Success */
@@ -73,9 +79,11 @@ typedef struct _HASH_DRBG_STATE {
 #define ERR_HASH_DRBG_MEM_FAIL -0x05 /* Ran out of memory */
 #define ERR_HASH_DRBG_DO_RESEED -0x06 /* Reseed required */
 
-/** @brief  Allocate a new @p HASH_DRBG_STATE state.
+/** @brief  Allocate a new @p HASH_DRBG_STATE state along with
+ *          its SHA-512 digest context.
  *
- *  @return  A @p pointer to a HASH_DRBG_STATE state.
+ *  @return  A @p pointer to a HASH_DRBG_STATE state, or Null if
+ *           the allocation or the digest fetch failed.
  */
 HASH_DRBG_STATE *hash_drbg_new();
 
@@ -141,4 +149,37 @@ int hash_drbg_generate(HASH_DRBG_STATE *state, uint8_t *output,
                        size_t output_len, const uint8_t *additional_input,
                        size_t additional_input_len);
 
+/** @brief  Register the entropy source used by @p hash_drbg_generate_bulk
+ *          to reseed the @p HASH_DRBG state when the reseed counter runs
+ *          out. Must be called after @p hash_drbg_init.
+ *
+ *  @param state                    The HASH_DRBG state.
+ *  @param entropy_cb               The entropy source callback, asked for
+ *                                  HASH_DRBG_MIN_ENTROPY_LEN bytes at a time
+ *                                  (can be Null).
+ *  @param entropy_ctx              The context passed to @p entropy_cb.
+ *
+ *  @return  Void.
+ */
+void hash_drbg_set_entropy_cb(HASH_DRBG_STATE *state,
+                              xr_entropy_cb_t entropy_cb, void *entropy_ctx);
+
+/** @brief  Fill a buffer of any size from a @p HASH_DRBG state.
+ *
+ *  The output is split into requests of at most HASH_DRBG_MAX_OUT_LEN
+ *  bytes, reseeding from the registered entropy source whenever the
+ *  reseed counter reaches its limit.
+ *
+ *  @param state                    The HASH_DRBG state (must be instantiated
+ *                                  once first by calling @p hash_drbg_init).
+ *  @param output                   The output buffer.
+ *  @param output_len               Then length of @p output in bytes.
+ *
+ *  @return  ERR_HASH_DRBG_DO_RESEED if a reseed is required and no entropy
+ *           source is registered.
+ *  @return  A ERR_HASH_DRBG_* value otherwise.
+ */
+int hash_drbg_generate_bulk(HASH_DRBG_STATE *state, uint8_t *output,
+                            size_t output_len);
+
 #endif /* HASH_DRBG_H */
\ No newline at end of file
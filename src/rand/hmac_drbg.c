@@ -16,24 +16,40 @@
  */
 
 #include "hmac_drbg.h"
+#include "common/secure_alloc.h"
 
 #include <string.h>
 
 #if __has_include(<openssl/sha.h>)
+#include <openssl/core_names.h>
 #include <openssl/evp.h>
-#include <openssl/hmac.h>
 #else
 #error "OpenSSL not found"
 #endif
 
 #define HMAC_DRBG_STATE_IS_INIT(x) ((!x) ? (0) : ((x)->flags & 0x01))
 
-/* Allocate a new HMAC_DRBG_STATE. */
+/* Allocate a new HMAC_DRBG_STATE, locked to physical memory (if the
+   lock limit allows) on the NUMA node of the calling thread. */
 HMAC_DRBG_STATE *hmac_drbg_new() {
   HMAC_DRBG_STATE *state;
+  char digest[] = "SHA512";
+  OSSL_PARAM params[2];
 
-  if (!(state = malloc(sizeof(HMAC_DRBG_STATE))))
+  if (!(state = xr_secure_alloc(sizeof(HMAC_DRBG_STATE), XR_NUMA_NODE_LOCAL,
+                                XR_SECURE_TRY_LOCK | XR_SECURE_GUARD)))
     return NULL;
+
+  params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0);
+  params[1] = OSSL_PARAM_construct_end();
+  if (!(state->mac = EVP_MAC_fetch(NULL, "HMAC", NULL)) ||
+      !(state->mac_ctx = EVP_MAC_CTX_new(state->mac)) ||
+      !EVP_MAC_CTX_set_params(state->mac_ctx, params)) {
+    EVP_MAC_CTX_free(state->mac_ctx);
+    EVP_MAC_free(state->mac);
+    xr_secure_free(state);
+    return NULL;
+  }
   return state;
 }
 
@@ -42,88 +58,74 @@ void hmac_drbg_clear(HMAC_DRBG_STATE *state) {
   if (!state)
     return;
 
+  EVP_MAC_CTX_free(state->mac_ctx);
+  EVP_MAC_free(state->mac);
   /* Clear the state info to prevent leaks */
-  zeroize((uint8_t *)state, sizeof(HMAC_DRBG_STATE));
-  free(state);
+  xr_secure_free(state);
 }
 
-/* Update HMAC_DRBG internal state (10.1.2.2) */
-static int hmac_drbg_update(HMAC_DRBG_STATE *state, const uint8_t *data,
-                            size_t data_len) {
-  int ret = ERR_HMAC_DRBG_SUCCESS;
+/* Derive the inner and outer hash states from K, they are reused for
+   every HMAC computed until K changes. */
+static int hmac_drbg_set_key(HMAC_DRBG_STATE *state) {
+  if (!EVP_MAC_init(state->mac_ctx, state->K, HMAC_DRBG_SHA512_OUTLEN, NULL))
+    return ERR_HMAC_DRBG_INTERNAL;
+  return ERR_HMAC_DRBG_SUCCESS;
+}
+
+/* V = HMAC(K, V) */
+static int hmac_drbg_next_v(HMAC_DRBG_STATE *state) {
+  size_t outl;
+
+  if (!EVP_MAC_init(state->mac_ctx, NULL, 0, NULL) ||
+      !EVP_MAC_update(state->mac_ctx, state->V, HMAC_DRBG_SHA512_OUTLEN) ||
+      !EVP_MAC_final(state->mac_ctx, state->V, &outl, HMAC_DRBG_SHA512_OUTLEN))
+    return ERR_HMAC_DRBG_INTERNAL;
+  return ERR_HMAC_DRBG_SUCCESS;
+}
+
+/* Update HMAC_DRBG internal state (10.1.2.2); provided_data is the
+   concatenation data1 || data2 || data3, which is fed to the HMAC in
+   pieces instead of being copied into one buffer. */
+static int hmac_drbg_update(HMAC_DRBG_STATE *state, const uint8_t *data1,
+                            size_t data1_len, const uint8_t *data2,
+                            size_t data2_len, const uint8_t *data3,
+                            size_t data3_len) {
+  int ret;
   uint8_t byte_val;
-  uint8_t md_value[EVP_MAX_MD_SIZE];
-  const EVP_MD *md = EVP_sha512();
-  uint8_t *buf, *temp;
-  size_t buf_len;
+  size_t outl;
 
   /* provided_data can be Null but not Null
      with non-zero length */
-  if (!data && data_len > 0)
+  if ((!data1 && data1_len > 0) || (!data2 && data2_len > 0) ||
+      (!data3 && data3_len > 0))
     return ERR_HMAC_DRBG_NULL_PTR;
 
-  if (data_len > HMAC_DRBG_MAX_INPUT_LEN)
+  if (data1_len > HMAC_DRBG_MAX_INPUT_LEN ||
+      data2_len > HMAC_DRBG_MAX_INPUT_LEN - data1_len ||
+      data3_len > HMAC_DRBG_MAX_INPUT_LEN - data1_len - data2_len)
     return ERR_HMAC_DRBG_BAD_ARGS;
 
-  buf_len = 1 + HMAC_DRBG_SHA512_OUTLEN + data_len;
-  if (!(buf = (uint8_t *)malloc(buf_len)))
-    return ERR_HMAC_DRBG_MEM_FAIL;
-  temp = buf;
-
-  /* HMAC(K, V || 0x00 || provided_data) */
-  memcpy(temp, state->V, HMAC_DRBG_SHA512_OUTLEN);
-  temp += HMAC_DRBG_SHA512_OUTLEN;
-  byte_val = 0x00;
-  memcpy(temp, &byte_val, 1);
-  temp += 1;
-  if (data_len)
-    memcpy(temp, data, data_len);
-  if (!HMAC(md, state->K, HMAC_DRBG_SHA512_OUTLEN, buf, buf_len, md_value,
-            NULL)) {
-    ret = ERR_HMAC_DRBG_INTERNAL;
-    goto cleanup;
-  }
-  memcpy(state->K, md_value, HMAC_DRBG_SHA512_OUTLEN);
-
-  /* V = HMAC(K, V) */
-  if (!HMAC(md, state->K, HMAC_DRBG_SHA512_OUTLEN, state->V,
-            HMAC_DRBG_SHA512_OUTLEN, md_value, NULL)) {
-    ret = ERR_HMAC_DRBG_INTERNAL;
-    goto cleanup;
-  }
-  memcpy(state->V, md_value, HMAC_DRBG_SHA512_OUTLEN);
-
-  if (data_len) {
-    /* K = HMAC(K, V || 0x01 || provided_data) */
-    temp = buf;
-    memcpy(temp, state->V, HMAC_DRBG_SHA512_OUTLEN);
-    temp += HMAC_DRBG_SHA512_OUTLEN;
-    byte_val = 0x01;
-    memcpy(temp, &byte_val, 1);
-    temp += 1;
-    memcpy(temp, data, data_len);
-    if (!HMAC(md, state->K, HMAC_DRBG_SHA512_OUTLEN, buf, buf_len, md_value,
-              NULL)) {
-      ret = ERR_HMAC_DRBG_INTERNAL;
-      goto cleanup;
-    }
-    memcpy(state->K, md_value, HMAC_DRBG_SHA512_OUTLEN);
+  for (byte_val = 0x00; byte_val <= 0x01; byte_val++) {
+    /* K = HMAC(K, V || byte_val || provided_data) */
+    if (!EVP_MAC_init(state->mac_ctx, NULL, 0, NULL) ||
+        !EVP_MAC_update(state->mac_ctx, state->V, HMAC_DRBG_SHA512_OUTLEN) ||
+        !EVP_MAC_update(state->mac_ctx, &byte_val, 1) ||
+        (data1_len && !EVP_MAC_update(state->mac_ctx, data1, data1_len)) ||
+        (data2_len && !EVP_MAC_update(state->mac_ctx, data2, data2_len)) ||
+        (data3_len && !EVP_MAC_update(state->mac_ctx, data3, data3_len)) ||
+        !EVP_MAC_final(state->mac_ctx, state->K, &outl,
+                       HMAC_DRBG_SHA512_OUTLEN))
+      return ERR_HMAC_DRBG_INTERNAL;
 
     /* V = HMAC(K, V) */
-    if (!HMAC(md, state->K, HMAC_DRBG_SHA512_OUTLEN, state->V,
-              HMAC_DRBG_SHA512_OUTLEN, md_value, NULL)) {
-      ret = ERR_HMAC_DRBG_INTERNAL;
-      goto cleanup;
-    }
-    memcpy(state->V, md_value, HMAC_DRBG_SHA512_OUTLEN);
+    if ((ret = hmac_drbg_set_key(state)) || (ret = hmac_drbg_next_v(state)))
+      return ret;
+
+    if (!data1_len && !data2_len && !data3_len)
+      break;
   }
 
-cleanup:
-  /* Destroy secrets */
-  zeroize(md_value, EVP_MAX_MD_SIZE);
-  zeroize(buf, buf_len);
-  free(buf);
-  return ret;
+  return ERR_HMAC_DRBG_SUCCESS;
 }
 
 /* Instantiate the HMAC_DRBG (10.1.2.3) */
@@ -132,8 +134,6 @@ int hmac_drbg_init(HMAC_DRBG_STATE *state, const uint8_t *entropy,
                    const uint8_t *personalization_str,
                    size_t personalization_str_len) {
   int ret = ERR_HMAC_DRBG_SUCCESS;
-  size_t seed_material_len;
-  uint8_t *seed_material, *temp;
 
   /* Entropy can not be null */
   if (!entropy)
@@ -158,34 +158,25 @@ int hmac_drbg_init(HMAC_DRBG_STATE *state, const uint8_t *entropy,
   if (personalization_str_len > HMAC_DRBG_MAX_PERS_STR_LEN)
     return ERR_HMAC_DRBG_BAD_ARGS;
 
-  seed_material_len = entropy_len + nonce_len + personalization_str_len;
-  if (!(seed_material = (uint8_t *)malloc(seed_material_len)))
-    return ERR_HMAC_DRBG_MEM_FAIL;
-  temp = seed_material;
-
-  memcpy(temp, entropy, entropy_len);
-  temp += entropy_len;
-  memcpy(temp, nonce, nonce_len);
-  temp += nonce_len;
-  if (personalization_str_len)
-    memcpy(temp, personalization_str, personalization_str_len);
-
   /* outlen bits */
   memset(state->K, 0x00, HMAC_DRBG_SHA512_OUTLEN);
   /* outlen bits */
   memset(state->V, 0x01, HMAC_DRBG_SHA512_OUTLEN);
 
-  /* Update K and V */
-  if (ERR_HMAC_DRBG_SUCCESS !=
-      (ret = hmac_drbg_update(state, seed_material, seed_material_len)))
-    goto cleanup;
+  /* Update K and V with seed_material = entropy || nonce ||
+     personalization_str */
+  if (ERR_HMAC_DRBG_SUCCESS != (ret = hmac_drbg_set_key(state)) ||
+      ERR_HMAC_DRBG_SUCCESS !=
+          (ret = hmac_drbg_update(state, entropy, entropy_len, nonce,
+                                  nonce_len, personalization_str,
+                                  personalization_str_len)))
+    return ret;
 
   state->reseed_counter = 1;
   state->flags = 0x01; /* Set init flag */
+  state->entropy_cb = NULL;
+  state->entropy_ctx = NULL;
 
-cleanup:
-  zeroize(seed_material, seed_material_len);
-  free(seed_material);
   return ret;
 }
 
@@ -194,8 +185,6 @@ int hmac_drbg_reseed(HMAC_DRBG_STATE *state, const uint8_t *entropy,
                      size_t entropy_len, const uint8_t *additional_input,
                      size_t additional_input_len) {
   int ret = ERR_HMAC_DRBG_SUCCESS;
-  size_t seed_material_len;
-  uint8_t *seed_material, *temp;
 
   if (!HMAC_DRBG_STATE_IS_INIT(state))
     return ERR_HMAC_DRBG_NOT_INIT;
@@ -213,25 +202,14 @@ int hmac_drbg_reseed(HMAC_DRBG_STATE *state, const uint8_t *entropy,
   if (!additional_input && additional_input_len > 0)
     return ERR_HMAC_DRBG_NULL_PTR;
 
-  seed_material_len = entropy_len + additional_input_len;
-  if (!(seed_material = (uint8_t *)malloc(seed_material_len)))
-    return ERR_HMAC_DRBG_MEM_FAIL;
-  temp = seed_material;
-
-  memcpy(temp, entropy, entropy_len);
-  temp += entropy_len;
-  if (additional_input_len)
-    memcpy(temp, additional_input, additional_input_len);
-
+  /* seed_material = entropy || additional_input */
   if (ERR_HMAC_DRBG_SUCCESS !=
-      (ret = hmac_drbg_update(state, seed_material, seed_material_len)))
-    goto cleanup;
+      (ret = hmac_drbg_update(state, entropy, entropy_len, additional_input,
+                              additional_input_len, NULL, 0)))
+    return ret;
 
   state->reseed_counter = 1;
 
-cleanup:
-  zeroize(seed_material, seed_material_len);
-  free(seed_material);
   return ret;
 }
 
@@ -241,8 +219,6 @@ int hmac_drbg_generate(HMAC_DRBG_STATE *state, uint8_t *output,
                        size_t additional_input_len) {
   int ret = ERR_HMAC_DRBG_SUCCESS;
   size_t remaining;
-  uint8_t md_value[EVP_MAX_MD_SIZE];
-  const EVP_MD *md = EVP_sha512();
 
   if (!HMAC_DRBG_STATE_IS_INIT(state))
     return ERR_HMAC_DRBG_NOT_INIT;
@@ -266,18 +242,16 @@ int hmac_drbg_generate(HMAC_DRBG_STATE *state, uint8_t *output,
 
   if (additional_input_len) {
     if (ERR_HMAC_DRBG_SUCCESS !=
-        (ret = hmac_drbg_update(state, additional_input, additional_input_len)))
+        (ret = hmac_drbg_update(state, additional_input, additional_input_len,
+                                NULL, 0, NULL, 0)))
       return ret;
   }
 
   remaining = output_len;
   /* generate (output_len / HMAC_DRBG_SHA512_OUTLEN) blocks */
   while (remaining >= HMAC_DRBG_SHA512_OUTLEN) {
-    if (!HMAC(md, state->K, HMAC_DRBG_SHA512_OUTLEN, state->V,
-              HMAC_DRBG_SHA512_OUTLEN, state->V, NULL)) {
-      ret = ERR_HMAC_DRBG_INTERNAL;
-      goto cleanup;
-    }
+    if (ERR_HMAC_DRBG_SUCCESS != (ret = hmac_drbg_next_v(state)))
+      return ret;
     memcpy(output, state->V, HMAC_DRBG_SHA512_OUTLEN);
     output += HMAC_DRBG_SHA512_OUTLEN;
     remaining -= HMAC_DRBG_SHA512_OUTLEN;
@@ -285,21 +259,17 @@ int hmac_drbg_generate(HMAC_DRBG_STATE *state, uint8_t *output,
 
   /* generate (output_len % HMAC_DRBG_SHA512_OUTLEN) bits */
   if (remaining) {
-    if (!HMAC(md, state->K, HMAC_DRBG_SHA512_OUTLEN, state->V,
-              HMAC_DRBG_SHA512_OUTLEN, state->V, NULL)) {
-      ret = ERR_HMAC_DRBG_INTERNAL;
-      goto cleanup;
-    }
+    if (ERR_HMAC_DRBG_SUCCESS != (ret = hmac_drbg_next_v(state)))
+      return ret;
     memcpy(output, state->V, remaining);
   }
 
   if (ERR_HMAC_DRBG_SUCCESS !=
-      (ret = hmac_drbg_update(state, additional_input, additional_input_len)))
-    goto cleanup;
+      (ret = hmac_drbg_update(state, additional_input, additional_input_len,
+                              NULL, 0, NULL, 0)))
+    return ret;
   state->reseed_counter += 1;
 
-cleanup:
-  zeroize(md_value, EVP_MAX_MD_SIZE);
   return ret;
 }
 
@@ -324,253 +294,82 @@ const char *hmac_drbg_err_string(int err) {
   }
 }
 
-#if defined(XR_TESTS_HMAC_DRBG)
-#include <assert.h>
-#include <ctype.h>
-#include <stdio.h>
-
+void hmac_drbg_set_entropy_cb(HMAC_DRBG_STATE *state,
+                              xr_entropy_cb_t entropy_cb, void *entropy_ctx) {
+  state->entropy_cb = entropy_cb;
+  state->entropy_ctx = entropy_ctx;
+}
 
-static inline void skip_spaces(FILE *f) {
-  int ch;
+/* Generate output_len bytes in SP 800-90A sized requests, reseeding
+   from the registered entropy source when required. */
+int hmac_drbg_generate_bulk(HMAC_DRBG_STATE *state, uint8_t *output,
+                            size_t output_len) {
+  int ret = ERR_HMAC_DRBG_SUCCESS;
+  uint8_t entropy[HMAC_DRBG_MIN_ENTROPY_LEN];
+  size_t chunk;
 
-  while ((ch = fgetc(f)) != EOF && isspace(ch))
-    ;
-  if (ch != EOF)
-    ungetc(ch, f);
-}
+  if (!HMAC_DRBG_STATE_IS_INIT(state))
+    return ERR_HMAC_DRBG_NOT_INIT;
 
-static int read_hex(FILE *f, uint8_t **val, const char *prefix,
-                    const unsigned int len) {
-  unsigned int i, value;
-  char buffer[2048];
+  if (!output && output_len > 0)
+    return ERR_HMAC_DRBG_NULL_PTR;
 
-  skip_spaces(f);
-  fgets(buffer, strlen(prefix) + 1, f);
-  if (strcmp(buffer, prefix)) {
-    printf("Cant read \"%s\"\n", prefix);
-    return 1;
-  }
-  *val = (uint8_t *)malloc(len);
-  if (*val == NULL) {
-    printf("Out of memory\n");
-    exit(1);
-  }
-  for (i = 0; i < len; ++i) {
-    fscanf(f, "%02x", &value);
-    (*val)[i] = (uint8_t)value;
+  while (output_len) {
+    chunk = min(output_len, HMAC_DRBG_MAX_OUTPUT_LEN);
+    ret = hmac_drbg_generate(state, output, chunk, NULL, 0);
+    if (ret == ERR_HMAC_DRBG_DO_RESEED && state->entropy_cb) {
+      if (state->entropy_cb(state->entropy_ctx, entropy, sizeof(entropy))) {
+        ret = ERR_HMAC_DRBG_INTERNAL;
+        break;
+      }
+      if (ERR_HMAC_DRBG_SUCCESS !=
+          (ret = hmac_drbg_reseed(state, entropy, sizeof(entropy), NULL, 0)))
+        break;
+      continue;
+    }
+    if (ret != ERR_HMAC_DRBG_SUCCESS)
+      break;
+    output += chunk;
+    output_len -= chunk;
   }
-  return 0;
-}
 
-static int read_uint(FILE *f, unsigned int *val, const char *format,
-                     const char *name) {
-  skip_spaces(f);
-  if (!fscanf(f, format, val)) {
-    printf("Cant read \"%s\"\n", name);
-    return 1;
-  }
-  return 0;
+  zeroize(entropy, sizeof(entropy));
+  return ret;
 }
 
-static int run_test_vecs(const char *filename) {
-  int rv;
-  FILE *f;
-  bool done;
-  unsigned int i;
-  unsigned int count, passed;
-  unsigned int entropy_input_length;
-  unsigned int nonce_length;
-  unsigned int personalization_string_length;
-  unsigned int additional_input_length;
-  unsigned int returned_bits_length;
-  uint8_t *entropy_input;
-  uint8_t *nonce;
-  uint8_t *personalization_string;
-  uint8_t *additional_input;
-  uint8_t *returned_bits;
-  uint8_t *generate_output;
-  HMAC_DRBG_STATE *state;
-  char buffer[1024];
+#if defined(XR_TESTS_HMAC_DRBG)
+#include "drbg_kat.h"
+#include <stdio.h>
 
-  if (NULL == (state = hmac_drbg_new())) {
-    printf("Out of memory\n");
-    exit(1);
-  }
 
-  if (NULL == (f = fopen(filename, "r"))) {
-    printf("Cant open file %s\n", filename);
+/* Instantiate, reseed and generate twice as the vector says */
+static int hmac_drbg_kat(const drbg_kat *kat, uint8_t *out) {
+  HMAC_DRBG_STATE *state;
+  int i, rv = 1;
+
+  if (NULL == (state = hmac_drbg_new()))
     return 1;
-  }
 
-  // Skip past the [SHA-512] line
-  count = 1;
-  while (!feof(f)) {
-    fgets(buffer, sizeof(buffer), f);
-    if (!strcmp(buffer, "[SHA-512]\n"))
-      break;
+  if (ERR_HMAC_DRBG_SUCCESS ==
+          hmac_drbg_init(state, kat->entropy, kat->entropy_len, kat->nonce,
+                         kat->nonce_len, kat->pers, kat->pers_len) &&
+      ERR_HMAC_DRBG_SUCCESS ==
+          hmac_drbg_reseed(state, kat->entropy_reseed, kat->entropy_len,
+                           kat->add_reseed, kat->add_len)) {
+    for (i = 0, rv = 0; i < 2 && !rv; ++i)
+      rv = (ERR_HMAC_DRBG_SUCCESS !=
+            hmac_drbg_generate(state, out, kat->returned_len, kat->add[i],
+                               kat->add_len));
   }
 
-  done = false;
-  passed = 0;
-  while (!feof(f)) {
-    fgets(buffer, sizeof(buffer), f);
-    if (!strcmp(buffer, "[PredictionResistance = False]")) {
-      printf("Error in parsing; the test vectors must be extracted from "
-             "drbgvectors_pr_false.zip\n");
-      rv = 1;
-      goto clean0;
-    }
-
-    // read length params and convert to bytes
-    if (read_uint(f, &entropy_input_length, "[EntropyInputLen = %u]",
-                  "EntropyInputLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    entropy_input_length >>= 3;
-    if (read_uint(f, &nonce_length, "[NonceLen = %u]", "NonceLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    nonce_length >>= 3;
-    if (read_uint(f, &personalization_string_length,
-                  "[PersonalizationStringLen = %u]",
-                  "PersonalizationStringLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    personalization_string_length >>= 3;
-    if (read_uint(f, &additional_input_length, "[AdditionalInputLen = %u]",
-                  "AdditionalInputLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    additional_input_length >>= 3;
-    if (read_uint(f, &returned_bits_length, "[ReturnedBitsLen = %u]",
-                  "ReturnedBitsLen")) {
-      rv = 1;
-      goto clean0;
-    }
-    returned_bits_length >>= 3;
-
-    while (!feof(f)) {
-      skip_spaces(f);
-      fgets(buffer, sizeof(buffer), f);
-      if (!strcmp(buffer, "[SHA-512]\n")) // next set of tests
-        break;
-      if (!strcmp(buffer, "[SHA-512/224]\n")) { // end of 'SHA-512' based tests
-        done = true;
-        break;
-      }
-
-      // init
-      if (read_hex(f, &entropy_input,
-                   "EntropyInput = ", entropy_input_length)) {
-        rv = 1;
-        goto clean0;
-      }
-      if (read_hex(f, &nonce, "Nonce = ", nonce_length)) {
-        rv = 1;
-        goto clean1;
-      }
-      if (read_hex(f, &personalization_string,
-                   "PersonalizationString = ", personalization_string_length)) {
-        rv = 1;
-        goto clean2;
-      }
-      assert(ERR_HMAC_DRBG_SUCCESS ==
-             hmac_drbg_init(state, entropy_input, entropy_input_length, nonce,
-                            nonce_length, personalization_string,
-                            personalization_string_length));
-
-      free(entropy_input);
-      entropy_input = NULL;
-      // reseed
-      if (read_hex(f, &entropy_input,
-                   "EntropyInputReseed = ", entropy_input_length)) {
-        rv = 1;
-        goto clean3;
-      }
-      if (read_hex(f, &additional_input,
-                   "AdditionalInputReseed = ", additional_input_length)) {
-        rv = 1;
-        goto clean3;
-      }
-      assert(ERR_HMAC_DRBG_SUCCESS ==
-             hmac_drbg_reseed(state, entropy_input, entropy_input_length,
-                              additional_input, additional_input_length));
-
-      // generate
-      if (NULL == (generate_output = (uint8_t *)malloc(returned_bits_length))) {
-        printf("Out of memory\n");
-        exit(1);
-      }
-      for (i = 0; i < 2; ++i) { // generate twice and overwrite the first output
-                                // with the second
-        if (read_hex(f, &additional_input,
-                     "AdditionalInput = ", additional_input_length)) {
-          rv = 1;
-          goto clean4;
-        }
-        if (additional_input_length == 0) {
-          free(additional_input);
-          additional_input = NULL;
-        }
-        assert(ERR_HMAC_DRBG_SUCCESS ==
-               hmac_drbg_generate(state, generate_output, returned_bits_length,
-                                  additional_input, additional_input_length));
-        free(additional_input);
-        additional_input = NULL;
-      }
-
-      // comapre result
-      if (read_hex(f, &returned_bits,
-                   "ReturnedBits = ", returned_bits_length)) {
-        rv = 1;
-        goto clean4;
-      }
-      if (!memcmp(generate_output, returned_bits, returned_bits_length)) {
-        passed++;
-        printf("Test #%-3d \x1B[92mPASS\x1B[0m\n", count);
-      } else {
-        printf("Test #%-3d \x1B[91mFAIL\x1B[0m\n", count);
-      }
-      free(entropy_input);
-      free(nonce);
-      free(personalization_string);
-      free(returned_bits);
-      free(generate_output);
-      count++;
-    }
-    if (done) {
-      count--;
-      printf("Total: %d, Passed: %d, Failed: %d\n", count, passed,
-             count - passed);
-      break;
-    }
-  }
-  rv = 0;
-  goto clean0;
-
-clean4:
-  free(generate_output);
-  free(additional_input);
-clean3:
-  free(personalization_string);
-clean2:
-  free(nonce);
-clean1:
-  free(entropy_input);
-clean0:
   hmac_drbg_clear(state);
-  fclose(f);
   return rv;
 }
 
 int hmac_drbg_run_test(void) {
   // Run 'SHA-512' based tests
   printf("HMAC_DRBG SHA-512 no pr\n");
-  return run_test_vecs("test/HMAC_DRBG.rsp");
+  return drbg_kat_run("test/HMAC_DRBG.rsp", "SHA-512", hmac_drbg_kat);
 }
 
 #endif /* XR_TESTS_HMAC_DRBG */
\ No newline at end of file
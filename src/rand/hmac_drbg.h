@@ -63,8 +63,15 @@ typedef struct _HMAC_DRBG_STATE {
   uint8_t V[HMAC_DRBG_SHA512_OUTLEN];
   /* 64-bit reseed counter */
   uint64_t reseed_counter;
+  /* Entropy source for automatic reseeding (can be Null) */
+  xr_entropy_cb_t entropy_cb;
+  void *entropy_ctx;
   /* Flags (usage specific) */
   uint8_t flags;
+  /* HMAC-SHA512 keyed with K; the inner and outer hash states derived
+     from K are kept in mac_ctx and reused until K changes */
+  struct evp_mac_st *mac;
+  struct evp_mac_ctx_st *mac_ctx;
 } HMAC_DRBG_STATE;
 
 #define ERR_HMAC_DRBG_SUCCESS 0x00 /* Success */
@@ -78,9 +85,11 @@ typedef struct _HMAC_DRBG_STATE {
 /* Return the error message. */
 const char *hmac_drbg_err_string(int err);
 
-/** @brief  Allocate a new @p HMAC_DRBG_STATE state.
+/** @brief  Allocate a new @p HMAC_DRBG_STATE state along with
+ *          its HMAC-SHA512 context.
  *
- *  @return  A pointer to a @p HMAC_DRBG_STATE state.
+ *  @return  A pointer to a @p HMAC_DRBG_STATE state, or Null if
+ *           the allocation or the HMAC fetch failed.
  */
 HMAC_DRBG_STATE *hmac_drbg_new();
 
@@ -146,4 +155,37 @@ int hmac_drbg_generate(HMAC_DRBG_STATE *state, uint8_t *output,
                        size_t output_len, const uint8_t *additional_input,
                        size_t additional_input_len);
 
+/** @brief  Register the entropy source used by @p hmac_drbg_generate_bulk
+ *          to reseed the @p HMAC_DRBG state when the reseed counter runs
+ *          out. Must be called after @p hmac_drbg_init.
+ *
+ *  @param state                    The HMAC_DRBG state.
+ *  @param entropy_cb               The entropy source callback, asked for
+ *                                  HMAC_DRBG_MIN_ENTROPY_LEN bytes at a time
+ *                                  (can be Null).
+ *  @param entropy_ctx              The context passed to @p entropy_cb.
+ *
+ *  @return  Void.
+ */
+void hmac_drbg_set_entropy_cb(HMAC_DRBG_STATE *state,
+                              xr_entropy_cb_t entropy_cb, void *entropy_ctx);
+
+/** @brief  Fill a buffer of any size from a @p HMAC_DRBG state.
+ *
+ *  The output is split into requests of at most HMAC_DRBG_MAX_OUTPUT_LEN
+ *  bytes, reseeding from the registered entropy source whenever the
+ *  reseed counter reaches its limit.
+ *
+ *  @param state                    The HMAC_DRBG state (must be instantiated
+ *                                  once first by calling @p hmac_drbg_init).
+ *  @param output                   The output buffer.
+ *  @param output_len               Then length of @p output in bytes.
+ *
+ *  @return  ERR_HMAC_DRBG_DO_RESEED if a reseed is required and no entropy
+ *           source is registered.
+ *  @return  A ERR_HMAC_DRBG_* value otherwise.
+ */
+int hmac_drbg_generate_bulk(HMAC_DRBG_STATE *state, uint8_t *output,
+                            size_t output_len);
+
 #endif /* HMAC_DRBG_H */
\ No newline at end of file
@@ -18,10 +18,18 @@
 #include "random.h"
 #include "common/defs.h"
 #include "common/exceptions.h"
-#include "common/ieee754_format.h"
 #include "trivium.h"
+#ifdef _WIN32
+#include "rngw32.h"
+#else
+#include "rngposix.h"
+#endif
+#include "xr_rng.h"
+#include "ziggurat.h"
+#include <float.h>
 #include <inttypes.h>
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
 
@@ -34,48 +42,306 @@
 #define _cos(x) cos(x)
 #define _pow(x, y) pow(x, y)
 
-static inline uint64_t ranged(uint64_t a, uint64_t b) {
-  if (a > b) {
-    return -1;
+/* Random words drawn from the PRNG per batch; must be even */
+#define XR_FILL_BATCH 256
+
+/* Use PTRS for Poisson variates with lambda at least this large */
+#define XR_POISSON_PTRS_CUTOFF 10.0
+/* Use BTPE for binomial variates with n * min(p, 1 - p) at least this large */
+#define XR_BINOMIAL_BTPE_CUTOFF 30.0
+
+/* Fill buf with n random 64-bit words */
+static inline void rand_words(u64 *buf, size_t n) {
+  TriviumFill((u8 *)buf, n * sizeof(u64));
+}
+
+/* Map a random word to a double in [0.0, 1.0) */
+static inline double unit(u64 w) { return (double)(w >> 11) * 0x1.0p-53; }
+
+/* Map a random word to a float in [0.0, 1.0) */
+static inline float unitf(u64 w) { return (float)(w >> 40) * 0x1.0p-24f; }
+
+/* Get a random double in [0.0, 1.0) for the rejection samplers */
+static inline double runit(void) { return unit(TriviumRand64()); }
+
+/* Full 128-bit product of a and b; returns the high half */
+static inline u64 mul64(u64 a, u64 b, u64 *lo) {
+#if defined(__SIZEOF_INT128__)
+  __extension__ unsigned __int128 m = (unsigned __int128)a * b;
+
+  *lo = (u64)m;
+  return (u64)(m >> 64);
+#else
+  u64 a0 = a & 0xffffffff, a1 = a >> 32, b0 = b & 0xffffffff, b1 = b >> 32;
+  u64 p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+  u64 mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+
+  *lo = (mid << 32) | (p00 & 0xffffffff);
+  return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+/**
+ * Lemire's nearly divisionless method; map the random word x to
+ * [0, s) using the high half of x * s, rejecting the (less than
+ * s out of 2^64) values of the low half that would bias the result.
+ * The threshold 2^64 mod s costs a division and is only needed when
+ * the low half is < s, which is rare unless s is huge.
+ */
+static inline u64 range_u64(u64 x, u64 s) {
+  u64 hi, lo, t;
+
+  hi = mul64(x, s, &lo);
+  if (lo < s) {
+    t = (0 - s) % s;
+    while (lo < t)
+      hi = mul64(TriviumRand64(), s, &lo);
+  }
+
+  return hi;
+}
+
+static inline u32 range_u32(u32 x, u32 s) {
+  u64 m = (u64)x * s;
+  u32 t;
+
+  if ((u32)m < s) {
+    t = (0 - s) % s;
+    while ((u32)m < t)
+      m = (u64)TriviumRand32() * s;
+  }
+
+  return (u32)(m >> 32);
+}
+
+/**
+ * Bounded integers
+ * Get random integers uniformly distributed over the range [a, b]
+ * (a and b are swapped if a > b) without modulo bias
+ *
+ * Daniel Lemire. 2019. Fast Random Integer Generation in an Interval.
+ * ACM Trans. Model. Comput. Simul. 29, 1, Article 3 (January 2019).
+ * https://doi.org/10.1145/3230636
+ */
+uint64_t xr_rand_range_u64(uint64_t a, uint64_t b) {
+  u64 t;
+
+  if (a > b)
+    t = a, a = b, b = t;
+
+  /* The full 64-bit range */
+  if (b - a == UINT64_MAX)
+    return TriviumRand64();
+
+  return a + range_u64(TriviumRand64(), b - a + 1);
+}
+
+uint32_t xr_rand_range_u32(uint32_t a, uint32_t b) {
+  u32 t;
+
+  if (a > b)
+    t = a, a = b, b = t;
+
+  if (b - a == UINT32_MAX)
+    return TriviumRand32();
+
+  return a + range_u32(TriviumRand32(), b - a + 1);
+}
+
+status_t xr_rand_range_u64_fill(uint64_t *out, size_t n, uint64_t a,
+                                uint64_t b) {
+  u64 t, s;
+  size_t m;
+
+  if (out == NULL && n) {
+    Warn("xr_rand_range_u64_fill : invalid arguments (expected out != NULL)",
+         WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  if (a > b)
+    t = a, a = b, b = t;
+
+  s = b - a + 1;
+
+  for (; n; n -= m, out += m) {
+    m = (n < XR_FILL_BATCH) ? n : XR_FILL_BATCH;
+    TriviumFill((u8 *)out, m * sizeof(uint64_t));
+
+    /* s == 0 is the full 64-bit range */
+    if (s == 0)
+      continue;
+
+    for (size_t i = 0; i < m; ++i)
+      out[i] = a + range_u64(out[i], s);
   }
 
-  return a + TriviumRand64() % ((b - a) + 1);
+  return SUCCESS;
 }
 
-static inline double uni(void) {
-  ieee754_double_t temp;
+status_t xr_rand_range_u32_fill(uint32_t *out, size_t n, uint32_t a,
+                                uint32_t b) {
+  u32 t, s;
+  size_t m;
 
-  /* Request 64-bit random value from the PRNG */
-  u64 rand = TriviumRand64();
+  if (out == NULL && n) {
+    Warn("xr_rand_range_u32_fill : invalid arguments (expected out != NULL)",
+         WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  if (a > b)
+    t = a, a = b, b = t;
+
+  s = b - a + 1;
+
+  for (; n; n -= m, out += m) {
+    m = (n < 2 * XR_FILL_BATCH) ? n : 2 * XR_FILL_BATCH;
+    TriviumFill((u8 *)out, m * sizeof(uint32_t));
+
+    if (s == 0)
+      continue;
 
-  /**
-   * Construct a 64-bit positive floating point number in [0.0, 1.0)
-   * by distributing the random bits over the 52-bit mantissa.
-   */
-  temp.fmt.sign = 0;
-  temp.fmt.exponent = IEEE754_DOUBLE_PREC_BIAS; /* Exponent bias */
-  temp.fmt.mantissa0 = ((rand & 0xFFF) << 8) | (rand >> 56);
-  temp.fmt.mantissa1 = ((rand >> 12) & 0xFFFFFFFF) ^ ((rand >> 44) & 0xFF);
+    for (size_t i = 0; i < m; ++i)
+      out[i] = a + range_u32(out[i], s);
+  }
 
-  return temp.d - 1.0;
+  return SUCCESS;
+}
+
+/**
+ * Ziggurat sampler for the standard normal distribution, starting
+ * with the random word w; bits 0-6 select the layer, bit 7 is the
+ * sign and bits 11-63 the position within the layer.
+ *
+ * About 99% of the samples are accepted on the first comparison,
+ * the rest (wedges and the tail) draw more words from the PRNG.
+ */
+static inline double zig_normal(u64 w) {
+  double x, a, b;
+  int i;
+
+  for (;;) {
+    i = (int)(w & (ZIG_NORM_LAYERS - 1));
+    x = unit(w) * zig_x_norm[i];
+
+    /* Inside the rectangle of the layer below */
+    if (x < zig_x_norm[i + 1])
+      break;
+
+    /* The base layer; sample from the tail beyond R */
+    if (i == 0) {
+      do {
+        a = -_log(1.0 - unit(TriviumRand64())) / ZIG_NORM_R;
+        b = -_log(1.0 - unit(TriviumRand64()));
+      } while (b + b < a * a);
+      x = ZIG_NORM_R + a;
+      break;
+    }
+
+    /* In the wedge; accept if under the curve */
+    if (zig_f_norm[i] +
+            unit(TriviumRand64()) * (zig_f_norm[i + 1] - zig_f_norm[i]) <
+        _exp(-0.5 * x * x))
+      break;
+
+    w = TriviumRand64();
+  }
+
+  return (w & 0x80) ? -x : x;
+}
+
+/**
+ * Ziggurat sampler for the standard exponential distribution,
+ * starting with the random word w; bits 0-7 select the layer and
+ * bits 11-63 the position within the layer.
+ */
+static inline double zig_exponential(u64 w) {
+  double x;
+  int i;
+
+  for (;;) {
+    i = (int)(w & (ZIG_EXP_LAYERS - 1));
+    x = unit(w) * zig_x_exp[i];
+
+    if (x < zig_x_exp[i + 1])
+      return x;
+
+    /* The tail is memoryless, so it is just R + Exp(1) */
+    if (i == 0)
+      return ZIG_EXP_R - _log(1.0 - unit(TriviumRand64()));
+
+    if (zig_f_exp[i] +
+            unit(TriviumRand64()) * (zig_f_exp[i + 1] - zig_f_exp[i]) <
+        _exp(-x))
+      return x;
+
+    w = TriviumRand64();
+  }
 }
 
 /**
  * Uniform distribution
- * Get random numbers uniformly distributed over the range [a, b]
+ * Get random numbers uniformly distributed over the range [a, b)
  */
+status_t xr_uniform_fill(double *out, size_t n, double a, double b) {
+  u64 buf[XR_FILL_BATCH];
+  const double scale = b - a;
+  size_t m;
+
+  if (out == NULL && n) {
+    Warn("xr_uniform_fill : invalid arguments (expected out != NULL)",
+         WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  for (; n; n -= m, out += m) {
+    m = (n < XR_FILL_BATCH) ? n : XR_FILL_BATCH;
+    rand_words(buf, m);
+
+    for (size_t i = 0; i < m; ++i)
+      out[i] = a + scale * unit(buf[i]);
+  }
+
+  return SUCCESS;
+}
+
+status_t xr_uniform_fillf(float *out, size_t n, float a, float b) {
+  u64 buf[XR_FILL_BATCH];
+  const float scale = b - a;
+  size_t m;
+
+  if (out == NULL && n) {
+    Warn("xr_uniform_fillf : invalid arguments (expected out != NULL)",
+         WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  for (; n; n -= m, out += m) {
+    m = (n < XR_FILL_BATCH) ? n : XR_FILL_BATCH;
+    rand_words(buf, m);
+
+    for (size_t i = 0; i < m; ++i)
+      out[i] = a + scale * unitf(buf[i]);
+  }
+
+  return SUCCESS;
+}
+
 void uniform(FILE *fp, double a, double b, int iter) {
+  double x[XR_FILL_BATCH];
+  int m;
+
   if (fp == NULL) {
     fp = stdout;
   }
 
-  double temp, x;
-
-  for (int i = 0; i < iter; ++i) {
-    temp = uni();
-    x = a + (b - a) * temp;
+  for (; iter > 0; iter -= m) {
+    m = (iter < XR_FILL_BATCH) ? iter : XR_FILL_BATCH;
+    xr_uniform_fill(x, m, a, b);
 
-    fprintf(fp, "%.lf\n", x);
+    for (int i = 0; i < m; ++i)
+      fprintf(fp, "%.lf\n", x[i]);
   }
 }
 
@@ -89,46 +355,194 @@ void uniform(FILE *fp, double a, double b, int iter) {
  * (by George Edward Pelham Box and Mervin Edgar Muller)
  *
  * If u1 and u2 are two independent random variables chosen from
- * the uniform unit interval [0, 1), then
+ * the uniform unit interval (0, 1], then
  *
- * x = sqrt(2 * ln(u1)) * cos(2 * pi * u2)
- * y = sqrt(2 * ln(u1)) * sin(2 * pi * u2)
+ * x = sqrt(-2 * ln(u1)) * cos(2 * pi * u2)
+ * y = sqrt(-2 * ln(u1)) * sin(2 * pi * u2)
  *
  * are two independent random variables from the standard normal
  * distribution (mu = 0, sigma = 1)
  *
  * (source: https://en.wikipedia.org/wiki/Box%E2%80%93Muller_transform)
+ *
+ * Alternatively (and by default) uses the Ziggurat method by George
+ * Marsaglia and Wai Wan Tsang, which needs about one random word and
+ * one table lookup per variate; see ziggurat.h.
  */
-void normal(FILE *fp, double mu, double sigma, int iter) {
-  if (sigma < 0) {
-    Warn("normal : invalid arguments (expected sigma >= 0)", WARN_INVALID_ARGS);
-    return;
+static void normal_fill_box_muller(double *out, size_t n, double mu,
+                                   double sigma) {
+  u64 buf[XR_FILL_BATCH];
+  double r, theta;
+  size_t m, i;
+
+  for (; n; n -= m, out += m) {
+    m = (n < XR_FILL_BATCH) ? n : XR_FILL_BATCH;
+    /* Each pair of variates takes two words */
+    rand_words(buf, (m + 1) & ~(size_t)1);
+
+    for (i = 0; i < m; i += 2) {
+      r = _sqrt(-2 * _log(1.0 - unit(buf[i]))) * sigma;
+      theta = 2 * _PI * unit(buf[i + 1]);
+
+      out[i] = r * _cos(theta) + mu;
+      if (i + 1 < m)
+        out[i + 1] = r * _sin(theta) + mu;
+    }
+  }
+}
+
+static void normal_fill_ziggurat(double *out, size_t n, double mu,
+                                 double sigma) {
+  u64 buf[XR_FILL_BATCH];
+  size_t m;
+
+  for (; n; n -= m, out += m) {
+    m = (n < XR_FILL_BATCH) ? n : XR_FILL_BATCH;
+    rand_words(buf, m);
+
+    for (size_t i = 0; i < m; ++i)
+      out[i] = zig_normal(buf[i]) * sigma + mu;
+  }
+}
+
+status_t xr_normal_fill_ex(double *out, size_t n, double mu, double sigma,
+                           xr_normal_method_t method) {
+  if (sigma < 0 || (out == NULL && n)) {
+    Warn("xr_normal_fill : invalid arguments (expected sigma >= 0)",
+         WARN_INVALID_ARGS);
+    return FAILURE;
   }
 
+  if (method == XR_NORMAL_BOX_MULLER)
+    normal_fill_box_muller(out, n, mu, sigma);
+  else
+    normal_fill_ziggurat(out, n, mu, sigma);
+
+  return SUCCESS;
+}
+
+status_t xr_normal_fill(double *out, size_t n, double mu, double sigma) {
+  return xr_normal_fill_ex(out, n, mu, sigma, XR_NORMAL_ZIGGURAT);
+}
+
+static void normal_fillf_box_muller(float *out, size_t n, float mu,
+                                    float sigma) {
+  u64 buf[XR_FILL_BATCH];
+  float r, theta;
+  size_t m, i;
+
+  for (; n; n -= m, out += m) {
+    m = (n < XR_FILL_BATCH) ? n : XR_FILL_BATCH;
+    rand_words(buf, (m + 1) & ~(size_t)1);
+
+    for (i = 0; i < m; i += 2) {
+      r = sqrtf(-2 * logf(1.0f - unitf(buf[i]))) * sigma;
+      theta = 2 * (float)_PI * unitf(buf[i + 1]);
+
+      out[i] = r * cosf(theta) + mu;
+      if (i + 1 < m)
+        out[i + 1] = r * sinf(theta) + mu;
+    }
+  }
+}
+
+static void normal_fillf_ziggurat(float *out, size_t n, float mu,
+                                  float sigma) {
+  u64 buf[XR_FILL_BATCH];
+  size_t m;
+
+  for (; n; n -= m, out += m) {
+    m = (n < XR_FILL_BATCH) ? n : XR_FILL_BATCH;
+    rand_words(buf, m);
+
+    for (size_t i = 0; i < m; ++i)
+      out[i] = (float)zig_normal(buf[i]) * sigma + mu;
+  }
+}
+
+status_t xr_normal_fillf_ex(float *out, size_t n, float mu, float sigma,
+                            xr_normal_method_t method) {
+  if (sigma < 0 || (out == NULL && n)) {
+    Warn("xr_normal_fillf : invalid arguments (expected sigma >= 0)",
+         WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  if (method == XR_NORMAL_BOX_MULLER)
+    normal_fillf_box_muller(out, n, mu, sigma);
+  else
+    normal_fillf_ziggurat(out, n, mu, sigma);
+
+  return SUCCESS;
+}
+
+status_t xr_normal_fillf(float *out, size_t n, float mu, float sigma) {
+  return xr_normal_fillf_ex(out, n, mu, sigma, XR_NORMAL_ZIGGURAT);
+}
+
+void normal(FILE *fp, double mu, double sigma, int iter) {
+  double x[XR_FILL_BATCH];
+  int m;
+
   if (fp == NULL) {
     fp = stdout;
   }
 
-  double u1, u2, x, y;
-  double *next = NULL;
+  for (; iter > 0; iter -= m) {
+    m = (iter < XR_FILL_BATCH) ? iter : XR_FILL_BATCH;
+    if (xr_normal_fill(x, m, mu, sigma) != SUCCESS)
+      return;
 
-  for (int i = 0; i < iter; ++i) {
-    /* Generate two uniform variates uniformly distributed over [0.0, 1.0) */
-    u1 = uni();
-    u2 = uni();
-    /* Generate independent normal variates x and y from N(mu, sigma) */
-    x = (_sqrt(-2 * _log(u1)) * _cos(2 * _PI * u2)) * sigma + mu;
-    y = (_sqrt(-2 * _log(u1)) * _sin(2 * _PI * u2)) * sigma + mu;
-
-    if (next == NULL) {
-      next = &y;
-    } else {
-      fprintf(fp, "%lf\n", y);
-      next = NULL;
-      continue;
-    }
+    for (int i = 0; i < m; ++i)
+      fprintf(fp, "%lf\n", x[i]);
+  }
+}
+
+/**
+ * Exponential distribution
+ *
+ * Get random numbers from the distribution of the time between events
+ * in a Poisson process with rate lambda (mean 1 / lambda)
+ *
+ * Uses the Ziggurat method (see ziggurat.h)
+ */
+status_t xr_exponential_fill(double *out, size_t n, double lambda) {
+  u64 buf[XR_FILL_BATCH];
+  const double scale = 1.0 / lambda;
+  size_t m;
+
+  if (!(lambda > 0) || (out == NULL && n)) {
+    Warn("xr_exponential_fill : invalid arguments (expected lambda > 0)",
+         WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  for (; n; n -= m, out += m) {
+    m = (n < XR_FILL_BATCH) ? n : XR_FILL_BATCH;
+    rand_words(buf, m);
+
+    for (size_t i = 0; i < m; ++i)
+      out[i] = zig_exponential(buf[i]) * scale;
+  }
 
-    fprintf(fp, "%lf\n", x);
+  return SUCCESS;
+}
+
+void exponential(FILE *fp, double lambda, int iter) {
+  double x[XR_FILL_BATCH];
+  int m;
+
+  if (fp == NULL) {
+    fp = stdout;
+  }
+
+  for (; iter > 0; iter -= m) {
+    m = (iter < XR_FILL_BATCH) ? iter : XR_FILL_BATCH;
+    if (xr_exponential_fill(x, m, lambda) != SUCCESS)
+      return;
+
+    for (int i = 0; i < m; ++i)
+      fprintf(fp, "%lf\n", x[i]);
   }
 }
 
@@ -149,40 +563,50 @@ void normal(FILE *fp, double mu, double sigma, int iter) {
  *
  * (source: https://en.wikipedia.org/wiki/Triangular_distribution)
  */
-void triangular(FILE *fp, double a, double b, double c, int iter) {
-  if (!(a < b && a <= c && c <= b)) {
-    Warn("triangular : invalid arguments (expected a < b, a <= c <= b)",
-         WARN_INVALID_ARGS);
+status_t xr_triangular_fill(double *out, size_t n, double a, double b,
+                            double c) {
+  u64 buf[XR_FILL_BATCH];
+  double U, F, lo, hi;
+  size_t m;
 
-    return;
+  if (!(a < b && a <= c && c <= b) || (out == NULL && n)) {
+    Warn("xr_triangular_fill : invalid arguments (expected a < b, a <= c <= b)",
+         WARN_INVALID_ARGS);
+    return FAILURE;
   }
 
-  if (fp == NULL) {
-    fp = stdout;
-  }
+  F = (c - a) / (b - a);
+  lo = (b - a) * (c - a);
+  hi = (b - a) * (b - c);
 
-  double U, F, X;
+  for (; n; n -= m, out += m) {
+    m = (n < XR_FILL_BATCH) ? n : XR_FILL_BATCH;
+    rand_words(buf, m);
 
-  if (b - a) {
-    F = (c - a) / (b - a);
+    for (size_t i = 0; i < m; ++i) {
+      U = unit(buf[i]);
+      out[i] = (U < F) ? a + _sqrt(U * lo) : b - _sqrt((1.0 - U) * hi);
+    }
+  }
 
-    for (int i = 0; i < iter; ++i) {
-      U = uni();
+  return SUCCESS;
+}
 
-      if (U < F) {
-        X = a + _sqrt(U * (b - a) * (c - a));
-      } else {
-        X = b - _sqrt((1.0 - U) * (b - a) * (b - c));
-      }
+void triangular(FILE *fp, double a, double b, double c, int iter) {
+  double x[XR_FILL_BATCH];
+  int m;
 
-      fprintf(fp, "%lf\n", X);
-    }
-  } else {
-    X = a;
+  if (fp == NULL) {
+    fp = stdout;
+  }
 
-    for (int i = 0; i < iter; ++i) {
-      fprintf(fp, "%lf\n", X);
-    }
+  for (; iter > 0; iter -= m) {
+    m = (iter < XR_FILL_BATCH) ? iter : XR_FILL_BATCH;
+    if (xr_triangular_fill(x, m, a, b, c) != SUCCESS)
+      return;
+
+    for (int i = 0; i < m; ++i)
+      fprintf(fp, "%lf\n", x[i]);
   }
 }
 
@@ -196,38 +620,114 @@ void triangular(FILE *fp, double a, double b, double c, int iter) {
  *
  * (source: https://en.wikipedia.org/wiki/Poisson_distribution)
  *
- * Uses the method proposed by C. D. Kemp and Adrienne W. Kemp
+ * For small lambda uses sequential search (inversion) as described by
+ * C. D. Kemp and Adrienne W. Kemp
  * Kemp, C. D., & Kemp, A. W. (1991). Poisson Random Variate Generation.
  * Journal of the Royal Statistical Society. Series C (Applied Statistics),
  * 40(1), 143–158. https://doi.org/10.2307/2347913
+ *
+ * For lambda >= XR_POISSON_PTRS_CUTOFF uses the transformed rejection
+ * method with squeeze (PTRS) by Wolfgang Hörmann, which takes constant
+ * expected time
+ * W. Hörmann. 1993. The transformed rejection method for generating
+ * Poisson random variables. Insurance: Mathematics and Economics 12(1),
+ * 39–45. https://doi.org/10.1016/0167-6687(93)90997-4
  */
-void poisson(FILE *fp, double lambda, int iter) {
-  if (lambda < 0) {
-    Warn("poisson : invalid arguments (expected lambda > 0)",
+typedef struct {
+  double lambda, loglam, a, b, invalpha, vr;
+} ptrs_params_t;
+
+static void ptrs_setup(ptrs_params_t *pp, double lambda) {
+  const double slam = _sqrt(lambda);
+
+  pp->lambda = lambda;
+  pp->loglam = _log(lambda);
+  pp->b = 0.931 + 2.53 * slam;
+  pp->a = -0.059 + 0.02483 * pp->b;
+  pp->invalpha = 1.1239 + 1.1328 / (pp->b - 3.4);
+  pp->vr = 0.9277 - 3.6224 / (pp->b - 2);
+}
+
+static int64_t poisson_ptrs(const ptrs_params_t *pp) {
+  double U, V, us, k;
+
+  for (;;) {
+    U = runit() - 0.5;
+    V = runit();
+    us = 0.5 - fabs(U);
+    k = floor((2 * pp->a / us + pp->b) * U + pp->lambda + 0.43);
+
+    /* Squeeze */
+    if (us >= 0.07 && V <= pp->vr)
+      return (int64_t)k;
+
+    if (k < 0 || (us < 0.013 && V > us))
+      continue;
+
+    if (_log(V) + _log(pp->invalpha) - _log(pp->a / (us * us) + pp->b) <=
+        -pp->lambda + k * pp->loglam - lgamma(k + 1))
+      return (int64_t)k;
+  }
+}
+
+status_t xr_poisson_fill(int64_t *out, size_t n, double lambda) {
+  u64 buf[XR_FILL_BATCH];
+  const double p0 = _exp(-lambda);
+  ptrs_params_t pp;
+  double u, p, F;
+  int64_t x;
+  size_t m;
+
+  if (lambda < 0 || (out == NULL && n)) {
+    Warn("xr_poisson_fill : invalid arguments (expected lambda > 0)",
          WARN_INVALID_ARGS);
-    return;
+    return FAILURE;
   }
 
-  if (fp == NULL) {
-    fp = stdout;
+  if (lambda >= XR_POISSON_PTRS_CUTOFF) {
+    ptrs_setup(&pp, lambda);
+    for (size_t i = 0; i < n; ++i)
+      out[i] = poisson_ptrs(&pp);
+    return SUCCESS;
   }
 
-  double u, F;
-  double p = _exp(-lambda);
-  int x;
+  for (; n; n -= m, out += m) {
+    m = (n < XR_FILL_BATCH) ? n : XR_FILL_BATCH;
+    rand_words(buf, m);
 
-  for (int i = 0; i < iter; ++i) {
-    F = p;
-    u = uni();
-    x = 0;
-
-    while (u > F) {
-      x = x + 1;
-      p = (lambda * p) / x;
-      F = F + p;
+    for (size_t i = 0; i < m; ++i) {
+      u = unit(buf[i]);
+      p = F = p0;
+      x = 0;
+
+      while (u > F) {
+        x = x + 1;
+        p = (lambda * p) / x;
+        F = F + p;
+      }
+
+      out[i] = x;
     }
+  }
+
+  return SUCCESS;
+}
+
+void poisson(FILE *fp, double lambda, int iter) {
+  int64_t x[XR_FILL_BATCH];
+  int m;
+
+  if (fp == NULL) {
+    fp = stdout;
+  }
 
-    fprintf(fp, "%d\n", x);
+  for (; iter > 0; iter -= m) {
+    m = (iter < XR_FILL_BATCH) ? iter : XR_FILL_BATCH;
+    if (xr_poisson_fill(x, m, lambda) != SUCCESS)
+      return;
+
+    for (int i = 0; i < m; ++i)
+      fprintf(fp, "%" PRId64 "\n", x[i]);
   }
 }
 
@@ -240,46 +740,448 @@ void poisson(FILE *fp, double lambda, int iter) {
  * success (with probability p) or failure (with probability q=1-p)
  * (source: https://en.wikipedia.org/wiki/Binomial_distribution)
  *
- * Uses the method proposed by Voratas Kachitvichyanukul and Bruce W. Schmeiser
+ * Uses the methods proposed by Voratas Kachitvichyanukul and Bruce W.
+ * Schmeiser; inversion for n * min(p, 1 - p) < XR_BINOMIAL_BTPE_CUTOFF and
+ * the BTPE (triangle, parallelogram, exponential) rejection method, which
+ * takes constant expected time, otherwise
  * Voratas Kachitvichyanukul and Bruce W. Schmeiser. 1988. Binomial random
  * variate generation. Commun. ACM 31, 2 (Feb. 1988), 216–222.
  * https://doi.org/10.1145/42372.42381
  */
-void binomial(FILE *fp, int n, double p, int iter) {
-  if (!(n > 0 && 0 <= p && p <= 1)) {
-    Warn("binomial : invalid arguments (expected n > 0, 0 <= p <= 1)",
-         WARN_INVALID_ARGS);
-    return;
+typedef struct {
+  int n;
+  double r, q, nrq, fm, m, p1, xm, xl, xr, c, laml, lamr, p2, p3, p4;
+} btpe_params_t;
+
+/* Set up BTPE for n trials with success probability r <= 0.5 */
+static void btpe_setup(btpe_params_t *bp, int n, double r) {
+  double a;
+
+  bp->n = n;
+  bp->r = r;
+  bp->q = 1 - r;
+  bp->nrq = n * r * bp->q;
+  bp->fm = n * r + r;
+  bp->m = floor(bp->fm);
+  bp->p1 = floor(2.195 * _sqrt(bp->nrq) - 4.6 * bp->q) + 0.5;
+  bp->xm = bp->m + 0.5;
+  bp->xl = bp->xm - bp->p1;
+  bp->xr = bp->xm + bp->p1;
+  bp->c = 0.134 + 20.5 / (15.3 + bp->m);
+  a = (bp->fm - bp->xl) / (bp->fm - bp->xl * r);
+  bp->laml = a * (1 + a / 2);
+  a = (bp->xr - bp->fm) / (bp->xr * bp->q);
+  bp->lamr = a * (1 + a / 2);
+  bp->p2 = bp->p1 * (1 + 2 * bp->c);
+  bp->p3 = bp->p2 + bp->c / bp->laml;
+  bp->p4 = bp->p3 + bp->c / bp->lamr;
+}
+
+/* Stirling's series remainder term for the final acceptance test */
+#define BTPE_STIRLING(x, x2)                                                   \
+  ((13680. - (462. - (132. - (99. - 140. / (x2)) / (x2)) / (x2)) / (x2)) /     \
+   (x) / 166320.)
+
+static int64_t binomial_btpe(const btpe_params_t *bp) {
+  const int n = bp->n;
+  double u, v, x, y, k, A, F, s, a, rho, t;
+  double x1, f1, z, w, x2, f2, z2, w2;
+
+  for (;;) {
+    u = runit() * bp->p4;
+    v = runit();
+
+    if (u <= bp->p1) {
+      /* Triangular region; always accepted */
+      return (int64_t)floor(bp->xm - bp->p1 * v + u);
+    } else if (u <= bp->p2) {
+      /* Parallelogram region */
+      x = bp->xl + (u - bp->p1) / bp->c;
+      v = v * bp->c + 1 - fabs(bp->m - x + 0.5) / bp->p1;
+      if (v > 1)
+        continue;
+      y = floor(x);
+    } else if (u <= bp->p3) {
+      /* Left exponential tail */
+      y = floor(bp->xl + _log(v) / bp->laml);
+      if (y < 0 || v == 0.0)
+        continue;
+      v = v * (u - bp->p2) * bp->laml;
+    } else {
+      /* Right exponential tail */
+      y = floor(bp->xr - _log(v) / bp->lamr);
+      if (y > n || v == 0.0)
+        continue;
+      v = v * (u - bp->p3) * bp->lamr;
+    }
+
+    k = fabs(y - bp->m);
+
+    if (k <= 20 || k >= bp->nrq / 2 - 1) {
+      /* Explicit evaluation of f(y) / f(m) */
+      s = bp->r / bp->q;
+      a = s * (n + 1);
+      F = 1.0;
+      if (bp->m < y) {
+        for (double i = bp->m + 1; i <= y; ++i)
+          F *= (a / i - s);
+      } else if (bp->m > y) {
+        for (double i = y + 1; i <= bp->m; ++i)
+          F /= (a / i - s);
+      }
+      if (v > F)
+        continue;
+      return (int64_t)y;
+    }
+
+    /* Squeeze using upper and lower bounds on log(f(y)) */
+    rho = (k / bp->nrq) *
+          ((k * (k / 3.0 + 0.625) + 0.16666666666666666) / bp->nrq + 0.5);
+    t = -k * k / (2 * bp->nrq);
+    A = _log(v);
+    if (A < t - rho)
+      return (int64_t)y;
+    if (A > t + rho)
+      continue;
+
+    /* Final acceptance test with Stirling's formula */
+    x1 = y + 1;
+    f1 = bp->m + 1;
+    z = n + 1 - bp->m;
+    w = n - y + 1;
+    x2 = x1 * x1;
+    f2 = f1 * f1;
+    z2 = z * z;
+    w2 = w * w;
+    if (A <= bp->xm * _log(f1 / x1) + (n - bp->m + 0.5) * _log(z / w) +
+                 (y - bp->m) * _log(w * bp->r / (x1 * bp->q)) +
+                 BTPE_STIRLING(f1, f2) + BTPE_STIRLING(z, z2) +
+                 BTPE_STIRLING(x1, x2) + BTPE_STIRLING(w, w2))
+      return (int64_t)y;
   }
+}
 
-  if (fp == NULL) {
-    fp = stdout;
+status_t xr_binomial_fill(int64_t *out, size_t n, int trials, double p) {
+  u64 buf[XR_FILL_BATCH];
+  double u, r, s, a, r0, pr;
+  btpe_params_t bp;
+  int64_t x;
+  int flip;
+  size_t m;
+
+  if (!(trials > 0 && 0 <= p && p <= 1) || (out == NULL && n)) {
+    Warn("xr_binomial_fill : invalid arguments (expected n > 0, 0 <= p <= 1)",
+         WARN_INVALID_ARGS);
+    return FAILURE;
   }
 
   if (p == 1) {
-    for (int i = 0; i < iter; ++i) {
-      fprintf(fp, "%d\n", n);
+    for (size_t i = 0; i < n; ++i)
+      out[i] = trials;
+    return SUCCESS;
+  }
+
+  /* Sample with min(p, 1 - p) and reflect if needed */
+  flip = p > 0.5;
+  pr = flip ? 1 - p : p;
+
+  if (trials * pr >= XR_BINOMIAL_BTPE_CUTOFF) {
+    btpe_setup(&bp, trials, pr);
+    for (size_t i = 0; i < n; ++i) {
+      x = binomial_btpe(&bp);
+      out[i] = flip ? trials - x : x;
     }
-  } else {
-    double u, a, r;
-    double s = p / (1 - p);
-    int x;
-
-    for (int i = 0; i < iter; ++i) {
-      a = (n + 1) * s;
-      r = _pow((1 - p), n);
-      u = uni();
+    return SUCCESS;
+  }
+
+  s = pr / (1 - pr);
+  a = (trials + 1) * s;
+  r0 = _pow((1 - pr), trials);
+
+  for (; n; n -= m, out += m) {
+    m = (n < XR_FILL_BATCH) ? n : XR_FILL_BATCH;
+    rand_words(buf, m);
+
+    for (size_t i = 0; i < m; ++i) {
+      u = unit(buf[i]);
+      r = r0;
       x = 0;
 
-      while (u > r) {
+      while (u > r && x < trials) {
         u = u - r;
         x = x + 1;
         r = ((a / x) - s) * r;
       }
 
-      fprintf(fp, "%d\n", x);
+      out[i] = flip ? trials - x : x;
     }
   }
+
+  return SUCCESS;
+}
+
+void binomial(FILE *fp, int n, double p, int iter) {
+  int64_t x[XR_FILL_BATCH];
+  int m;
+
+  if (fp == NULL) {
+    fp = stdout;
+  }
+
+  for (; iter > 0; iter -= m) {
+    m = (iter < XR_FILL_BATCH) ? iter : XR_FILL_BATCH;
+    if (xr_binomial_fill(x, m, n, p) != SUCCESS)
+      return;
+
+    for (int i = 0; i < m; ++i)
+      fprintf(fp, "%" PRId64 "\n", x[i]);
+  }
+}
+
+/**
+ * Discrete distributions
+ *
+ * Walker's alias method: the k outcomes are laid out as k columns of
+ * height 1/k; column i keeps outcome i with probability prob[i] and
+ * hands the rest to alias[i]. Vose's algorithm fills the columns by
+ * pairing an outcome with scaled weight k * p < 1 with one >= 1.
+ *
+ * A variate costs one random word: the high half of w * k picks the
+ * column (without bias, as in range_u64), and the low half, uniform
+ * in steps of k / 2^64, is compared against prob[column].
+ *
+ * Michael D. Vose. 1991. A Linear Algorithm for Generating Random
+ * Numbers with a Given Distribution. IEEE Trans. Softw. Eng. 17, 9.
+ */
+xr_discrete_table *xr_discrete_table_new(const double *weights, size_t k) {
+  xr_discrete_table *t;
+  double sum = 0, *p;
+  size_t *work, ns = 0, nl, s, l;
+
+  if (weights == NULL || k == 0 || k > UINT32_MAX) {
+    Warn("xr_discrete_table_new : invalid arguments (expected 1 to 2^32 - 1 "
+         "weights)",
+         WARN_INVALID_ARGS);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < k; ++i) {
+    if (!(weights[i] >= 0 && weights[i] <= DBL_MAX)) {
+      Warn("xr_discrete_table_new : invalid arguments (expected finite "
+           "weights >= 0)",
+           WARN_INVALID_ARGS);
+      return NULL;
+    }
+    sum += weights[i];
+  }
+
+  if (!(sum > 0 && sum <= DBL_MAX)) {
+    Warn("xr_discrete_table_new : invalid arguments (expected a finite "
+         "positive sum of weights)",
+         WARN_INVALID_ARGS);
+    return NULL;
+  }
+
+  /* The table and its columns in one block */
+  t = (xr_discrete_table *)malloc(sizeof(xr_discrete_table) +
+                                  k * (sizeof(u64) + sizeof(u32)));
+  p = (double *)malloc(k * sizeof(double));
+  work = (size_t *)malloc(k * sizeof(size_t));
+  if (t == NULL || p == NULL || work == NULL) {
+    Log(ERR_NO_MEMORY, false, -1, __LINE__);
+    free(t);
+    free(p);
+    free(work);
+    return NULL;
+  }
+
+  t->k = (u32)k;
+  t->thresh = (0 - (u64)k) % k;
+  t->prob = (u64 *)(t + 1);
+  t->alias = (u32 *)(t->prob + k);
+
+  /* The small outcomes are stacked from the bottom of work, the large
+     ones from the top */
+  nl = k;
+  for (size_t i = 0; i < k; ++i) {
+    p[i] = weights[i] / sum * (double)k;
+    if (p[i] < 1)
+      work[ns++] = i;
+    else
+      work[--nl] = i;
+  }
+
+  while (ns && nl < k) {
+    s = work[--ns];
+    l = work[nl++];
+    /* p[s] can fall just below 0 by rounding */
+    t->prob[s] = p[s] > 0 ? (u64)ldexp(p[s], 64) : 0;
+    t->alias[s] = (u32)l;
+    p[l] = (p[l] + p[s]) - 1;
+    if (p[l] < 1)
+      work[ns++] = l;
+    else
+      work[--nl] = l;
+  }
+
+  /* Full columns, and the ones left over by rounding errors */
+  while (ns)
+    s = work[--ns], t->prob[s] = UINT64_MAX, t->alias[s] = (u32)s;
+  while (nl < k)
+    l = work[nl++], t->prob[l] = UINT64_MAX, t->alias[l] = (u32)l;
+
+  free(p);
+  free(work);
+  return t;
+}
+
+void xr_discrete_table_free(xr_discrete_table *table) { free(table); }
+
+/* A word for the rare rejections of the column choice */
+static inline status_t discrete_word(struct xr_rng *rng, u64 *w) {
+  if (rng == NULL) {
+    *w = TriviumRand64();
+    return SUCCESS;
+  }
+  return xr_rng_generate(rng, (u8 *)w, sizeof(*w));
+}
+
+static inline status_t discrete_pick(const xr_discrete_table *t, u64 w,
+                                     struct xr_rng *rng, u32 *out) {
+  u64 hi, lo;
+
+  hi = mul64(w, t->k, &lo);
+  if (lo < t->k) {
+    while (lo < t->thresh) {
+      if (discrete_word(rng, &w) != SUCCESS)
+        return FAILURE;
+      hi = mul64(w, t->k, &lo);
+    }
+  }
+
+  *out = lo < t->prob[hi] ? (u32)hi : t->alias[hi];
+  return SUCCESS;
+}
+
+static status_t discrete_fill(const xr_discrete_table *t, uint32_t *out,
+                              size_t n, struct xr_rng *rng) {
+  u64 buf[XR_FILL_BATCH];
+  size_t m;
+
+  if (t == NULL || (out == NULL && n)) {
+    Warn("xr_discrete_fill : invalid arguments (expected non-NULL values)",
+         WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  for (; n; n -= m, out += m) {
+    m = (n < XR_FILL_BATCH) ? n : XR_FILL_BATCH;
+    if (rng == NULL)
+      rand_words(buf, m);
+    else if (xr_rng_generate(rng, (u8 *)buf, m * sizeof(u64)) != SUCCESS)
+      return FAILURE;
+
+    for (size_t i = 0; i < m; ++i) {
+      if (discrete_pick(t, buf[i], rng, &out[i]) != SUCCESS)
+        return FAILURE;
+    }
+  }
+
+  return SUCCESS;
+}
+
+status_t xr_discrete_fill(const xr_discrete_table *table, uint32_t *out,
+                          size_t n) {
+  return discrete_fill(table, out, n, NULL);
+}
+
+status_t xr_discrete_fill_rng(const xr_discrete_table *table, uint32_t *out,
+                              size_t n, struct xr_rng *rng) {
+  if (rng == NULL) {
+    Warn("xr_discrete_fill_rng : invalid arguments (expected rng != NULL)",
+         WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  return discrete_fill(table, out, n, rng);
+}
+
+/* Random bytes drawn from the RNG per block in xr_randstr_fill() */
+#define XR_RANDSTR_BLOCK 64
+
+/**
+ * Random strings over an arbitrary alphabet
+ *
+ * The alphabet is copied to a lookup table of k (<= 256) symbols and
+ * each random byte (or nibble, if k <= 16) is masked to the nearest
+ * power of two >= k; values >= k are rejected so that the result is
+ * unbiased. There is no rejection at all when k is a power of two
+ * (e.g. hex and base64url), so every byte maps to one symbol.
+ *
+ * The strings are meant for secrets (API tokens, password reset
+ * codes), so the random bytes are drawn in blocks from the DRBGs of
+ * the RNG with RngFetchBytes(), not from the Trivium stream used by
+ * the samplers, and zeroized after use. The RNG must be started.
+ *
+ * Writes len characters and a terminating NUL to out.
+ */
+status_t xr_randstr_fill(char *out, size_t len, const char *alphabet) {
+  u8 table[256], buf[XR_RANDSTR_BLOCK];
+  size_t k, i = 0, j, n;
+  unsigned int mask, c;
+
+  if (out == NULL || alphabet == NULL || (k = strlen(alphabet)) == 0 ||
+      k > 256) {
+    Warn("xr_randstr_fill : invalid arguments (expected 1 to 256 symbols)",
+         WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  if (!DidRngStart()) {
+    Warn("xr_randstr_fill : the RNG is not started", WARN_UNSAFE);
+    return FAILURE;
+  }
+
+  memcpy(table, alphabet, k);
+  for (mask = 1; mask < k; mask <<= 1)
+    ;
+  mask -= 1;
+
+  while (i < len) {
+    if (!RngFetchBytes(buf, sizeof(buf))) {
+      zeroize((u8 *)out, len);
+      zeroize(buf, sizeof(buf));
+      return FAILURE;
+    }
+
+    if (mask <= 0xf) {
+      /* Two symbols per byte */
+      for (j = 0; j < sizeof(buf) && i < len; ++j) {
+        if ((c = buf[j] & mask) < k)
+          out[i++] = (char)table[c];
+        if ((c = (buf[j] >> 4) & mask) < k && i < len)
+          out[i++] = (char)table[c];
+      }
+    } else if (mask + 1 == k) {
+      /* A straight table lookup per byte */
+      n = (len - i < sizeof(buf)) ? len - i : sizeof(buf);
+      for (j = 0; j < n; ++j)
+        out[i + j] = (char)table[buf[j] & mask];
+      i += n;
+    } else {
+      for (j = 0; j < sizeof(buf) && i < len; ++j) {
+        if ((c = buf[j] & mask) < k)
+          out[i++] = (char)table[c];
+      }
+    }
+  }
+
+  out[len] = '\0';
+
+  /* Prevent leaks */
+  zeroize(buf, sizeof(buf));
+
+  return SUCCESS;
 }
 
 /**
@@ -294,7 +1196,7 @@ void binomial(FILE *fp, int n, double p, int iter) {
  * sc - special characters
  */
 void randstr(FILE *fp, char lc, char uc, char nc, char sc, int len, int iter) {
-  if (len > 1000) {
+  if (len < 0 || len > 1000) {
     Warn("randstr : invalid arguments (expected len <= 1000)",
          WARN_INVALID_ARGS);
     return;
@@ -310,7 +1212,8 @@ void randstr(FILE *fp, char lc, char uc, char nc, char sc, int len, int iter) {
     return;
   }
 
-  char charset[92];
+  char charset[92] = "";
+  char str[1001];
 
   if (lc)
     strcat(charset, "abcdefghijklmnopqrstuvwxyz");
@@ -322,9 +1225,74 @@ void randstr(FILE *fp, char lc, char uc, char nc, char sc, int len, int iter) {
     strcat(charset, "!@#$%^&*()_+-=[]{}|;:,.<>?\\");
 
   for (int i = 0; i < iter; ++i) {
-    for (int ch = 0; ch < len; ++ch) {
-      fprintf(fp, "%c", charset[TriviumRand8() % strlen(charset)]);
+    if (xr_randstr_fill(str, len, charset) != SUCCESS)
+      break;
+    fprintf(fp, "%s\n", str);
+  }
+
+  zeroize((u8 *)str, sizeof(str));
+}
+
+#if defined(XR_TESTS_RANDOM)
+
+#define XR_RANDSTR_TEST_LEN (1 << 20)
+
+/* Every character must come from the alphabet, and every symbol must
+   come up within six standard deviations of its expected count */
+static int randstr_test_alphabet(const char *name, const char *alphabet) {
+  static char str[XR_RANDSTR_TEST_LEN + 1];
+  size_t counts[256] = {0}, k = strlen(alphabet);
+  double e = (double)XR_RANDSTR_TEST_LEN / k, sd = sqrt(e * (1.0 - 1.0 / k));
+  const char *p;
+  int fails = 0;
+
+  if (xr_randstr_fill(str, XR_RANDSTR_TEST_LEN, alphabet) != SUCCESS ||
+      str[XR_RANDSTR_TEST_LEN] != '\0') {
+    printf("Randstr %s FAIL\n", name);
+    return 1;
+  }
+
+  for (size_t i = 0; i < XR_RANDSTR_TEST_LEN; i++) {
+    if ((p = memchr(alphabet, str[i], k)) == NULL) {
+      fails++;
+      break;
     }
-    fprintf(fp, "\n");
+    counts[p - alphabet]++;
+  }
+
+  for (size_t i = 0; i < k && !fails; i++) {
+    if (fabs((double)counts[i] - e) > 6.0 * sd)
+      fails++;
   }
-}
\ No newline at end of file
+
+  printf("Randstr %s %s\n", name, fails ? "FAIL" : "PASS");
+  return fails;
+}
+
+int random_run_test(void) {
+  bool bStarted = !DidRngStart();
+  int fails = 0;
+
+  printf("Running tests for rand/random.c\n");
+
+  if (bStarted && !RngStart()) {
+    printf("Start FAIL\n");
+    return 1;
+  }
+
+  /* Powers of two (no rejection), per nibble and per byte */
+  fails += randstr_test_alphabet("hex", XR_ALPHABET_HEX);
+  fails += randstr_test_alphabet("base64url", XR_ALPHABET_BASE64URL);
+  /* Rejection, per nibble and per byte */
+  fails += randstr_test_alphabet("decimal", "0123456789");
+  fails += randstr_test_alphabet(
+      "alphanumeric",
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789");
+
+  if (bStarted)
+    RngStop();
+
+  return fails;
+}
+
+#endif /* XR_TESTS_RANDOM */
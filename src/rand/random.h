@@ -27,10 +27,86 @@
 
 #pragma once
 
+#include "common/defs.h"
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
+/*
+ * The xr_*_fill functions write n variates to the out buffer;
+ * they return FAILURE (with a warning) on invalid arguments and
+ * SUCCESS otherwise. The FILE based functions print iter variates
+ * (one per line) to fp, or stdout if fp is NULL.
+ */
+
+/* Algorithms for sampling the normal distribution */
+typedef enum {
+  XR_NORMAL_ZIGGURAT = 0, /* Default */
+  XR_NORMAL_BOX_MULLER
+} xr_normal_method_t;
+
+/* Alphabets for xr_randstr_fill() */
+#define XR_ALPHABET_HEX "0123456789abcdef"
+#define XR_ALPHABET_BASE64URL                                                  \
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
+
+/* Uniform integers in [a, b] (a and b are swapped if a > b) */
+uint64_t xr_rand_range_u64(uint64_t a, uint64_t b);
+uint32_t xr_rand_range_u32(uint32_t a, uint32_t b);
+status_t xr_rand_range_u64_fill(uint64_t *out, size_t n, uint64_t a,
+                                uint64_t b);
+status_t xr_rand_range_u32_fill(uint32_t *out, size_t n, uint32_t a,
+                                uint32_t b);
+
+status_t xr_uniform_fill(double *out, size_t n, double a, double b);
+status_t xr_uniform_fillf(float *out, size_t n, float a, float b);
+status_t xr_normal_fill(double *out, size_t n, double mu, double sigma);
+status_t xr_normal_fillf(float *out, size_t n, float mu, float sigma);
+status_t xr_normal_fill_ex(double *out, size_t n, double mu, double sigma,
+                           xr_normal_method_t method);
+status_t xr_normal_fillf_ex(float *out, size_t n, float mu, float sigma,
+                            xr_normal_method_t method);
+status_t xr_exponential_fill(double *out, size_t n, double lambda);
+status_t xr_triangular_fill(double *out, size_t n, double a, double b,
+                            double c);
+status_t xr_poisson_fill(int64_t *out, size_t n, double lambda);
+status_t xr_binomial_fill(int64_t *out, size_t n, int trials, double p);
+
+/**
+ * A discrete distribution over the outcomes 0 .. k - 1 with the given
+ * (relative) weights, sampled in O(1) time per variate with Walker's
+ * alias method; built once in O(k) time with Vose's algorithm.
+ */
+typedef struct xr_discrete_table {
+  uint32_t k;
+  uint64_t thresh;  /* 2^64 mod k, for the unbiased column choice */
+  uint64_t *prob;   /* Probability (scaled to 2^64) of keeping a column */
+  uint32_t *alias;  /* The outcome that takes the rest of the column */
+} xr_discrete_table;
+
+/* Build a table from k (1 to 2^32 - 1) finite, non-negative weights
+   with a positive sum; returns NULL (with a warning) on invalid
+   weights or if out of memory */
+xr_discrete_table *xr_discrete_table_new(const double *weights, size_t k);
+void xr_discrete_table_free(xr_discrete_table *table);
+
+struct xr_rng; /* See xr_rng.h */
+
+/* Write n outcomes of the distribution to out, drawing from Trivium
+   (xr_discrete_fill) or from a generator (xr_discrete_fill_rng) */
+status_t xr_discrete_fill(const xr_discrete_table *table, uint32_t *out,
+                          size_t n);
+status_t xr_discrete_fill_rng(const xr_discrete_table *table, uint32_t *out,
+                              size_t n, struct xr_rng *rng);
+
+/* Write len random characters from alphabet (1 to 256 symbols) and a
+   terminating NUL to out, which must hold len + 1 bytes; the bytes come
+   from RngFetchBytes(), so the RNG must be started */
+status_t xr_randstr_fill(char *out, size_t len, const char *alphabet);
+
 void uniform(FILE *fp, double a, double b, int iter);
 void normal(FILE *fp, double mu, double sigma, int iter);
+void exponential(FILE *fp, double lambda, int iter);
 void triangular(FILE *fp, double a, double b, double c, int iter);
 void poisson(FILE *fp, double lambda, int iter);
 void binomial(FILE *fp, int n, double p, int iter);
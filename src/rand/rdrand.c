@@ -28,14 +28,22 @@
 #include "rdrand.h"
 #include "common/defs.h"
 
+#include <string.h>
+
 #if defined(__x86_64__) || defined(_M_X64) || defined(_M_IX86) ||              \
     defined(__i386)
 #if defined(_MSC_VER)
 // Visual Studio
 #include <intrin.h> // __cpuid, __cpuidex
+#include <immintrin.h> // _rdrand*_step, _rdseed*_step
+#define RDRAND_TARGET
+#define RDSEED_TARGET
 #elif defined(__GNUC__)
 // GCC / LLVM (Clang)
 #include <cpuid.h> // __get_cpuid, __get_cpuid_count
+#include <immintrin.h> // _rdrand*_step, _rdseed*_step
+#define RDRAND_TARGET __attribute__((target("rdrnd")))
+#define RDSEED_TARGET __attribute__((target("rdseed")))
 #endif
 #endif
 
@@ -238,3 +246,130 @@ int rdseed64_step(unsigned long long int *therand) {
   *therand = val;
   return cf_error_status;
 }
+
+/* Underflow totals; only updated when an underflow occurs */
+static uint64_t nRdrandUnderflows = 0;
+static uint64_t nRdseedUnderflows = 0;
+
+uint64_t rdrand_underflows(void) {
+  return __atomic_load_n(&nRdrandUnderflows, __ATOMIC_RELAXED);
+}
+
+uint64_t rdseed_underflows(void) {
+  return __atomic_load_n(&nRdseedUnderflows, __ATOMIC_RELAXED);
+}
+
+#if defined(RDRAND_TARGET)
+
+/* Fill one machine word at a time; the intrinsics return the carry
+   flag directly, so there is no flag juggling as in the asm above */
+#if defined(__x86_64__) || defined(_M_X64)
+typedef unsigned long long rd_word_t;
+#define rdrand_word_step _rdrand64_step
+#define rdseed_word_step _rdseed64_step
+#else
+typedef unsigned int rd_word_t;
+#define rdrand_word_step _rdrand32_step
+#define rdseed_word_step _rdseed32_step
+#endif
+
+static inline RDRAND_TARGET int rdrand_word(rd_word_t *w) {
+  for (int i = 0; i < RDRAND_RETRY_LIMIT; i++) {
+    if (rdrand_word_step(w)) {
+      if (i)
+        __atomic_fetch_add(&nRdrandUnderflows, i, __ATOMIC_RELAXED);
+      return 1;
+    }
+  }
+  __atomic_fetch_add(&nRdrandUnderflows, RDRAND_RETRY_LIMIT, __ATOMIC_RELAXED);
+  return 0;
+}
+
+static inline RDSEED_TARGET int rdseed_word(rd_word_t *w,
+                                            unsigned int *budget) {
+  unsigned int backoff = 1;
+
+  while (!rdseed_word_step(w)) {
+    if (*budget == 0)
+      return 0;
+    --*budget;
+    for (unsigned int i = 0; i < backoff; i++)
+      _mm_pause();
+    if (backoff < RDSEED_MAX_BACKOFF)
+      backoff <<= 1;
+  }
+  return 1;
+}
+
+RDRAND_TARGET size_t rdrand_fill(uint8_t *buf, size_t len) {
+  rd_word_t w[4];
+  size_t n = 0;
+
+  /* Four words per iteration */
+  for (; len - n >= sizeof(w); n += sizeof(w)) {
+    if (!rdrand_word(&w[0]) || !rdrand_word(&w[1]) || !rdrand_word(&w[2]) ||
+        !rdrand_word(&w[3]))
+      goto out;
+    memcpy(buf + n, w, sizeof(w));
+  }
+
+  while (n < len) {
+    size_t chunk = min(len - n, sizeof(w[0]));
+    if (!rdrand_word(&w[0]))
+      goto out;
+    memcpy(buf + n, w, chunk);
+    n += chunk;
+  }
+
+out:
+  zeroize((uint8_t *)w, sizeof(w));
+  return n;
+}
+
+RDSEED_TARGET size_t rdseed_fill(uint8_t *buf, size_t len) {
+  rd_word_t w[4];
+  unsigned int budget = RDSEED_RETRY_BUDGET;
+  size_t n = 0;
+
+  /* Four words per iteration */
+  for (; len - n >= sizeof(w); n += sizeof(w)) {
+    if (!rdseed_word(&w[0], &budget) || !rdseed_word(&w[1], &budget) ||
+        !rdseed_word(&w[2], &budget) || !rdseed_word(&w[3], &budget))
+      goto out;
+    memcpy(buf + n, w, sizeof(w));
+  }
+
+  while (n < len) {
+    size_t chunk = min(len - n, sizeof(w[0]));
+    if (!rdseed_word(&w[0], &budget))
+      goto out;
+    memcpy(buf + n, w, chunk);
+    n += chunk;
+  }
+
+out:
+  /* Every retry spends one unit of the budget, and the final
+     failure (if any) one more */
+  if (budget != RDSEED_RETRY_BUDGET || n < len)
+    __atomic_fetch_add(&nRdseedUnderflows,
+                       RDSEED_RETRY_BUDGET - budget + (n < len),
+                       __ATOMIC_RELAXED);
+  zeroize((uint8_t *)w, sizeof(w));
+  return n;
+}
+
+#else /* unknown compiler architecture */
+
+size_t rdrand_fill(uint8_t *buf, size_t len) {
+  (void)buf;
+  (void)len;
+  return 0;
+}
+
+size_t rdseed_fill(uint8_t *buf, size_t len) {
+  (void)buf;
+  (void)len;
+  return 0;
+}
+
+#endif
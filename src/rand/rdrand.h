@@ -31,6 +31,46 @@ int check_rdseed();
 int rdrand_check_support();
 int rdseed_check_support();
 
+#include <stddef.h>
+#include <stdint.h>
+
+/* Consecutive RDRAND underflows after which the DRNG is deemed
+   to have failed (as recommended by the Intel DRNG guide) */
+#define RDRAND_RETRY_LIMIT 10
+
+/* Total RDSEED underflows tolerated in one call to rdseed_fill();
+   RDSEED underflows whenever the conditioner has no fresh seed
+   ready, so each retry first backs off with PAUSE */
+#define RDSEED_RETRY_BUDGET 4096
+
+/* Maximum PAUSEs between two RDSEED retries (power of 2) */
+#define RDSEED_MAX_BACKOFF 64
+
+/**
+ * Fill buf with len random bytes from RDRAND, written directly into
+ * the buffer one machine word at a time.
+ *
+ * Returns the number of bytes written, which is less than len only
+ * if RDRAND underflowed RDRAND_RETRY_LIMIT times in a row.
+ */
+size_t rdrand_fill(uint8_t *buf, size_t len);
+
+/**
+ * Fill buf with len random bytes from RDSEED, written directly into
+ * the buffer one machine word at a time.
+ *
+ * Returns the number of bytes written, which is less than len only
+ * if more than RDSEED_RETRY_BUDGET underflows occurred.
+ */
+size_t rdseed_fill(uint8_t *buf, size_t len);
+
+/**
+ * Get the total number of underflows (failed attempts, including
+ * the retried ones) seen by rdrand_fill() and rdseed_fill() so far.
+ */
+uint64_t rdrand_underflows(void);
+uint64_t rdseed_underflows(void);
+
 /**
  * Get 16-bit random number with RDRAND
  * and write the value to *therand.
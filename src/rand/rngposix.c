@@ -0,0 +1,1904 @@
+/**
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* pthread_setaffinity_np(), CPU_SET() and getrandom() */
+#define _GNU_SOURCE
+
+#include "rngposix.h"
+#include "common/secure_alloc.h"
+#include "chacha_drbg.h"
+#include "crypto/sha512.h"
+#include "ctr_drbg.h"
+#include "jitterentropy/jitterentropy.h"
+#include "rdrand.h"
+#include "rngseed.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__) || defined(__FreeBSD__)
+#define RNG_HAVE_GETRANDOM
+#include <sys/random.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/sysinfo.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386)
+#include <x86intrin.h> /* __rdtsc */
+#endif
+
+/* The randomness pool */
+static uint8_t *pRandPool = NULL;
+static unsigned int nCurrentPoolWritePos = 0;
+static unsigned int nCurrentPoolReadPos = 0;
+/* Bytes added to the pool since it was last mixed */
+static unsigned int nPoolBytesSinceMix = 0;
+
+/* The fast and slow poll threads, both woken up early by RandCleanStop()
+   through threadCond; bFirstSlowPollDone is set once the first slow
+   poll has been attempted */
+static pthread_t fastPollThread;
+static pthread_t slowPollThread;
+static bool bFastPollThreadStarted = false;
+static bool bSlowPollThreadStarted = false;
+static pthread_mutex_t threadMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t threadCond = PTHREAD_COND_INITIALIZER;
+static bool bTerminatePollThreads = false;
+static bool bFirstSlowPollDone = false;
+/* With RNG_START_FAST, set until the first request has been served */
+static volatile bool bFastStartPending = false;
+
+/* A Jitter RNG collector and the processor it is pinned to */
+typedef struct _JENT_JOB {
+  struct rand_data *collector;
+  int cpu; /* -1 if not pinned */
+  void (*fn)(struct _JENT_JOB *job); /* Run by RandJentRunJobs() */
+  ssize_t ret;
+  uint8_t bytes[RNG_JENT_COLLECTOR_BYTES];
+} JENT_JOB;
+
+/* The Jitter RNG collectors used by the slow polls, allocated once
+   (after the startup health tests) by RandJentInit() */
+static JENT_JOB jentJobs[RNG_JENT_MAX_COLLECTORS];
+static unsigned int nJentCollectors = 0;
+/* 1 once RandJentInit() has succeeded, -1 if it failed */
+static int nJentInitState = 0;
+
+/* RNG_START_FAST: the DRBG was seeded by RandPoolInitEx() from the
+   initial seed, without waiting for the first slow poll */
+static bool bFastStart = false;
+/* The seed file, if any (owned copy of the path) */
+static char *pSeedFilePath = NULL;
+
+/* The central DRBG seeded from the pool which seeds the per-thread DRBGs */
+static CTR_DRBG_STATE *pRandDrbg = NULL;
+static volatile bool bDidSeedDrbg = false;
+
+/* Incremented every time the central DRBG is (re)seeded from the pool */
+static volatile long nRandDrbgGeneration = 0;
+
+/* Per-thread DRBG, kept in thread-specific storage so that it is
+   cleared and freed when the thread exits; all of them are also
+   linked together so that RandCleanStop() can free them */
+typedef struct _RAND_THREAD_DRBG {
+  union {
+    CTR_DRBG_STATE drbg;
+    CHACHA_DRBG_STATE chacha; /* If bThreadDrbgChaCha */
+  };
+  long generation; /* Central generation last seeded from; 0 if unseeded */
+  RAND_THREAD_STATS stats;
+  struct _RAND_THREAD_DRBG *prev, *next;
+} RAND_THREAD_DRBG;
+
+static pthread_key_t randThreadKey;
+static bool bDidCreateThreadKey = false;
+static RAND_THREAD_DRBG *pThreadDrbgList = NULL;
+static unsigned int nThreadDrbgs = 0;
+/* Counters of the per-thread DRBGs that have been freed */
+static RAND_THREAD_STATS threadStatsRetired;
+/* Protects pThreadDrbgList; never destroyed since threads may exit
+   at any time */
+static pthread_mutex_t threadDrbgListMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Use the ChaCha20 generator instead of the CTR_DRBG for the
+   per-thread DRBGs; set when the host has no AES hardware */
+static bool bThreadDrbgChaCha = false;
+
+static void RandThreadDrbgFree(void *pData);
+
+/* A slot of the prefetch ring; seq tells whether the slot holds
+   fresh output (pos + 1) or is free to be filled (pos) */
+typedef struct _RAND_RING_SLOT {
+  volatile uint32_t seq;
+  uint8_t data[RNG_RING_SLOT_SIZE];
+} ALIGN(64) RAND_RING_SLOT;
+
+/* The prefetch ring, filled by a single producer thread and
+   drained by any number of consumers */
+static RAND_RING_SLOT *pRandRing = NULL;
+static volatile uint32_t nRingHead = 0; /* Next slot to fill */
+static volatile uint32_t nRingTail = 0; /* Next slot to pop */
+static unsigned int nRingWatermark = 0;
+static unsigned int nRingBatch = 0;
+static pthread_t ringFillThread;
+static bool bRingFillThreadStarted = false;
+static pthread_mutex_t ringMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ringCond = PTHREAD_COND_INITIALIZER;
+static bool bRingFillPending = false;
+static volatile bool bRingEnabled = false;
+static volatile bool bTerminateRingFillThread = false;
+
+static void RandRingStop(void);
+
+bool bStrictChecksEnabled = false;
+
+/* Internal control and status variables */
+static bool bDidRandPoolInit = false;
+static volatile bool bDidSlowPoll = false;
+
+/* Global status variables for RDRAND and RDSEED */
+bool HasRdrand = false;
+bool HasRdseed = false;
+
+/* The pool lock */
+static pthread_mutex_t randMutex;
+/* The lock for the DRBG; if both are held, drbgMutex must be
+   locked first */
+static pthread_mutex_t drbgMutex;
+/* Serializes slow polls; must be locked before randMutex
+   if both are held */
+static pthread_mutex_t slowPollMutex;
+
+/* The fork handlers are registered once per process */
+static bool bDidRegisterAtfork = false;
+
+/* Start time of the current pool lock hold (protected by the lock) */
+static uint64_t nPoolLockStart = 0;
+
+/* Lock the pool, counting the acquisitions that have to wait */
+static void RandLockPool(void) {
+  if (pthread_mutex_trylock(&randMutex) != 0) {
+    uint64_t start = RandStatsStart();
+
+    RNG_STAT_INC(randStats.pool_lock_contended);
+    pthread_mutex_lock(&randMutex);
+    RandStatsRecord(&randStats.pool_lock_wait, start);
+  }
+  RNG_STAT_INC(randStats.pool_lock_acquires);
+  nPoolLockStart = RandStatsStart();
+}
+
+static void RandUnlockPool(void) {
+  RandStatsRecord(&randStats.pool_lock_hold, nPoolLockStart);
+  pthread_mutex_unlock(&randMutex);
+}
+
+/* 64 byte buffer */
+typedef struct _BUF_ST {
+  size_t size;
+  union {
+    uint8_t bytes[64];
+    uint32_t words[64 / 4];
+  };
+} BUF, *PBUF;
+
+/* Add a single byte to the pool, mixing the pool once a full
+   block of input has been absorbed */
+#define AddByte(x)                                                             \
+  do {                                                                         \
+    if (nCurrentPoolWritePos == RNG_POOL_SIZE)                                 \
+      nCurrentPoolWritePos = 0;                                                \
+    pRandPool[nCurrentPoolWritePos++] ^= (uint8_t)x;                           \
+    if (++nPoolBytesSinceMix == RNG_POOL_MIX_INTERVAL)                         \
+      RandPoolMix();                                                           \
+  } while (0)
+
+/* Add a pointer (or a pointer-sized handle) to the pool */
+#define AddPtr(x) Add64((uint64_t)(uintptr_t)(x))
+
+/* Adding multiple bytes to the pool */
+
+static void Add32(uint32_t x) {
+  AddByte(x);
+  AddByte((x >> 8));
+  AddByte((x >> 16));
+  AddByte((x >> 24));
+}
+
+static void Add64(uint64_t x) {
+  AddByte(x);
+  AddByte((x >> 8));
+  AddByte((x >> 16));
+  AddByte((x >> 24));
+  AddByte((x >> 32));
+  AddByte((x >> 40));
+  AddByte((x >> 48));
+  AddByte((x >> 56));
+}
+
+/* Add a buffer to the pool; the bytes up to the next mix (or the end
+   of the pool) are XORed in as one run */
+static void AddBuf(const uint8_t *buf, size_t size) {
+  size_t i, n;
+
+  while (size) {
+    if (nCurrentPoolWritePos == RNG_POOL_SIZE)
+      nCurrentPoolWritePos = 0;
+    n = min(size, (size_t)(RNG_POOL_MIX_INTERVAL - nPoolBytesSinceMix));
+    n = min(n, (size_t)(RNG_POOL_SIZE - nCurrentPoolWritePos));
+    for (i = 0; i < n; ++i)
+      pRandPool[nCurrentPoolWritePos + i] ^= buf[i];
+    nCurrentPoolWritePos += (unsigned int)n;
+    nPoolBytesSinceMix += (unsigned int)n;
+    buf += n;
+    size -= n;
+    if (nPoolBytesSinceMix == RNG_POOL_MIX_INTERVAL)
+      RandPoolMix();
+  }
+}
+
+/* Add a buffer to the pool while holding the pool lock */
+static void AddBufLocked(const uint8_t *buf, size_t size) {
+  RandLockPool();
+  AddBuf(buf, size);
+  RandUnlockPool();
+}
+
+/* Add the current value of a clock to the pool, if it is supported */
+static void AddClock(clockid_t clk) {
+  struct timespec ts;
+
+  if (clock_gettime(clk, &ts) == 0) {
+    Add64((uint64_t)ts.tv_sec);
+    Add32((uint32_t)ts.tv_nsec);
+  }
+}
+
+/**
+ * Read len bytes from the kernel CSPRNG. With nonBlocking set, fail
+ * with EAGAIN instead of waiting if the kernel pool is not yet
+ * initialized (early boot).
+ *
+ * Returns true on success, false otherwise (with errno set).
+ */
+static bool RandOsBytes(uint8_t *buf, size_t len, bool nonBlocking) {
+#if defined(RNG_HAVE_GETRANDOM)
+  ssize_t ret;
+
+  while (len) {
+    ret = getrandom(buf, len, nonBlocking ? GRND_NONBLOCK : 0);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    buf += ret;
+    len -= (size_t)ret;
+  }
+  return true;
+#else
+  /* getentropy() serves at most 256 bytes per call and never fails
+     once the kernel pool is initialized */
+  (void)nonBlocking;
+  while (len) {
+    size_t n = min(len, (size_t)256);
+    if (getentropy(buf, n) != 0)
+      return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+#endif
+}
+
+/* Get the absolute CLOCK_REALTIME time ms milliseconds from now */
+static void RandDeadline(struct timespec *ts, long ms) {
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_sec += ms / 1000;
+  ts->tv_nsec += (ms % 1000) * 1000000L;
+  if (ts->tv_nsec >= 1000000000L) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000L;
+  }
+}
+
+/**
+ * Wait for up to ms milliseconds, or until the poll threads are told
+ * to terminate.
+ *
+ * Returns true if the threads are to terminate, false otherwise.
+ */
+static bool RandPollThreadSleep(long ms) {
+  struct timespec deadline;
+  bool terminate;
+
+  RandDeadline(&deadline, ms);
+
+  pthread_mutex_lock(&threadMutex);
+  while (!bTerminatePollThreads &&
+         pthread_cond_timedwait(&threadCond, &threadMutex, &deadline) !=
+             ETIMEDOUT)
+    ;
+  terminate = bTerminatePollThreads;
+  pthread_mutex_unlock(&threadMutex);
+
+  return terminate;
+}
+
+/* Whether RandCleanStop() has told the poll threads to terminate */
+static bool RandPollThreadsStopping(void) {
+  return __atomic_load_n(&bTerminatePollThreads, __ATOMIC_ACQUIRE);
+}
+
+/* Allocate size zeroed bytes on the local NUMA node, between guard
+   pages and locked to physical memory, so that they are never written
+   to swap */
+static void *RandSecureAlloc(size_t size) {
+  void *p;
+
+  if ((p = xr_secure_alloc(size, XR_NUMA_NODE_LOCAL,
+                           XR_SECURE_LOCK | XR_SECURE_GUARD)) == NULL)
+    Log(ERR_RAND_INIT, false, errno, __LINE__);
+
+  return p;
+}
+
+static bool RandReseedDrbg(int forceSlowPoll);
+static bool RandJentInit(void);
+static int RandDrbgCentralCallback(void *ctx, uint8_t *buf, size_t len);
+static void *FastPollThreadProc(void *_dummy);
+static void *SlowPollThreadProc(void *_dummy);
+static void RandAtforkPrepare(void);
+static void RandAtforkParent(void);
+static void RandAtforkChild(void);
+
+/**
+ * Add the initial seed to the pool: RNG_SEED_LEN bytes from the kernel
+ * CSPRNG (waiting for it to be initialized if need be), the seed from
+ * the seed file if there is a valid one, and a fast poll.
+ *
+ * Returns true if the kernel CSPRNG delivered its bytes, so that the
+ * seed does not depend on the seed file.
+ */
+static bool RandInitialSeed(void) {
+  uint8_t seed[RNG_SEED_LEN];
+  bool bOsSeed;
+
+  if (!(bOsSeed = RandOsBytes(seed, sizeof(seed), false)))
+    Log(ERR_GETRANDOM, false, errno, __LINE__);
+
+  RandLockPool();
+  if (bOsSeed)
+    AddBuf(seed, sizeof(seed));
+  if (pSeedFilePath && RandSeedFileRead(pSeedFilePath, seed))
+    AddBuf(seed, sizeof(seed));
+  if (!RandFastPoll())
+    bOsSeed = false;
+  RandUnlockPool();
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+
+  return bOsSeed;
+}
+
+/* Replace the seed file with fresh output of the central DRBG */
+static void RandSeedFileUpdate(void) {
+  uint8_t seed[RNG_SEED_LEN];
+
+  if (RandDrbgCentralCallback(NULL, seed, sizeof(seed)) == 0)
+    RandSeedFileWrite(pSeedFilePath, seed);
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+}
+
+/**
+ * Initialize the Random Number Generator. Mount the pool onto
+ * memory, run the Jitter RNG startup tests and start the fast
+ * and slow poll threads; see RngStartEx() for the flags and the
+ * seed file.
+ *
+ * Allocate RNG_POOL_SIZE bytes of memory for the randomness pool
+ * and lock the region to physical memory to prevent the pool from
+ * being paged to the disk.
+ */
+bool RandPoolInitEx(unsigned int flags, const char *seedFile) {
+  if (bDidRandPoolInit)
+    return true;
+
+  nCurrentPoolWritePos = 0;
+  nCurrentPoolReadPos = 0;
+  nPoolBytesSinceMix = 0;
+
+  if ((pRandPool = RandSecureAlloc(RNG_POOL_SIZE)) == NULL)
+    return false;
+
+  /* The DRBG state is locked to physical memory just like the pool */
+  if ((pRandDrbg = RandSecureAlloc(sizeof(CTR_DRBG_STATE))) == NULL) {
+    xr_secure_free(pRandPool);
+    pRandPool = NULL;
+    return false;
+  }
+
+  pthread_mutex_init(&randMutex, NULL);
+  pthread_mutex_init(&drbgMutex, NULL);
+  pthread_mutex_init(&slowPollMutex, NULL);
+
+  bTerminatePollThreads = false;
+  bFirstSlowPollDone = false;
+  bDidRandPoolInit = true;
+
+  /* The child of a fork() must not repeat the output of its parent */
+  if (!bDidRegisterAtfork) {
+    if (pthread_atfork(RandAtforkPrepare, RandAtforkParent,
+                       RandAtforkChild) != 0) {
+      Log(ERR_RAND_INIT, false, ENOMEM, __LINE__);
+      goto err;
+    }
+    bDidRegisterAtfork = true;
+  }
+
+  /* The destructor clears and frees the per-thread DRBGs on thread exit */
+  if (pthread_key_create(&randThreadKey, RandThreadDrbgFree) != 0) {
+    Log(ERR_RAND_INIT, false, errno, __LINE__);
+    goto err;
+  }
+  bDidCreateThreadKey = true;
+
+  bThreadDrbgChaCha = !aes256_has_hw();
+
+  if (rdrand_check_support())
+    HasRdrand = true;
+  if (rdseed_check_support())
+    HasRdseed = true;
+
+  if (seedFile != NULL && (pSeedFilePath = strdup(seedFile)) == NULL) {
+    Log(ERR_NO_MEMORY, false, ENOMEM, __LINE__);
+    goto err;
+  }
+
+  /* In strict mode the first output always waits for the first slow
+     poll, and with it for the Jitter RNG */
+  bFastStart = (flags & RNG_START_FAST) && !bStrictChecksEnabled;
+
+  /* Otherwise the Jitter RNG startup health tests are run by the
+     first slow poll, in the background */
+  if (!bFastStart && !RandJentInit())
+    goto err;
+
+  /* Seed the DRBG right away from the initial seed; if the kernel
+     CSPRNG fails, fall back to waiting for the first slow poll */
+  if (bFastStart && !(RandInitialSeed() && RandReseedDrbg(false)))
+    bFastStart = false;
+  else if (!bFastStart && pSeedFilePath)
+    RandInitialSeed();
+  bFastStartPending = bFastStart;
+
+  if (pthread_create(&fastPollThread, NULL, FastPollThreadProc, NULL) != 0) {
+    Log(ERR_RAND_INIT, false, errno, __LINE__);
+    goto err;
+  }
+  bFastPollThreadStarted = true;
+
+  /* Start the first slow poll right away in the background, so that it
+     is usually done by the time the first bytes are requested */
+  if (pthread_create(&slowPollThread, NULL, SlowPollThreadProc, NULL) != 0) {
+    Log(ERR_RAND_INIT, false, errno, __LINE__);
+    goto err;
+  }
+  bSlowPollThreadStarted = true;
+
+  return true;
+
+err:
+  RandCleanStop();
+  return false;
+}
+
+bool RandPoolInit(void) { return RandPoolInitEx(0, NULL); }
+
+/**
+ * Safely stop the RNG, terminate the threads, reset all global
+ * status and control flags and free all per-thread DRBGs.
+ *
+ * Unlock the pool and clear it to zero before freeing the memory.
+ */
+void RandCleanStop(void) {
+  RAND_THREAD_DRBG *pThreadDrbg, *pNext;
+
+  if (!bDidRandPoolInit)
+    return;
+
+  pthread_mutex_lock(&threadMutex);
+  bTerminatePollThreads = true;
+  pthread_cond_broadcast(&threadCond);
+  pthread_mutex_unlock(&threadMutex);
+
+  /* An ongoing slow poll is finished first */
+  if (bFastPollThreadStarted) {
+    pthread_join(fastPollThread, NULL);
+    bFastPollThreadStarted = false;
+  }
+
+  if (bSlowPollThreadStarted) {
+    pthread_join(slowPollThread, NULL);
+    bSlowPollThreadStarted = false;
+  }
+
+  /* This also clears the collector states */
+  for (unsigned int i = 0; i < nJentCollectors; i++) {
+    if (jentJobs[i].collector != NULL)
+      jent_entropy_collector_free(jentJobs[i].collector);
+  }
+  zeroize((uint8_t *)jentJobs, sizeof(jentJobs));
+  nJentCollectors = 0;
+  nJentInitState = 0;
+
+  /* Leave a fresh seed for the next run, which now also carries the
+     slow polls of this one */
+  if (pSeedFilePath != NULL) {
+    if (bDidSeedDrbg)
+      RandSeedFileUpdate();
+    free(pSeedFilePath);
+    pSeedFilePath = NULL;
+  }
+  bFastStart = false;
+  bFastStartPending = false;
+
+  RandRingStop();
+
+  /* Deleting the key does not run the destructors, so the DRBGs of
+     the threads that are still alive are freed here */
+  if (bDidCreateThreadKey) {
+    pthread_setspecific(randThreadKey, NULL);
+    pthread_key_delete(randThreadKey);
+    bDidCreateThreadKey = false;
+  }
+
+  pthread_mutex_lock(&threadDrbgListMutex);
+  for (pThreadDrbg = pThreadDrbgList; pThreadDrbg; pThreadDrbg = pNext) {
+    pNext = pThreadDrbg->next;
+    RandStatsRetireThread(&threadStatsRetired, &pThreadDrbg->stats);
+    xr_secure_free(pThreadDrbg);
+  }
+  pThreadDrbgList = NULL;
+  nThreadDrbgs = 0;
+  pthread_mutex_unlock(&threadDrbgListMutex);
+
+  pthread_mutex_destroy(&randMutex);
+  pthread_mutex_destroy(&drbgMutex);
+  pthread_mutex_destroy(&slowPollMutex);
+
+  /* Clear, unlock and free the central DRBG */
+  ctr_drbg_clear(pRandDrbg);
+  xr_secure_free(pRandDrbg);
+
+  pRandDrbg = NULL;
+  bDidSeedDrbg = false;
+  nRandDrbgGeneration = 0;
+
+  /* Unlock, clear and free the randomness pool */
+  xr_secure_free(pRandPool);
+
+  pRandPool = NULL;
+  bStrictChecksEnabled = false;
+  bDidRandPoolInit = false;
+  bDidSlowPoll = false;
+  nCurrentPoolWritePos = 0;
+  nCurrentPoolReadPos = 0;
+  nPoolBytesSinceMix = 0;
+}
+
+/**
+ * fork() handlers. The locks of the RNG are held across the fork so
+ * that the child does not inherit them in the middle of an update
+ * (in the order drbgMutex, slowPollMutex, randMutex; no other lock
+ * is taken while threadDrbgListMutex is held).
+ */
+static void RandAtforkPrepare(void) {
+  if (!bDidRandPoolInit)
+    return;
+
+  pthread_mutex_lock(&drbgMutex);
+  pthread_mutex_lock(&slowPollMutex);
+  pthread_mutex_lock(&randMutex);
+  pthread_mutex_lock(&threadDrbgListMutex);
+}
+
+static void RandAtforkParent(void) {
+  if (!bDidRandPoolInit)
+    return;
+
+  pthread_mutex_unlock(&threadDrbgListMutex);
+  pthread_mutex_unlock(&randMutex);
+  pthread_mutex_unlock(&slowPollMutex);
+  pthread_mutex_unlock(&drbgMutex);
+}
+
+/**
+ * The child starts with a copy of the central DRBG, of the DRBG of
+ * the thread that forked and of the prefetch ring, and without any of
+ * the threads of its parent. The ring and all the per-thread DRBGs
+ * are wiped and freed, and the central DRBG is reseeded from the
+ * kernel CSPRNG before the child can fetch any bytes (or, if that
+ * fails, from a slow poll on the first request).
+ *
+ * The child has no poll threads, so its central DRBG is then only
+ * reseeded when its reseed counter runs out or by RngForceReseed();
+ * RngStop() and RngStart() bring the threads back.
+ */
+static void RandAtforkChild(void) {
+  RAND_THREAD_DRBG *pThreadDrbg, *pNext;
+  uint8_t seed[CTR_DRBG_ENTROPY_LEN];
+
+  if (!bDidRandPoolInit)
+    return;
+
+  /* None of the waiters on these exist in the child */
+  threadMutex = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+  threadCond = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+  ringMutex = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+  ringCond = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+
+  bFastPollThreadStarted = false;
+  bSlowPollThreadStarted = false;
+  /* A first request polls inline rather than waiting for the slow
+     poll thread */
+  bFirstSlowPollDone = true;
+  bFastStartPending = false;
+
+  /* The prefetched bytes were the parent's to hand out */
+  if (pRandRing != NULL) {
+    bRingEnabled = false;
+    bRingFillThreadStarted = false;
+    bRingFillPending = false;
+    xr_secure_free(pRandRing);
+    pRandRing = NULL;
+  }
+
+  /* Freeing clears them; this thread allocates a new one on its
+     next request */
+  for (pThreadDrbg = pThreadDrbgList; pThreadDrbg; pThreadDrbg = pNext) {
+    pNext = pThreadDrbg->next;
+    RandStatsRetireThread(&threadStatsRetired, &pThreadDrbg->stats);
+    xr_secure_free(pThreadDrbg);
+  }
+  pThreadDrbgList = NULL;
+  nThreadDrbgs = 0;
+  if (bDidCreateThreadKey)
+    pthread_setspecific(randThreadKey, NULL);
+
+  if (bDidSeedDrbg) {
+    if (!RandOsBytes(seed, sizeof(seed), false) ||
+        ctr_drbg_reseed(pRandDrbg, seed, NULL, 0) != SUCCESS) {
+      ctr_drbg_clear(pRandDrbg);
+      bDidSeedDrbg = false;
+      bDidSlowPoll = false;
+      bFastStart = false;
+    }
+  }
+  __atomic_add_fetch(&nRandDrbgGeneration, 1, __ATOMIC_SEQ_CST);
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+
+  pthread_mutex_unlock(&threadDrbgListMutex);
+  pthread_mutex_unlock(&randMutex);
+  pthread_mutex_unlock(&slowPollMutex);
+  pthread_mutex_unlock(&drbgMutex);
+}
+
+/**
+ * The thread procedure called periodically to poll for system entropy.
+ *
+ * Every poll also mixes the pool, and every RNG_DRBG_RESEED_INTERVAL
+ * polls the DRBG is reseeded from the pool, so that none of this work
+ * has to be done inline when bytes are requested.
+ */
+static void *FastPollThreadProc(void *_dummy) {
+  unsigned int nPolls = 0;
+
+  (void)_dummy;
+
+  do {
+    RandLockPool();
+    RandFastPoll();
+    RandUnlockPool();
+
+    if (++nPolls >= RNG_DRBG_RESEED_INTERVAL) {
+      nPolls = 0;
+      if (bDidSeedDrbg)
+        RandReseedDrbg(false);
+    }
+  } while (!RandPollThreadSleep(RNG_FAST_POLL_INTERVAL));
+
+  return NULL;
+}
+
+/**
+ * The thread procedure for the slow polls, which runs the first one
+ * immediately and then one every RNG_SLOW_POLL_INTERVAL. The results
+ * reach the DRBG with the next periodic reseed from the pool.
+ *
+ * With RNG_START_FAST the first slow poll waits for the first request
+ * to be served (for at most RNG_FAST_START_DELAY), so that it does not
+ * compete with it for the processor, and then also runs the Jitter RNG
+ * startup health tests; its results are brought into the DRBG at once.
+ * The seed file is replaced before that, so that it is not read again
+ * should the process die early.
+ */
+static void *SlowPollThreadProc(void *_dummy) {
+  bool bFirst = true;
+
+  (void)_dummy;
+
+  if (bFastStart) {
+    struct timespec deadline;
+#if defined(SCHED_BATCH)
+    struct sched_param param = {0};
+
+    /* The caller does not wait for the slow polls, so keep them (and
+       the Jitter RNG threads, which inherit the policy) from preempting
+       it on a busy or single processor */
+    pthread_setschedparam(pthread_self(), SCHED_BATCH, &param);
+#endif
+#if defined(__linux__)
+    /* The nice value is per thread on Linux; it cannot be raised back
+       without privileges, so the slow polls stay in the background */
+    setpriority(PRIO_PROCESS, (id_t)gettid(), 19);
+#endif
+
+    RandDeadline(&deadline, RNG_FAST_START_DELAY);
+
+    pthread_mutex_lock(&threadMutex);
+    while (bFastStartPending && !bTerminatePollThreads &&
+           pthread_cond_timedwait(&threadCond, &threadMutex, &deadline) !=
+               ETIMEDOUT)
+      ;
+    bFastStartPending = false;
+    pthread_mutex_unlock(&threadMutex);
+
+    if (pSeedFilePath)
+      RandSeedFileUpdate();
+  }
+
+  do {
+    bool bPolled;
+
+    if (RandPollThreadsStopping())
+      break;
+    bPolled = RandSlowPoll();
+
+    /* A fetch may be waiting for this, with drbgMutex held */
+    pthread_mutex_lock(&threadMutex);
+    bFirstSlowPollDone = true;
+    pthread_cond_broadcast(&threadCond);
+    pthread_mutex_unlock(&threadMutex);
+
+    if (bPolled && bFirst && (bFastStart || pSeedFilePath)) {
+      RandReseedDrbg(false);
+      if (!bFastStart)
+        RandSeedFileUpdate();
+    }
+    bFirst = false;
+  } while (!RandPollThreadSleep(RNG_SLOW_POLL_INTERVAL));
+
+  return NULL;
+}
+
+/**
+ * The fast poll function which gathers entropy from the kernel
+ * CSPRNG, the CPU and various high-resolution clocks. It makes no
+ * file system accesses, so it is cheap enough to run inline on every
+ * pool extraction.
+ *
+ * Called with randMutex held.
+ */
+static bool RandFastPollSources(void) {
+  BUF buf;
+  PBUF bufPtr = &buf;
+  struct rusage usage;
+
+  /* Request 16 bytes from the kernel CSPRNG without blocking; the
+     kernel pool may not be initialized yet this early in boot */
+  bufPtr->size = 16;
+  if (RandOsBytes(bufPtr->bytes, bufPtr->size, true)) {
+    AddBuf(bufPtr->bytes, bufPtr->size);
+  } else if (errno != EAGAIN) {
+    Log(ERR_GETRANDOM, false, errno, __LINE__);
+    return false;
+  }
+
+  /* Use RDSEED and RDRAND, if available, as a source of random bytes */
+  {
+    size_t n;
+
+    /* Request 16 bytes from RDRAND */
+    if (HasRdrand && (n = rdrand_fill(bufPtr->bytes, 16)))
+      AddBuf(bufPtr->bytes, n);
+
+    /* Request 16 bytes from RDSEED */
+    if (HasRdseed && (n = rdseed_fill(bufPtr->bytes, 16)))
+      AddBuf(bufPtr->bytes, n);
+  }
+
+  Add32((uint32_t)getpid());    /* Process ID for the current process */
+  AddPtr(pthread_self());       /* Thread ID for the current thread */
+  AddPtr(&usage);               /* Current stack address */
+
+  /* Resource usage of the current process, which includes the CPU
+     time used in user and kernel mode and the page fault and
+     context switch counts */
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    AddBuf((uint8_t *)&usage, sizeof(usage));
+
+  /* The clocks are read through the vDSO (without a system call)
+     where possible */
+  AddClock(CLOCK_REALTIME);
+  AddClock(CLOCK_MONOTONIC);
+  AddClock(CLOCK_PROCESS_CPUTIME_ID);
+  AddClock(CLOCK_THREAD_CPUTIME_ID);
+#if defined(CLOCK_MONOTONIC_RAW)
+  AddClock(CLOCK_MONOTONIC_RAW);
+#endif
+#if defined(CLOCK_BOOTTIME)
+  AddClock(CLOCK_BOOTTIME);
+#endif
+
+#if defined(__x86_64__) || defined(__i386)
+  {
+    /* x86 always has a TSC that can be read as an intrinsic. */
+    Add64((uint64_t)__rdtsc());
+  }
+#endif
+
+  /* Mix the pool */
+  RandPoolMix();
+
+  /* Prevent leaks */
+  zeroize((uint8_t *)bufPtr, sizeof(buf));
+  zeroize((uint8_t *)&usage, sizeof(usage));
+
+  return true;
+}
+
+bool RandFastPoll(void) {
+  uint64_t start = RandStatsStart();
+  bool ret = RandFastPollSources();
+
+  RNG_STAT_INC(*(ret ? &randStats.fast_polls : &randStats.fast_poll_failures));
+  RandStatsRecord(&randStats.fast_poll, start);
+
+  return ret;
+}
+
+static void JentCollectorAlloc(JENT_JOB *job) {
+  job->collector = jent_entropy_collector_alloc(1, 0);
+}
+
+static void JentCollectorRead(JENT_JOB *job) {
+  job->ret = jent_read_entropy(job->collector, (char *)job->bytes,
+                               sizeof(job->bytes));
+}
+
+static void *JentJobThreadProc(void *pJob) {
+  JENT_JOB *job = (JENT_JOB *)pJob;
+
+#if defined(__linux__)
+  if (job->cpu >= 0) {
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(job->cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  }
+#endif
+  job->fn(job);
+  return NULL;
+}
+
+/**
+ * Run fn on every Jitter RNG job.
+ *
+ * With more than one job, each one runs on its own thread pinned
+ * to a different processor so that the jobs run in parallel;  a
+ * job whose thread could not be created is run in the  calling
+ * thread instead.
+ */
+static void RandJentRunJobs(void (*fn)(JENT_JOB *job)) {
+  pthread_t threads[RNG_JENT_MAX_COLLECTORS];
+  bool started[RNG_JENT_MAX_COLLECTORS];
+  unsigned int i;
+
+  if (nJentCollectors == 1) {
+    fn(&jentJobs[0]);
+    return;
+  }
+
+  for (i = 0; i < nJentCollectors; i++) {
+    jentJobs[i].fn = fn;
+    started[i] = pthread_create(&threads[i], NULL, JentJobThreadProc,
+                                &jentJobs[i]) == 0;
+    if (!started[i])
+      fn(&jentJobs[i]);
+  }
+
+  for (i = 0; i < nJentCollectors; i++) {
+    if (started[i])
+      pthread_join(threads[i], NULL);
+  }
+}
+
+/**
+ * Run the Jitter RNG startup health tests and allocate one collector
+ * with osr = 1 for each processor the process may run on (see the
+ * note in rngw32.c on the choice of osr). Allocating a collector also
+ * generates its first block of noise, which takes about as long as
+ * the health tests, so the collectors are allocated in parallel, each
+ * on the processor it is pinned to.
+ *
+ * This is done only once, by RandPoolInitEx() before the poll threads
+ * start or (with RNG_START_FAST) by the first slow poll, with
+ * slowPollMutex held.
+ *
+ * Returns true if the Jitter RNG is ready.
+ */
+static bool RandJentInit(void) {
+  if (nJentInitState != 0)
+    return nJentInitState > 0;
+  nJentInitState = -1;
+
+  if (jent_entropy_init() != 0) {
+    Log(ERR_JENT_FAILURE, false, -1, __LINE__);
+    return false;
+  }
+
+  {
+#if defined(__linux__)
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+      for (int cpu = 0; cpu < CPU_SETSIZE &&
+                        nJentCollectors < RNG_JENT_MAX_COLLECTORS;
+           cpu++) {
+        if (CPU_ISSET(cpu, &cpus))
+          jentJobs[nJentCollectors++].cpu = cpu;
+      }
+    }
+#endif
+
+    /* Fall back to a single collector that is not pinned */
+    if (nJentCollectors == 0) {
+      jentJobs[0].cpu = -1;
+      nJentCollectors = 1;
+    }
+  }
+
+  RandJentRunJobs(JentCollectorAlloc);
+
+  for (unsigned int i = 0; i < nJentCollectors; i++) {
+    if (jentJobs[i].collector == NULL) {
+      Log(ERR_JENT_FAILURE, false, -1, __LINE__);
+      return false;
+    }
+  }
+
+  nJentInitState = 1;
+  return true;
+}
+
+/**
+ * Read RNG_JENT_COLLECTOR_BYTES bytes from every Jitter RNG
+ * collector, in parallel, and add them to the pool. Every
+ * collector runs its own health tests on each read.
+ *
+ * Returns true if all the collectors delivered their bytes.
+ */
+static bool RandJentCollect(void) {
+  unsigned int i;
+  bool bOk = true;
+
+  RandJentRunJobs(JentCollectorRead);
+
+  for (i = 0; i < nJentCollectors; i++) {
+    if (jentJobs[i].ret > 0) {
+      AddBufLocked(jentJobs[i].bytes, jentJobs[i].ret);
+    } else {
+      Log(ERR_JENT_FAILURE, false, -1, __LINE__);
+      bOk = false;
+    }
+    zeroize(jentJobs[i].bytes, sizeof(jentJobs[i].bytes));
+  }
+
+  return bOk;
+}
+
+#if defined(__linux__)
+/* Kernel statistics read by the slow poll; the counters in these
+   change constantly and are hard to predict from outside */
+static const char *const szProcFiles[] = {
+    "/proc/stat",       "/proc/meminfo",  "/proc/vmstat",
+    "/proc/diskstats",  "/proc/net/dev",  "/proc/interrupts",
+    "/proc/softirqs",   "/proc/loadavg",  "/proc/self/stat",
+    "/proc/self/status"};
+
+/* Add the contents of a (possibly missing) file to the pool */
+static void AddFileLocked(const char *path) {
+  uint8_t buf[4096];
+  ssize_t n;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    return;
+
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    AddBufLocked(buf, (size_t)n);
+
+  close(fd);
+  zeroize(buf, sizeof(buf));
+}
+#endif
+
+/**
+ * The slow poll performs a more in-depth search for random bytes,
+ * from the Jitter RNG, the (blocking) kernel CSPRNG and the kernel
+ * statistics on the system performance.
+ *
+ * The pool lock is only held while the gathered data is added to
+ * the pool, so fetches are not blocked while the statistics are
+ * being read.
+ */
+static bool RandSlowPollUnlocked(void) {
+  BUF buf;
+  PBUF bufPtr = &buf;
+  struct rusage usage;
+
+  /* This data is fixed for the lifetime of the process and
+     hence added only once */
+  static bool bAddedStartupInfo = false;
+
+  if (!bAddedStartupInfo) {
+    struct utsname name;
+    uint32_t ids[4];
+
+    if (uname(&name) == 0)
+      AddBufLocked((uint8_t *)&name, sizeof(name));
+
+    ids[0] = (uint32_t)getppid();
+    ids[1] = (uint32_t)getuid();
+    ids[2] = (uint32_t)getgid();
+    ids[3] = (uint32_t)getsid(0);
+    AddBufLocked((uint8_t *)ids, sizeof(ids));
+    bAddedStartupInfo = true;
+  }
+
+  /* Read from the Jitter RNG collectors, which sample
+     noise based on high-resolution CPU timing jitter */
+  if (!RandJentCollect())
+    return false;
+
+  /* Read 64 bytes from the kernel CSPRNG, waiting for it to be
+     initialized if need be (this thread is in the background) */
+  bufPtr->size = 64;
+  if (RandOsBytes(bufPtr->bytes, bufPtr->size, false)) {
+    AddBufLocked(bufPtr->bytes, bufPtr->size);
+  } else {
+    Log(ERR_GETRANDOM, false, errno, __LINE__);
+    if (bStrictChecksEnabled)
+      return false;
+  }
+
+  if (getrusage(RUSAGE_CHILDREN, &usage) == 0)
+    AddBufLocked((uint8_t *)&usage, sizeof(usage));
+
+#if defined(__linux__)
+  {
+    struct sysinfo info;
+
+    /* Uptime, load averages, memory and swap usage, process count */
+    if (sysinfo(&info) == 0)
+      AddBufLocked((uint8_t *)&info, sizeof(info));
+  }
+
+  for (size_t i = 0; i < count(szProcFiles); i++)
+    AddFileLocked(szProcFiles[i]);
+#endif
+
+  /* Mix the pool */
+  RandLockPool();
+  RandPoolMix();
+  RandUnlockPool();
+
+  /* Prevent leaks */
+  zeroize((uint8_t *)bufPtr, sizeof(buf));
+  zeroize((uint8_t *)&usage, sizeof(usage));
+
+  return true;
+}
+
+/* Run a slow poll; slow polls are serialized by slowPollMutex, which
+   must be locked before randMutex if both are held */
+bool RandSlowPoll(void) {
+  uint64_t start;
+  bool ret;
+
+  pthread_mutex_lock(&slowPollMutex);
+  start = RandStatsStart();
+  /* The Jitter RNG startup tests may have run until RngStop() */
+  if ((ret = RandJentInit() && !RandPollThreadsStopping() &&
+             RandSlowPollUnlocked()))
+    __atomic_store_n(&bDidSlowPoll, true, __ATOMIC_RELEASE);
+  RandStatsRecord(&randStats.slow_poll, start);
+  pthread_mutex_unlock(&slowPollMutex);
+
+  RNG_STAT_INC(*(ret ? &randStats.slow_polls : &randStats.slow_poll_failures));
+
+  return ret;
+}
+
+/**
+ * The pool mixing function; see RandPoolMix() in rngw32.c for the
+ * construction. It uses the in-tree sha512() rather than the OpenSSL
+ * SHA512(), whose first call costs about a millisecond of library
+ * initialization at startup.
+ *
+ * Note: RNG_POOL_SIZE must be divisible by SHA512_DIGEST_LENGTH.
+ */
+void RandPoolMix(void) {
+  uint64_t start = RandStatsStart();
+  uint8_t digest[SHA512_DIGEST_LENGTH + 1];
+  uint8_t buf[SHA512_DIGEST_LENGTH];
+
+  /* Compute the SHA512 digest of the entire pool */
+  sha512(pRandPool, RNG_POOL_SIZE, digest);
+
+  for (int i = 0; i < RNG_POOL_CHUNKS; i++) {
+    /* Derive the digest for this chunk */
+    digest[SHA512_DIGEST_LENGTH] = (uint8_t)i;
+    sha512(digest, sizeof(digest), buf);
+    /* Add the resulting digest message back to the pool */
+    for (int j = 0; j < SHA512_DIGEST_LENGTH; j++) {
+      pRandPool[i * RNG_POOL_CHUNK_SIZE + j] ^= buf[j];
+    }
+  }
+  nPoolBytesSinceMix = 0;
+
+  /* Prevent leaks */
+  zeroize(digest, sizeof(digest));
+  zeroize(buf, SHA512_DIGEST_LENGTH);
+
+  RNG_STAT_INC(randStats.pool_mixes);
+  RandStatsRecord(&randStats.pool_mix, start);
+}
+
+/**
+ * Extract random data from the pool to the buffer by inverting,
+ * mixing and adding the contents of the randomness pool to the
+ * output buffer using modulo 2^8 addition to prevent state leaks.
+ *
+ * This is only used to (re)seed the DRBG.
+ */
+static bool RandPoolExtract(uint8_t *data, size_t len, int forceSlowPoll) {
+  bool ret = false, bPolled;
+
+  /* There is at max RNG_POOL_SIZE worth of entropy in the
+     pool at any given instant */
+  if (len > RNG_POOL_SIZE) {
+    Log(ERR_REQUEST_TOO_LARGE, false, -1, __LINE__);
+    return false;
+  }
+
+  /* The pool must have seen at least one slow poll (or, with
+     RNG_START_FAST, the initial seed); wait for the first background
+     poll rather than running another one, and only poll here if that
+     one failed or a fresh poll was explicitly asked for */
+  bPolled = bFastStart || __atomic_load_n(&bDidSlowPoll, __ATOMIC_ACQUIRE);
+  if (!bPolled && !forceSlowPoll) {
+    pthread_mutex_lock(&threadMutex);
+    while (!bFirstSlowPollDone && !bTerminatePollThreads)
+      pthread_cond_wait(&threadCond, &threadMutex);
+    pthread_mutex_unlock(&threadMutex);
+    bPolled = __atomic_load_n(&bDidSlowPoll, __ATOMIC_ACQUIRE);
+  }
+
+  if ((!bPolled || forceSlowPoll) && !RandSlowPoll())
+    return false;
+
+  RandLockPool();
+
+  /* Mix the pool */
+  if (!RandFastPoll())
+    goto cleanup;
+
+  /* Add the current pool contents to the output buffer */
+  for (size_t i = 0; i < len; ++i) {
+    if (nCurrentPoolReadPos == RNG_POOL_SIZE)
+      nCurrentPoolReadPos = 0;
+
+    data[i] = pRandPool[nCurrentPoolReadPos];
+    nCurrentPoolReadPos++;
+  }
+
+  /* Invert the pool */
+  for (size_t i = 0; i < RNG_POOL_SIZE / sizeof(uint32_t); ++i) {
+    Ptr32(pRandPool)[i] = Ptr32(pRandPool)[i] ^ 0xffffffff;
+  }
+
+  /* Mix the pool */
+  if (!RandFastPoll())
+    goto cleanup;
+
+  /* Add the new pool contents to the output buffer */
+  for (size_t i = 0; i < len; ++i) {
+    if (nCurrentPoolReadPos == RNG_POOL_SIZE)
+      nCurrentPoolReadPos = 0;
+
+    data[i] ^= pRandPool[nCurrentPoolReadPos];
+    nCurrentPoolReadPos++;
+  }
+
+  /* Mix the pool */
+  RandPoolMix();
+
+  ret = true;
+
+cleanup:
+
+  RandUnlockPool();
+
+  return ret;
+}
+
+/* Entropy callback for the DRBG, in case the reseed counter runs out
+   before the next periodic reseed. Called with drbgMutex held. */
+static int RandDrbgEntropyCallback(void *ctx, uint8_t *buf, size_t len) {
+  (void)ctx;
+  return RandPoolExtract(buf, len, false) ? 0 : 1;
+}
+
+/* Instantiate the DRBG from the pool, or reseed it if it already is */
+static bool RandReseedDrbg(int forceSlowPoll) {
+  bool ret = false;
+  uint8_t seed[CTR_DRBG_ENTROPY_LEN];
+  uint64_t start = RandStatsStart();
+
+  pthread_mutex_lock(&drbgMutex);
+
+  if (!RandPoolExtract(seed, CTR_DRBG_ENTROPY_LEN, forceSlowPoll))
+    goto cleanup;
+
+  if (!bDidSeedDrbg) {
+    if (ctr_drbg_init(pRandDrbg, seed, NULL, 0) != SUCCESS)
+      goto cleanup;
+    ctr_drbg_set_entropy_cb(pRandDrbg, RandDrbgEntropyCallback, NULL);
+    bDidSeedDrbg = true;
+  } else if (ctr_drbg_reseed(pRandDrbg, seed, NULL, 0) != SUCCESS) {
+    goto cleanup;
+  }
+
+  /* Have the per-thread DRBGs reseed on their next request */
+  __atomic_add_fetch(&nRandDrbgGeneration, 1, __ATOMIC_SEQ_CST);
+
+  ret = true;
+
+cleanup:
+  pthread_mutex_unlock(&drbgMutex);
+
+  /* Prevent leaks */
+  zeroize(seed, CTR_DRBG_ENTROPY_LEN);
+
+  RNG_STAT_INC(*(ret ? &randStats.drbg_reseeds
+                     : &randStats.drbg_reseed_failures));
+  RandStatsRecord(&randStats.drbg_reseed, start);
+
+  return ret;
+}
+
+/* Generate output from the central DRBG; used to seed the per-thread
+   DRBGs (and as their entropy callback) */
+static int RandDrbgCentralCallback(void *ctx, uint8_t *buf, size_t len) {
+  status_t status;
+
+  (void)ctx;
+
+  pthread_mutex_lock(&drbgMutex);
+  status = ctr_drbg_generate_bulk(pRandDrbg, buf, len);
+  pthread_mutex_unlock(&drbgMutex);
+
+  if (status != SUCCESS)
+    return 1;
+
+  RNG_STAT_ADD(randStats.central_drbg_bytes, len);
+  return 0;
+}
+
+/* Thread-specific data destructor; clear and free the DRBG of an
+   exiting thread */
+static void RandThreadDrbgFree(void *pData) {
+  RAND_THREAD_DRBG *pThreadDrbg = (RAND_THREAD_DRBG *)pData;
+
+  if (pThreadDrbg == NULL)
+    return;
+
+  pthread_mutex_lock(&threadDrbgListMutex);
+  if (pThreadDrbg->prev)
+    pThreadDrbg->prev->next = pThreadDrbg->next;
+  else
+    pThreadDrbgList = pThreadDrbg->next;
+  if (pThreadDrbg->next)
+    pThreadDrbg->next->prev = pThreadDrbg->prev;
+  nThreadDrbgs--;
+  RandStatsRetireThread(&threadStatsRetired, &pThreadDrbg->stats);
+  pthread_mutex_unlock(&threadDrbgListMutex);
+
+  xr_secure_free(pThreadDrbg);
+}
+
+/* Get the (possibly unseeded) DRBG of the calling thread, allocating
+   it on first use */
+static RAND_THREAD_DRBG *RandGetThreadLocal(void) {
+  RAND_THREAD_DRBG *pThreadDrbg;
+
+  pThreadDrbg = (RAND_THREAD_DRBG *)pthread_getspecific(randThreadKey);
+
+  if (pThreadDrbg == NULL) {
+    /* Allocated by the thread itself, so on its own NUMA node; locked
+       if the memory lock limit leaves room for one page per thread */
+    if ((pThreadDrbg = (RAND_THREAD_DRBG *)xr_secure_alloc(
+             sizeof(RAND_THREAD_DRBG), XR_NUMA_NODE_LOCAL,
+             XR_SECURE_TRY_LOCK | XR_SECURE_GUARD)) == NULL) {
+      Log(ERR_NO_MEMORY, false, ENOMEM, __LINE__);
+      return NULL;
+    }
+
+    if (pthread_setspecific(randThreadKey, pThreadDrbg) != 0) {
+      xr_secure_free(pThreadDrbg);
+      Log(ERR_RAND_INIT, false, errno, __LINE__);
+      return NULL;
+    }
+
+    pthread_mutex_lock(&threadDrbgListMutex);
+    pThreadDrbg->prev = NULL;
+    pThreadDrbg->next = pThreadDrbgList;
+    if (pThreadDrbgList)
+      pThreadDrbgList->prev = pThreadDrbg;
+    pThreadDrbgList = pThreadDrbg;
+    nThreadDrbgs++;
+    pthread_mutex_unlock(&threadDrbgListMutex);
+  }
+
+  return pThreadDrbg;
+}
+
+/**
+ * Get the DRBG of the calling thread, allocating it on first use and
+ * reseeding it from the central DRBG whenever the central generation
+ * has moved on. Only this slow path takes drbgMutex.
+ */
+static RAND_THREAD_DRBG *RandGetThreadDrbg(void) {
+  RAND_THREAD_DRBG *pThreadDrbg;
+  uint8_t seed[CTR_DRBG_ENTROPY_LEN];
+  long generation;
+  status_t status;
+  uint64_t start;
+
+  if ((pThreadDrbg = RandGetThreadLocal()) == NULL)
+    return NULL;
+
+  generation = __atomic_load_n(&nRandDrbgGeneration, __ATOMIC_ACQUIRE);
+
+  if (pThreadDrbg->generation == generation)
+    return pThreadDrbg;
+
+  start = RandStatsStart();
+
+  if (RandDrbgCentralCallback(NULL, seed, CTR_DRBG_ENTROPY_LEN) != 0)
+    return NULL;
+
+  if (bThreadDrbgChaCha) {
+    /* Takes the first CHACHA_DRBG_ENTROPY_LEN bytes of the seed */
+    if (pThreadDrbg->generation == 0) {
+      status = chacha_drbg_init(&pThreadDrbg->chacha, seed, NULL, 0);
+      chacha_drbg_set_entropy_cb(&pThreadDrbg->chacha,
+                                 RandDrbgCentralCallback, NULL);
+    } else {
+      status = chacha_drbg_reseed(&pThreadDrbg->chacha, seed, NULL, 0);
+    }
+  } else if (pThreadDrbg->generation == 0) {
+    status = ctr_drbg_init(&pThreadDrbg->drbg, seed, NULL, 0);
+    ctr_drbg_set_entropy_cb(&pThreadDrbg->drbg, RandDrbgCentralCallback, NULL);
+  } else {
+    status = ctr_drbg_reseed(&pThreadDrbg->drbg, seed, NULL, 0);
+  }
+
+  /* Prevent leaks */
+  zeroize(seed, CTR_DRBG_ENTROPY_LEN);
+
+  if (status != SUCCESS)
+    return NULL;
+
+  pThreadDrbg->generation = generation;
+
+  RNG_STAT_LOCAL_ADD(pThreadDrbg->stats.drbg_reseeds, 1);
+  RandStatsRecord(&randStats.drbg_reseed, start);
+
+  return pThreadDrbg;
+}
+
+/* Generate output from a (seeded) per-thread DRBG */
+static inline status_t RandThreadDrbgGenerate(RAND_THREAD_DRBG *pThreadDrbg,
+                                              uint8_t *data, size_t len) {
+  if (bThreadDrbgChaCha)
+    return chacha_drbg_fetch(&pThreadDrbg->chacha, data, len);
+  return ctr_drbg_generate_bulk(&pThreadDrbg->drbg, data, len);
+}
+
+/* Wake up the ring producer */
+static void RandRingSignal(void) {
+  pthread_mutex_lock(&ringMutex);
+  bRingFillPending = true;
+  pthread_cond_signal(&ringCond);
+  pthread_mutex_unlock(&ringMutex);
+}
+
+/* Fill up to nRingBatch free slots of the ring from the DRBG of the
+   producer thread; stops early if the ring is full */
+static void RandRingFill(void) {
+  RAND_THREAD_DRBG *pThreadDrbg;
+  RAND_RING_SLOT *pSlot;
+  uint32_t pos;
+
+  if ((pThreadDrbg = RandGetThreadDrbg()) == NULL)
+    return;
+
+  for (unsigned int i = 0; i < nRingBatch; ++i) {
+    pos = nRingHead;
+    pSlot = &pRandRing[pos & (RNG_RING_SLOTS - 1)];
+
+    /* Not yet released by its consumer */
+    if (__atomic_load_n(&pSlot->seq, __ATOMIC_ACQUIRE) != pos)
+      break;
+
+    if (RandThreadDrbgGenerate(pThreadDrbg, pSlot->data, RNG_RING_SLOT_SIZE) !=
+        SUCCESS)
+      break;
+    RNG_STAT_LOCAL_ADD(pThreadDrbg->stats.drbg_bytes, RNG_RING_SLOT_SIZE);
+
+    /* Publish the slot */
+    __atomic_store_n(&pSlot->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&nRingHead, pos + 1, __ATOMIC_RELEASE);
+  }
+}
+
+/* The ring producer, woken up by consumers once the number of
+   filled slots drops below the watermark */
+static void *RingFillThreadProc(void *_dummy) {
+  struct timespec deadline;
+
+  (void)_dummy;
+
+  for (;;) {
+    RandDeadline(&deadline, RNG_FAST_POLL_INTERVAL);
+
+    pthread_mutex_lock(&ringMutex);
+    while (!bRingFillPending && !bTerminateRingFillThread &&
+           pthread_cond_timedwait(&ringCond, &ringMutex, &deadline) !=
+               ETIMEDOUT)
+      ;
+    bRingFillPending = false;
+    pthread_mutex_unlock(&ringMutex);
+
+    if (bTerminateRingFillThread)
+      break;
+
+    RandRingFill();
+  }
+
+  /* The producer DRBG is freed by the key destructor */
+  return NULL;
+}
+
+/**
+ * Pop one slot off the ring and copy the first len bytes to the
+ * output buffer. The whole slot is zeroized before it is released,
+ * so no byte is ever handed out twice. Returns false if the ring is
+ * empty.
+ */
+static bool RandRingPop(uint8_t *data, size_t len) {
+  RAND_RING_SLOT *pSlot;
+  uint32_t pos, seq;
+  int32_t dif;
+
+  pos = __atomic_load_n(&nRingTail, __ATOMIC_RELAXED);
+
+  for (;;) {
+    pSlot = &pRandRing[pos & (RNG_RING_SLOTS - 1)];
+    seq = __atomic_load_n(&pSlot->seq, __ATOMIC_ACQUIRE);
+    dif = (int32_t)(seq - (pos + 1));
+
+    if (dif == 0) {
+      /* Claim the slot; on failure pos is updated to the current tail */
+      if (__atomic_compare_exchange_n(&nRingTail, &pos, pos + 1, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        break;
+    } else if (dif < 0) {
+      /* Empty */
+      RandRingSignal();
+      return false;
+    } else {
+      pos = __atomic_load_n(&nRingTail, __ATOMIC_RELAXED);
+    }
+  }
+
+  memcpy(data, pSlot->data, len);
+  zeroize(pSlot->data, RNG_RING_SLOT_SIZE);
+
+  /* Release the slot to the producer */
+  __atomic_store_n(&pSlot->seq, pos + RNG_RING_SLOTS, __ATOMIC_RELEASE);
+
+  if (__atomic_load_n(&nRingHead, __ATOMIC_ACQUIRE) - (pos + 1) <
+      nRingWatermark)
+    RandRingSignal();
+
+  return true;
+}
+
+/* Stop the ring producer thread and wipe the ring */
+static void RandRingStop(void) {
+  if (pRandRing == NULL)
+    return;
+
+  bRingEnabled = false;
+
+  if (bRingFillThreadStarted) {
+    pthread_mutex_lock(&ringMutex);
+    bTerminateRingFillThread = true;
+    pthread_cond_signal(&ringCond);
+    pthread_mutex_unlock(&ringMutex);
+
+    pthread_join(ringFillThread, NULL);
+    bRingFillThreadStarted = false;
+  }
+
+  bTerminateRingFillThread = false;
+  bRingFillPending = false;
+
+  xr_secure_free(pRandRing);
+
+  pRandRing = NULL;
+}
+
+/* Allocate the ring and start the producer thread */
+static bool RandRingStart(unsigned int watermark, unsigned int batch) {
+  if (!bDidRandPoolInit || pRandRing != NULL)
+    return false;
+
+  if (watermark == 0 || watermark > RNG_RING_SLOTS || batch == 0 ||
+      batch > RNG_RING_SLOTS) {
+    Warn("Invalid prefetch parameters (expected values in 1..RNG_RING_SLOTS)",
+         WARN_INVALID_ARGS);
+    return false;
+  }
+
+  /* The producer seeds its DRBG from the central DRBG */
+  if (!bDidSeedDrbg && !RandReseedDrbg(false))
+    return false;
+
+  if ((pRandRing = RandSecureAlloc(RNG_RING_SLOTS * sizeof(RAND_RING_SLOT))) ==
+      NULL)
+    return false;
+
+  for (unsigned int i = 0; i < RNG_RING_SLOTS; ++i)
+    pRandRing[i].seq = (uint32_t)i;
+
+  nRingHead = 0;
+  nRingTail = 0;
+  nRingWatermark = watermark;
+  nRingBatch = batch;
+
+  /* Fill the ring right away */
+  bRingFillPending = true;
+
+  if (pthread_create(&ringFillThread, NULL, RingFillThreadProc, NULL) != 0) {
+    Log(ERR_RAND_INIT, false, errno, __LINE__);
+    RandRingStop();
+    return false;
+  }
+  bRingFillThreadStarted = true;
+
+  bRingEnabled = true;
+
+  return true;
+}
+
+/**
+ * Fetch random data to the buffer. Small requests are served from
+ * the prefetch ring if it is enabled and not empty. All others are
+ * served by a per-thread DRBG without taking any locks; a CTR_DRBG, or
+ * the ChaCha20 generator if the host has no AES hardware. These are
+ * seeded from a central CTR_DRBG that is seeded from the pool on the
+ * first request (or if forceSlowPoll is set), and periodically
+ * reseeded from the pool by the fast poll thread.
+ */
+bool RandFetchBytes(uint8_t *data, size_t len, int forceSlowPoll) {
+  RAND_THREAD_DRBG *pThreadDrbg;
+  RAND_THREAD_STATS *pStats;
+  uint64_t start = RandStatsStart(), genStart;
+  bool ret = false;
+
+  if (data == NULL) {
+    Warn("Invalid data pointer (expected a non-NULL value)", WARN_INVALID_ARGS);
+    return false;
+  }
+
+  /* This is a fatal error (triggers an immediate process termination)
+     for now, but might be changed in future versions to a false return */
+  if (!bDidRandPoolInit)
+    Throw(ERR_RAND_INIT, FATAL, -1, __LINE__);
+
+  /* The counters of the calling thread */
+  if ((pThreadDrbg = RandGetThreadLocal()) == NULL)
+    return false;
+  pStats = &pThreadDrbg->stats;
+
+  if ((!bDidSeedDrbg || forceSlowPoll) && !RandReseedDrbg(forceSlowPoll))
+    goto out;
+
+  if (bRingEnabled && !forceSlowPoll) {
+    if (len <= RNG_RING_SLOT_SIZE && RandRingPop(data, len)) {
+      RNG_STAT_LOCAL_ADD(pStats->ring_hits, 1);
+      ret = true;
+      goto out;
+    }
+    RNG_STAT_LOCAL_ADD(pStats->ring_misses, 1);
+  }
+
+  if (RandGetThreadDrbg() == NULL)
+    goto out;
+
+  genStart = RandStatsStart();
+  if (RandThreadDrbgGenerate(pThreadDrbg, data, len) == SUCCESS) {
+    RNG_STAT_LOCAL_ADD(pStats->drbg_bytes, len);
+    ret = true;
+  }
+  RandStatsRecord(&randStats.drbg_generate, genStart);
+  RNG_STAT_SET(pStats->reseed_counter,
+               bThreadDrbgChaCha ? pThreadDrbg->chacha.reseed_counter
+                                 : pThreadDrbg->drbg.reseed_counter);
+
+out:
+  /* Let the first slow poll start */
+  if (bFastStartPending && ret) {
+    pthread_mutex_lock(&threadMutex);
+    bFastStartPending = false;
+    pthread_cond_broadcast(&threadCond);
+    pthread_mutex_unlock(&threadMutex);
+  }
+
+  RNG_STAT_LOCAL_ADD(pStats->fetch_calls, 1);
+  if (ret)
+    RNG_STAT_LOCAL_ADD(pStats->fetch_bytes, len);
+  else
+    RNG_STAT_LOCAL_ADD(pStats->fetch_failures, 1);
+  RandStatsRecord(&randStats.fetch, start);
+
+  return ret;
+}
+
+/**
+ * Start the Random Number Generator. There can be only a
+ * single active instance.
+ *
+ * Returns 1 if the RNG started successfully, 0 otherwise.
+ */
+bool RngStart(void) { return RandPoolInit(); }
+
+/**
+ * Start the Random Number Generator with RNG_START_* flags and an
+ * optional seed file; see rngposix.h.
+ *
+ * Returns 1 if the RNG started successfully, 0 otherwise.
+ */
+bool RngStartEx(unsigned int flags, const char *seedFile) {
+  return RandPoolInitEx(flags, seedFile);
+}
+
+/* There are no user events to add on POSIX systems. */
+void RngEnableUserEvents(void) {}
+
+/* Returns 1 if the RNG is currently active, 0 otherwise. */
+bool DidRngStart(void) { return bDidRandPoolInit; }
+
+bool DidRngSlowPoll(void) {
+  return __atomic_load_n(&bDidSlowPoll, __ATOMIC_ACQUIRE);
+}
+
+/* Safely stop the Random Number Generator. */
+void RngStop(void) { RandCleanStop(); }
+
+/* Mix the RNG pool. */
+void RngMix(void) {
+  RandLockPool();
+  RandPoolMix();
+  RandUnlockPool();
+}
+
+/**
+ * Run a slow poll in the calling thread and reseed the DRBG
+ * from the pool.
+ *
+ * Returns 1 if the reseed was successful, 0 otherwise.
+ */
+bool RngForceReseed(void) {
+  if (!bDidRandPoolInit)
+    return false;
+  return RandReseedDrbg(true);
+}
+
+/**
+ * Start prefetching random bytes into the ring.
+ *
+ * Returns 1 if prefetching started successfully, 0 otherwise.
+ */
+bool RngStartPrefetch(unsigned int watermark, unsigned int batch) {
+  return RandRingStart(watermark, batch);
+}
+
+/* Stop prefetching and wipe the ring. */
+void RngStopPrefetch(void) { RandRingStop(); }
+
+/**
+ * Request random data from the RNG.
+ *
+ * Returns 1 if the request was successful, 0 otherwise.
+ */
+bool RngFetchBytes(uint8_t *data, size_t len) {
+  return RandFetchBytes(data, len, false);
+}
+
+/**
+ * Take a snapshot of the RNG statistics; see rngstats.h.
+ */
+void RngGetStats(struct xr_stats *stats) {
+  RAND_THREAD_DRBG *pThreadDrbg;
+
+  if (stats == NULL) {
+    Warn("Invalid stats pointer (expected a non-NULL value)",
+         WARN_INVALID_ARGS);
+    return;
+  }
+
+  RandStatsCollect(stats);
+  stats->drbg_generation =
+      (uint64_t)__atomic_load_n(&nRandDrbgGeneration, __ATOMIC_RELAXED);
+
+  pthread_mutex_lock(&threadDrbgListMutex);
+  RandStatsAddThread(stats, &threadStatsRetired);
+  for (pThreadDrbg = pThreadDrbgList; pThreadDrbg;
+       pThreadDrbg = pThreadDrbg->next)
+    RandStatsAddThread(stats, &pThreadDrbg->stats);
+  stats->thread_drbgs = nThreadDrbgs;
+  pthread_mutex_unlock(&threadDrbgListMutex);
+
+  if (bDidRandPoolInit && bDidSeedDrbg) {
+    pthread_mutex_lock(&drbgMutex);
+    stats->central_drbg_reseed_counter = pRandDrbg->reseed_counter;
+    pthread_mutex_unlock(&drbgMutex);
+  }
+}
+
+#if defined(XR_TESTS_RNG_POSIX)
+
+#include <stdio.h>
+/* <sys/wait.h> declares the kill() of <signal.h>, which clashes with
+   the kill() of common/exceptions.h */
+#define kill xr_signal_kill
+#include <sys/wait.h>
+#undef kill
+
+#define RNG_FORK_TEST_SMALL 32  /* Served from the prefetch ring */
+#define RNG_FORK_TEST_LARGE 256 /* Served by the per-thread DRBG */
+
+/* Fetch the same requests in the parent and in a forked child */
+static bool rngposix_test_fork(uint8_t parent[], uint8_t child[]) {
+  const size_t len = RNG_FORK_TEST_SMALL + RNG_FORK_TEST_LARGE;
+  int fds[2], status;
+  size_t got = 0;
+  ssize_t n;
+  pid_t pid;
+
+  if (pipe(fds) != 0)
+    return false;
+
+  if ((pid = fork()) < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    bool ok;
+
+    close(fds[0]);
+    ok = RngFetchBytes(child, RNG_FORK_TEST_SMALL) &&
+         RngFetchBytes(child + RNG_FORK_TEST_SMALL, RNG_FORK_TEST_LARGE) &&
+         write(fds[1], child, len) == (ssize_t)len;
+    _exit(ok ? 0 : 1);
+  }
+
+  close(fds[1]);
+  if (!RngFetchBytes(parent, RNG_FORK_TEST_SMALL) ||
+      !RngFetchBytes(parent + RNG_FORK_TEST_SMALL, RNG_FORK_TEST_LARGE))
+    got = len + 1;
+  while (got < len && (n = read(fds[0], child + got, len - got)) > 0)
+    got += (size_t)n;
+  close(fds[0]);
+
+  return waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+         WEXITSTATUS(status) == 0 && got == len;
+}
+
+/* The child of a fork() must not repeat any output of its parent, be
+   it prefetched or generated by the DRBG of the thread that forked */
+int rngposix_run_test(void) {
+  uint8_t parent[RNG_FORK_TEST_SMALL + RNG_FORK_TEST_LARGE];
+  uint8_t child[RNG_FORK_TEST_SMALL + RNG_FORK_TEST_LARGE];
+  bool bStarted = !DidRngStart();
+  int fails = 0;
+
+  printf("Running tests for rand/rngposix.c\n");
+
+  /* Seed the per-thread DRBG and fill the ring before forking */
+  if ((bStarted && !RngStart()) || !RngFetchBytes(parent, 16) ||
+      !RngStartPrefetch(RNG_RING_DEFAULT_WATERMARK, RNG_RING_DEFAULT_BATCH)) {
+    printf("Start FAIL\n");
+    return 1;
+  }
+  usleep(50 * 1000);
+
+  if (!rngposix_test_fork(parent, child) ||
+      !memcmp(parent, child, RNG_FORK_TEST_SMALL) ||
+      !memcmp(parent + RNG_FORK_TEST_SMALL, child + RNG_FORK_TEST_SMALL,
+              RNG_FORK_TEST_LARGE)) {
+    printf("Fork FAIL\n");
+    fails++;
+  } else {
+    printf("Fork PASS\n");
+  }
+
+  RngStopPrefetch();
+  if (bStarted)
+    RngStop();
+
+  return fails;
+}
+
+#endif /* XR_TESTS_RNG_POSIX */
@@ -0,0 +1,345 @@
+/**
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rngseed.h"
+#include "crypto/sha512.h"
+
+#include <openssl/sha.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
+
+#define RNG_SEED_MAGIC "XRSEED01"
+
+/* The on-disk layout of a seed file */
+typedef struct _RNG_SEED_FILE {
+  uint8_t magic[8];
+  uint8_t seed[RNG_SEED_LEN];
+  uint8_t tag[SHA512_DIGEST_LENGTH];
+} RNG_SEED_FILE;
+
+#if RNG_SEED_FILE_SIZE != 8 + RNG_SEED_LEN + SHA512_DIGEST_LENGTH
+#error "RNG_SEED_FILE_SIZE does not match RNG_SEED_FILE"
+#endif
+
+/* Hash the (public) identity of the host and the user writing the file */
+static void RandSeedIdentity(uint8_t digest[SHA512_DIGEST_LENGTH]) {
+  /* Room for the host name, a user name or ID and a machine ID */
+  char id[512];
+  size_t len = 0;
+
+#if defined(_WIN32)
+  DWORD n;
+
+  n = (DWORD)(sizeof(id) / 2);
+  if (GetComputerNameA(id, &n))
+    len = n + 1;
+  n = GetEnvironmentVariableA("USERPROFILE", id + len,
+                              (DWORD)(sizeof(id) - len));
+  if (n < sizeof(id) - len)
+    len += n;
+#else
+  struct utsname name;
+  int fd;
+  ssize_t n;
+
+  len = (size_t)snprintf(id, sizeof(id), "%u",
+                         (unsigned int)geteuid()) + 1;
+  if (uname(&name) == 0) {
+    n = (ssize_t)snprintf(id + len, sizeof(id) - len, "%s", name.nodename);
+    len += min((size_t)n + 1, sizeof(id) - len);
+  }
+
+  /* Persistent across reboots, unlike the boot ID */
+  if ((fd = open("/etc/machine-id", O_RDONLY | O_CLOEXEC)) >= 0) {
+    if ((n = read(fd, id + len, sizeof(id) - len)) > 0)
+      len += (size_t)n;
+    close(fd);
+  }
+#endif
+
+  sha512((const uint8_t *)id, len, digest);
+}
+
+/* Compute the integrity checksum of a seed file; it is not keyed, so
+   it only catches corrupted and misplaced files */
+static void RandSeedTag(const RNG_SEED_FILE *file,
+                        uint8_t tag[SHA512_DIGEST_LENGTH]) {
+  uint8_t buf[8 + SHA512_DIGEST_LENGTH + RNG_SEED_LEN];
+
+  memcpy(buf, file->magic, 8);
+  RandSeedIdentity(buf + 8);
+  memcpy(buf + 8 + SHA512_DIGEST_LENGTH, file->seed, RNG_SEED_LEN);
+  sha512(buf, sizeof(buf), tag);
+
+  /* Prevent leaks */
+  zeroize(buf, sizeof(buf));
+}
+
+bool RandSeedFileRead(const char *path, uint8_t seed[RNG_SEED_LEN]) {
+  RNG_SEED_FILE file;
+  uint8_t tag[SHA512_DIGEST_LENGTH];
+  bool ret = false;
+
+  if (path == NULL || seed == NULL) {
+    Warn("Invalid seed file arguments (expected non-NULL values)",
+         WARN_INVALID_ARGS);
+    return false;
+  }
+
+#if defined(_WIN32)
+  {
+    HANDLE hFile;
+    LARGE_INTEGER size;
+    DWORD dwRead = 0;
+
+    hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+      return false;
+
+    if (!GetFileSizeEx(hFile, &size) ||
+        size.QuadPart != (LONGLONG)sizeof(file) ||
+        !ReadFile(hFile, &file, (DWORD)sizeof(file), &dwRead, NULL) ||
+        dwRead != sizeof(file)) {
+      CloseHandle(hFile);
+      goto rejected;
+    }
+    CloseHandle(hFile);
+  }
+#else
+  {
+    struct stat st;
+    ssize_t n;
+    int fd;
+
+    /* A missing file is the normal case on the first run */
+    if ((fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) < 0) {
+      if (errno != ENOENT)
+        goto rejected;
+      return false;
+    }
+
+    /* Only trust a file that no one else could have read or written */
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_uid != geteuid() || (st.st_mode & (S_IRWXG | S_IRWXO)) ||
+        st.st_size != (off_t)sizeof(file)) {
+      close(fd);
+      goto rejected;
+    }
+
+    do {
+      n = read(fd, &file, sizeof(file));
+    } while (n < 0 && errno == EINTR);
+    close(fd);
+
+    if (n != (ssize_t)sizeof(file))
+      goto rejected;
+  }
+#endif
+
+  RandSeedTag(&file, tag);
+  if (memcmp(file.magic, RNG_SEED_MAGIC, 8) ||
+      xr_memcmp(file.tag, tag, SHA512_DIGEST_LENGTH))
+    goto rejected;
+
+  memcpy(seed, file.seed, RNG_SEED_LEN);
+  ret = true;
+  goto cleanup;
+
+rejected:
+  Warn("The seed file was rejected (unreadable, corrupted, written on "
+       "another host or by another user, or accessible to other users)",
+       WARN_UNSAFE);
+
+cleanup:
+  /* Prevent leaks */
+  zeroize((uint8_t *)&file, sizeof(file));
+  zeroize(tag, sizeof(tag));
+
+  return ret;
+}
+
+bool RandSeedFileWrite(const char *path, const uint8_t seed[RNG_SEED_LEN]) {
+  RNG_SEED_FILE file;
+  char *tmp = NULL;
+  size_t len;
+  bool ret = false;
+
+  if (path == NULL || seed == NULL) {
+    Warn("Invalid seed file arguments (expected non-NULL values)",
+         WARN_INVALID_ARGS);
+    return false;
+  }
+
+  memcpy(file.magic, RNG_SEED_MAGIC, 8);
+  memcpy(file.seed, seed, RNG_SEED_LEN);
+  RandSeedTag(&file, file.tag);
+
+  len = strlen(path) + sizeof(".tmp");
+  if ((tmp = (char *)malloc(len)) == NULL) {
+    Log(ERR_NO_MEMORY, false, -1, __LINE__);
+    goto cleanup;
+  }
+  snprintf(tmp, len, "%s.tmp", path);
+
+#if defined(_WIN32)
+  {
+    HANDLE hFile;
+    DWORD dwWritten = 0;
+    BOOL bOk;
+
+    hFile = CreateFileA(tmp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_WRITE_THROUGH, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+      Log(ERR_CANNOT_ACCESS_DISK, false, GetLastError(), __LINE__);
+      goto cleanup;
+    }
+
+    bOk = WriteFile(hFile, &file, (DWORD)sizeof(file), &dwWritten, NULL) &&
+          dwWritten == sizeof(file) && FlushFileBuffers(hFile);
+    CloseHandle(hFile);
+
+    if (!bOk || !MoveFileExA(tmp, path,
+                             MOVEFILE_REPLACE_EXISTING |
+                                 MOVEFILE_WRITE_THROUGH)) {
+      Log(ERR_CANNOT_ACCESS_DISK, false, GetLastError(), __LINE__);
+      DeleteFileA(tmp);
+      goto cleanup;
+    }
+  }
+#else
+  {
+    ssize_t n;
+    int fd;
+
+    /* A stale temporary file (or a link planted in its place) is
+       removed rather than written through */
+    unlink(tmp);
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+                   S_IRUSR | S_IWUSR)) < 0) {
+      Log(ERR_CANNOT_ACCESS_DISK, false, errno, __LINE__);
+      goto cleanup;
+    }
+
+    do {
+      n = write(fd, &file, sizeof(file));
+    } while (n < 0 && errno == EINTR);
+
+    if (n != (ssize_t)sizeof(file) || fsync(fd) != 0) {
+      Log(ERR_CANNOT_ACCESS_DISK, false, errno, __LINE__);
+      close(fd);
+      unlink(tmp);
+      goto cleanup;
+    }
+    close(fd);
+
+    if (rename(tmp, path) != 0) {
+      Log(ERR_CANNOT_ACCESS_DISK, false, errno, __LINE__);
+      unlink(tmp);
+      goto cleanup;
+    }
+  }
+#endif
+
+  ret = true;
+
+cleanup:
+  free(tmp);
+
+  /* Prevent leaks */
+  zeroize((uint8_t *)&file, sizeof(file));
+
+  return ret;
+}
+
+#if defined(XR_TESTS_RNG_SEED)
+
+/* A seed must read back as written, and a tampered seed file must be
+   rejected */
+int rngseed_run_test(void) {
+  static const char *path = "test/rngseed.bin";
+  uint8_t seed[RNG_SEED_LEN], got[RNG_SEED_LEN];
+  RNG_SEED_FILE file;
+  FILE *fp;
+  int fails = 0;
+
+  printf("Running tests for rand/rngseed.c\n");
+
+  for (size_t i = 0; i < RNG_SEED_LEN; i++)
+    seed[i] = (uint8_t)(i * 7 + 1);
+
+  remove(path);
+  if (RandSeedFileRead(path, got)) {
+    printf("Missing file FAIL\n");
+    fails++;
+  }
+
+  if (!RandSeedFileWrite(path, seed) || !RandSeedFileRead(path, got) ||
+      memcmp(got, seed, RNG_SEED_LEN)) {
+    printf("Write and read FAIL\n");
+    fails++;
+  } else {
+    printf("Write and read PASS\n");
+  }
+
+  /* Flip one bit of the seed */
+  if ((fp = fopen(path, "rb")) == NULL) {
+    fails++;
+  } else if (fread(&file, 1, sizeof(file), fp) != sizeof(file)) {
+    fclose(fp);
+    fails++;
+  } else {
+    fclose(fp);
+    file.seed[17] ^= 0x10;
+    if ((fp = fopen(path, "wb")) != NULL) {
+      fwrite(&file, 1, sizeof(file), fp);
+      fclose(fp);
+    }
+    if (RandSeedFileRead(path, got)) {
+      printf("Tampered file FAIL\n");
+      fails++;
+    } else {
+      printf("Tampered file PASS\n");
+    }
+  }
+
+#if !defined(_WIN32)
+  /* A file readable by others is not trusted even if it is intact */
+  if (!RandSeedFileWrite(path, seed) || chmod(path, 0644) != 0 ||
+      RandSeedFileRead(path, got)) {
+    printf("Permissions FAIL\n");
+    fails++;
+  } else {
+    printf("Permissions PASS\n");
+  }
+#endif
+
+  remove(path);
+
+  return fails;
+}
+
+#endif /* XR_TESTS_RNG_SEED */
@@ -0,0 +1,78 @@
+/**
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * The seed file of the RNG core, shared by the rngw32.c and rngposix.c
+ * backends.
+ *
+ * A seed file carries RNG_SEED_LEN bytes of DRBG output from one run
+ * to the next, so that the first output of a process started with
+ * RNG_START_FAST does not rest on the OS CSPRNG alone while the Jitter
+ * RNG and the first slow poll are still running in the background.
+ *
+ * The file carries an integrity checksum: the SHA-512 digest of the
+ * seed and of the host and user names, so that a truncated or
+ * corrupted file, or one copied from another host or user, is not
+ * used. The checksum is not keyed, since everything it covers is
+ * public; anyone who can write the file can forge it. The only
+ * protection against that is the file's access control: on POSIX
+ * systems it must be a regular file owned by the user with no group
+ * or other permissions, and on Windows it is only as safe as the
+ * directory it is kept in. This is why the seed is only ever added
+ * to the pool on top of the OS CSPRNG output, never used in its place.
+ * The file is replaced with fresh output as soon as it has been read
+ * (and again by RngStop()), so that the same seed is never used twice.
+ */
+
+#ifndef RNGSEED_H
+#define RNGSEED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common/defs.h"
+#include <stdbool.h>
+
+/* Bytes of seed in a seed file */
+#define RNG_SEED_LEN 64
+
+/* Size of a seed file: magic, seed and SHA-512 checksum */
+#define RNG_SEED_FILE_SIZE (8 + RNG_SEED_LEN + 64)
+
+/**
+ * Read and check the seed file at path.
+ *
+ * Returns true if the file exists and is valid, false otherwise
+ * (a file that exists but is rejected is reported with a warning).
+ */
+bool RandSeedFileRead(const char *path, uint8_t seed[RNG_SEED_LEN]);
+
+/**
+ * Checksum a seed and atomically replace the seed file at path with it,
+ * through a temporary file next to it that is flushed to the disk
+ * before it is renamed.
+ *
+ * Returns true on success, false otherwise.
+ */
+bool RandSeedFileWrite(const char *path, const uint8_t seed[RNG_SEED_LEN]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RNGSEED_H */
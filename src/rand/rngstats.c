@@ -0,0 +1,102 @@
+/**
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rngstats.h"
+#include "ctr_drbg.h"
+#include "rdrand.h"
+
+#include <string.h>
+
+struct xr_stats randStats;
+volatile bool bRandTimingEnabled = false;
+
+bool RngEnableTiming(bool enable) {
+#if defined(RNG_STATS_HAVE_TSC)
+  __atomic_store_n(&bRandTimingEnabled, enable, __ATOMIC_RELAXED);
+  return true;
+#else
+  (void)enable;
+  return false;
+#endif
+}
+
+void RandStatsRecord(struct xr_hist *h, uint64_t start) {
+#if defined(RNG_STATS_HAVE_TSC)
+  uint64_t cycles, max;
+  int bucket;
+
+  if (start == 0)
+    return;
+
+  cycles = (uint64_t)__rdtsc() - start;
+  bucket = cycles ? 63 - __builtin_clzll(cycles) : 0;
+  if (bucket >= XR_STATS_HIST_BUCKETS)
+    bucket = XR_STATS_HIST_BUCKETS - 1;
+
+  RNG_STAT_INC(h->count);
+  RNG_STAT_ADD(h->total_cycles, cycles);
+  RNG_STAT_INC(h->buckets[bucket]);
+
+  max = RNG_STAT_LOAD(h->max_cycles);
+  while (cycles > max &&
+         !__atomic_compare_exchange_n(&h->max_cycles, &max, cycles, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+#else
+  (void)h;
+  (void)start;
+#endif
+}
+
+void RandStatsCollect(struct xr_stats *stats) {
+  const uint64_t *src = (const uint64_t *)&randStats;
+  uint64_t *dst = (uint64_t *)stats;
+
+  /* The struct is made of uint64_t fields only */
+  for (size_t i = 0; i < sizeof(struct xr_stats) / sizeof(uint64_t); i++)
+    dst[i] = RNG_STAT_LOAD(src[i]);
+
+  stats->drbg_max_reseed_count = CTR_DRBG_MAX_RESEED_CNT;
+  stats->rdrand_underflows = rdrand_underflows();
+  stats->rdseed_underflows = rdseed_underflows();
+  stats->timing_enabled = RNG_STAT_LOAD(bRandTimingEnabled);
+}
+
+void RandStatsAddThread(struct xr_stats *stats, const RAND_THREAD_STATS *ts) {
+  uint64_t reseed_counter = RNG_STAT_LOAD(ts->reseed_counter);
+
+  stats->fetch_calls += RNG_STAT_LOAD(ts->fetch_calls);
+  stats->fetch_bytes += RNG_STAT_LOAD(ts->fetch_bytes);
+  stats->fetch_failures += RNG_STAT_LOAD(ts->fetch_failures);
+  stats->ring_hits += RNG_STAT_LOAD(ts->ring_hits);
+  stats->ring_misses += RNG_STAT_LOAD(ts->ring_misses);
+  stats->thread_drbg_bytes += RNG_STAT_LOAD(ts->drbg_bytes);
+  stats->thread_drbg_reseeds += RNG_STAT_LOAD(ts->drbg_reseeds);
+  if (reseed_counter > stats->thread_drbg_max_reseed_counter)
+    stats->thread_drbg_max_reseed_counter = reseed_counter;
+}
+
+void RandStatsRetireThread(RAND_THREAD_STATS *retired,
+                           const RAND_THREAD_STATS *ts) {
+  RNG_STAT_ADD(retired->fetch_calls, ts->fetch_calls);
+  RNG_STAT_ADD(retired->fetch_bytes, ts->fetch_bytes);
+  RNG_STAT_ADD(retired->fetch_failures, ts->fetch_failures);
+  RNG_STAT_ADD(retired->ring_hits, ts->ring_hits);
+  RNG_STAT_ADD(retired->ring_misses, ts->ring_misses);
+  RNG_STAT_ADD(retired->drbg_bytes, ts->drbg_bytes);
+  RNG_STAT_ADD(retired->drbg_reseeds, ts->drbg_reseeds);
+}
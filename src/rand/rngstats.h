@@ -0,0 +1,190 @@
+/**
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Runtime statistics of the RNG core, shared by the rngw32.c and
+ * rngposix.c backends.
+ *
+ * The event counters are always maintained; those updated on every
+ * RngFetchBytes() call are kept per thread (written only by their
+ * thread) and summed by RngGetStats(), everything else is a relaxed
+ * atomic. The latency histograms cost two TSC reads per event and
+ * are only filled while enabled with RngEnableTiming().
+ */
+
+#ifndef RNGSTATS_H
+#define RNGSTATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common/defs.h"
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386)
+#include <x86intrin.h> /* __rdtsc */
+#define RNG_STATS_HAVE_TSC
+#endif
+
+/* Number of log2 buckets per latency histogram */
+#define XR_STATS_HIST_BUCKETS 32
+
+/**
+ * A latency histogram in TSC cycles; bucket i counts the events that
+ * took [2^i, 2^(i+1)) cycles (bucket 0 also counts 0 cycles, and the
+ * last bucket everything above).
+ */
+struct xr_hist {
+  uint64_t count;
+  uint64_t total_cycles;
+  uint64_t max_cycles;
+  uint64_t buckets[XR_STATS_HIST_BUCKETS];
+};
+
+/**
+ * A snapshot of the RNG statistics. All counters are totals since
+ * the process started (across RngStart()/RngStop() cycles); compute
+ * rates from the difference of two snapshots.
+ */
+struct xr_stats {
+  /* RngFetchBytes() / RandFetchBytes() */
+  uint64_t fetch_calls;
+  uint64_t fetch_bytes;
+  uint64_t fetch_failures;
+  uint64_t ring_hits;   /* Requests served from the prefetch ring */
+  uint64_t ring_misses; /* Ring enabled but empty (or request too large) */
+
+  /* Pool activity */
+  uint64_t fast_polls;
+  uint64_t fast_poll_failures;
+  uint64_t slow_polls;
+  uint64_t slow_poll_failures;
+  uint64_t pool_mixes;
+
+  /* The pool lock (randCritSec / randMutex) */
+  uint64_t pool_lock_acquires;
+  uint64_t pool_lock_contended; /* Acquires that had to wait */
+
+  /* The central DRBG, (re)seeded from the pool */
+  uint64_t drbg_reseeds;
+  uint64_t drbg_reseed_failures;
+  uint64_t drbg_generation;
+  uint64_t central_drbg_bytes; /* Seeds handed to the per-thread DRBGs */
+  uint64_t central_drbg_reseed_counter;
+
+  /* The per-thread DRBGs, (re)seeded from the central DRBG */
+  uint64_t thread_drbgs; /* Currently allocated */
+  uint64_t thread_drbg_reseeds;
+  uint64_t thread_drbg_bytes;
+  uint64_t thread_drbg_max_reseed_counter;
+
+  /* The reseed_counter limit of the DRBGs (CTR_DRBG_MAX_RESEED_CNT) */
+  uint64_t drbg_max_reseed_count;
+
+  /* Underflows of the CPU generators (see rdrand.h) */
+  uint64_t rdrand_underflows;
+  uint64_t rdseed_underflows;
+
+  /* Nonzero if the histograms below are being filled */
+  uint64_t timing_enabled;
+
+  struct xr_hist fetch;
+  struct xr_hist fast_poll;
+  struct xr_hist slow_poll;
+  struct xr_hist pool_mix;
+  struct xr_hist drbg_generate;
+  struct xr_hist drbg_reseed;
+  struct xr_hist pool_lock_wait;
+  struct xr_hist pool_lock_hold;
+};
+
+/**
+ * Take a snapshot of the RNG statistics. Can be called at any time
+ * from any thread; the per-thread DRBG figures are only included
+ * while the RNG is running.
+ */
+void RngGetStats(struct xr_stats *stats);
+
+/**
+ * Start (or stop) filling the latency histograms.
+ *
+ * Returns 1 if timing is supported (the CPU has a TSC), 0 otherwise.
+ */
+bool RngEnableTiming(bool enable);
+
+/*
+ * Internal interface of the backends
+ */
+
+/* Relaxed atomic updates of the shared counters */
+#define RNG_STAT_ADD(x, n)                                                     \
+  __atomic_fetch_add(&(x), (uint64_t)(n), __ATOMIC_RELAXED)
+#define RNG_STAT_INC(x) RNG_STAT_ADD(x, 1)
+#define RNG_STAT_LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define RNG_STAT_SET(x, v)                                                     \
+  __atomic_store_n(&(x), (uint64_t)(v), __ATOMIC_RELAXED)
+
+/* Update a counter that only its owning thread writes; a plain load
+   and store, but safe to read from other threads */
+#define RNG_STAT_LOCAL_ADD(x, n) RNG_STAT_SET(x, RNG_STAT_LOAD(x) + (n))
+
+/* The counters kept by each per-thread DRBG */
+typedef struct _RAND_THREAD_STATS {
+  uint64_t fetch_calls;
+  uint64_t fetch_bytes;
+  uint64_t fetch_failures;
+  uint64_t ring_hits;
+  uint64_t ring_misses;
+  uint64_t drbg_bytes;
+  uint64_t drbg_reseeds;
+  uint64_t reseed_counter; /* Copy of the DRBG reseed_counter */
+} RAND_THREAD_STATS;
+
+/* The shared counters and histograms */
+extern struct xr_stats randStats;
+extern volatile bool bRandTimingEnabled;
+
+/* Get the start time of an event, or 0 if timing is disabled */
+static inline uint64_t RandStatsStart(void) {
+#if defined(RNG_STATS_HAVE_TSC)
+  return __atomic_load_n(&bRandTimingEnabled, __ATOMIC_RELAXED)
+             ? (uint64_t)__rdtsc()
+             : 0;
+#else
+  return 0;
+#endif
+}
+
+/* Add the event that started at start (if nonzero) to h */
+void RandStatsRecord(struct xr_hist *h, uint64_t start);
+
+/* Copy the shared counters and histograms to stats */
+void RandStatsCollect(struct xr_stats *stats);
+
+/* Add the counters of a per-thread DRBG to stats */
+void RandStatsAddThread(struct xr_stats *stats, const RAND_THREAD_STATS *ts);
+
+/* Fold the counters of an exiting thread into *retired */
+void RandStatsRetireThread(RAND_THREAD_STATS *retired,
+                           const RAND_THREAD_STATS *ts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RNGSTATS_H */
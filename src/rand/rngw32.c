@@ -16,9 +16,14 @@
  */
 
 #include "rngw32.h"
+#include "common/secure_alloc.h"
+#include "chacha_drbg.h"
 #include "crypto/crc.h"
+#include "crypto/sha512.h"
+#include "ctr_drbg.h"
 #include "jitterentropy/jitterentropy.h"
 #include "rdrand.h"
+#include "rngseed.h"
 
 #include <bcrypt.h>
 #include <iphlpapi.h>
@@ -34,16 +39,103 @@
 static uint8_t *pRandPool = NULL;
 static UINT nCurrentPoolWritePos = 0;
 static UINT nCurrentPoolReadPos = 0;
+/* Bytes added to the pool since it was last mixed */
+static UINT nPoolBytesSinceMix = 0;
 
 /* The fast poll thread handle */
 static HANDLE hPeriodicFastPollThreadHandle = NULL;
 
+/* The background slow poll thread; hSlowPollDoneEvent is set once
+   the first slow poll has been attempted */
+static HANDLE hSlowPollThreadHandle = NULL;
+static HANDLE hSlowPollStopEvent = NULL;
+static HANDLE hSlowPollDoneEvent = NULL;
+/* With RNG_START_FAST, set once the first request has been served */
+static HANDLE hFastStartEvent = NULL;
+
+/* A Jitter RNG collector and the processor it is pinned to */
+typedef struct _JENT_JOB {
+  struct rand_data *collector;
+  DWORD_PTR affinity;
+  void (*fn)(struct _JENT_JOB *job); /* Run by RandJentRunJobs() */
+  ssize_t ret;
+  uint8_t bytes[RNG_JENT_COLLECTOR_BYTES];
+} JENT_JOB;
+
+/* The Jitter RNG collectors used by the slow polls, allocated once
+   (after the startup health tests) by RandJentInit() */
+static JENT_JOB jentJobs[RNG_JENT_MAX_COLLECTORS];
+static UINT nJentCollectors = 0;
+/* 1 once RandJentInit() has succeeded, -1 if it failed */
+static int nJentInitState = 0;
+
+/* RNG_START_FAST: the DRBG was seeded by RandPoolInitEx() from the
+   initial seed, without waiting for the first slow poll */
+static BOOL bFastStart = FALSE;
+/* The seed file, if any (owned copy of the path) */
+static char *pSeedFilePath = NULL;
+
+/* The central DRBG seeded from the pool which seeds the per-thread DRBGs */
+static CTR_DRBG_STATE *pRandDrbg = NULL;
+static BOOL volatile bDidSeedDrbg = FALSE;
+
+/* Incremented every time the central DRBG is (re)seeded from the pool */
+static LONG volatile nRandDrbgGeneration = 0;
+
+/* Per-thread DRBG, kept in fiber local storage so that it is
+   cleared and freed when the thread exits */
+typedef struct _RAND_THREAD_DRBG {
+  union {
+    CTR_DRBG_STATE drbg;
+    CHACHA_DRBG_STATE chacha; /* If bThreadDrbgChaCha */
+  };
+  LONG generation; /* Central generation last seeded from; 0 if unseeded */
+  RAND_THREAD_STATS stats;
+  struct _RAND_THREAD_DRBG *prev, *next;
+} RAND_THREAD_DRBG;
+
+static DWORD dwRandFlsIndex = FLS_OUT_OF_INDEXES;
+static RAND_THREAD_DRBG *pThreadDrbgList = NULL;
+static UINT nThreadDrbgs = 0;
+/* Counters of the per-thread DRBGs that have been freed */
+static RAND_THREAD_STATS threadStatsRetired;
+/* Protects pThreadDrbgList; statically initialized and never
+   destroyed since threads may exit at any time */
+static SRWLOCK threadDrbgListLock = SRWLOCK_INIT;
+
+/* Use the ChaCha20 generator instead of the CTR_DRBG for the
+   per-thread DRBGs; set when the host has no AES hardware */
+static BOOL bThreadDrbgChaCha = FALSE;
+
+static VOID WINAPI RandThreadDrbgFree(PVOID lpFlsData);
+
+/* A slot of the prefetch ring; seq tells whether the slot holds
+   fresh output (pos + 1) or is free to be filled (pos) */
+typedef struct __declspec(align(64)) _RAND_RING_SLOT {
+  LONG volatile seq;
+  uint8_t data[RNG_RING_SLOT_SIZE];
+} RAND_RING_SLOT;
+
+/* The prefetch ring, filled by a single producer thread and
+   drained by any number of consumers */
+static RAND_RING_SLOT *pRandRing = NULL;
+static LONG volatile nRingHead = 0; /* Next slot to fill */
+static LONG volatile nRingTail = 0; /* Next slot to pop */
+static UINT nRingWatermark = 0;
+static UINT nRingBatch = 0;
+static HANDLE hRingFillThreadHandle = NULL;
+static HANDLE hRingFillEvent = NULL;
+static BOOL volatile bRingEnabled = FALSE;
+static BOOL volatile bTerminateRingFillThread = FALSE;
+
+static void RandRingStop(void);
+
 BOOL bStrictChecksEnabled = FALSE;
 BOOL bUserEventsEnabled = FALSE;
 
 /* Internal control and status variables */
 static BOOL bDidRandPoolInit = FALSE;
-static BOOL bDidSlowPoll = FALSE;
+static BOOL volatile bDidSlowPoll = FALSE;
 static BOOL bIsWin32CngAvailable = FALSE;
 
 /* Global status variables for RDRAND and RDSEED */
@@ -70,9 +162,37 @@ static HHOOK hKbdHook = NULL;
 
 /* The critical section */
 CRITICAL_SECTION randCritSec;
+/* The critical section for the DRBG; if both are held, drbgCritSec
+   must be entered first */
+CRITICAL_SECTION drbgCritSec;
+/* Serializes slow polls; must be entered before randCritSec
+   if both are held */
+CRITICAL_SECTION slowPollCritSec;
 /* Thread control variable for the fast poll thread */
 BOOL volatile bTerminateFastPollThread = FALSE;
 
+/* Start time of the current pool lock hold (protected by the lock) */
+static uint64_t nPoolLockStart = 0;
+
+/* Enter the pool critical section, counting the entries that have
+   to wait */
+static void RandLockPool(void) {
+  if (!TryEnterCriticalSection(&randCritSec)) {
+    uint64_t start = RandStatsStart();
+
+    RNG_STAT_INC(randStats.pool_lock_contended);
+    EnterCriticalSection(&randCritSec);
+    RandStatsRecord(&randStats.pool_lock_wait, start);
+  }
+  RNG_STAT_INC(randStats.pool_lock_acquires);
+  nPoolLockStart = RandStatsStart();
+}
+
+static void RandUnlockPool(void) {
+  RandStatsRecord(&randStats.pool_lock_hold, nPoolLockStart);
+  LeaveCriticalSection(&randCritSec);
+}
+
 /* 64 byte buffer */
 typedef struct _BUF_ST {
   size_t size;
@@ -82,14 +202,15 @@ typedef struct _BUF_ST {
   };
 } BUF, *PBUF;
 
-/* Add a single byte to the pool */
+/* Add a single byte to the pool, mixing the pool once a full
+   block of input has been absorbed */
 #define AddByte(x)                                                             \
   do {                                                                         \
-    if (nCurrentPoolWritePos % RNG_POOL_MIX_INTERVAL == 0)                     \
-      RandPoolMix();                                                           \
     if (nCurrentPoolWritePos == RNG_POOL_SIZE)                                 \
       nCurrentPoolWritePos = 0;                                                \
     pRandPool[nCurrentPoolWritePos++] ^= (uint8_t)x;                           \
+    if (++nPoolBytesSinceMix == RNG_POOL_MIX_INTERVAL)                         \
+      RandPoolMix();                                                           \
   } while (0)
 
 /* Add a pointer to the pool */
@@ -126,13 +247,34 @@ void Add64(uint64_t x) {
   AddByte((x >> 56));
 }
 
-/* Add a buffer to the pool */
+/* Add a buffer to the pool; the bytes up to the next mix (or the end
+   of the pool) are XORed in as one run */
 static void AddBuf(uint8_t *buf, size_t size) {
-  for (size_t i = 0; i < size; ++i) {
-    AddByte(buf[i]);
+  size_t i, n;
+
+  while (size) {
+    if (nCurrentPoolWritePos == RNG_POOL_SIZE)
+      nCurrentPoolWritePos = 0;
+    n = min(size, (size_t)(RNG_POOL_MIX_INTERVAL - nPoolBytesSinceMix));
+    n = min(n, (size_t)(RNG_POOL_SIZE - nCurrentPoolWritePos));
+    for (i = 0; i < n; ++i)
+      pRandPool[nCurrentPoolWritePos + i] ^= buf[i];
+    nCurrentPoolWritePos += (UINT)n;
+    nPoolBytesSinceMix += (UINT)n;
+    buf += n;
+    size -= n;
+    if (nPoolBytesSinceMix == RNG_POOL_MIX_INTERVAL)
+      RandPoolMix();
   }
 }
 
+/* Add a buffer to the pool while holding the pool lock */
+static void AddBufLocked(uint8_t *buf, size_t size) {
+  RandLockPool();
+  AddBuf(buf, size);
+  RandUnlockPool();
+}
+
 /* Type definitions and function pointers to call the CNG API functions */
 typedef NTSTATUS(WINAPI *BCRYPTOPENALGORITHMPROVIDER)(
     BCRYPT_ALG_HANDLE *phAlgorithm, LPCWSTR pszAlgId, LPCWSTR pszImplementation,
@@ -149,39 +291,104 @@ static BCRYPTOPENALGORITHMPROVIDER pBCryptOpenAlgorithmProvider = NULL;
 static BCRYPTGENRANDOM pBCryptGenRandom = NULL;
 static BCRYPTCLOSEALGORITHMPROVIDER pBCryptCloseAlgorithmProvider = NULL;
 
+static BOOL RandReseedDrbg(int forceSlowPoll);
+static BOOL RandJentInit(void);
+static int RandDrbgCentralCallback(void *ctx, uint8_t *buf, size_t len);
+static unsigned __stdcall SlowPollThreadProc(void *_dummy);
+
+/**
+ * Add the initial seed to the pool: RNG_SEED_LEN bytes from the CNG
+ * provider, the seed from the seed file if there is a valid one, and
+ * a fast poll.
+ *
+ * Returns TRUE if the CNG provider delivered its bytes, so that the
+ * seed does not depend on the seed file.
+ */
+static BOOL RandInitialSeed(void) {
+  uint8_t seed[RNG_SEED_LEN];
+  BOOL bOsSeed;
+
+  if (!(bOsSeed = pBCryptGenRandom(hBCryptProv, seed, sizeof(seed), 0) ==
+                  ERROR_SUCCESS))
+    Log(ERR_WIN32_CNG, FALSE, GetLastError(), __LINE__);
+
+  RandLockPool();
+  if (bOsSeed)
+    AddBuf(seed, sizeof(seed));
+  if (pSeedFilePath && RandSeedFileRead(pSeedFilePath, seed))
+    AddBuf(seed, sizeof(seed));
+  if (!RandFastPoll())
+    bOsSeed = FALSE;
+  RandUnlockPool();
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+
+  return bOsSeed;
+}
+
+/* Replace the seed file with fresh output of the central DRBG */
+static void RandSeedFileUpdate(void) {
+  uint8_t seed[RNG_SEED_LEN];
+
+  if (RandDrbgCentralCallback(NULL, seed, sizeof(seed)) == 0)
+    RandSeedFileWrite(pSeedFilePath, seed);
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+}
+
 /**
  * Initialize the  Random Number Generator.   Mount the pool  onto
  * memory, start the fast  poll thread, load and init the  Windows
- * CNG randomness provider.
+ * CNG randomness provider; see RngStartEx() for the flags and the
+ * seed file.
  *
  * Allocate RNG_POOL_SIZE  bytes of memory for the randomness pool
  * and Lock the region to physical memory to prevent the pool from
  * being paged to the disk.
  */
-BOOL RandPoolInit(void) {
+BOOL RandPoolInitEx(unsigned int flags, const char *seedFile) {
   if (bDidRandPoolInit)
     return TRUE;
 
   nCurrentPoolWritePos = 0;
   nCurrentPoolReadPos = 0;
+  nPoolBytesSinceMix = 0;
 
   InitializeCriticalSection(&randCritSec);
+  InitializeCriticalSection(&drbgCritSec);
+  InitializeCriticalSection(&slowPollCritSec);
 
-  pRandPool = _aligned_malloc(RNG_POOL_SIZE, 8);
+  /* The pool is locked to physical memory, between guard pages and on
+     the NUMA node of the calling thread */
+  pRandPool = xr_secure_alloc(RNG_POOL_SIZE, XR_NUMA_NODE_LOCAL,
+                              XR_SECURE_LOCK | XR_SECURE_GUARD);
 
   if (pRandPool == NULL) {
-    Log(ERR_NO_MEMORY, FALSE, errno, __LINE__);
+    Log(ERR_RAND_INIT, FALSE, GetLastError(), __LINE__);
     return FALSE;
   }
 
-  if (VirtualLock(pRandPool, RNG_POOL_SIZE) == 0) {
-    _aligned_free(pRandPool);
+  /* The DRBG state is locked to physical memory just like the pool */
+  pRandDrbg = xr_secure_alloc(sizeof(CTR_DRBG_STATE), XR_NUMA_NODE_LOCAL,
+                              XR_SECURE_LOCK | XR_SECURE_GUARD);
+
+  if (pRandDrbg == NULL) {
+    xr_secure_free(pRandPool);
+    pRandPool = NULL;
     Log(ERR_RAND_INIT, FALSE, GetLastError(), __LINE__);
     return FALSE;
   }
 
   bDidRandPoolInit = TRUE;
 
+  /* The callback clears and frees the per-thread DRBGs on thread exit */
+  if ((dwRandFlsIndex = FlsAlloc(RandThreadDrbgFree)) == FLS_OUT_OF_INDEXES) {
+    Log(ERR_RAND_INIT, FALSE, GetLastError(), __LINE__);
+    goto err;
+  }
+
   dwWin32CngLastErr = ERROR_SUCCESS;
 
   /* Load the BCrypt library and initialize the CNG API function pointers */
@@ -219,15 +426,49 @@ BOOL RandPoolInit(void) {
     }
   }
 
+  bThreadDrbgChaCha = !aes256_has_hw();
+
   if (rdrand_check_support())
     bHasRdrand = TRUE;
   if (rdseed_check_support())
     bHasRdseed = TRUE;
 
+  if (seedFile != NULL && (pSeedFilePath = _strdup(seedFile)) == NULL) {
+    Log(ERR_NO_MEMORY, FALSE, ERROR_NOT_ENOUGH_MEMORY, __LINE__);
+    goto err;
+  }
+
+  /* In strict mode the first output always waits for the first slow
+     poll, and with it for the Jitter RNG */
+  bFastStart = (flags & RNG_START_FAST) && !bStrictChecksEnabled;
+
+  /* Otherwise the Jitter RNG startup health tests are run by the
+     first slow poll, in the background */
+  if (!bFastStart && !RandJentInit())
+    goto err;
+
+  /* Seed the DRBG right away from the initial seed; if the CNG
+     provider fails, fall back to waiting for the first slow poll */
+  if (bFastStart && !(RandInitialSeed() && RandReseedDrbg(FALSE)))
+    bFastStart = FALSE;
+  else if (!bFastStart && pSeedFilePath)
+    RandInitialSeed();
+
+  if (bFastStart && !(hFastStartEvent = CreateEvent(NULL, TRUE, FALSE, NULL)))
+    goto err;
+
   if (!(hPeriodicFastPollThreadHandle =
             (HANDLE)_beginthreadex(NULL, 0, FastPollThreadProc, NULL, 0, NULL)))
     goto err;
 
+  /* Start the first slow poll right away in the background, so that it
+     is usually done by the time the first bytes are requested */
+  if (!(hSlowPollStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL)) ||
+      !(hSlowPollDoneEvent = CreateEvent(NULL, TRUE, FALSE, NULL)) ||
+      !(hSlowPollThreadHandle =
+            (HANDLE)_beginthreadex(NULL, 0, SlowPollThreadProc, NULL, 0, NULL)))
+    goto err;
+
   return TRUE;
 
 err:
@@ -237,6 +478,8 @@ err:
   return FALSE;
 }
 
+BOOL RandPoolInit(void) { return RandPoolInitEx(0, NULL); }
+
 /**
  * Safely stop RNG, release all hooks,  terminate the thread, reset
  * all  global  status and  control flags  and free any dynamically
@@ -251,7 +494,7 @@ void RandCleanStop(void) {
   if (!bDidRandPoolInit)
     return;
 
-  EnterCriticalSection(&randCritSec);
+  RandLockPool();
 
   if (hMouseHook != NULL) {
     UnhookWindowsHookEx(hMouseHook);
@@ -264,11 +507,53 @@ void RandCleanStop(void) {
 
   bTerminateFastPollThread = TRUE;
 
-  LeaveCriticalSection(&randCritSec);
+  RandUnlockPool();
 
   if (hPeriodicFastPollThreadHandle != NULL)
     WaitForSingleObject(hPeriodicFastPollThreadHandle, INFINITE);
 
+  /* An ongoing slow poll is finished first */
+  if (hSlowPollThreadHandle != NULL) {
+    SetEvent(hSlowPollStopEvent);
+    WaitForSingleObject(hSlowPollThreadHandle, INFINITE);
+    CloseHandle(hSlowPollThreadHandle);
+    hSlowPollThreadHandle = NULL;
+  }
+
+  if (hSlowPollStopEvent != NULL) {
+    CloseHandle(hSlowPollStopEvent);
+    hSlowPollStopEvent = NULL;
+  }
+
+  if (hSlowPollDoneEvent != NULL) {
+    CloseHandle(hSlowPollDoneEvent);
+    hSlowPollDoneEvent = NULL;
+  }
+
+  if (hFastStartEvent != NULL) {
+    CloseHandle(hFastStartEvent);
+    hFastStartEvent = NULL;
+  }
+
+  /* This also clears the collector states */
+  for (UINT i = 0; i < nJentCollectors; i++) {
+    if (jentJobs[i].collector != NULL)
+      jent_entropy_collector_free(jentJobs[i].collector);
+  }
+  zeroize((uint8_t *)jentJobs, sizeof(jentJobs));
+  nJentCollectors = 0;
+  nJentInitState = 0;
+
+  /* Leave a fresh seed for the next run, which now also carries the
+     slow polls of this one */
+  if (pSeedFilePath != NULL) {
+    if (bDidSeedDrbg)
+      RandSeedFileUpdate();
+    free(pSeedFilePath);
+    pSeedFilePath = NULL;
+  }
+  bFastStart = FALSE;
+
   if (bIsWin32CngAvailable) {
     pBCryptCloseAlgorithmProvider(hBCryptProv, 0);
     bIsWin32CngAvailable = FALSE;
@@ -298,12 +583,29 @@ void RandCleanStop(void) {
 
   hPeriodicFastPollThreadHandle = NULL;
 
+  RandRingStop();
+
+  /* Freeing the index runs the callback for the DRBG of each thread */
+  if (dwRandFlsIndex != FLS_OUT_OF_INDEXES) {
+    FlsFree(dwRandFlsIndex);
+    dwRandFlsIndex = FLS_OUT_OF_INDEXES;
+  }
+  nThreadDrbgs = 0;
+
   DeleteCriticalSection(&randCritSec);
+  DeleteCriticalSection(&drbgCritSec);
+  DeleteCriticalSection(&slowPollCritSec);
+
+  /* Clear, unlock and free the central DRBG */
+  ctr_drbg_clear(pRandDrbg);
+  xr_secure_free(pRandDrbg);
+
+  pRandDrbg = NULL;
+  bDidSeedDrbg = FALSE;
+  nRandDrbgGeneration = 0;
 
   /* Unlock, clear and free the randomness pool */
-  VirtualUnlock(pRandPool, RNG_POOL_SIZE);
-  zeroize(pRandPool, RNG_POOL_SIZE);
-  _aligned_free(pRandPool);
+  xr_secure_free(pRandPool);
 
   pRandPool = NULL;
   bStrictChecksEnabled = FALSE;
@@ -311,29 +613,102 @@ void RandCleanStop(void) {
   bDidSlowPoll = FALSE;
   nCurrentPoolWritePos = 0;
   nCurrentPoolReadPos = 0;
+  nPoolBytesSinceMix = 0;
+}
+
+/* Whether RandCleanStop() has told the slow poll thread to stop */
+static BOOL RandPollThreadsStopping(void) {
+  return WaitForSingleObject(hSlowPollStopEvent, 0) == WAIT_OBJECT_0;
 }
 
-/* The thread procedure called periodically to poll for system entropy. */
+/**
+ * The thread procedure called periodically to poll for system entropy.
+ *
+ * Every poll also mixes the pool, and every RNG_DRBG_RESEED_INTERVAL
+ * polls the DRBG is reseeded from the pool, so that none of this work
+ * has to be done inline when bytes are requested.
+ */
 static unsigned __stdcall FastPollThreadProc(void *_dummy) {
+  UINT nPolls = 0;
+
   UNREFERENCED_PARAMETER(_dummy);
 
   for (;;) {
-    EnterCriticalSection(&randCritSec);
+    RandLockPool();
 
     if (bTerminateFastPollThread) {
       bTerminateFastPollThread = FALSE;
-      LeaveCriticalSection(&randCritSec);
+      RandUnlockPool();
       _endthreadex(0);
     } else {
       RandFastPoll();
     }
 
-    LeaveCriticalSection(&randCritSec);
+    RandUnlockPool();
+
+    if (++nPolls >= RNG_DRBG_RESEED_INTERVAL) {
+      nPolls = 0;
+      if (bDidSeedDrbg)
+        RandReseedDrbg(FALSE);
+    }
 
     Sleep(RNG_FAST_POLL_INTERVAL);
   }
 }
 
+/**
+ * The thread procedure for the slow polls, which runs the first one
+ * immediately and then one every RNG_SLOW_POLL_INTERVAL. The results
+ * reach the DRBG with the next periodic reseed from the pool.
+ *
+ * With RNG_START_FAST the first slow poll waits for the first request
+ * to be served (for at most RNG_FAST_START_DELAY), so that it does not
+ * compete with it for the processor, and then also runs the Jitter RNG
+ * startup health tests; its results are brought into the DRBG at once.
+ * The seed file is replaced before that, so that it is not read again
+ * should the process die early.
+ */
+static unsigned __stdcall SlowPollThreadProc(void *_dummy) {
+  DWORD dwWait = 0;
+  BOOL bFirst = TRUE;
+
+  UNREFERENCED_PARAMETER(_dummy);
+
+  if (bFastStart) {
+    HANDLE hEvents[2] = {hSlowPollStopEvent, hFastStartEvent};
+
+    /* The caller does not wait for the slow polls, so keep them from
+       preempting it on a busy or single processor */
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+
+    WaitForMultipleObjects(2, hEvents, FALSE, RNG_FAST_START_DELAY);
+
+    if (pSeedFilePath)
+      RandSeedFileUpdate();
+  }
+
+  while (WaitForSingleObject(hSlowPollStopEvent, dwWait) == WAIT_TIMEOUT) {
+    BOOL bPolled = RandSlowPoll();
+
+    /* A fetch may be waiting for this, with drbgCritSec held */
+    SetEvent(hSlowPollDoneEvent);
+
+    if (bPolled && bFirst && (bFastStart || pSeedFilePath)) {
+      RandReseedDrbg(FALSE);
+      if (!bFastStart)
+        RandSeedFileUpdate();
+    }
+    bFirst = FALSE;
+    dwWait = RNG_SLOW_POLL_INTERVAL;
+  }
+
+  /* Release any fetch still waiting for the first poll */
+  SetEvent(hSlowPollDoneEvent);
+
+  _endthreadex(0);
+  return 0;
+}
+
 /**
  * Enumerate all top-level windows on the screen using
  * EnumWindows() and add the window information to the
@@ -403,9 +778,9 @@ LRESULT CALLBACK MouseProc(int nCode, WPARAM wParam, LPARAM lParam) {
     for (int i = 0; i < 4; ++i)
       timeCrc = UPDC32((Ptr8(&dwTimeDelta))[i], timeCrc);
 
-    EnterCriticalSection(&randCritSec);
+    RandLockPool();
     Add32((uint32_t)(crc + timeCrc));
-    LeaveCriticalSection(&randCritSec);
+    RandUnlockPool();
 
     prevPt = lpMouse->pt;
   }
@@ -453,9 +828,9 @@ LRESULT CALLBACK KeyboardProc(int nCode, WPARAM wParam, LPARAM lParam) {
     for (int i = 0; i < 4; ++i)
       timeCrc = UPDC32((Ptr8(&dwTimeDelta))[i], timeCrc);
 
-    EnterCriticalSection(&randCritSec);
+    RandLockPool();
     Add32((uint32_t)(crc + timeCrc));
-    LeaveCriticalSection(&randCritSec);
+    RandUnlockPool();
 
     prevPrevKey = prevKey;
     prevKey = key;
@@ -523,7 +898,7 @@ exit:
  * The fast poll function which gathers entropy from various basic
  * pieces of system information by calling  Windows API functions.
  */
-BOOL RandFastPoll(void) {
+static BOOL RandFastPollSources(void) {
   BUF buf;
   PBUF bufPtr = &buf;
   HANDLE handle;
@@ -551,25 +926,15 @@ BOOL RandFastPoll(void) {
 
   /* Use RDSEED and RDRAND, if available, as a source of random bytes */
   {
-    uint64_t rand;
+    size_t n;
 
     /* Request 16 bytes from RDRAND */
-    if (bHasRdrand) {
-      if (rdrand64_step(&rand))
-        Add64(rand);
-
-      if (rdrand64_step(&rand))
-        Add64(rand);
-    }
+    if (bHasRdrand && (n = rdrand_fill(bufPtr->bytes, 16)))
+      AddBuf(bufPtr->bytes, n);
 
     /* Request 16 bytes from RDSEED */
-    if (bHasRdseed) {
-      if (rdseed64_step(&rand))
-        Add64(rand);
-
-      if (rdseed64_step(&rand))
-        Add64(rand);
-    }
+    if (bHasRdseed && (n = rdseed_fill(bufPtr->bytes, 16)))
+      AddBuf(bufPtr->bytes, n);
   }
 
   Add32(GetCurrentProcessId()); /* Process ID for the current process */
@@ -693,6 +1058,16 @@ BOOL RandFastPoll(void) {
   return TRUE;
 }
 
+BOOL RandFastPoll(void) {
+  uint64_t start = RandStatsStart();
+  BOOL ret = RandFastPollSources();
+
+  RNG_STAT_INC(*(ret ? &randStats.fast_polls : &randStats.fast_poll_failures));
+  RandStatsRecord(&randStats.fast_poll, start);
+
+  return ret;
+}
+
 /* Type definitions and function pointers to call the native NT functions */
 typedef NTSTATUS(NTAPI *NTQUERYSYSTEMINFORMATION)(ULONG SystemInformationClass,
                                                   PVOID SystemInformation,
@@ -778,13 +1153,160 @@ typedef struct {
 
 #pragma pack(pop)
 
+static void JentCollectorRead(JENT_JOB *job) {
+  job->ret = jent_read_entropy(job->collector, (char *)job->bytes,
+                               sizeof(job->bytes));
+}
+
+static void JentCollectorAlloc(JENT_JOB *job) {
+  job->collector = jent_entropy_collector_alloc(1, 0);
+}
+
+static unsigned __stdcall JentJobThreadProc(void *pJob) {
+  JENT_JOB *job = (JENT_JOB *)pJob;
+
+  if (job->affinity)
+    SetThreadAffinityMask(GetCurrentThread(), job->affinity);
+  job->fn(job);
+  return 0;
+}
+
+/**
+ * Run fn on every Jitter RNG job.
+ *
+ * With more than one job, each one runs on its own thread pinned
+ * to a different processor so that the jobs run in parallel;  a
+ * job whose thread could not be created is run in the  calling
+ * thread instead.
+ */
+static void RandJentRunJobs(void (*fn)(JENT_JOB *job)) {
+  HANDLE hThreads[RNG_JENT_MAX_COLLECTORS];
+  UINT i, nThreads = 0;
+
+  if (nJentCollectors == 1) {
+    fn(&jentJobs[0]);
+    return;
+  }
+
+  for (i = 0; i < nJentCollectors; i++) {
+    HANDLE hThread;
+
+    jentJobs[i].fn = fn;
+    hThread = (HANDLE)_beginthreadex(NULL, 0, JentJobThreadProc, &jentJobs[i],
+                                     0, NULL);
+    if (hThread)
+      hThreads[nThreads++] = hThread;
+    else
+      fn(&jentJobs[i]);
+  }
+
+  if (nThreads)
+    WaitForMultipleObjects(nThreads, hThreads, TRUE, INFINITE);
+  for (i = 0; i < nThreads; i++)
+    CloseHandle(hThreads[i]);
+}
+
+/**
+ * Run the Jitter RNG startup health tests and allocate one collector
+ * with osr = 1 for each processor the process may run on. Allocating
+ * a collector also generates its first block of noise, which takes
+ * about as long as the health tests, so the collectors are allocated
+ * in parallel, each on the processor it is pinned to.
+ *
+ * This is done only once, by RandPoolInitEx() before the poll threads
+ * start or (with RNG_START_FAST) by the first slow poll, with
+ * slowPollCritSec held.
+ *
+ * According to SP 800-90B, each raw data sample consists of
+ * one timestamp delta, which is 64 bits long. It is assumed
+ * that only the least significant 4 bits of each  timestamp
+ * delta contains  any true entropy.  The JENT design states
+ * that the Jitter RNG can deliver full entropy  if and only
+ * if the min-entropy is at least  1/osr bit of entropy  per
+ * timestamp.
+ *
+ * Returns TRUE if the Jitter RNG is ready.
+ */
+static BOOL RandJentInit(void) {
+  DWORD_PTR dwProcessMask, dwSystemMask;
+  UINT i;
+
+  if (nJentInitState != 0)
+    return nJentInitState > 0;
+  nJentInitState = -1;
+
+  if (jent_entropy_init() != 0) {
+    Log(ERR_JENT_FAILURE, FALSE, -1, __LINE__);
+    return FALSE;
+  }
+
+  if (!GetProcessAffinityMask(GetCurrentProcess(), &dwProcessMask,
+                              &dwSystemMask))
+    dwProcessMask = 0;
+
+  for (i = 0; i < sizeof(DWORD_PTR) * 8 &&
+              nJentCollectors < RNG_JENT_MAX_COLLECTORS;
+       i++) {
+    if (dwProcessMask & ((DWORD_PTR)1 << i))
+      jentJobs[nJentCollectors++].affinity = (DWORD_PTR)1 << i;
+  }
+
+  /* Fall back to a single collector that is not pinned */
+  if (nJentCollectors == 0) {
+    jentJobs[0].affinity = 0;
+    nJentCollectors = 1;
+  }
+
+  RandJentRunJobs(JentCollectorAlloc);
+
+  for (i = 0; i < nJentCollectors; i++) {
+    if (jentJobs[i].collector == NULL) {
+      Log(ERR_JENT_FAILURE, FALSE, -1, __LINE__);
+      return FALSE;
+    }
+  }
+
+  nJentInitState = 1;
+  return TRUE;
+}
+
+/**
+ * Read RNG_JENT_COLLECTOR_BYTES bytes from every Jitter RNG
+ * collector, in parallel, and add them to the pool. Every
+ * collector runs its own health tests on each read.
+ *
+ * Returns TRUE if all the collectors delivered their bytes.
+ */
+static BOOL RandJentCollect(void) {
+  UINT i;
+  BOOL bOk = TRUE;
+
+  RandJentRunJobs(JentCollectorRead);
+
+  for (i = 0; i < nJentCollectors; i++) {
+    if (jentJobs[i].ret > 0) {
+      AddBufLocked(jentJobs[i].bytes, jentJobs[i].ret);
+    } else {
+      Log(ERR_JENT_FAILURE, FALSE, -1, __LINE__);
+      bOk = FALSE;
+    }
+    zeroize(jentJobs[i].bytes, sizeof(jentJobs[i].bytes));
+  }
+
+  return bOk;
+}
+
 /**
  * The slow poll performs a more in-depth and exhaustive
  * search  for random  bytes including network  and disk
  * statistics,  and various pieces of system performance
  * information.
+ *
+ * The pool lock is only held while the gathered data is
+ * added to the pool,  so fetches are not blocked  while
+ * the system statistics are being queried.
  */
-BOOL RandSlowPoll(void) {
+static BOOL RandSlowPollUnlocked(void) {
   NTSTATUS status;
   DWORD dwSize;
   BUF buf;
@@ -798,43 +1320,14 @@ BOOL RandSlowPoll(void) {
     STARTUPINFO startupInfo;
     startupInfo.cb = sizeof(STARTUPINFO);
     GetStartupInfo(&startupInfo);
-    AddBuf(Ptr8(&startupInfo), sizeof(STARTUPINFO));
+    AddBufLocked(Ptr8(&startupInfo), sizeof(STARTUPINFO));
     bAddedStartupInfo = TRUE;
   }
 
-  {
-    /* Read 32 bytes from the Jitter RNG, which samples
-       noise based on high-resolution CPU timing jitter */
-    bufPtr->size = 32;
-    BOOL collected = FALSE;
-
-    if (jent_entropy_init() == 0) {
-      /* Poll data from the Jitter RNG with osr = 1.
-
-         According to SP 800-90B, each raw data sample consists of
-         one timestamp delta, which is 64 bits long. It is assumed
-         that only the least significant 4 bits of each  timestamp
-         delta contains  any true entropy.  The JENT design states
-         that the Jitter RNG can deliver full entropy  if and only
-         if the min-entropy is at least  1/osr bit of entropy  per
-         timestamp. */
-      struct rand_data *collector = jent_entropy_collector_alloc(1, 0);
-      if (collector) {
-        ssize_t ret =
-            jent_read_entropy(collector, (char *)bufPtr->bytes, bufPtr->size);
-        if (ret > 0) {
-          AddBuf(bufPtr->bytes, ret);
-          collected = TRUE;
-        }
-        jent_entropy_collector_free(collector);
-      }
-    }
-
-    if (!collected) {
-      Log(ERR_JENT_FAILURE, FALSE, -1, __LINE__);
-      return FALSE;
-    }
-  }
+  /* Read from the Jitter RNG collectors, which sample
+     noise based on high-resolution CPU timing jitter */
+  if (!RandJentCollect())
+    return FALSE;
 
   {
     HANDLE hDevice;
@@ -858,7 +1351,7 @@ BOOL RandSlowPoll(void) {
       if (DeviceIoControl(hDevice, IOCTL_DISK_PERFORMANCE, NULL, 0,
                           &diskPerformance, sizeof(diskPerformance), &dwSize,
                           NULL))
-        AddBuf(Ptr8(&diskPerformance), sizeof(DISK_PERFORMANCE));
+        AddBufLocked(Ptr8(&diskPerformance), sizeof(DISK_PERFORMANCE));
 
       CloseHandle(hDevice);
     }
@@ -926,7 +1419,7 @@ BOOL RandSlowPoll(void) {
       /* Recieve the system information into the allocated buffer */
       status = pNtQuerySystemInformation(dwType[i], buf, ulSize, NULL);
       if (status == ERROR_SUCCESS)
-        AddBuf(Ptr8(buf), ulSize);
+        AddBufLocked(Ptr8(buf), ulSize);
       else {
         free(buf);
         Log(ERR_WIN32_WINAPI, FALSE, GetLastError(), __LINE__);
@@ -961,9 +1454,9 @@ BOOL RandSlowPoll(void) {
     MIB_TCPSTATS tcpStats;
     MIB_IPSTATS ipStats;
     if (pGetTcpStatisticsEx(&tcpStats, AF_INET) == NO_ERROR)
-      AddBuf(Ptr8(&tcpStats), sizeof(MIB_TCPSTATS));
+      AddBufLocked(Ptr8(&tcpStats), sizeof(MIB_TCPSTATS));
     if (pGetIpStatisticsEx(&ipStats, AF_INET) == NO_ERROR)
-      AddBuf(Ptr8(&ipStats), sizeof(MIB_IPSTATS));
+      AddBufLocked(Ptr8(&ipStats), sizeof(MIB_IPSTATS));
   }
 
   /* Find out whether this is an NT server or workstation if necessary */
@@ -1027,7 +1520,7 @@ BOOL RandSlowPoll(void) {
             (LPWSTR)(isWorkstation ? L"LanmanWorkstation" : L"LanmanServer"), 0,
             0, &lpBuffer) == 0) {
       pNetApiBufferSize(lpBuffer, &dwSize);
-      AddBuf(Ptr8(lpBuffer), dwSize);
+      AddBufLocked(Ptr8(lpBuffer), dwSize);
       pNetApiBufferFree(lpBuffer);
     }
   }
@@ -1042,9 +1535,7 @@ BOOL RandSlowPoll(void) {
       if ((pGpuZData = (GPUZ_SH_MEM *)MapViewOfFile(hGPUZData, FILE_MAP_READ, 0,
                                                     0, 0)) != NULL) {
         if (pGpuZData->version == 1) {
-          EnterCriticalSection(&randCritSec);
-          AddBuf(Ptr8(pGpuZData), sizeof(GPUZ_SH_MEM));
-          LeaveCriticalSection(&randCritSec);
+          AddBufLocked(Ptr8(pGpuZData), sizeof(GPUZ_SH_MEM));
         }
         UnmapViewOfFile(pGpuZData);
       }
@@ -1061,9 +1552,7 @@ BOOL RandSlowPoll(void) {
                                          "CoreTempMappingObject")) != NULL) {
       if ((pCoreTempData = (CORE_TEMP_SHARED_DATA *)MapViewOfFile(
                hCoreTempData, FILE_MAP_READ, 0, 0, 0)) != NULL) {
-        EnterCriticalSection(&randCritSec);
-        AddBuf(Ptr8(pCoreTempData), sizeof(CORE_TEMP_SHARED_DATA));
-        LeaveCriticalSection(&randCritSec);
+        AddBufLocked(Ptr8(pCoreTempData), sizeof(CORE_TEMP_SHARED_DATA));
 
         UnmapViewOfFile(pCoreTempData);
       }
@@ -1072,7 +1561,9 @@ BOOL RandSlowPoll(void) {
   }
 
   /* Mix the pool */
+  RandLockPool();
   RandPoolMix();
+  RandUnlockPool();
 
   /* Prevent leaks */
   zeroize(bufPtr, sizeof(buf));
@@ -1080,28 +1571,46 @@ BOOL RandSlowPoll(void) {
   return TRUE;
 }
 
+/* Run a slow poll; slow polls are serialized by slowPollCritSec, which
+   must be entered before randCritSec if both are held */
+BOOL RandSlowPoll(void) {
+  uint64_t start;
+  BOOL ret;
+
+  EnterCriticalSection(&slowPollCritSec);
+  start = RandStatsStart();
+  /* The Jitter RNG startup tests may have run until RngStop() */
+  if ((ret = RandJentInit() && !RandPollThreadsStopping() &&
+             RandSlowPollUnlocked()))
+    bDidSlowPoll = TRUE;
+  RandStatsRecord(&randStats.slow_poll, start);
+  LeaveCriticalSection(&slowPollCritSec);
+
+  RNG_STAT_INC(*(ret ? &randStats.slow_polls : &randStats.slow_poll_failures));
+
+  return ret;
+}
+
 /**
  * Schematic for the pool mixing function
  * (for more info see https://vibhav950.github.io/Xrand).
  *
- *               ┌────────────────────────────────────────┐
- *            XOR│                                        │
- * ┌────────┬────▼───┬────────────────────────────────┐   │
- * │        │        │        Randomness pool         │   │
- * │________│________│________________________________│   │
- *                                                        │
- * └─────────────────────────┬────────────────────────┘   │
- *             SHA-512 digest│                            │
- *                           └────────────────────────────┘
- *                     Successive hashes
- *                     ────────────────►
+ * ┌────────┬────────┬────────────────────────────────┐
+ * │ chunk0 │ chunk1 │        Randomness pool         │
+ * │________│________│________________________________│
+ *      ▲        ▲                 │
+ *   XOR│     XOR│                 │SHA-512 digest D
+ *      │        │                 ▼
+ *  H(D || 0) H(D || 1)   ...   H(D || RNG_POOL_CHUNKS - 1)
  */
 
 /**
- * The pool mixing function.  The digest of the entire pool is computed
- * using a cryptographic one-way hash function and the resulting digest
- * is added back to the pool using modulo 2^8 addition while preserving
- * its previous contents.
+ * The pool mixing function.  The digest D of the entire pool is computed
+ * once using a cryptographic one-way hash function, and each chunk of the
+ * pool is then added (modulo 2^8) to the digest of D followed by the chunk
+ * index, preserving its previous contents.  Every chunk hence depends on
+ * the whole pool, at the cost of one pass over the pool and one single
+ * block hash per chunk.
  *
  * Note: RNG_POOL_SIZE must be divisible by SHA512_DIGEST_LENGTH.
  */
@@ -1110,40 +1619,42 @@ void RandPoolMix(void) {
     Throw(ERR_INVALID_POOL_SIZE, FATAL, -1, __LINE__);
   }
 
+  uint64_t start = RandStatsStart();
+  uint8_t digest[SHA512_DIGEST_LENGTH + 1];
   uint8_t buf[SHA512_DIGEST_LENGTH];
 
-  for (int i = 0; i < RNG_POOL_SIZE; i += SHA512_DIGEST_LENGTH) {
-    /* Compute the SHA512 digest of the entire pool */
-    SHA512(pRandPool, RNG_POOL_SIZE, buf);
+  /* Compute the SHA512 digest of the entire pool */
+  sha512(pRandPool, RNG_POOL_SIZE, digest);
+
+  for (int i = 0; i < RNG_POOL_CHUNKS; i++) {
+    /* Derive the digest for this chunk */
+    digest[SHA512_DIGEST_LENGTH] = (uint8_t)i;
+    sha512(digest, sizeof(digest), buf);
     /* Add the resulting digest message back to the pool */
     for (int j = 0; j < SHA512_DIGEST_LENGTH; j++) {
-      pRandPool[i + j] ^= buf[j];
+      pRandPool[i * RNG_POOL_CHUNK_SIZE + j] ^= buf[j];
     }
   }
+  nPoolBytesSinceMix = 0;
 
   /* Prevent leaks */
+  zeroize(digest, sizeof(digest));
   zeroize(buf, SHA512_DIGEST_LENGTH);
+
+  RNG_STAT_INC(randStats.pool_mixes);
+  RandStatsRecord(&randStats.pool_mix, start);
 }
 
 /**
- * Fetch random data to the buffer by inverting, mixing and
- * adding the contents of the randomness pool to the output
- * buffer using modulo 2^8 addition to prevent state leaks.
+ * Extract random data from the pool to the buffer by inverting,
+ * mixing and adding the contents of the randomness pool to the
+ * output buffer using modulo 2^8 addition to prevent state leaks.
+ *
+ * This is only used to (re)seed the DRBG.
  */
-BOOL RandFetchBytes(uint8_t *data, size_t len, int forceSlowPoll) {
+static BOOL RandPoolExtract(uint8_t *data, size_t len, int forceSlowPoll) {
   BOOL ret = FALSE;
 
-  if (data == NULL) {
-    Warn("Invalid data pointer (expected a non-NULL value)", WARN_INVALID_ARGS);
-    return FALSE;
-  }
-
-  if (len < 0) {
-    Warn("Invalid request length (expected a positive value)",
-         WARN_INVALID_ARGS);
-    return FALSE;
-  }
-
   /* There is at max RNG_POOL_SIZE worth of entropy in the
      pool at any given instant */
   if (len > RNG_POOL_SIZE) {
@@ -1151,19 +1662,21 @@ BOOL RandFetchBytes(uint8_t *data, size_t len, int forceSlowPoll) {
     return FALSE;
   }
 
-  /* This is a fatal error (triggers an immediate process termination)
-     for now, but might be changed in future versions to a FALSE return */
-  if (!bDidRandPoolInit)
-    Throw(ERR_RAND_INIT, FATAL, GetLastError(), __LINE__);
+  /* The pool must have seen at least one slow poll (or, with
+     RNG_START_FAST, the initial seed); wait for the first background
+     poll rather than running another one, and only poll here if that
+     one failed or a fresh poll was explicitly asked for */
+  if (!bFastStart && !bDidSlowPoll && !forceSlowPoll) {
+    /* RngStop() may end the thread before its first poll, in which
+       case the poll below fails */
+    HANDLE hEvents[2] = {hSlowPollDoneEvent, hSlowPollStopEvent};
+    WaitForMultipleObjects(2, hEvents, FALSE, INFINITE);
+  }
 
-  EnterCriticalSection(&randCritSec);
+  if (((!bFastStart && !bDidSlowPoll) || forceSlowPoll) && !RandSlowPoll())
+    return FALSE;
 
-  if (!bDidSlowPoll || forceSlowPoll) {
-    if (!RandSlowPoll())
-      goto cleanup;
-    else
-      bDidSlowPoll = TRUE;
-  }
+  RandLockPool();
 
   if (bUserEventsEnabled && !AddUserEvents())
     goto cleanup;
@@ -1206,7 +1719,432 @@ BOOL RandFetchBytes(uint8_t *data, size_t len, int forceSlowPoll) {
 
 cleanup:
 
-  LeaveCriticalSection(&randCritSec);
+  RandUnlockPool();
+
+  return ret;
+}
+
+/* Entropy callback for the DRBG, in case the reseed counter runs out
+   before the next periodic reseed. Called with drbgCritSec held. */
+static int RandDrbgEntropyCallback(void *ctx, uint8_t *buf, size_t len) {
+  UNREFERENCED_PARAMETER(ctx);
+  return RandPoolExtract(buf, len, FALSE) ? 0 : 1;
+}
+
+/* Instantiate the DRBG from the pool, or reseed it if it already is */
+static BOOL RandReseedDrbg(int forceSlowPoll) {
+  BOOL ret = FALSE;
+  uint8_t seed[CTR_DRBG_ENTROPY_LEN];
+  uint64_t start = RandStatsStart();
+
+  EnterCriticalSection(&drbgCritSec);
+
+  if (!RandPoolExtract(seed, CTR_DRBG_ENTROPY_LEN, forceSlowPoll))
+    goto cleanup;
+
+  if (!bDidSeedDrbg) {
+    if (ctr_drbg_init(pRandDrbg, seed, NULL, 0) != SUCCESS)
+      goto cleanup;
+    ctr_drbg_set_entropy_cb(pRandDrbg, RandDrbgEntropyCallback, NULL);
+    bDidSeedDrbg = TRUE;
+  } else if (ctr_drbg_reseed(pRandDrbg, seed, NULL, 0) != SUCCESS) {
+    goto cleanup;
+  }
+
+  /* Have the per-thread DRBGs reseed on their next request */
+  InterlockedIncrement(&nRandDrbgGeneration);
+
+  ret = TRUE;
+
+cleanup:
+  LeaveCriticalSection(&drbgCritSec);
+
+  /* Prevent leaks */
+  zeroize(seed, CTR_DRBG_ENTROPY_LEN);
+
+  RNG_STAT_INC(*(ret ? &randStats.drbg_reseeds
+                     : &randStats.drbg_reseed_failures));
+  RandStatsRecord(&randStats.drbg_reseed, start);
+
+  return ret;
+}
+
+/* Generate output from the central DRBG; used to seed the per-thread
+   DRBGs (and as their entropy callback) */
+static int RandDrbgCentralCallback(void *ctx, uint8_t *buf, size_t len) {
+  status_t status;
+
+  UNREFERENCED_PARAMETER(ctx);
+
+  EnterCriticalSection(&drbgCritSec);
+  status = ctr_drbg_generate_bulk(pRandDrbg, buf, len);
+  LeaveCriticalSection(&drbgCritSec);
+
+  if (status != SUCCESS)
+    return 1;
+
+  RNG_STAT_ADD(randStats.central_drbg_bytes, len);
+  return 0;
+}
+
+/* FLS callback; clear and free the DRBG of an exiting thread */
+static VOID WINAPI RandThreadDrbgFree(PVOID lpFlsData) {
+  RAND_THREAD_DRBG *pThreadDrbg = (RAND_THREAD_DRBG *)lpFlsData;
+
+  if (pThreadDrbg == NULL)
+    return;
+
+  AcquireSRWLockExclusive(&threadDrbgListLock);
+  if (pThreadDrbg->prev)
+    pThreadDrbg->prev->next = pThreadDrbg->next;
+  else
+    pThreadDrbgList = pThreadDrbg->next;
+  if (pThreadDrbg->next)
+    pThreadDrbg->next->prev = pThreadDrbg->prev;
+  nThreadDrbgs--;
+  RandStatsRetireThread(&threadStatsRetired, &pThreadDrbg->stats);
+  ReleaseSRWLockExclusive(&threadDrbgListLock);
+
+  xr_secure_free(pThreadDrbg);
+}
+
+/* Get the (possibly unseeded) DRBG of the calling thread, allocating
+   it on first use */
+static RAND_THREAD_DRBG *RandGetThreadLocal(void) {
+  RAND_THREAD_DRBG *pThreadDrbg;
+
+  pThreadDrbg = (RAND_THREAD_DRBG *)FlsGetValue(dwRandFlsIndex);
+
+  if (pThreadDrbg == NULL) {
+    /* Allocated by the thread itself, so on its own NUMA node; locked
+       if the working set leaves room for one page per thread */
+    pThreadDrbg = xr_secure_alloc(sizeof(RAND_THREAD_DRBG), XR_NUMA_NODE_LOCAL,
+                                  XR_SECURE_TRY_LOCK | XR_SECURE_GUARD);
+
+    if (pThreadDrbg == NULL) {
+      Log(ERR_NO_MEMORY, FALSE, GetLastError(), __LINE__);
+      return NULL;
+    }
+
+    if (!FlsSetValue(dwRandFlsIndex, pThreadDrbg)) {
+      xr_secure_free(pThreadDrbg);
+      Log(ERR_RAND_INIT, FALSE, GetLastError(), __LINE__);
+      return NULL;
+    }
+
+    AcquireSRWLockExclusive(&threadDrbgListLock);
+    pThreadDrbg->prev = NULL;
+    pThreadDrbg->next = pThreadDrbgList;
+    if (pThreadDrbgList)
+      pThreadDrbgList->prev = pThreadDrbg;
+    pThreadDrbgList = pThreadDrbg;
+    nThreadDrbgs++;
+    ReleaseSRWLockExclusive(&threadDrbgListLock);
+  }
+
+  return pThreadDrbg;
+}
+
+/**
+ * Get the DRBG of the calling thread, allocating it on first use and
+ * reseeding it from the central DRBG whenever the central generation
+ * has moved on. Only this slow path takes drbgCritSec.
+ */
+static RAND_THREAD_DRBG *RandGetThreadDrbg(void) {
+  RAND_THREAD_DRBG *pThreadDrbg;
+  uint8_t seed[CTR_DRBG_ENTROPY_LEN];
+  LONG generation;
+  status_t status;
+  uint64_t start;
+
+  if ((pThreadDrbg = RandGetThreadLocal()) == NULL)
+    return NULL;
+
+  generation = nRandDrbgGeneration;
+
+  if (pThreadDrbg->generation == generation)
+    return pThreadDrbg;
+
+  start = RandStatsStart();
+
+  if (RandDrbgCentralCallback(NULL, seed, CTR_DRBG_ENTROPY_LEN) != 0)
+    return NULL;
+
+  if (bThreadDrbgChaCha) {
+    /* Takes the first CHACHA_DRBG_ENTROPY_LEN bytes of the seed */
+    if (pThreadDrbg->generation == 0) {
+      status = chacha_drbg_init(&pThreadDrbg->chacha, seed, NULL, 0);
+      chacha_drbg_set_entropy_cb(&pThreadDrbg->chacha,
+                                 RandDrbgCentralCallback, NULL);
+    } else {
+      status = chacha_drbg_reseed(&pThreadDrbg->chacha, seed, NULL, 0);
+    }
+  } else if (pThreadDrbg->generation == 0) {
+    status = ctr_drbg_init(&pThreadDrbg->drbg, seed, NULL, 0);
+    ctr_drbg_set_entropy_cb(&pThreadDrbg->drbg, RandDrbgCentralCallback, NULL);
+  } else {
+    status = ctr_drbg_reseed(&pThreadDrbg->drbg, seed, NULL, 0);
+  }
+
+  /* Prevent leaks */
+  zeroize(seed, CTR_DRBG_ENTROPY_LEN);
+
+  if (status != SUCCESS)
+    return NULL;
+
+  pThreadDrbg->generation = generation;
+
+  RNG_STAT_LOCAL_ADD(pThreadDrbg->stats.drbg_reseeds, 1);
+  RandStatsRecord(&randStats.drbg_reseed, start);
+
+  return pThreadDrbg;
+}
+
+/* Generate output from a (seeded) per-thread DRBG */
+static inline status_t RandThreadDrbgGenerate(RAND_THREAD_DRBG *pThreadDrbg,
+                                              uint8_t *data, size_t len) {
+  if (bThreadDrbgChaCha)
+    return chacha_drbg_fetch(&pThreadDrbg->chacha, data, len);
+  return ctr_drbg_generate_bulk(&pThreadDrbg->drbg, data, len);
+}
+
+/* Fill up to nRingBatch free slots of the ring from the DRBG of the
+   producer thread; stops early if the ring is full */
+static void RandRingFill(void) {
+  RAND_THREAD_DRBG *pThreadDrbg;
+  RAND_RING_SLOT *pSlot;
+  LONG pos;
+
+  if ((pThreadDrbg = RandGetThreadDrbg()) == NULL)
+    return;
+
+  for (UINT i = 0; i < nRingBatch; ++i) {
+    pos = nRingHead;
+    pSlot = &pRandRing[(ULONG)pos & (RNG_RING_SLOTS - 1)];
+
+    /* Not yet released by its consumer */
+    if (pSlot->seq != pos)
+      break;
+
+    if (RandThreadDrbgGenerate(pThreadDrbg, pSlot->data, RNG_RING_SLOT_SIZE) !=
+        SUCCESS)
+      break;
+    RNG_STAT_LOCAL_ADD(pThreadDrbg->stats.drbg_bytes, RNG_RING_SLOT_SIZE);
+
+    /* Publish the slot (full barrier) */
+    InterlockedExchange(&pSlot->seq, (LONG)((ULONG)pos + 1));
+    nRingHead = (LONG)((ULONG)pos + 1);
+  }
+}
+
+/* The ring producer, woken up by consumers once the number of
+   filled slots drops below the watermark */
+static unsigned __stdcall RingFillThreadProc(void *_dummy) {
+  UNREFERENCED_PARAMETER(_dummy);
+
+  for (;;) {
+    WaitForSingleObject(hRingFillEvent, RNG_FAST_POLL_INTERVAL);
+
+    if (bTerminateRingFillThread)
+      break;
+
+    RandRingFill();
+  }
+
+  _endthreadex(0);
+  return 0;
+}
+
+/**
+ * Pop one slot off the ring and copy the first len bytes to the
+ * output buffer. The whole slot is zeroized before it is released,
+ * so no byte is ever handed out twice. Returns FALSE if the ring is
+ * empty.
+ */
+static BOOL RandRingPop(uint8_t *data, size_t len) {
+  RAND_RING_SLOT *pSlot;
+  LONG pos, seq, dif;
+
+  pos = nRingTail;
+
+  for (;;) {
+    pSlot = &pRandRing[(ULONG)pos & (RNG_RING_SLOTS - 1)];
+    seq = pSlot->seq;
+    MemoryBarrier();
+    dif = (LONG)((ULONG)seq - ((ULONG)pos + 1));
+
+    if (dif == 0) {
+      /* Claim the slot */
+      LONG prev = InterlockedCompareExchange(
+          &nRingTail, (LONG)((ULONG)pos + 1), pos);
+      if (prev == pos)
+        break;
+      pos = prev;
+    } else if (dif < 0) {
+      /* Empty */
+      SetEvent(hRingFillEvent);
+      return FALSE;
+    } else {
+      pos = nRingTail;
+    }
+  }
+
+  memcpy(data, pSlot->data, len);
+  zeroize(pSlot->data, RNG_RING_SLOT_SIZE);
+
+  /* Release the slot to the producer (full barrier) */
+  InterlockedExchange(&pSlot->seq, (LONG)((ULONG)pos + RNG_RING_SLOTS));
+
+  if ((ULONG)nRingHead - ((ULONG)pos + 1) < nRingWatermark)
+    SetEvent(hRingFillEvent);
+
+  return TRUE;
+}
+
+/* Stop the ring producer thread and wipe the ring */
+static void RandRingStop(void) {
+  if (pRandRing == NULL)
+    return;
+
+  bRingEnabled = FALSE;
+  bTerminateRingFillThread = TRUE;
+
+  if (hRingFillThreadHandle != NULL) {
+    SetEvent(hRingFillEvent);
+    WaitForSingleObject(hRingFillThreadHandle, INFINITE);
+    CloseHandle(hRingFillThreadHandle);
+    hRingFillThreadHandle = NULL;
+  }
+
+  if (hRingFillEvent != NULL) {
+    CloseHandle(hRingFillEvent);
+    hRingFillEvent = NULL;
+  }
+
+  bTerminateRingFillThread = FALSE;
+
+  xr_secure_free(pRandRing);
+
+  pRandRing = NULL;
+}
+
+/* Allocate the ring and start the producer thread */
+static BOOL RandRingStart(UINT watermark, UINT batch) {
+  if (!bDidRandPoolInit || pRandRing != NULL)
+    return FALSE;
+
+  if (watermark == 0 || watermark > RNG_RING_SLOTS || batch == 0 ||
+      batch > RNG_RING_SLOTS) {
+    Warn("Invalid prefetch parameters (expected values in 1..RNG_RING_SLOTS)",
+         WARN_INVALID_ARGS);
+    return FALSE;
+  }
+
+  /* The producer seeds its DRBG from the central DRBG */
+  if (!bDidSeedDrbg && !RandReseedDrbg(FALSE))
+    return FALSE;
+
+  pRandRing = xr_secure_alloc(RNG_RING_SLOTS * sizeof(RAND_RING_SLOT),
+                              XR_NUMA_NODE_LOCAL,
+                              XR_SECURE_LOCK | XR_SECURE_GUARD);
+
+  if (pRandRing == NULL) {
+    Log(ERR_RAND_INIT, FALSE, GetLastError(), __LINE__);
+    return FALSE;
+  }
+
+  for (UINT i = 0; i < RNG_RING_SLOTS; ++i)
+    pRandRing[i].seq = (LONG)i;
+
+  nRingHead = 0;
+  nRingTail = 0;
+  nRingWatermark = watermark;
+  nRingBatch = batch;
+
+  if ((hRingFillEvent = CreateEvent(NULL, FALSE, TRUE, NULL)) == NULL) {
+    Log(ERR_RAND_INIT, FALSE, GetLastError(), __LINE__);
+    RandRingStop();
+    return FALSE;
+  }
+
+  if ((hRingFillThreadHandle = (HANDLE)_beginthreadex(
+           NULL, 0, RingFillThreadProc, NULL, 0, NULL)) == NULL) {
+    Log(ERR_RAND_INIT, FALSE, GetLastError(), __LINE__);
+    RandRingStop();
+    return FALSE;
+  }
+
+  bRingEnabled = TRUE;
+
+  return TRUE;
+}
+
+/**
+ * Fetch random data to the buffer. Small requests are served from
+ * the prefetch ring if it is enabled and not empty. All others are
+ * served by a per-thread DRBG without taking any locks; a CTR_DRBG, or
+ * the ChaCha20 generator if the host has no AES hardware. These are seeded
+ * from a central CTR_DRBG that is seeded from the pool on the first
+ * request (or if forceSlowPoll is set), and periodically reseeded
+ * from the pool by the fast poll thread.
+ */
+BOOL RandFetchBytes(uint8_t *data, size_t len, int forceSlowPoll) {
+  RAND_THREAD_DRBG *pThreadDrbg;
+  RAND_THREAD_STATS *pStats;
+  uint64_t start = RandStatsStart(), genStart;
+  BOOL ret = FALSE;
+
+  if (data == NULL) {
+    Warn("Invalid data pointer (expected a non-NULL value)", WARN_INVALID_ARGS);
+    return FALSE;
+  }
+
+  /* This is a fatal error (triggers an immediate process termination)
+     for now, but might be changed in future versions to a FALSE return */
+  if (!bDidRandPoolInit)
+    Throw(ERR_RAND_INIT, FATAL, GetLastError(), __LINE__);
+
+  /* The counters of the calling thread */
+  if ((pThreadDrbg = RandGetThreadLocal()) == NULL)
+    return FALSE;
+  pStats = &pThreadDrbg->stats;
+
+  if ((!bDidSeedDrbg || forceSlowPoll) && !RandReseedDrbg(forceSlowPoll))
+    goto out;
+
+  if (bRingEnabled && !forceSlowPoll) {
+    if (len <= RNG_RING_SLOT_SIZE && RandRingPop(data, len)) {
+      RNG_STAT_LOCAL_ADD(pStats->ring_hits, 1);
+      ret = TRUE;
+      goto out;
+    }
+    RNG_STAT_LOCAL_ADD(pStats->ring_misses, 1);
+  }
+
+  if (RandGetThreadDrbg() == NULL)
+    goto out;
+
+  genStart = RandStatsStart();
+  if (RandThreadDrbgGenerate(pThreadDrbg, data, len) == SUCCESS) {
+    RNG_STAT_LOCAL_ADD(pStats->drbg_bytes, len);
+    ret = TRUE;
+  }
+  RandStatsRecord(&randStats.drbg_generate, genStart);
+  RNG_STAT_SET(pStats->reseed_counter,
+               bThreadDrbgChaCha ? pThreadDrbg->chacha.reseed_counter
+                                 : pThreadDrbg->drbg.reseed_counter);
+
+out:
+  /* Let the first slow poll start */
+  if (hFastStartEvent != NULL && ret)
+    SetEvent(hFastStartEvent);
+
+  RNG_STAT_LOCAL_ADD(pStats->fetch_calls, 1);
+  if (ret)
+    RNG_STAT_LOCAL_ADD(pStats->fetch_bytes, len);
+  else
+    RNG_STAT_LOCAL_ADD(pStats->fetch_failures, 1);
+  RandStatsRecord(&randStats.fetch, start);
 
   return ret;
 }
@@ -1219,6 +2157,16 @@ cleanup:
  */
 bool RngStart(void) { return RandPoolInit(); }
 
+/**
+ * Start the Random Number Generator with RNG_START_* flags and an
+ * optional seed file; see rngw32.h.
+ *
+ * Returns 1 if the RNG started successfully, 0 otherwise.
+ */
+bool RngStartEx(unsigned int flags, const char *seedFile) {
+  return RandPoolInitEx(flags, seedFile) ? true : false;
+}
+
 /* Add randomness using user events (keystrokes and mouse movement) */
 void RngEnableUserEvents(void) { bUserEventsEnabled = true; }
 
@@ -1233,11 +2181,65 @@ void RngStop(void) { RandCleanStop(); }
 /* Mix the RNG pool. */
 void RngMix(void) { RandPoolMix(); }
 
+/**
+ * Run a slow poll in the calling thread and reseed the DRBG
+ * from the pool.
+ *
+ * Returns 1 if the reseed was successful, 0 otherwise.
+ */
+bool RngForceReseed(void) {
+  if (!bDidRandPoolInit)
+    return false;
+  return RandReseedDrbg(TRUE);
+}
+
+/**
+ * Start prefetching random bytes into the ring.
+ *
+ * Returns 1 if prefetching started successfully, 0 otherwise.
+ */
+bool RngStartPrefetch(unsigned int watermark, unsigned int batch) {
+  return RandRingStart(watermark, batch);
+}
+
+/* Stop prefetching and wipe the ring. */
+void RngStopPrefetch(void) { RandRingStop(); }
+
 /**
  * Request random data from the RNG.
  *
  * Returns 1 if the request was successful, 0 otherwise.
  */
 bool RngFetchBytes(uint8_t *data, size_t len) {
-  return RandFetchBytes(data, len, true);
+  return RandFetchBytes(data, len, false);
+}
+
+/**
+ * Take a snapshot of the RNG statistics; see rngstats.h.
+ */
+void RngGetStats(struct xr_stats *stats) {
+  RAND_THREAD_DRBG *pThreadDrbg;
+
+  if (stats == NULL) {
+    Warn("Invalid stats pointer (expected a non-NULL value)",
+         WARN_INVALID_ARGS);
+    return;
+  }
+
+  RandStatsCollect(stats);
+  stats->drbg_generation = (uint64_t)nRandDrbgGeneration;
+
+  AcquireSRWLockShared(&threadDrbgListLock);
+  RandStatsAddThread(stats, &threadStatsRetired);
+  for (pThreadDrbg = pThreadDrbgList; pThreadDrbg;
+       pThreadDrbg = pThreadDrbg->next)
+    RandStatsAddThread(stats, &pThreadDrbg->stats);
+  stats->thread_drbgs = nThreadDrbgs;
+  ReleaseSRWLockShared(&threadDrbgListLock);
+
+  if (bDidRandPoolInit && bDidSeedDrbg) {
+    EnterCriticalSection(&drbgCritSec);
+    stats->central_drbg_reseed_counter = pRandDrbg->reseed_counter;
+    LeaveCriticalSection(&drbgCritSec);
+  }
 }
@@ -23,6 +23,7 @@ extern "C" {
 #endif
 
 #include "common/defs.h"
+#include "rngstats.h"
 #include <windows.h>
 
 /* OpenSSL is required for cryptographic utilities */
@@ -46,13 +47,74 @@ extern "C" {
 /* Interval in milliseconds between successive fast polls */
 #define RNG_FAST_POLL_INTERVAL 500
 
+/**
+ * Interval in milliseconds between successive slow polls, which
+ * run on a background thread (the first one right at startup).
+ */
+#define RNG_SLOW_POLL_INTERVAL (10 * 60 * 1000)
+
 /**
  * Call the pool mix function after every RNG_POOL_MIX_INTERVAL
- * bytes added to the pool.
+ * bytes added to the pool (one SHA-512 input block).
+ */
+#define RNG_POOL_MIX_INTERVAL 128
+
+#if RNG_POOL_SIZE % RNG_POOL_MIX_INTERVAL
+#error "RNG_POOL_SIZE must be a multiple of RNG_POOL_MIX_INTERVAL"
+#endif
+
+/**
+ * Reseed the DRBG serving RngFetchBytes() from the pool after
+ * every RNG_DRBG_RESEED_INTERVAL fast polls (~30 seconds).
+ */
+#define RNG_DRBG_RESEED_INTERVAL 60
+
+/**
+ * Maximum number of Jitter RNG collectors run in parallel by a slow
+ * poll, one per logical processor the process may run on; bounded by
+ * the number of threads a single wait can join.
+ */
+#define RNG_JENT_MAX_COLLECTORS MAXIMUM_WAIT_OBJECTS
+
+/* Bytes read from each Jitter RNG collector per slow poll */
+#define RNG_JENT_COLLECTOR_BYTES 32
+
+/* Number of slots in the prefetch ring (must be a power of 2) */
+#define RNG_RING_SLOTS 256
+
+#if RNG_RING_SLOTS & (RNG_RING_SLOTS - 1)
+#error "RNG_RING_SLOTS must be a power of 2"
+#endif
+
+/**
+ * Bytes of DRBG output per ring slot; requests of at most this
+ * many bytes are served from the ring when prefetching is enabled.
+ */
+#define RNG_RING_SLOT_SIZE 64
+
+/* Default refill watermark and batch size (in slots) */
+#define RNG_RING_DEFAULT_WATERMARK (RNG_RING_SLOTS / 4)
+#define RNG_RING_DEFAULT_BATCH (RNG_RING_SLOTS / 2)
+
+/* RngStartEx() flags */
+
+/**
+ * Seed the DRBG while starting, from the CNG provider, the fast poll
+ * sources and the seed file (if any), instead of on the first request
+ * after the first slow poll; the Jitter RNG startup health tests and
+ * the first slow poll then run in the background, and the DRBG is
+ * reseeded as soon as that poll is done. Ignored in strict mode.
  */
-#define RNG_POOL_MIX_INTERVAL 32
+#define RNG_START_FAST 0x01
+
+/**
+ * With RNG_START_FAST, the longest time in milliseconds for which the
+ * first slow poll is held back while the first request is pending.
+ */
+#define RNG_FAST_START_DELAY 50
 
 BOOL RandPoolInit(void);
+BOOL RandPoolInitEx(unsigned int flags, const char *seedFile);
 void RandCleanStop(void);
 BOOL RandFastPoll(void);
 BOOL RandSlowPoll(void);
@@ -65,6 +127,22 @@ LRESULT CALLBACK KeyboardProc(int nCode, WPARAM wParam, LPARAM lParam);
 static unsigned __stdcall FastPollThreadProc(void *_dummy);
 
 bool RngStart(void);
+
+/**
+ * Start the RNG like RngStart(), with RNG_START_* flags.
+ *
+ * If seedFile is not Null, the seed in that file (see rngseed.h) is
+ * added to the pool at startup, and the file is replaced with fresh
+ * DRBG output as soon as the DRBG is seeded and again by RngStop().
+ * Pick a path in a directory that only the user can write to.
+ *
+ * With RNG_START_FAST, a Jitter RNG failure is only reported by the
+ * first slow poll; DidRngSlowPoll() tells whether one has succeeded.
+ *
+ * Returns 1 if the RNG started successfully, 0 otherwise.
+ */
+bool RngStartEx(unsigned int flags, const char *seedFile);
+
 void RngEnableUserEvents(void);
 void RngStop(void);
 bool DidRngStart(void);
@@ -72,13 +150,48 @@ bool DidRngSlowPoll(void);
 void RngMix(void);
 
 /**
- * Fetch len bytes from the randomness pool where len can be any
- * positive value lesser than or equal to RNG_POOL_SIZE.
+ * Run a slow poll in the calling thread and reseed the DRBG from
+ * the pool; the per-thread DRBGs reseed on their next request.
+ * Slow polls otherwise only run in the background, so this is for
+ * callers that need fresh system entropy right away.
+ *
+ * Returns 1 if the reseed was successful, 0 otherwise.
+ */
+bool RngForceReseed(void);
+
+/**
+ * Fetch len bytes (of any length) from the DRBG of the calling
+ * thread (a CTR_DRBG, or the ChaCha20 generator on hosts without
+ * AES hardware). The per-thread DRBGs are seeded from a central CTR_DRBG
+ * which is seeded from the randomness pool on first use and then
+ * periodically reseeded from the pool in the background; a thread
+ * reseeds on its next request after each central reseed.
  *
  * Returns 1 if the bytes were fetched successfully, 0 otherwise.
  */
 bool RngFetchBytes(uint8_t *out, size_t len);
 
+/**
+ * Start a background thread that keeps a ring of RNG_RING_SLOTS
+ * slots filled with DRBG output, so that requests of at most
+ * RNG_RING_SLOT_SIZE bytes can be served with only atomic operations.
+ * Each slot is handed out to exactly one request and zeroized after
+ * it is copied, any unused bytes of the slot are discarded.
+ *
+ * The thread is woken up to fill up to batch slots whenever fewer
+ * than watermark slots are left; both must be in 1..RNG_RING_SLOTS.
+ * Requests fall back to the per-thread DRBG when the ring is empty.
+ *
+ * Returns 1 if prefetching started successfully, 0 otherwise.
+ */
+bool RngStartPrefetch(unsigned int watermark, unsigned int batch);
+
+/**
+ * Stop prefetching and wipe the ring; must not be called while
+ * other threads are fetching bytes. Also done by RngStop().
+ */
+void RngStopPrefetch(void);
+
 extern BOOL bStrictChecksEnabled;
 extern BOOL bUserEventsEnabled;
 extern BOOL HasRdrand;
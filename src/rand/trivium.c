@@ -26,23 +26,26 @@
 
 #include "trivium.h"
 #include "common/endianness.h"
+#ifdef _WIN32
 #include "rngw32.h"
+#else
+#include "rngposix.h"
+#endif
+#include <string.h>
 
-/* 288-bit internal state */
-static u32 x1, x2, x3, x4, x5, x6, x7, x8, x9;
+#if (defined(__x86_64__) || defined(__i386)) &&                                \
+    (defined(__GNUC__) || defined(__clang__))
+#define TRIVIUM_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
-static u32 t1, t2, t3;
-static u8 z;
+/* The state of the TriviumRand* generator */
+static TRIVIUM_STATE trivium_state;
 
 /* Global counter to handle periodic reseeding */
 static s32 ctr = -1;
 
-#if defined(__LITTLE_ENDIAN__)
-#define BE_U32(_x) bswap32(_x)
-#else
-#define BE_U32(_x) (_x)
-#endif
-
 /*
  * The constant key is the first 80 bits from the
  * first 7 decimal digits of the square roots of
@@ -53,34 +56,81 @@ static const u8 trivium_k[TRIVIUM_KEY_SIZE + 2] = {
 };
 
 /*
- * Update and rotate the internal state and generate one bit of keystream.
+ * The 64-bit window of register r starting o bits in; bit (63 - j) of
+ * the window is the value of a tap at step j of the next 64 steps.
  */
-#define TRIVIUM_UPDATE_ROTATE                                                  \
-  {                                                                            \
-    t1 = ((x3 >> 1) ^ (x3 >> 28)) & 0x1;  /* t1 <- s66 + s93 */                \
-    t2 = ((x6 >> 1) ^ (x6 >> 16)) & 0x1;  /* t2 <- s162 + s177 */              \
-    t3 = ((x8 >> 18) ^ (x9 >> 31)) & 0x1; /* t3 <- s243 + s288 */              \
-    z = t1 ^ t2 ^ t3;                     /* z <- t1 + t2 + t3 */              \
-    /* t1 <- t1 + s91.s92 + s171 */                                            \
-    t1 = (t1 ^ ((x3 >> 26) & (x3 >> 27)) ^ (x6 >> 10)) & 0x1;                  \
-    /* t2 <- t2 + s175.s176 + s264 */                                          \
-    t2 = (t2 ^ ((x6 >> 14) & (x6 >> 15)) ^ (x9 >> 7)) & 0x1;                   \
-    /* t3 <- t3 + s286.s287 + s69 */                                           \
-    t3 = (t3 ^ ((x9 >> 29) & (x9 >> 30)) ^ (x3 >> 4)) & 0x1;                   \
-    /* (s178, s179, ..., s288) <- (t2, s178, ..., s287) */                     \
-    x9 = (x9 << 1) | (x8 >> 31);                                               \
-    x8 = (x8 << 1) | (x7 >> 31);                                               \
-    x7 = (x7 << 1) | (x6 >> 31);                                               \
-    /* (s94, s95, ..., s177) <- (t1, s94, ..., s176) */                        \
-    x6 = ((x6 << 1) & 0xfffdffff) | ((u32)t2 << 17) | (x5 >> 31);              \
-    x5 = (x5 << 1) | (x4 >> 31);                                               \
-    x4 = (x4 << 1) | (x3 >> 31);                                               \
-    /* (s1, s2, ..., s93) <- (t3, s1, ..., s92) */                             \
-    x3 = ((x3 << 1) & 0xdfffffff) | ((u32)t1 << 29) | (x2 >> 31);              \
-    x2 = (x2 << 1) | (x1 >> 31);                                               \
-    x1 = (x1 << 1) | t3;                                                       \
+#define TRIVIUM_TAP(r, o) (((r)[0] >> (o)) | ((r)[1] << (64 - (o))))
+
+/*
+ * Run 64 rounds of the update function at once and return the 64
+ * keystream bits, the first one in the most significant bit.
+ *
+ * No tap is closer than 64 bits to the start of its register, so all
+ * the taps for the next 64 rounds can be read from the current state.
+ */
+static inline u64 trivium_update64(TRIVIUM_STATE *ctx) {
+  u64 *ra = ctx->ra, *rb = ctx->rb, *rc = ctx->rc;
+  u64 t1, t2, t3, z;
+
+  t1 = TRIVIUM_TAP(ra, 2) ^ TRIVIUM_TAP(ra, 29);  /* t1 <- s66 + s93 */
+  t2 = TRIVIUM_TAP(rb, 5) ^ TRIVIUM_TAP(rb, 20);  /* t2 <- s162 + s177 */
+  t3 = TRIVIUM_TAP(rc, 2) ^ TRIVIUM_TAP(rc, 47);  /* t3 <- s243 + s288 */
+  z = t1 ^ t2 ^ t3;                               /* z <- t1 + t2 + t3 */
+  /* t1 <- t1 + s91.s92 + s171 */
+  t1 ^= (TRIVIUM_TAP(ra, 27) & TRIVIUM_TAP(ra, 28)) ^ TRIVIUM_TAP(rb, 14);
+  /* t2 <- t2 + s175.s176 + s264 */
+  t2 ^= (TRIVIUM_TAP(rb, 18) & TRIVIUM_TAP(rb, 19)) ^ TRIVIUM_TAP(rc, 23);
+  /* t3 <- t3 + s286.s287 + s69 */
+  t3 ^= (TRIVIUM_TAP(rc, 45) & TRIVIUM_TAP(rc, 46)) ^ TRIVIUM_TAP(ra, 5);
+  /* Shift each register by 64 bits, the feedback bits enter in order */
+  ra[1] = ra[0];
+  ra[0] = t3;
+  rb[1] = rb[0];
+  rb[0] = t1;
+  rc[1] = rc[0];
+  rc[0] = t2;
+
+  return z;
+}
+
+/* Get the next n (1 <= n <= 64) bits of keystream. */
+static inline u64 trivium_next(TRIVIUM_STATE *ctx, int n) {
+  u64 rand;
+  int m;
+
+  if (n <= ctx->ks_bits) {
+    rand = ctx->ks >> (64 - n);
+    ctx->ks = (n == 64) ? 0 : ctx->ks << n;
+    ctx->ks_bits -= n;
+    return rand;
   }
 
+  /* Take what is left and the rest from a new batch */
+  m = n - ctx->ks_bits;
+  rand = ctx->ks_bits ? ctx->ks >> (64 - ctx->ks_bits) : 0;
+  ctx->ks = trivium_update64(ctx);
+  if (m == 64) {
+    rand = ctx->ks;
+    ctx->ks = 0;
+  } else {
+    rand = (rand << m) | (ctx->ks >> (64 - m));
+    ctx->ks <<= m;
+  }
+  ctx->ks_bits = 64 - m;
+
+  return rand;
+}
+
+/* Get 64 bits of the packed 288-bit state x starting at bit pos. */
+static u64 trivium_unpack(const u32 *x, int pos) {
+  u64 r = 0;
+
+  for (int i = 0; i < 64 && pos + i < 288; ++i)
+    r |= (u64)((x[(pos + i) >> 5] >> ((pos + i) & 31)) & 0x1) << i;
+
+  return r;
+}
+
 /*
  * Initialize the internal state by inserting the key and IV and rotate the
  * internal state over 4 full cycles (4 * 288 update rounds) without generating
@@ -90,20 +140,327 @@ static const u8 trivium_k[TRIVIUM_KEY_SIZE + 2] = {
  * (s94, s95, ..., s177) <- (IV1, ..., IV80, 0, ..., 0)
  * (s178, s179, ..., s288) <- (0, ..., 0, 1, 1, 1)
  */
-static void trivium_init(u32 *k, u32 *iv) {
-  x1 = (k[0] >> 2) | ((k[1] & 0x3) << 30);
-  x2 = (k[1] >> 2) | ((k[2] & 0x3) << 30);
-  x3 = (u32)0 | (k[2] & 0x3fff) | ((iv[0] & 0x7) << 29);
-  x4 = (iv[0] >> 3) | ((iv[1] & 0x7) << 29);
-  x5 = (iv[1] >> 3) | ((iv[2] & 0x7) << 29);
-  x6 = (u32)0 | ((iv[2] >> 3) & 0x1fff);
-  x7 = x8 = 0;
-  x9 = 0xe0000000; /* 0....111 */
+void trivium_init(TRIVIUM_STATE *ctx, const u8 key[TRIVIUM_KEY_SIZE],
+                  const u8 iv[TRIVIUM_IV_SIZE]) {
+  u32 x[9], k[3], v[3];
+
+  /* Zero-padded copies of the key and IV */
+  k[2] = v[2] = 0;
+  memcpy(k, key, TRIVIUM_KEY_SIZE);
+  memcpy(v, iv, TRIVIUM_IV_SIZE);
+
+  x[0] = (k[0] >> 2) | ((k[1] & 0x3) << 30);
+  x[1] = (k[1] >> 2) | ((k[2] & 0x3) << 30);
+  x[2] = (u32)0 | (k[2] & 0x3fff) | ((v[0] & 0x7) << 29);
+  x[3] = (v[0] >> 3) | ((v[1] & 0x7) << 29);
+  x[4] = (v[1] >> 3) | ((v[2] & 0x7) << 29);
+  x[5] = (u32)0 | ((v[2] >> 3) & 0x1fff);
+  x[6] = x[7] = 0;
+  x[8] = 0xe0000000; /* 0....111 */
+
+  /* Split the packed state into the three registers */
+  ctx->ra[0] = trivium_unpack(x, 0);
+  ctx->ra[1] = trivium_unpack(x, 64) & 0x1fffffff;
+  ctx->rb[0] = trivium_unpack(x, 93);
+  ctx->rb[1] = trivium_unpack(x, 157) & 0xfffff;
+  ctx->rc[0] = trivium_unpack(x, 177);
+  ctx->rc[1] = trivium_unpack(x, 241);
+
+  zeroize((u8 *)x, sizeof(x));
+  zeroize((u8 *)k, sizeof(k));
+  zeroize((u8 *)v, sizeof(v));
 
   /* Run blank rounds */
-  for (int i = 0; i < 4 * 288; ++i) {
-    TRIVIUM_UPDATE_ROTATE
+  for (int i = 0; i < 4 * 288 / 64; ++i)
+    (void)trivium_update64(ctx);
+
+  ctx->ks = 0;
+  ctx->ks_bits = 0;
+}
+
+/* Fill the buffer with len bytes of keystream. */
+void trivium_generate(TRIVIUM_STATE *ctx, u8 *out, size_t len) {
+  u64 w;
+
+  /* Drain the buffered bits first */
+  for (; len && ctx->ks_bits; --len)
+    *out++ = (u8)trivium_next(ctx, 8);
+
+  for (; len >= 8; len -= 8, out += 8) {
+    w = hton64(trivium_update64(ctx));
+    memcpy(out, &w, 8);
+  }
+
+  for (; len; --len)
+    *out++ = (u8)trivium_next(ctx, 8);
+}
+
+/* Clear the state to prevent leaks. */
+void trivium_clear(TRIVIUM_STATE *ctx) {
+  zeroize((u8 *)ctx, sizeof(TRIVIUM_STATE));
+}
+
+/* Lane-parallel (x8) implementation */
+
+#define TRIVIUM_X8_BATCH 64 /* Blocks per call to a kernel */
+
+typedef void (*trivium_x8_blocks_fn)(TRIVIUM_X8_STATE *, u8 *, size_t);
+
+/* One 64-round update of every lane; output is big-endian per lane. */
+static void trivium_x8_blocks_ref(TRIVIUM_X8_STATE *ctx, u8 *out,
+                                  size_t nblocks) {
+  TRIVIUM_STATE lane;
+  u64 w;
+
+  for (size_t i = 0; i < nblocks; ++i) {
+    for (int l = 0; l < TRIVIUM_X8_LANES; ++l) {
+      lane.ra[0] = ctx->ra[0][l], lane.ra[1] = ctx->ra[1][l];
+      lane.rb[0] = ctx->rb[0][l], lane.rb[1] = ctx->rb[1][l];
+      lane.rc[0] = ctx->rc[0][l], lane.rc[1] = ctx->rc[1][l];
+      w = hton64(trivium_update64(&lane));
+      memcpy(out + 8 * (TRIVIUM_X8_LANES * i + l), &w, 8);
+      ctx->ra[0][l] = lane.ra[0], ctx->ra[1][l] = lane.ra[1];
+      ctx->rb[0][l] = lane.rb[0], ctx->rb[1][l] = lane.rb[1];
+      ctx->rc[0][l] = lane.rc[0], ctx->rc[1][l] = lane.rc[1];
+    }
+  }
+
+  zeroize((u8 *)&lane, sizeof(lane));
+}
+
+#if defined(TRIVIUM_X86)
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+#define AVX512_TARGET __attribute__((target("avx512f,avx512bw")))
+
+#define CPU_AVX2 (1 << 0)
+#define CPU_AVX512 (1 << 1) /* AVX512F and AVX512BW */
+
+static int trivium_cpu_features(void) {
+  static volatile int features = -1;
+  unsigned int eax, ebx, ecx, edx, xcr0_lo = 0, xcr0_hi = 0;
+  int f = 0;
+
+  if (features != -1)
+    return features;
+
+  /* The OS must save the YMM/ZMM state for AVX to be usable */
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 27)) &&
+      (ecx & (1 << 28))) {
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x06) == 0x06 &&
+        __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+      if (ebx & (1 << 5))
+        f |= CPU_AVX2;
+      if ((ebx & (1 << 16)) && (ebx & (1U << 30)) && (xcr0_lo & 0xe6) == 0xe6)
+        f |= CPU_AVX512;
+    }
+  }
+
+  features = f;
+  return f;
+}
+
+#define TRIVIUM_TAP256(r0, r1, o)                                              \
+  _mm256_or_si256(_mm256_srli_epi64(r0, o), _mm256_slli_epi64(r1, 64 - (o)))
+
+/* Lanes 0-3 and 4-7 are held in two sets of YMM registers. */
+static AVX2_TARGET void trivium_x8_blocks_avx2(TRIVIUM_X8_STATE *ctx, u8 *out,
+                                               size_t nblocks) {
+  const __m256i bswap = _mm256_set_epi8(
+      8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+      13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i a0[2], a1[2], b0[2], b1[2], c0[2], c1[2];
+  __m256i t1, t2, t3, z;
+
+  for (int h = 0; h < 2; ++h) {
+    a0[h] = _mm256_loadu_si256((const __m256i *)&ctx->ra[0][4 * h]);
+    a1[h] = _mm256_loadu_si256((const __m256i *)&ctx->ra[1][4 * h]);
+    b0[h] = _mm256_loadu_si256((const __m256i *)&ctx->rb[0][4 * h]);
+    b1[h] = _mm256_loadu_si256((const __m256i *)&ctx->rb[1][4 * h]);
+    c0[h] = _mm256_loadu_si256((const __m256i *)&ctx->rc[0][4 * h]);
+    c1[h] = _mm256_loadu_si256((const __m256i *)&ctx->rc[1][4 * h]);
+  }
+
+  for (size_t i = 0; i < nblocks; ++i) {
+    for (int h = 0; h < 2; ++h) {
+      t1 = _mm256_xor_si256(TRIVIUM_TAP256(a0[h], a1[h], 2),
+                            TRIVIUM_TAP256(a0[h], a1[h], 29));
+      t2 = _mm256_xor_si256(TRIVIUM_TAP256(b0[h], b1[h], 5),
+                            TRIVIUM_TAP256(b0[h], b1[h], 20));
+      t3 = _mm256_xor_si256(TRIVIUM_TAP256(c0[h], c1[h], 2),
+                            TRIVIUM_TAP256(c0[h], c1[h], 47));
+      z = _mm256_xor_si256(_mm256_xor_si256(t1, t2), t3);
+      t1 = _mm256_xor_si256(
+          t1, _mm256_xor_si256(_mm256_and_si256(TRIVIUM_TAP256(a0[h], a1[h], 27),
+                                                TRIVIUM_TAP256(a0[h], a1[h], 28)),
+                               TRIVIUM_TAP256(b0[h], b1[h], 14)));
+      t2 = _mm256_xor_si256(
+          t2, _mm256_xor_si256(_mm256_and_si256(TRIVIUM_TAP256(b0[h], b1[h], 18),
+                                                TRIVIUM_TAP256(b0[h], b1[h], 19)),
+                               TRIVIUM_TAP256(c0[h], c1[h], 23)));
+      t3 = _mm256_xor_si256(
+          t3, _mm256_xor_si256(_mm256_and_si256(TRIVIUM_TAP256(c0[h], c1[h], 45),
+                                                TRIVIUM_TAP256(c0[h], c1[h], 46)),
+                               TRIVIUM_TAP256(a0[h], a1[h], 5)));
+      a1[h] = a0[h], a0[h] = t3;
+      b1[h] = b0[h], b0[h] = t1;
+      c1[h] = c0[h], c0[h] = t2;
+      _mm256_storeu_si256((__m256i *)(out + 64 * i + 32 * h),
+                          _mm256_shuffle_epi8(z, bswap));
+    }
+  }
+
+  for (int h = 0; h < 2; ++h) {
+    _mm256_storeu_si256((__m256i *)&ctx->ra[0][4 * h], a0[h]);
+    _mm256_storeu_si256((__m256i *)&ctx->ra[1][4 * h], a1[h]);
+    _mm256_storeu_si256((__m256i *)&ctx->rb[0][4 * h], b0[h]);
+    _mm256_storeu_si256((__m256i *)&ctx->rb[1][4 * h], b1[h]);
+    _mm256_storeu_si256((__m256i *)&ctx->rc[0][4 * h], c0[h]);
+    _mm256_storeu_si256((__m256i *)&ctx->rc[1][4 * h], c1[h]);
+  }
+
+  /* Don't leave the state behind in the YMM registers */
+  _mm256_zeroall();
+}
+
+#define TRIVIUM_TAP512(r0, r1, o)                                              \
+  _mm512_or_si512(_mm512_srli_epi64(r0, o), _mm512_slli_epi64(r1, 64 - (o)))
+
+/* All eight lanes are held in one set of ZMM registers. */
+static AVX512_TARGET void trivium_x8_blocks_avx512(TRIVIUM_X8_STATE *ctx,
+                                                   u8 *out, size_t nblocks) {
+  const __m512i bswap = _mm512_broadcast_i32x4(_mm_set_epi8(
+      8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7));
+  __m512i a0, a1, b0, b1, c0, c1, t1, t2, t3, z;
+
+  a0 = _mm512_loadu_si512(ctx->ra[0]);
+  a1 = _mm512_loadu_si512(ctx->ra[1]);
+  b0 = _mm512_loadu_si512(ctx->rb[0]);
+  b1 = _mm512_loadu_si512(ctx->rb[1]);
+  c0 = _mm512_loadu_si512(ctx->rc[0]);
+  c1 = _mm512_loadu_si512(ctx->rc[1]);
+
+  for (size_t i = 0; i < nblocks; ++i) {
+    t1 = _mm512_xor_si512(TRIVIUM_TAP512(a0, a1, 2), TRIVIUM_TAP512(a0, a1, 29));
+    t2 = _mm512_xor_si512(TRIVIUM_TAP512(b0, b1, 5), TRIVIUM_TAP512(b0, b1, 20));
+    t3 = _mm512_xor_si512(TRIVIUM_TAP512(c0, c1, 2), TRIVIUM_TAP512(c0, c1, 47));
+    /* z <- t1 + t2 + t3 */
+    z = _mm512_ternarylogic_epi64(t1, t2, t3, 0x96);
+    /* t <- t + ab + c */
+    t1 = _mm512_xor_si512(
+        t1, _mm512_ternarylogic_epi64(TRIVIUM_TAP512(a0, a1, 27),
+                                      TRIVIUM_TAP512(a0, a1, 28),
+                                      TRIVIUM_TAP512(b0, b1, 14), 0x6a));
+    t2 = _mm512_xor_si512(
+        t2, _mm512_ternarylogic_epi64(TRIVIUM_TAP512(b0, b1, 18),
+                                      TRIVIUM_TAP512(b0, b1, 19),
+                                      TRIVIUM_TAP512(c0, c1, 23), 0x6a));
+    t3 = _mm512_xor_si512(
+        t3, _mm512_ternarylogic_epi64(TRIVIUM_TAP512(c0, c1, 45),
+                                      TRIVIUM_TAP512(c0, c1, 46),
+                                      TRIVIUM_TAP512(a0, a1, 5), 0x6a));
+    a1 = a0, a0 = t3;
+    b1 = b0, b0 = t1;
+    c1 = c0, c0 = t2;
+    _mm512_storeu_si512(out + 64 * i, _mm512_shuffle_epi8(z, bswap));
+  }
+
+  _mm512_storeu_si512(ctx->ra[0], a0);
+  _mm512_storeu_si512(ctx->ra[1], a1);
+  _mm512_storeu_si512(ctx->rb[0], b0);
+  _mm512_storeu_si512(ctx->rb[1], b1);
+  _mm512_storeu_si512(ctx->rc[0], c0);
+  _mm512_storeu_si512(ctx->rc[1], c1);
+
+  /* Don't leave the state behind in the vector registers */
+  _mm256_zeroall();
+}
+
+#endif /* TRIVIUM_X86 */
+
+/* Pick the widest kernel the host CPU supports. */
+static trivium_x8_blocks_fn trivium_x8_get_kernel(void) {
+#if defined(TRIVIUM_X86)
+  int f = trivium_cpu_features();
+
+  if (f & CPU_AVX512)
+    return trivium_x8_blocks_avx512;
+  if (f & CPU_AVX2)
+    return trivium_x8_blocks_avx2;
+#endif
+  return trivium_x8_blocks_ref;
+}
+
+/* Initialize lane l of the context from an initialized TRIVIUM_STATE. */
+static void trivium_x8_set_lane(TRIVIUM_X8_STATE *ctx, int l,
+                                const TRIVIUM_STATE *lane) {
+  ctx->ra[0][l] = lane->ra[0], ctx->ra[1][l] = lane->ra[1];
+  ctx->rb[0][l] = lane->rb[0], ctx->rb[1][l] = lane->rb[1];
+  ctx->rc[0][l] = lane->rc[0], ctx->rc[1][l] = lane->rc[1];
+}
+
+/* Initialize the eight lanes with a shared key and one IV per lane. */
+void trivium_x8_init(TRIVIUM_X8_STATE *ctx, const u8 key[TRIVIUM_KEY_SIZE],
+                     const u8 iv[TRIVIUM_X8_LANES][TRIVIUM_IV_SIZE]) {
+  TRIVIUM_STATE lane;
+
+  for (int l = 0; l < TRIVIUM_X8_LANES; ++l) {
+    trivium_init(&lane, key, iv[l]);
+    trivium_x8_set_lane(ctx, l, &lane);
+  }
+
+  trivium_clear(&lane);
+}
+
+/* Initialize the eight lanes with the constant key and
+   independent IVs from the RNG. Returns SUCCESS/FAILURE. */
+status_t trivium_x8_seed(TRIVIUM_X8_STATE *ctx) {
+  u8 iv[TRIVIUM_X8_LANES][TRIVIUM_IV_SIZE];
+
+  if (!RngFetchBytes(&iv[0][0], sizeof(iv)))
+    return FAILURE;
+
+  trivium_x8_init(ctx, trivium_k, (const u8(*)[TRIVIUM_IV_SIZE])iv);
+  zeroize(&iv[0][0], sizeof(iv));
+
+  return SUCCESS;
+}
+
+/* Generate nblocks interleaved blocks; 8 bytes per lane per block. */
+void trivium_x8_generate(TRIVIUM_X8_STATE *ctx, u8 *out, size_t nblocks) {
+  trivium_x8_get_kernel()(ctx, out, nblocks);
+}
+
+/* Generate len bytes of keystream for each lane into out[lane];
+   len must be a multiple of 8. */
+void trivium_x8_generate_lanes(TRIVIUM_X8_STATE *ctx,
+                               u8 *out[TRIVIUM_X8_LANES], size_t len) {
+  u8 buf[TRIVIUM_X8_BATCH * TRIVIUM_X8_BLOCK_SIZE];
+  trivium_x8_blocks_fn kernel = trivium_x8_get_kernel();
+  size_t n, off = 0;
+
+  len /= 8;
+  while (len) {
+    n = (len < TRIVIUM_X8_BATCH) ? len : TRIVIUM_X8_BATCH;
+    kernel(ctx, buf, n);
+
+    /* Scatter the interleaved blocks to the lanes */
+    for (size_t i = 0; i < n; ++i)
+      for (int l = 0; l < TRIVIUM_X8_LANES; ++l)
+        memcpy(out[l] + off + 8 * i,
+               buf + TRIVIUM_X8_BLOCK_SIZE * i + 8 * l, 8);
+
+    off += 8 * n;
+    len -= n;
   }
+
+  zeroize(buf, sizeof(buf));
+}
+
+/* Clear the context to prevent leaks. */
+void trivium_x8_clear(TRIVIUM_X8_STATE *ctx) {
+  zeroize((u8 *)ctx, sizeof(TRIVIUM_X8_STATE));
 }
 
 /*
@@ -124,76 +481,69 @@ static void trivium_set_seed(void) {
   (void)RngFetchBytes(iv, TRIVIUM_IV_SIZE);
 
   ctr = 0;
-  trivium_init(Ptr32(&trivium_k[0]), Ptr32(&iv[0]));
+  trivium_init(&trivium_state, trivium_k, iv);
   zeroize(iv, sizeof(iv));
 }
 
 /* Return 8 bits of random keystream. */
 u8 TriviumRand8() {
-  u8 rand = 0;
-
   if (ctr >= TRIVIUM_RESEED_PERIOD || ctr == -1)
     trivium_set_seed();
 
-  for (int i = 0; i < 8; ++i) {
-    TRIVIUM_UPDATE_ROTATE
-
-    rand = (rand << 1) | z;
-  }
   ctr += 8;
 
-  return rand;
+  return (u8)trivium_next(&trivium_state, 8);
 }
 
 /* Return 16 bits of random keystream. */
 u16 TriviumRand16() {
-  u16 rand = 0;
-
   if (ctr >= TRIVIUM_RESEED_PERIOD || ctr == -1)
     trivium_set_seed();
 
-  for (int i = 0; i < 16; ++i) {
-    TRIVIUM_UPDATE_ROTATE
-
-    rand = (rand << 1) | z;
-  }
   ctr += 16;
 
-  return rand;
+  return (u16)trivium_next(&trivium_state, 16);
 }
 
 /* Return 32 bits of random keystream. */
 u32 TriviumRand32() {
-  u32 rand = 0;
-
   if (ctr >= TRIVIUM_RESEED_PERIOD || ctr == -1)
     trivium_set_seed();
 
-  for (int i = 0; i < 32; ++i) {
-    TRIVIUM_UPDATE_ROTATE
-
-    rand = (rand << 1) | z;
-  }
   ctr += 32;
 
-  return rand;
+  return (u32)trivium_next(&trivium_state, 32);
 }
 
 /* Return 64 bits of random keystream. */
 u64 TriviumRand64() {
-  u64 rand = 0;
-
   if (ctr >= TRIVIUM_RESEED_PERIOD || ctr == -1)
     trivium_set_seed();
 
-  for (int i = 0; i < 64; ++i) {
-    TRIVIUM_UPDATE_ROTATE
-
-    rand = (rand << 1) | z;
-  }
   ctr += 64;
 
-  return rand;
+  return trivium_next(&trivium_state, 64);
+}
+
+/* Fill the buffer with random keystream; the output is the same
+   as that of len successive calls to TriviumRand8(). */
+void TriviumFill(u8 *out, size_t len) {
+  size_t n;
+
+  while (len) {
+    if (ctr >= TRIVIUM_RESEED_PERIOD || ctr == -1)
+      trivium_set_seed();
+
+    /* Bytes left until the next reseed */
+    n = (size_t)((TRIVIUM_RESEED_PERIOD - ctr + 7) / 8);
+    if (n > len)
+      n = len;
+
+    ctr += (s32)(8 * n);
+    trivium_generate(&trivium_state, out, n);
+    out += n;
+    len -= n;
+  }
 }
 
 /* Init the Trivium CSPRNG.
@@ -212,15 +562,7 @@ status_t TriviumCsprngInit() {
 /* Reset the counter and internal state. */
 void TriviumCsprngReset() {
   /* Clear the internal state to prevent leaks */
-  x1 = 0;
-  x2 = 0;
-  x3 = 0;
-  x4 = 0;
-  x5 = 0;
-  x6 = 0;
-  x7 = 0;
-  x8 = 0;
-  x9 = 0;
+  trivium_clear(&trivium_state);
 
   /* Reset the reseed counter */
   ctr = -1;
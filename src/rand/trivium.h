@@ -10,6 +10,9 @@
  *  secret state has 288 bits. Although Trivium guarantees 2^64 key-stream bits,
  *  this generator is reseeded with a new IV after every 2^20 bytes generated.
  *
+ *  The state is updated 64 rounds at a time and the keystream is buffered,
+ *  the output is the same as that of the bit-serial description.
+ *
  *  @author Vibhav Tiwari [vibhav950 on GitHub]
  *
  * LICENSE
@@ -44,6 +47,134 @@
 /* Period for re-seeding the CSPRNG. */
 #define TRIVIUM_RESEED_PERIOD (1ULL << 20)
 
+/**
+ * This struct defines the internal state of a Trivium
+ * keystream generator. Each thread should own its own
+ * context; a context must not be shared without locking.
+ */
+typedef struct _TRIVIUM_STATE {
+  /* The three shift registers, 64 bits per lane; lane [0] holds
+     the first 64 bits of the register */
+  u64 ra[2]; /* (s1, ..., s93) */
+  u64 rb[2]; /* (s94, ..., s177) */
+  u64 rc[2]; /* (s178, ..., s288) */
+  /* Buffered keystream bits, consumed from the most significant bit */
+  u64 ks;
+  int ks_bits;
+} TRIVIUM_STATE;
+
+/** @brief  Initialize the Trivium context with a key-IV pair.
+ *
+ *  @param ctx                          The context to initialize.
+ *  @param key                          The 80-bit key.
+ *  @param iv                           The 80-bit IV.
+ *
+ *  @return  Void.
+ */
+void trivium_init(TRIVIUM_STATE *ctx, const u8 key[TRIVIUM_KEY_SIZE],
+                  const u8 iv[TRIVIUM_IV_SIZE]);
+
+/** @brief  Generate keystream bytes.
+ *
+ *  The context is not reseeded; the caller must initialize it
+ *  again with a new IV well before 2^64 bits are generated.
+ *
+ *  @param ctx                          The Trivium context.
+ *  @param out                          The output buffer.
+ *  @param len                          The number of bytes to generate.
+ *
+ *  @return  Void.
+ */
+void trivium_generate(TRIVIUM_STATE *ctx, u8 *out, size_t len);
+
+/** @brief  Clear the Trivium context.
+ *
+ *  @param ctx                          The context to clear.
+ *
+ *  @return  Void.
+ */
+void trivium_clear(TRIVIUM_STATE *ctx);
+
+/* Number of independent instances in a TRIVIUM_X8_STATE. */
+#define TRIVIUM_X8_LANES 8
+/* Bytes of interleaved output per x8 block (8 bytes per lane). */
+#define TRIVIUM_X8_BLOCK_SIZE (8 * TRIVIUM_X8_LANES)
+
+/**
+ * This struct defines the state of eight independent Trivium
+ * instances, laid out so that each 64-bit lane word of every
+ * instance sits in one SIMD lane (AVX2 or AVX-512 if available).
+ */
+typedef struct _TRIVIUM_X8_STATE {
+  u64 ra[2][TRIVIUM_X8_LANES];
+  u64 rb[2][TRIVIUM_X8_LANES];
+  u64 rc[2][TRIVIUM_X8_LANES];
+} TRIVIUM_X8_STATE;
+
+/** @brief  Initialize the eight lanes with a shared key and
+ *          one IV per lane; lane l produces the same keystream
+ *          as trivium_init() with @p key and @p iv [l].
+ *
+ *  @param ctx                          The context to initialize.
+ *  @param key                          The 80-bit key.
+ *  @param iv                           The 80-bit IV of each lane.
+ *
+ *  @return  Void.
+ */
+void trivium_x8_init(TRIVIUM_X8_STATE *ctx, const u8 key[TRIVIUM_KEY_SIZE],
+                     const u8 iv[TRIVIUM_X8_LANES][TRIVIUM_IV_SIZE]);
+
+/** @brief  Initialize the eight lanes with the constant key of
+ *          the Trivium CSPRNG and independent IVs fetched from
+ *          the RNG.
+ *
+ *  @param ctx                          The context to initialize.
+ *
+ *  @return  FAILURE if the IVs could not be fetched.
+ *  @return  SUCCESS otherwise.
+ */
+status_t trivium_x8_seed(TRIVIUM_X8_STATE *ctx);
+
+/** @brief  Generate interleaved keystream; block i holds the
+ *          i-th 8 bytes of lane 0, then of lane 1 and so on.
+ *
+ *  @param ctx                          The x8 context.
+ *  @param out                          The output buffer, at least
+ *                                      @p nblocks * TRIVIUM_X8_BLOCK_SIZE
+ *                                      bytes.
+ *  @param nblocks                      The number of blocks to generate.
+ *
+ *  @return  Void.
+ */
+void trivium_x8_generate(TRIVIUM_X8_STATE *ctx, u8 *out, size_t nblocks);
+
+/** @brief  Generate @p len bytes of keystream for each lane into
+ *          its own buffer.
+ *
+ *  @param ctx                          The x8 context.
+ *  @param out                          The output buffer of each lane.
+ *  @param len                          The number of bytes per lane;
+ *                                      must be a multiple of 8.
+ *
+ *  @return  Void.
+ */
+void trivium_x8_generate_lanes(TRIVIUM_X8_STATE *ctx,
+                               u8 *out[TRIVIUM_X8_LANES], size_t len);
+
+/** @brief  Clear the x8 context.
+ *
+ *  @param ctx                          The context to clear.
+ *
+ *  @return  Void.
+ */
+void trivium_x8_clear(TRIVIUM_X8_STATE *ctx);
+
+/*
+ * The TriviumCsprng and TriviumRand* functions below share a single
+ * process-wide context (seeded from the RNG) and are not thread-safe;
+ * use a TRIVIUM_STATE per thread instead.
+ */
+
 /* Init the Trivium CSPRNG. */
 XRAND_UNSTABLE status_t TriviumCsprngInit(void);
 /* Reset the counter and internal state. */
@@ -57,5 +188,7 @@ XRAND_UNSTABLE u16 TriviumRand16();
 XRAND_UNSTABLE u32 TriviumRand32();
 /* Fetch a 64-bit random number. */
 XRAND_UNSTABLE u64 TriviumRand64();
+/* Fill a buffer with len random bytes. */
+XRAND_UNSTABLE void TriviumFill(u8 *out, size_t len);
 
 #endif /* TRIVIUM_H */
\ No newline at end of file
@@ -0,0 +1,705 @@
+/**
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "xr_rng.h"
+#include "common/exceptions.h"
+#include "common/secure_alloc.h"
+#ifdef _WIN32
+#include "rngw32.h"
+#else
+#include "rngposix.h"
+#endif
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Seed material for the HASH_DRBG and HMAC_DRBG instantiation:
+   the entropy input followed by a nonce of half the strength */
+#define XR_RNG_SHA_ENTROPY_LEN 32
+#define XR_RNG_SHA_NONCE_LEN 16
+#define XR_RNG_SHA_SEED_LEN (XR_RNG_SHA_ENTROPY_LEN + XR_RNG_SHA_NONCE_LEN)
+
+/* Seed material for Trivium: a fresh key and IV */
+#define XR_RNG_TRIVIUM_SEED_LEN (TRIVIUM_KEY_SIZE + TRIVIUM_IV_SIZE)
+
+/* The default entropy source */
+static int xr_rng_entropy_rng(void *ctx, uint8_t *buf, size_t len) {
+  (void)ctx;
+  return RngFetchBytes(buf, len) ? 0 : 1;
+}
+
+static inline status_t xr_rng_get_seed(xr_rng *rng, uint8_t *seed,
+                                       size_t len) {
+  return rng->entropy_cb(rng->entropy_ctx, seed, len) == 0 ? SUCCESS
+                                                           : FAILURE;
+}
+
+/*
+ * CTR_DRBG
+ */
+
+static status_t ctr_init(xr_rng *rng) {
+  uint8_t seed[CTR_DRBG_ENTROPY_LEN];
+  status_t ret;
+
+  if ((ret = xr_rng_get_seed(rng, seed, sizeof(seed))) == SUCCESS &&
+      (ret = ctr_drbg_init(&rng->u.ctr, seed, NULL, 0)) == SUCCESS)
+    ctr_drbg_set_entropy_cb(&rng->u.ctr, rng->entropy_cb, rng->entropy_ctx);
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+  return ret;
+}
+
+static status_t ctr_generate(xr_rng *rng, uint8_t *out, size_t len,
+                             const uint8_t *addn, size_t addn_len) {
+  size_t n;
+
+  /* The additional input goes into the first request */
+  if (addn_len) {
+    n = min(len, (size_t)CTR_DRBG_MAX_OUT_LEN);
+    if (ctr_drbg_generate(&rng->u.ctr, out, n, addn, addn_len) != SUCCESS)
+      return FAILURE;
+    out += n;
+    len -= n;
+  }
+
+  return ctr_drbg_generate_bulk(&rng->u.ctr, out, len);
+}
+
+static status_t ctr_reseed(xr_rng *rng) {
+  uint8_t seed[CTR_DRBG_ENTROPY_LEN];
+  status_t ret;
+
+  if ((ret = xr_rng_get_seed(rng, seed, sizeof(seed))) == SUCCESS)
+    ret = ctr_drbg_reseed(&rng->u.ctr, seed, NULL, 0);
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+  return ret;
+}
+
+static void ctr_clear(xr_rng *rng) { ctr_drbg_clear(&rng->u.ctr); }
+
+/*
+ * HASH_DRBG
+ */
+
+static status_t hash_init(xr_rng *rng) {
+  uint8_t seed[XR_RNG_SHA_SEED_LEN];
+  status_t ret = FAILURE;
+
+  if ((rng->u.hash = hash_drbg_new()) == NULL)
+    return FAILURE;
+
+  if (xr_rng_get_seed(rng, seed, sizeof(seed)) == SUCCESS &&
+      hash_drbg_init(rng->u.hash, seed, XR_RNG_SHA_ENTROPY_LEN,
+                     seed + XR_RNG_SHA_ENTROPY_LEN, XR_RNG_SHA_NONCE_LEN, NULL,
+                     0) == ERR_HASH_DRBG_SUCCESS) {
+    hash_drbg_set_entropy_cb(rng->u.hash, rng->entropy_cb, rng->entropy_ctx);
+    ret = SUCCESS;
+  } else {
+    hash_drbg_clear(rng->u.hash);
+    rng->u.hash = NULL;
+  }
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+  return ret;
+}
+
+static status_t hash_generate(xr_rng *rng, uint8_t *out, size_t len,
+                              const uint8_t *addn, size_t addn_len) {
+  size_t n;
+
+  if (addn_len) {
+    n = min(len, (size_t)HASH_DRBG_MAX_OUT_LEN);
+    if (hash_drbg_generate(rng->u.hash, out, n, addn, addn_len) !=
+        ERR_HASH_DRBG_SUCCESS)
+      return FAILURE;
+    out += n;
+    len -= n;
+  }
+
+  return xr_rng_hash_generate(rng, out, len);
+}
+
+static status_t hash_reseed(xr_rng *rng) {
+  uint8_t seed[XR_RNG_SHA_ENTROPY_LEN];
+  status_t ret = FAILURE;
+
+  if (xr_rng_get_seed(rng, seed, sizeof(seed)) == SUCCESS &&
+      hash_drbg_reseed(rng->u.hash, seed, sizeof(seed), NULL, 0) ==
+          ERR_HASH_DRBG_SUCCESS)
+    ret = SUCCESS;
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+  return ret;
+}
+
+static void hash_clear(xr_rng *rng) {
+  if (rng->u.hash != NULL)
+    hash_drbg_clear(rng->u.hash);
+  rng->u.hash = NULL;
+}
+
+/*
+ * HMAC_DRBG
+ */
+
+static status_t hmac_init(xr_rng *rng) {
+  uint8_t seed[XR_RNG_SHA_SEED_LEN];
+  status_t ret = FAILURE;
+
+  if ((rng->u.hmac = hmac_drbg_new()) == NULL)
+    return FAILURE;
+
+  if (xr_rng_get_seed(rng, seed, sizeof(seed)) == SUCCESS &&
+      hmac_drbg_init(rng->u.hmac, seed, XR_RNG_SHA_ENTROPY_LEN,
+                     seed + XR_RNG_SHA_ENTROPY_LEN, XR_RNG_SHA_NONCE_LEN, NULL,
+                     0) == ERR_HMAC_DRBG_SUCCESS) {
+    hmac_drbg_set_entropy_cb(rng->u.hmac, rng->entropy_cb, rng->entropy_ctx);
+    ret = SUCCESS;
+  } else {
+    hmac_drbg_clear(rng->u.hmac);
+    rng->u.hmac = NULL;
+  }
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+  return ret;
+}
+
+static status_t hmac_generate(xr_rng *rng, uint8_t *out, size_t len,
+                              const uint8_t *addn, size_t addn_len) {
+  size_t n;
+
+  if (addn_len) {
+    n = min(len, (size_t)HMAC_DRBG_MAX_OUTPUT_LEN);
+    if (hmac_drbg_generate(rng->u.hmac, out, n, addn, addn_len) !=
+        ERR_HMAC_DRBG_SUCCESS)
+      return FAILURE;
+    out += n;
+    len -= n;
+  }
+
+  return xr_rng_hmac_generate(rng, out, len);
+}
+
+static status_t hmac_reseed(xr_rng *rng) {
+  uint8_t seed[XR_RNG_SHA_ENTROPY_LEN];
+  status_t ret = FAILURE;
+
+  if (xr_rng_get_seed(rng, seed, sizeof(seed)) == SUCCESS &&
+      hmac_drbg_reseed(rng->u.hmac, seed, sizeof(seed), NULL, 0) ==
+          ERR_HMAC_DRBG_SUCCESS)
+    ret = SUCCESS;
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+  return ret;
+}
+
+static void hmac_clear(xr_rng *rng) {
+  if (rng->u.hmac != NULL)
+    hmac_drbg_clear(rng->u.hmac);
+  rng->u.hmac = NULL;
+}
+
+/*
+ * ChaCha20
+ */
+
+static status_t chacha_init(xr_rng *rng) {
+  uint8_t seed[CHACHA_DRBG_ENTROPY_LEN];
+  status_t ret;
+
+  if ((ret = xr_rng_get_seed(rng, seed, sizeof(seed))) == SUCCESS &&
+      (ret = chacha_drbg_init(&rng->u.chacha, seed, NULL, 0)) == SUCCESS)
+    chacha_drbg_set_entropy_cb(&rng->u.chacha, rng->entropy_cb,
+                               rng->entropy_ctx);
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+  return ret;
+}
+
+static status_t chacha_generate(xr_rng *rng, uint8_t *out, size_t len,
+                                const uint8_t *addn, size_t addn_len) {
+  /* The additional input goes into the key */
+  if (addn_len &&
+      chacha_drbg_update(&rng->u.chacha, addn, addn_len) != SUCCESS)
+    return FAILURE;
+
+  return xr_rng_chacha_generate(rng, out, len);
+}
+
+static status_t chacha_reseed(xr_rng *rng) {
+  uint8_t seed[CHACHA_DRBG_ENTROPY_LEN];
+  status_t ret;
+
+  if ((ret = xr_rng_get_seed(rng, seed, sizeof(seed))) == SUCCESS)
+    ret = chacha_drbg_reseed(&rng->u.chacha, seed, NULL, 0);
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+  return ret;
+}
+
+static void chacha_clear(xr_rng *rng) { chacha_drbg_clear(&rng->u.chacha); }
+
+/*
+ * Trivium; rekeyed with a fresh key and IV from the entropy source
+ * every XR_RNG_TRIVIUM_REKEY_BYTES bytes, like the TriviumRand*
+ * generator is
+ */
+
+static status_t trivium_rekey(xr_rng *rng) {
+  uint8_t seed[XR_RNG_TRIVIUM_SEED_LEN];
+  status_t ret;
+
+  if ((ret = xr_rng_get_seed(rng, seed, sizeof(seed))) == SUCCESS) {
+    trivium_init(&rng->u.trivium.state, seed, seed + TRIVIUM_KEY_SIZE);
+    rng->u.trivium.left = XR_RNG_TRIVIUM_REKEY_BYTES;
+  }
+
+  /* Prevent leaks */
+  zeroize(seed, sizeof(seed));
+  return ret;
+}
+
+status_t xr_rng_trivium_generate_rekey(xr_rng *rng, uint8_t *out, size_t len) {
+  size_t n;
+
+  while (len) {
+    if (rng->u.trivium.left == 0 && trivium_rekey(rng) != SUCCESS)
+      return FAILURE;
+    n = min(len, rng->u.trivium.left);
+    trivium_generate(&rng->u.trivium.state, out, n);
+    rng->u.trivium.left -= n;
+    out += n;
+    len -= n;
+  }
+
+  return SUCCESS;
+}
+
+static status_t trivium_generate_addn(xr_rng *rng, uint8_t *out, size_t len,
+                                      const uint8_t *addn, size_t addn_len) {
+  (void)addn;
+
+  if (addn_len) {
+    Warn("Additional input is not supported by the Trivium engine",
+         WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  return xr_rng_trivium_generate(rng, out, len);
+}
+
+static void trivium_clear_state(xr_rng *rng) {
+  trivium_clear(&rng->u.trivium.state);
+  rng->u.trivium.left = 0;
+}
+
+static const xr_rng_method xr_rng_methods[XR_RNG_ENGINES] = {
+    [XR_RNG_TRIVIUM] = {"Trivium", XR_RNG_TRIVIUM, 80, trivium_rekey,
+                        trivium_generate_addn, trivium_rekey,
+                        trivium_clear_state},
+    [XR_RNG_CTR_DRBG] = {"CTR_DRBG (AES-256)", XR_RNG_CTR_DRBG, 256, ctr_init,
+                         ctr_generate, ctr_reseed, ctr_clear},
+    [XR_RNG_HASH_DRBG] = {"HASH_DRBG (SHA-512)", XR_RNG_HASH_DRBG, 256,
+                          hash_init, hash_generate, hash_reseed, hash_clear},
+    [XR_RNG_HMAC_DRBG] = {"HMAC_DRBG (SHA-512)", XR_RNG_HMAC_DRBG, 256,
+                          hmac_init, hmac_generate, hmac_reseed, hmac_clear},
+    [XR_RNG_CHACHA20] = {"ChaCha20", XR_RNG_CHACHA20, 256, chacha_init,
+                         chacha_generate, chacha_reseed, chacha_clear},
+};
+
+/* The engine state goes on the NUMA node of the calling thread, so a
+   generator created by each worker stays local to it; it is locked to
+   physical memory if the lock limit allows, and is page-aligned (the
+   CTR_DRBG key schedule must be 16-byte aligned) */
+static xr_rng *xr_rng_alloc(void) {
+  return (xr_rng *)xr_secure_alloc(sizeof(xr_rng), XR_NUMA_NODE_LOCAL,
+                                   XR_SECURE_TRY_LOCK | XR_SECURE_GUARD);
+}
+
+static void xr_rng_dealloc(xr_rng *rng) { xr_secure_free(rng); }
+
+xr_rng *xr_rng_new_engine(xr_rng_engine_t engine, xr_entropy_cb_t entropy_cb,
+                          void *entropy_ctx) {
+  xr_rng *rng;
+
+  if ((unsigned int)engine >= XR_RNG_ENGINES) {
+    Warn("Invalid engine", WARN_INVALID_ARGS);
+    return NULL;
+  }
+
+  if (entropy_cb == NULL && !DidRngStart()) {
+    Log(ERR_RAND_INIT, false, -1, __LINE__);
+    return NULL;
+  }
+
+  if ((rng = xr_rng_alloc()) == NULL) {
+    Log(ERR_NO_MEMORY, false, ENOMEM, __LINE__);
+    return NULL;
+  }
+
+  memset(rng, 0, sizeof(xr_rng));
+  rng->meth = &xr_rng_methods[engine];
+  rng->entropy_cb = entropy_cb ? entropy_cb : xr_rng_entropy_rng;
+  rng->entropy_ctx = entropy_cb ? entropy_ctx : NULL;
+
+  if (rng->meth->init(rng) != SUCCESS) {
+    rng->meth->clear(rng);
+    xr_rng_dealloc(rng);
+    return NULL;
+  }
+
+  return rng;
+}
+
+xr_rng *xr_rng_new(unsigned int strength, xr_entropy_cb_t entropy_cb,
+                   void *entropy_ctx) {
+  /* The engines are listed in order of preference */
+  for (int i = 0; i < XR_RNG_ENGINES; i++) {
+    if (xr_rng_methods[i].strength >= strength) {
+      /* The portable constant-time AES is several times slower
+         than ChaCha20 */
+      if (i == XR_RNG_CTR_DRBG && !aes256_has_hw())
+        i = XR_RNG_CHACHA20;
+      return xr_rng_new_engine((xr_rng_engine_t)i, entropy_cb, entropy_ctx);
+    }
+  }
+
+  Warn("No engine has the requested security strength", WARN_INVALID_ARGS);
+  return NULL;
+}
+
+void xr_rng_free(xr_rng *rng) {
+  if (rng == NULL)
+    return;
+
+  rng->meth->clear(rng);
+  xr_rng_dealloc(rng);
+}
+
+status_t xr_rng_reseed(xr_rng *rng) {
+  if (rng == NULL) {
+    Warn("Invalid rng pointer (expected a non-NULL value)", WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  return rng->meth->reseed(rng);
+}
+
+status_t xr_rng_generate_ex(xr_rng *rng, uint8_t *out, size_t len,
+                            const uint8_t *additional_input,
+                            size_t additional_input_len) {
+  if (rng == NULL || (out == NULL && len) ||
+      (additional_input == NULL && additional_input_len)) {
+    Warn("Invalid arguments (expected non-NULL values)", WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  return rng->meth->generate(rng, out, len, additional_input,
+                             additional_input_len);
+}
+
+status_t xr_rng_generate_iov(xr_rng *rng, const xr_iovec *iov, int cnt) {
+  uint8_t stack_buf[XR_RNG_IOV_STACK_LEN], *buf = stack_buf, *p;
+  size_t len = 0;
+  status_t ret;
+  int i;
+
+  if (rng == NULL || (iov == NULL && cnt) || cnt < 0) {
+    Warn("Invalid arguments (expected non-NULL values)", WARN_INVALID_ARGS);
+    return FAILURE;
+  }
+
+  for (i = 0; i < cnt; i++) {
+    if ((iov[i].iov_base == NULL && iov[i].iov_len) ||
+        iov[i].iov_len > SIZE_MAX - len) {
+      Warn("Invalid iovec", WARN_INVALID_ARGS);
+      return FAILURE;
+    }
+    len += iov[i].iov_len;
+  }
+
+  if (len > sizeof(stack_buf) && (buf = (uint8_t *)malloc(len)) == NULL) {
+    Log(ERR_NO_MEMORY, false, ENOMEM, __LINE__);
+    return FAILURE;
+  }
+
+  if ((ret = rng->meth->generate(rng, buf, len, NULL, 0)) == SUCCESS) {
+    for (i = 0, p = buf; i < cnt; p += iov[i++].iov_len)
+      memcpy(iov[i].iov_base, p, iov[i].iov_len);
+  }
+
+  /* Prevent leaks */
+  zeroize(buf, len);
+  if (buf != stack_buf)
+    free(buf);
+  return ret;
+}
+
+int xr_rng_f_rng(void *ctx, uint8_t *out, size_t len,
+                 const uint8_t *additional_input,
+                 size_t additional_input_len) {
+  return xr_rng_generate_ex((xr_rng *)ctx, out, len, additional_input,
+                            additional_input_len) == SUCCESS
+             ? 0
+             : 1;
+}
+
+static void *xr_rng_bn_new(void *arg) {
+  (void)arg;
+  return xr_rng_new(XR_RNG_STRENGTH_256, NULL, NULL);
+}
+
+static void xr_rng_bn_free(void *rng_ctx) { xr_rng_free((xr_rng *)rng_ctx); }
+
+const bn_rng_factory xr_rng_bn_factory = {xr_rng_f_rng, xr_rng_bn_new,
+                                          xr_rng_bn_free, NULL};
+
+#if defined(XR_TESTS_XR_RNG)
+
+#include <stdio.h>
+
+#define XR_RNG_TEST_LEN 3000
+
+/* A deterministic entropy source; ctx points to a byte counter */
+static int xr_rng_test_entropy(void *ctx, uint8_t *buf, size_t len) {
+  uint8_t *c = (uint8_t *)ctx;
+
+  for (size_t i = 0; i < len; i++)
+    buf[i] = (*c)++;
+  return 0;
+}
+
+/* Same seed, same engine: the vtable and the static dispatch must give
+   the same stream (the DRBGs update their state after every request,
+   so both make the same requests) */
+static int xr_rng_test_engine(xr_rng_engine_t engine) {
+  static uint8_t a[XR_RNG_TEST_LEN], b[XR_RNG_TEST_LEN];
+  uint8_t ca = 0, cb = 0;
+  xr_rng *ra, *rb;
+  int ret = 1;
+
+  ra = xr_rng_new_engine(engine, xr_rng_test_entropy, &ca);
+  rb = xr_rng_new_engine(engine, xr_rng_test_entropy, &cb);
+  if (ra == NULL || rb == NULL)
+    goto cleanup;
+
+  if (xr_rng_engine(ra) != engine ||
+      xr_rng_generate(ra, a, 1000) != SUCCESS ||
+      xr_rng_generate(ra, a + 1000, 1) != SUCCESS ||
+      xr_rng_generate(ra, a + 1001, XR_RNG_TEST_LEN - 1001) != SUCCESS ||
+      xr_rng_generate_as(rb, engine, b, 1000) != SUCCESS ||
+      xr_rng_generate_as(rb, engine, b + 1000, 1) != SUCCESS ||
+      xr_rng_generate_as(rb, engine, b + 1001, XR_RNG_TEST_LEN - 1001) !=
+          SUCCESS ||
+      memcmp(a, b, XR_RNG_TEST_LEN))
+    goto cleanup;
+
+  /* Reseeding must change the stream */
+  if (xr_rng_reseed(rb) != SUCCESS ||
+      xr_rng_generate(ra, a, 64) != SUCCESS ||
+      xr_rng_generate(rb, b, 64) != SUCCESS || !memcmp(a, b, 64))
+    goto cleanup;
+
+  ret = 0;
+
+cleanup:
+  xr_rng_free(ra);
+  xr_rng_free(rb);
+  return ret;
+}
+
+/* The CTR_DRBG engine must give the stream of a CTR_DRBG seeded with
+   the same entropy */
+static int xr_rng_test_ctr(void) {
+  static uint8_t a[XR_RNG_TEST_LEN], b[XR_RNG_TEST_LEN];
+  uint8_t seed[CTR_DRBG_ENTROPY_LEN];
+  uint8_t c = 0, c0 = 0;
+  CTR_DRBG_STATE drbg;
+  xr_rng *rng;
+  int ret = 1;
+
+  if ((rng = xr_rng_new_engine(XR_RNG_CTR_DRBG, xr_rng_test_entropy, &c)) ==
+      NULL)
+    return 1;
+
+  xr_rng_test_entropy(&c0, seed, sizeof(seed));
+  if (ctr_drbg_init(&drbg, seed, NULL, 0) == SUCCESS &&
+      ctr_drbg_generate_bulk(&drbg, a, XR_RNG_TEST_LEN) == SUCCESS &&
+      xr_rng_f_rng(rng, b, XR_RNG_TEST_LEN, NULL, 0) == 0 &&
+      !memcmp(a, b, XR_RNG_TEST_LEN))
+    ret = 0;
+
+  ctr_drbg_clear(&drbg);
+  xr_rng_free(rng);
+  return ret;
+}
+
+/* The Trivium engine must rekey across XR_RNG_TRIVIUM_REKEY_BYTES */
+static int xr_rng_test_trivium_rekey(void) {
+  static uint8_t buf[XR_RNG_TRIVIUM_REKEY_BYTES + 64];
+  uint8_t c = 0;
+  xr_rng *rng;
+  int ret = 1;
+
+  if ((rng = xr_rng_new_engine(XR_RNG_TRIVIUM, xr_rng_test_entropy, &c)) ==
+      NULL)
+    return 1;
+
+  /* One seed at startup, one at the rekey */
+  if (xr_rng_generate(rng, buf, sizeof(buf)) == SUCCESS &&
+      c == 2 * XR_RNG_TRIVIUM_SEED_LEN &&
+      rng->u.trivium.left == XR_RNG_TRIVIUM_REKEY_BYTES - 64)
+    ret = 0;
+
+  xr_rng_free(rng);
+  return ret;
+}
+
+static int xr_rng_test_presets(void) {
+  static const struct {
+    unsigned int strength;
+    xr_rng_engine_t engine;
+  } tests[] = {{0, XR_RNG_TRIVIUM},
+               {XR_RNG_STRENGTH_SIMULATION, XR_RNG_TRIVIUM},
+               {XR_RNG_STRENGTH_128, XR_RNG_CTR_DRBG},
+               {XR_RNG_STRENGTH_256, XR_RNG_CTR_DRBG}};
+  uint8_t c = 0, addn[4] = {1, 2, 3, 4}, buf[16];
+  xr_rng_engine_t engine;
+  xr_rng *rng;
+
+  for (size_t i = 0; i < count(tests); i++) {
+    if ((rng = xr_rng_new(tests[i].strength, xr_rng_test_entropy, &c)) ==
+        NULL)
+      return 1;
+    engine = tests[i].engine;
+    if (engine == XR_RNG_CTR_DRBG && !aes256_has_hw())
+      engine = XR_RNG_CHACHA20;
+    if (xr_rng_engine(rng) != engine ||
+        xr_rng_strength(rng) < tests[i].strength) {
+      xr_rng_free(rng);
+      return 1;
+    }
+    xr_rng_free(rng);
+  }
+
+  if (xr_rng_new(XR_RNG_STRENGTH_256 + 1, xr_rng_test_entropy, &c) != NULL)
+    return 1;
+
+  /* Additional input is only taken by the DRBGs */
+  for (int e = 0; e < XR_RNG_ENGINES; e++) {
+    if ((rng = xr_rng_new_engine((xr_rng_engine_t)e, xr_rng_test_entropy,
+                                 &c)) == NULL)
+      return 1;
+    if ((xr_rng_generate_ex(rng, buf, sizeof(buf), addn, sizeof(addn)) ==
+         SUCCESS) != (e != XR_RNG_TRIVIUM)) {
+      xr_rng_free(rng);
+      return 1;
+    }
+    xr_rng_free(rng);
+  }
+
+  return 0;
+}
+
+/* A batch must get the same bytes as one contiguous request from the
+   same seed, on the stack and on the heap */
+static int xr_rng_test_iov(void) {
+  static uint8_t a[2 * XR_RNG_IOV_STACK_LEN], b[2 * XR_RNG_IOV_STACK_LEN];
+  static const size_t lens[] = {12, 0, 16, 1, 4067, 4096};
+  xr_iovec iov[count(lens)];
+  uint8_t ca = 0, cb = 0;
+  xr_rng *ra, *rb;
+  size_t len, off;
+  int ret = 1;
+
+  ra = xr_rng_new_engine(XR_RNG_CTR_DRBG, xr_rng_test_entropy, &ca);
+  rb = xr_rng_new_engine(XR_RNG_CTR_DRBG, xr_rng_test_entropy, &cb);
+  if (ra == NULL || rb == NULL)
+    goto cleanup;
+
+  /* The first five just fit on the stack, all six do not */
+  for (int n = 5; n <= 6; n++) {
+    off = 0;
+    for (int i = 0; i < n; off += lens[i++]) {
+      iov[i].iov_base = a + off;
+      iov[i].iov_len = lens[i];
+    }
+    len = off;
+    memset(a, 0, sizeof(a));
+    if (xr_rng_generate_iov(ra, iov, n) != SUCCESS ||
+        xr_rng_generate(rb, b, len) != SUCCESS || memcmp(a, b, len))
+      goto cleanup;
+  }
+
+  if (xr_rng_generate_iov(ra, NULL, 0) != SUCCESS)
+    goto cleanup;
+
+  iov[0].iov_base = NULL;
+  iov[0].iov_len = 1;
+  if (xr_rng_generate_iov(ra, iov, 1) != FAILURE)
+    goto cleanup;
+
+  ret = 0;
+
+cleanup:
+  xr_rng_free(ra);
+  xr_rng_free(rb);
+  return ret;
+}
+
+int xr_rng_run_test(void) {
+  int ret, fails = 0;
+
+  printf("Running tests for rand/xr_rng.c\n");
+
+  for (int e = 0; e < XR_RNG_ENGINES; e++) {
+    ret = xr_rng_test_engine((xr_rng_engine_t)e);
+    printf("  %-20s dispatch: %s\n", xr_rng_methods[e].name,
+           ret ? "FAILED" : "OK");
+    fails += ret;
+  }
+
+  ret = xr_rng_test_ctr();
+  printf("  CTR_DRBG stream: %s\n", ret ? "FAILED" : "OK");
+  fails += ret;
+
+  ret = xr_rng_test_trivium_rekey();
+  printf("  Trivium rekey: %s\n", ret ? "FAILED" : "OK");
+  fails += ret;
+
+  ret = xr_rng_test_iov();
+  printf("  Scatter generate: %s\n", ret ? "FAILED" : "OK");
+  fails += ret;
+
+  ret = xr_rng_test_presets();
+  printf("  Presets: %s\n", ret ? "FAILED" : "OK");
+  fails += ret;
+
+  return fails;
+}
+
+#endif /* XR_TESTS_XR_RNG */
@@ -0,0 +1,290 @@
+/**
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XR_RNG_H
+#define XR_RNG_H
+
+#include "common/bignum.h"
+#include "common/defs.h"
+#include "chacha_drbg.h"
+#include "ctr_drbg.h"
+#include "hash_drbg.h"
+#include "hmac_drbg.h"
+#include "trivium.h"
+
+/**
+ * A single generator object in front of the CTR_DRBG, HASH_DRBG,
+ * HMAC_DRBG, ChaCha20 and Trivium engines, so that callers can pick
+ * an engine by the security strength they need instead of by name.
+ *
+ * Every engine is seeded from an entropy source (the RNG by default)
+ * and reseeds itself from the same source when its reseed limit is
+ * reached. All functions return SUCCESS or FAILURE, whatever the
+ * error scheme of the underlying engine.
+ */
+
+/* The generator engines, in the order xr_rng_new() prefers them:
+   Trivium is the cheapest for requests of up to a few hundred bytes,
+   the CTR_DRBG the cheapest of the DRBGs (with AES hardware); the
+   ChaCha20 engine takes the place of the CTR_DRBG without it */
+typedef enum {
+  XR_RNG_TRIVIUM = 0, /* Trivium keystream (80-bit strength) */
+  XR_RNG_CTR_DRBG,    /* CTR_DRBG with AES-256 */
+  XR_RNG_HASH_DRBG,   /* HASH_DRBG with SHA-512 */
+  XR_RNG_HMAC_DRBG,   /* HMAC_DRBG with HMAC-SHA512 */
+  XR_RNG_CHACHA20,    /* ChaCha20 with fast key erasure */
+  XR_RNG_ENGINES
+} xr_rng_engine_t;
+
+/* Preset security strengths (in bits) for xr_rng_new() */
+#define XR_RNG_STRENGTH_SIMULATION 80 /* Sampling and simulations only */
+#define XR_RNG_STRENGTH_128 128
+#define XR_RNG_STRENGTH_256 256 /* Highest strength of all the engines */
+
+/* Bytes of Trivium keystream generated before rekeying */
+#define XR_RNG_TRIVIUM_REKEY_BYTES (TRIVIUM_RESEED_PERIOD / 8)
+
+typedef struct xr_rng xr_rng;
+
+/**
+ * The engine methods; generate() fills a buffer of any size and
+ * takes care of reseeding, reseed() pulls fresh seed material from
+ * the entropy source.
+ */
+typedef struct xr_rng_method {
+  const char *name;
+  xr_rng_engine_t engine;
+  unsigned int strength;
+  status_t (*init)(xr_rng *rng);
+  status_t (*generate)(xr_rng *rng, uint8_t *out, size_t len,
+                       const uint8_t *additional_input,
+                       size_t additional_input_len);
+  status_t (*reseed)(xr_rng *rng);
+  void (*clear)(xr_rng *rng);
+} xr_rng_method;
+
+/**
+ * The generator object; the engine state is kept inline, except
+ * for the HASH_DRBG and HMAC_DRBG states which hold OpenSSL
+ * contexts and are allocated by their own constructors.
+ */
+struct xr_rng {
+  const xr_rng_method *meth;
+  xr_entropy_cb_t entropy_cb;
+  void *entropy_ctx;
+  union {
+    CTR_DRBG_STATE ctr;
+    HASH_DRBG_STATE *hash;
+    HMAC_DRBG_STATE *hmac;
+    CHACHA_DRBG_STATE chacha;
+    struct {
+      TRIVIUM_STATE state;
+      size_t left; /* Bytes left before the next rekey */
+    } trivium;
+  } u;
+};
+
+/** @brief  Create a generator with the fastest engine of at least
+ *          the requested security strength.
+ *
+ *  @param strength                     The security strength in bits,
+ *                                      at most XR_RNG_STRENGTH_256.
+ *  @param entropy_cb                   The entropy source; the RNG
+ *                                      (RngFetchBytes) if Null, in which
+ *                                      case the RNG must be started.
+ *  @param entropy_ctx                  The context passed to @p entropy_cb.
+ *
+ *  @return  A pointer to the generator, or Null if no engine has the
+ *           requested strength or the engine could not be seeded.
+ */
+xr_rng *xr_rng_new(unsigned int strength, xr_entropy_cb_t entropy_cb,
+                   void *entropy_ctx);
+
+/** @brief  Create a generator with the given engine.
+ *
+ *  @param engine                       The engine.
+ *  @param entropy_cb                   The entropy source (the RNG
+ *                                      if Null).
+ *  @param entropy_ctx                  The context passed to @p entropy_cb.
+ *
+ *  @return  A pointer to the generator, or Null on failure.
+ */
+xr_rng *xr_rng_new_engine(xr_rng_engine_t engine, xr_entropy_cb_t entropy_cb,
+                          void *entropy_ctx);
+
+/** @brief  Clear the engine state and free the generator.
+ *
+ *  @param rng                          The generator (can be Null).
+ *
+ *  @return  Void.
+ */
+void xr_rng_free(xr_rng *rng);
+
+/** @brief  Reseed the generator from its entropy source.
+ *
+ *  @param rng                          The generator.
+ *
+ *  @return  FAILURE if the entropy source fails.
+ *  @return  SUCCESS otherwise.
+ */
+status_t xr_rng_reseed(xr_rng *rng);
+
+/** @brief  Generate pseudorandom bytes with additional input; the
+ *          DRBG engines mix @p additional_input into the first
+ *          request (SP 800-90Ar1), the Trivium engine has no such
+ *          input and fails if one is given.
+ *
+ *  @param rng                          The generator.
+ *  @param out                          The output buffer.
+ *  @param len                          The output length in bytes.
+ *  @param additional_input             Additional input (can be Null).
+ *  @param additional_input_len         The length of @p additional_input
+ *                                      in bytes.
+ *
+ *  @return  FAILURE if the engine or its entropy source fails.
+ *  @return  SUCCESS otherwise.
+ */
+status_t xr_rng_generate_ex(xr_rng *rng, uint8_t *out, size_t len,
+                            const uint8_t *additional_input,
+                            size_t additional_input_len);
+
+/* A destination buffer of xr_rng_generate_iov(), laid out as the
+   POSIX struct iovec */
+typedef struct xr_iovec {
+  void *iov_base;
+  size_t iov_len;
+} xr_iovec;
+
+/* Batches of up to this many bytes are generated on the stack */
+#define XR_RNG_IOV_STACK_LEN 4096
+
+/** @brief  Fill a batch of buffers, e.g. the nonces of a batch of
+ *          packets, from a single generate request: one contiguous
+ *          output of the total length is scattered into the buffers
+ *          in order, so the request overhead (locking, key schedule,
+ *          backtracking update) is paid once per batch.
+ *
+ *  @param rng                          The generator.
+ *  @param iov                          The buffers.
+ *  @param cnt                          The number of buffers.
+ *
+ *  @return  FAILURE if the arguments are invalid, the scratch buffer
+ *           for a batch over XR_RNG_IOV_STACK_LEN bytes cannot be
+ *           allocated or the engine fails.
+ *  @return  SUCCESS otherwise.
+ */
+status_t xr_rng_generate_iov(xr_rng *rng, const xr_iovec *iov, int cnt);
+
+/** @brief  An @p f_rng_t (see bignum.h) drawing from a generator
+ *          passed as @p ctx, e.g. for bn_generate_proabable_prime().
+ *
+ *  @return  0 on success, nonzero otherwise.
+ */
+int xr_rng_f_rng(void *ctx, uint8_t *out, size_t len,
+                 const uint8_t *additional_input, size_t additional_input_len);
+
+/* Hands out a new XR_RNG_STRENGTH_256 generator seeded from the RNG
+   to each worker of bn_generate_prime_parallel(); the RNG must be
+   started */
+extern const bn_rng_factory xr_rng_bn_factory;
+
+/* Slow path of xr_rng_trivium_generate(); rekeys as needed */
+status_t xr_rng_trivium_generate_rekey(xr_rng *rng, uint8_t *out, size_t len);
+
+/* The engine description and security strength of a generator */
+static inline const char *xr_rng_name(const xr_rng *rng) {
+  return rng->meth->name;
+}
+
+static inline unsigned int xr_rng_strength(const xr_rng *rng) {
+  return rng->meth->strength;
+}
+
+static inline xr_rng_engine_t xr_rng_engine(const xr_rng *rng) {
+  return rng->meth->engine;
+}
+
+/* Fill a buffer of any size through the engine methods */
+static inline status_t xr_rng_generate(xr_rng *rng, uint8_t *out,
+                                       size_t len) {
+  return rng->meth->generate(rng, out, len, NULL, 0);
+}
+
+/*
+ * Static dispatch for hot loops; each call goes straight to the
+ * engine, which must be the one the generator was created with.
+ */
+
+static inline status_t xr_rng_ctr_generate(xr_rng *rng, uint8_t *out,
+                                           size_t len) {
+  return ctr_drbg_generate_bulk(&rng->u.ctr, out, len);
+}
+
+static inline status_t xr_rng_hash_generate(xr_rng *rng, uint8_t *out,
+                                            size_t len) {
+  return hash_drbg_generate_bulk(rng->u.hash, out, len) ==
+                 ERR_HASH_DRBG_SUCCESS
+             ? SUCCESS
+             : FAILURE;
+}
+
+static inline status_t xr_rng_hmac_generate(xr_rng *rng, uint8_t *out,
+                                            size_t len) {
+  return hmac_drbg_generate_bulk(rng->u.hmac, out, len) ==
+                 ERR_HMAC_DRBG_SUCCESS
+             ? SUCCESS
+             : FAILURE;
+}
+
+static inline status_t xr_rng_chacha_generate(xr_rng *rng, uint8_t *out,
+                                              size_t len) {
+  return chacha_drbg_fetch(&rng->u.chacha, out, len);
+}
+
+static inline status_t xr_rng_trivium_generate(xr_rng *rng, uint8_t *out,
+                                               size_t len) {
+  if (len > rng->u.trivium.left)
+    return xr_rng_trivium_generate_rekey(rng, out, len);
+
+  trivium_generate(&rng->u.trivium.state, out, len);
+  rng->u.trivium.left -= len;
+  return SUCCESS;
+}
+
+/**
+ * Fill a buffer through the engine given as a compile-time constant;
+ * the switch folds away, leaving a direct (inlinable) engine call.
+ */
+static inline status_t xr_rng_generate_as(xr_rng *rng, xr_rng_engine_t engine,
+                                          uint8_t *out, size_t len) {
+  switch (engine) {
+  case XR_RNG_TRIVIUM:
+    return xr_rng_trivium_generate(rng, out, len);
+  case XR_RNG_CTR_DRBG:
+    return xr_rng_ctr_generate(rng, out, len);
+  case XR_RNG_HASH_DRBG:
+    return xr_rng_hash_generate(rng, out, len);
+  case XR_RNG_HMAC_DRBG:
+    return xr_rng_hmac_generate(rng, out, len);
+  case XR_RNG_CHACHA20:
+    return xr_rng_chacha_generate(rng, out, len);
+  default:
+    return FAILURE;
+  }
+}
+
+#endif /* XR_RNG_H */
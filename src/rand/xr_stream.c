@@ -0,0 +1,509 @@
+/**
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if !defined(_WIN32)
+#define _GNU_SOURCE /* O_DIRECT */
+#endif
+
+#include "xr_stream.h"
+#include "common/exceptions.h"
+#include "common/secure_alloc.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#include <process.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define XR_STREAM_RING_SIZE (XR_STREAM_BUFFERS * (size_t)XR_STREAM_CHUNK_SIZE)
+
+/* Writes len bytes to the sink */
+typedef status_t (*xr_stream_write_fn)(void *sink, const uint8_t *buf,
+                                       size_t len);
+
+/**
+ * The ring shared by the generator thread and the writer; filled
+ * counts the buffers generated and not yet written, the generator
+ * fills them in ring order and the writer drains them in the same
+ * order. Everything below the lock is protected by it.
+ */
+typedef struct xr_stream {
+  xr_rng *rng;
+  uint8_t *ring;
+  size_t len[XR_STREAM_BUFFERS];
+#if defined(_WIN32)
+  CRITICAL_SECTION lock;
+  CONDITION_VARIABLE cond;
+#else
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+#endif
+  uint64_t left;       /* Bytes still to be generated */
+  unsigned int filled; /* Buffers ready to be written */
+  int stop;            /* Set by the writer to stop the generator */
+  int done;            /* Set by the generator when it returns */
+  status_t status;     /* Of the generator */
+} xr_stream;
+
+#if defined(_WIN32)
+#define XR_STREAM_LOCK(s) EnterCriticalSection(&(s)->lock)
+#define XR_STREAM_UNLOCK(s) LeaveCriticalSection(&(s)->lock)
+#define XR_STREAM_WAIT(s) SleepConditionVariableCS(&(s)->cond, &(s)->lock, INFINITE)
+#define XR_STREAM_SIGNAL(s) WakeAllConditionVariable(&(s)->cond)
+#else
+#define XR_STREAM_LOCK(s) pthread_mutex_lock(&(s)->lock)
+#define XR_STREAM_UNLOCK(s) pthread_mutex_unlock(&(s)->lock)
+#define XR_STREAM_WAIT(s) pthread_cond_wait(&(s)->cond, &(s)->lock)
+#define XR_STREAM_SIGNAL(s) pthread_cond_broadcast(&(s)->cond)
+#endif
+
+static inline uint8_t *xr_stream_buf(xr_stream *s, unsigned int i) {
+  return s->ring + (size_t)i * XR_STREAM_CHUNK_SIZE;
+}
+
+/* Monotonic time in seconds */
+static double xr_stream_now(void) {
+#if defined(_WIN32)
+  LARGE_INTEGER t, f;
+
+  QueryPerformanceCounter(&t);
+  QueryPerformanceFrequency(&f);
+  return (double)t.QuadPart / (double)f.QuadPart;
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* The generator thread; fills the ring in order until all the output
+   is generated, the writer stops it or the generator fails */
+static void xr_stream_generate(xr_stream *s) {
+  unsigned int i = 0;
+  size_t len;
+
+  for (;;) {
+    XR_STREAM_LOCK(s);
+    while (s->filled == XR_STREAM_BUFFERS && !s->stop)
+      XR_STREAM_WAIT(s);
+    if (s->stop || s->left == 0)
+      break;
+    len = (size_t)min(s->left, (uint64_t)XR_STREAM_CHUNK_SIZE);
+    s->left -= len;
+    XR_STREAM_UNLOCK(s);
+
+    /* The buffer is ours until filled is incremented */
+    if (xr_rng_generate(s->rng, xr_stream_buf(s, i), len) != SUCCESS) {
+      XR_STREAM_LOCK(s);
+      s->status = FAILURE;
+      break;
+    }
+
+    XR_STREAM_LOCK(s);
+    s->len[i] = len;
+    s->filled++;
+    XR_STREAM_SIGNAL(s);
+    XR_STREAM_UNLOCK(s);
+
+    i = (i + 1) % XR_STREAM_BUFFERS;
+  }
+
+  s->done = 1;
+  XR_STREAM_SIGNAL(s);
+  XR_STREAM_UNLOCK(s);
+}
+
+#if defined(_WIN32)
+static unsigned __stdcall xr_stream_thread(void *arg) {
+  xr_stream_generate((xr_stream *)arg);
+  return 0;
+}
+#else
+static void *xr_stream_thread(void *arg) {
+  xr_stream_generate((xr_stream *)arg);
+  return NULL;
+}
+#endif
+
+/* Run the pipeline: generate on a new thread and drain the ring to
+   the sink from this one */
+static status_t xr_stream_run(void *sink, xr_stream_write_fn write_fn,
+                              uint64_t total_len, xr_rng *rng,
+                              xr_stream_progress_cb cb, void *cb_ctx) {
+  xr_stream s = {0};
+  xr_stream_progress progress = {0};
+#if defined(_WIN32)
+  HANDLE th;
+#else
+  pthread_t th;
+#endif
+  status_t ret = SUCCESS;
+  unsigned int i = 0;
+  double start;
+
+  if (rng == NULL || write_fn == NULL)
+    return FAILURE;
+
+  if (total_len == 0)
+    return SUCCESS;
+
+  /* Page-aligned for unbuffered I/O, and locked so that the generator
+     never waits on a page fault; the lock is only a hint and its
+     failure (e.g. RLIMIT_MEMLOCK) is not an error */
+  if ((s.ring = (uint8_t *)xr_secure_alloc(
+           XR_STREAM_RING_SIZE, XR_NUMA_NODE_LOCAL,
+           XR_SECURE_TRY_LOCK | XR_SECURE_LARGE_PAGES)) == NULL) {
+    Log(ERR_NO_MEMORY, false, -1, __LINE__);
+    return FAILURE;
+  }
+
+  s.rng = rng;
+  s.left = total_len;
+  s.status = SUCCESS;
+  progress.total = total_len;
+
+#if defined(_WIN32)
+  InitializeCriticalSection(&s.lock);
+  InitializeConditionVariable(&s.cond);
+  if ((th = (HANDLE)_beginthreadex(NULL, 0, xr_stream_thread, &s, 0, NULL)) ==
+      NULL) {
+    DeleteCriticalSection(&s.lock);
+    xr_secure_free(s.ring);
+    return FAILURE;
+  }
+#else
+  pthread_mutex_init(&s.lock, NULL);
+  pthread_cond_init(&s.cond, NULL);
+  if (pthread_create(&th, NULL, xr_stream_thread, &s)) {
+    pthread_cond_destroy(&s.cond);
+    pthread_mutex_destroy(&s.lock);
+    xr_secure_free(s.ring);
+    return FAILURE;
+  }
+#endif
+
+  start = xr_stream_now();
+
+  for (;;) {
+    XR_STREAM_LOCK(&s);
+    while (s.filled == 0 && !s.done)
+      XR_STREAM_WAIT(&s);
+    if (s.filled == 0 || s.status != SUCCESS) {
+      XR_STREAM_UNLOCK(&s);
+      break;
+    }
+    XR_STREAM_UNLOCK(&s);
+
+    ret = write_fn(sink, xr_stream_buf(&s, i), s.len[i]);
+
+    if (ret == SUCCESS) {
+      progress.written += s.len[i];
+      progress.seconds = xr_stream_now() - start;
+      progress.bytes_per_sec = progress.seconds > 0
+                                   ? (double)progress.written / progress.seconds
+                                   : 0;
+      if (cb != NULL && cb(cb_ctx, &progress))
+        ret = FAILURE;
+    }
+
+    XR_STREAM_LOCK(&s);
+    s.filled--;
+    if (ret != SUCCESS)
+      s.stop = 1;
+    XR_STREAM_SIGNAL(&s);
+    XR_STREAM_UNLOCK(&s);
+
+    if (ret != SUCCESS)
+      break;
+    i = (i + 1) % XR_STREAM_BUFFERS;
+  }
+
+#if defined(_WIN32)
+  WaitForSingleObject(th, INFINITE);
+  CloseHandle(th);
+  DeleteCriticalSection(&s.lock);
+#else
+  pthread_join(th, NULL);
+  pthread_cond_destroy(&s.cond);
+  pthread_mutex_destroy(&s.lock);
+#endif
+
+  xr_secure_free(s.ring);
+
+  if (ret == SUCCESS && (s.status != SUCCESS || progress.written != total_len))
+    ret = FAILURE;
+  return ret;
+}
+
+#if defined(_WIN32)
+
+static status_t xr_stream_write_handle(void *sink, const uint8_t *buf,
+                                       size_t len) {
+  HANDLE h = (HANDLE)sink;
+  DWORD n;
+
+  /* The chunks are well below 4 GiB */
+  while (len) {
+    if (!WriteFile(h, buf, (DWORD)len, &n, NULL) || n == 0) {
+      Log(ERR_CANNOT_ACCESS_DISK, false, GetLastError(), __LINE__);
+      return FAILURE;
+    }
+    buf += n;
+    len -= n;
+  }
+
+  return SUCCESS;
+}
+
+status_t xr_stream_to_handle(HANDLE h, uint64_t total_len, xr_rng *rng,
+                             xr_stream_progress_cb cb, void *cb_ctx) {
+  if (h == INVALID_HANDLE_VALUE)
+    return FAILURE;
+
+  return xr_stream_run((void *)h, xr_stream_write_handle, total_len, rng, cb,
+                       cb_ctx);
+}
+
+status_t xr_stream_to_fd(int fd, uint64_t total_len, xr_rng *rng,
+                         xr_stream_progress_cb cb, void *cb_ctx) {
+  return xr_stream_to_handle((HANDLE)_get_osfhandle(fd), total_len, rng, cb,
+                             cb_ctx);
+}
+
+status_t xr_stream_to_file(const char *path, uint64_t total_len, xr_rng *rng,
+                           xr_stream_progress_cb cb, void *cb_ctx) {
+  DWORD flags = FILE_ATTRIBUTE_NORMAL;
+  status_t ret;
+  HANDLE h;
+
+  /* Unbuffered writes must be whole sectors */
+  if (total_len % XR_STREAM_ALIGN == 0)
+    flags |= FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH;
+
+  if ((h = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                       NULL, OPEN_ALWAYS, flags, NULL)) ==
+      INVALID_HANDLE_VALUE) {
+    Log(ERR_CANNOT_ACCESS_DISK, false, GetLastError(), __LINE__);
+    return FAILURE;
+  }
+
+  ret = xr_stream_to_handle(h, total_len, rng, cb, cb_ctx);
+  if (ret == SUCCESS && !FlushFileBuffers(h))
+    ret = FAILURE;
+
+  CloseHandle(h);
+  return ret;
+}
+
+#else
+
+static status_t xr_stream_write_fd(void *sink, const uint8_t *buf,
+                                   size_t len) {
+  int fd = *(int *)sink;
+  status_t ret = SUCCESS;
+  ssize_t n;
+
+#if defined(O_DIRECT)
+  /* Only the last chunk can be unaligned; finish it through the page
+     cache, and give the descriptor back to the caller as it was */
+  bool restore = false;
+  int flags;
+  if (len % XR_STREAM_ALIGN && (flags = fcntl(fd, F_GETFL)) != -1 &&
+      (flags & O_DIRECT))
+    restore = fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+#endif
+
+  while (len) {
+    if ((n = write(fd, buf, len)) < 0) {
+      if (errno == EINTR)
+        continue;
+      Log(ERR_CANNOT_ACCESS_DISK, false, errno, __LINE__);
+      ret = FAILURE;
+      break;
+    }
+    if (n == 0) {
+      Log(ERR_CANNOT_ACCESS_DISK, false, ENOSPC, __LINE__);
+      ret = FAILURE;
+      break;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+
+#if defined(O_DIRECT)
+  if (restore)
+    fcntl(fd, F_SETFL, flags);
+#endif
+
+  return ret;
+}
+
+status_t xr_stream_to_fd(int fd, uint64_t total_len, xr_rng *rng,
+                         xr_stream_progress_cb cb, void *cb_ctx) {
+  if (fd < 0)
+    return FAILURE;
+
+  return xr_stream_run(&fd, xr_stream_write_fd, total_len, rng, cb, cb_ctx);
+}
+
+status_t xr_stream_to_file(const char *path, uint64_t total_len, xr_rng *rng,
+                           xr_stream_progress_cb cb, void *cb_ctx) {
+  status_t ret;
+  int fd = -1;
+
+#if defined(O_DIRECT)
+  /* Some file systems (e.g. tmpfs) refuse O_DIRECT */
+  if (total_len % XR_STREAM_ALIGN == 0)
+    fd = open(path, O_WRONLY | O_CREAT | O_DIRECT, 0600);
+#endif
+  if (fd < 0 && (fd = open(path, O_WRONLY | O_CREAT, 0600)) < 0) {
+    Log(ERR_CANNOT_ACCESS_DISK, false, errno, __LINE__);
+    return FAILURE;
+  }
+
+  ret = xr_stream_to_fd(fd, total_len, rng, cb, cb_ctx);
+  if (ret == SUCCESS && fsync(fd) != 0)
+    ret = FAILURE;
+
+  close(fd);
+  return ret;
+}
+
+#endif /* _WIN32 */
+
+#if defined(XR_TESTS_XR_STREAM)
+
+#include <stdio.h>
+#include <string.h>
+
+#define XR_STREAM_TEST_LEN (3 * XR_STREAM_CHUNK_SIZE + 12345)
+
+/* A deterministic entropy source; ctx points to a byte counter */
+static int xr_stream_test_entropy(void *ctx, uint8_t *buf, size_t len) {
+  uint8_t *c = (uint8_t *)ctx;
+
+  for (size_t i = 0; i < len; i++)
+    buf[i] = (*c)++;
+  return 0;
+}
+
+typedef struct {
+  uint64_t written; /* As last reported */
+  int calls;
+  int cancel_at; /* Cancel on this call, if nonzero */
+} xr_stream_test_ctx;
+
+static int xr_stream_test_progress(void *ctx, const xr_stream_progress *p) {
+  xr_stream_test_ctx *t = (xr_stream_test_ctx *)ctx;
+
+  t->written = p->written;
+  return ++t->calls == t->cancel_at;
+}
+
+/* The stream must match the same generator making the same chunked
+   requests, and must stop when cancelled */
+int xr_stream_run_test(void) {
+  static uint8_t got[XR_STREAM_TEST_LEN], want[XR_STREAM_TEST_LEN];
+  xr_stream_test_ctx t = {0};
+  uint8_t ca = 0, cb = 0;
+  xr_rng *ra = NULL, *rb = NULL;
+  FILE *fp = NULL;
+  size_t off, n;
+  int ret = 1;
+
+  printf("Running tests for rand/xr_stream.c\n");
+
+  ra = xr_rng_new_engine(XR_RNG_CTR_DRBG, xr_stream_test_entropy, &ca);
+  rb = xr_rng_new_engine(XR_RNG_CTR_DRBG, xr_stream_test_entropy, &cb);
+  if (ra == NULL || rb == NULL || (fp = tmpfile()) == NULL)
+    goto cleanup;
+
+  for (off = 0; off < XR_STREAM_TEST_LEN; off += n) {
+    n = min((size_t)XR_STREAM_TEST_LEN - off, (size_t)XR_STREAM_CHUNK_SIZE);
+    if (xr_rng_generate(rb, want + off, n) != SUCCESS)
+      goto cleanup;
+  }
+
+  if (xr_stream_to_fd(fileno(fp), XR_STREAM_TEST_LEN, ra,
+                      xr_stream_test_progress, &t) != SUCCESS ||
+      t.written != XR_STREAM_TEST_LEN || t.calls != 4) {
+    printf("Stream to file FAIL\n");
+    goto cleanup;
+  }
+
+  rewind(fp);
+  if (fread(got, 1, sizeof(got), fp) != sizeof(got) ||
+      fgetc(fp) != EOF || memcmp(got, want, sizeof(got))) {
+    printf("Stream output FAIL\n");
+    goto cleanup;
+  }
+  printf("Stream output PASS\n");
+
+  t.calls = 0;
+  t.cancel_at = 2;
+  if (xr_stream_to_fd(fileno(fp), XR_STREAM_TEST_LEN, ra,
+                      xr_stream_test_progress, &t) != FAILURE ||
+      t.written != 2 * XR_STREAM_CHUNK_SIZE) {
+    printf("Stream cancel FAIL\n");
+    goto cleanup;
+  }
+  printf("Stream cancel PASS\n");
+
+#if defined(O_DIRECT)
+  /* The unaligned tail must not leave the caller's descriptor changed;
+     some file systems (e.g. tmpfs) refuse O_DIRECT altogether */
+  {
+    static const char *path = "test/xr_stream.bin";
+    int fd, flags = -1;
+    off_t size = -1;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0600)) >=
+        0) {
+      if (xr_stream_to_fd(fd, XR_STREAM_TEST_LEN, ra, NULL, NULL) == SUCCESS) {
+        flags = fcntl(fd, F_GETFL);
+        size = lseek(fd, 0, SEEK_END);
+      }
+      close(fd);
+      remove(path);
+
+      if (flags == -1 || !(flags & O_DIRECT) || size != XR_STREAM_TEST_LEN) {
+        printf("Stream O_DIRECT FAIL\n");
+        goto cleanup;
+      }
+      printf("Stream O_DIRECT PASS\n");
+    }
+  }
+#endif
+
+  ret = 0;
+
+cleanup:
+  if (fp != NULL)
+    fclose(fp);
+  xr_rng_free(ra);
+  xr_rng_free(rb);
+  return ret;
+}
+
+#endif /* XR_TESTS_XR_STREAM */
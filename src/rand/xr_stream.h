@@ -0,0 +1,104 @@
+/** @file xr_stream.h
+ *  @brief Stream pseudorandom output from a generator to a file or
+ *         block device, e.g. to wipe disk sectors.
+ *
+ *  The output is generated into a ring of XR_STREAM_BUFFERS aligned,
+ *  page-locked buffers by a generator thread while the calling thread
+ *  drains the filled ones to the device, so that generation and I/O
+ *  overlap and a wipe runs at the speed of the disk.
+ *
+ * LICENSE
+ * =======
+ *
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XR_STREAM_H
+#define XR_STREAM_H
+
+#include "common/defs.h"
+#include "xr_rng.h"
+
+/* Size of each generate request and write */
+#define XR_STREAM_CHUNK_SIZE (1 << 20)
+
+/* Buffers in the ring; three let the generator run one buffer ahead
+   while a write is in flight */
+#define XR_STREAM_BUFFERS 3
+
+/* Alignment of the buffers, and of the offsets and lengths of
+   unbuffered (O_DIRECT / FILE_FLAG_NO_BUFFERING) writes */
+#define XR_STREAM_ALIGN 4096
+
+/* Progress of a stream, passed to the progress callback */
+typedef struct xr_stream_progress {
+  uint64_t written;     /* Bytes written so far */
+  uint64_t total;       /* Bytes to write */
+  double seconds;       /* Time since the stream started */
+  double bytes_per_sec; /* Average throughput */
+} xr_stream_progress;
+
+/**
+ * Called from the writing thread after each write; return nonzero
+ * to cancel the stream.
+ */
+typedef int (*xr_stream_progress_cb)(void *ctx,
+                                     const xr_stream_progress *progress);
+
+/** @brief  Write @p total_len bytes of output of a generator to a
+ *          file descriptor, from its current offset.
+ *
+ *  The generator is used from a second thread for the duration of the
+ *  call and must not be used by the caller meanwhile. A descriptor
+ *  opened with O_DIRECT must be at an aligned offset; it is switched
+ *  to buffered I/O for an unaligned tail.
+ *
+ *  @param fd                           The file descriptor.
+ *  @param total_len                    The number of bytes to write.
+ *  @param rng                          The generator.
+ *  @param cb                           The progress callback (can be Null).
+ *  @param cb_ctx                       The context passed to @p cb.
+ *
+ *  @return  FAILURE if the generator or a write fails, or if the
+ *           stream is cancelled by @p cb.
+ *  @return  SUCCESS otherwise.
+ */
+status_t xr_stream_to_fd(int fd, uint64_t total_len, xr_rng *rng,
+                         xr_stream_progress_cb cb, void *cb_ctx);
+
+/** @brief  Write @p total_len bytes of output of a generator to the
+ *          start of a file or block device, bypassing the page cache
+ *          when @p total_len is a multiple of XR_STREAM_ALIGN and the
+ *          file system allows it. The file is created if it does not
+ *          exist, but never truncated.
+ *
+ *  @return  FAILURE if the file cannot be opened, or as for
+ *           xr_stream_to_fd().
+ *  @return  SUCCESS otherwise.
+ */
+status_t xr_stream_to_file(const char *path, uint64_t total_len, xr_rng *rng,
+                           xr_stream_progress_cb cb, void *cb_ctx);
+
+#if defined(_WIN32)
+/** @brief  Write @p total_len bytes of output of a generator to a
+ *          file or device handle, from its current file pointer;
+ *          see xr_stream_to_fd().
+ */
+status_t xr_stream_to_handle(HANDLE h, uint64_t total_len, xr_rng *rng,
+                             xr_stream_progress_cb cb, void *cb_ctx);
+#endif
+
+#endif /* XR_STREAM_H */
@@ -0,0 +1,321 @@
+/** @file ziggurat.h
+ *  @brief Ziggurat tables for the normal and exponential samplers.
+ *
+ *  Marsaglia and Tsang's ziggurat with 128 layers for the normal and
+ *  256 layers for the exponential distribution. For f(x) = exp(-x^2/2)
+ *  (resp. exp(-x)), R the start of the tail and V the common area of
+ *  each layer, the tables hold
+ *
+ *  x[0] = V / f(R), x[1] = R, x[i + 1] = f^-1(V / x[i] + f(x[i])),
+ *  x[n] = 0 and f[i] = f(x[i]).
+ *
+ *  Computed in double precision from the recurrence above; these are
+ *  constants and must not be edited by hand.
+ *
+ *  Marsaglia, G., & Tsang, W. W. (2000). The Ziggurat Method for
+ *  Generating Random Variables. Journal of Statistical Software, 5(8),
+ *  1–7. https://doi.org/10.18637/jss.v005.i08
+ *
+ * LICENSE
+ * =======
+ *
+ * Copyright (C) 2024-25  Xrand
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZIGGURAT_H
+#define ZIGGURAT_H
+
+#define ZIG_NORM_LAYERS 128
+#define ZIG_NORM_R 3.442619855899 /* Start of the normal tail */
+
+#define ZIG_EXP_LAYERS 256
+#define ZIG_EXP_R 7.69711747013104972 /* Start of the exponential tail */
+
+/* Normal layer edges x[i] */
+static const double zig_x_norm[ZIG_NORM_LAYERS + 1] = {
+    3.7130862467425501, 3.4426198558990002, 3.2230849845811416,
+    3.0832288582168683, 2.9786962526477803, 2.8943440070215289,
+    2.8231253505489105, 2.7611693723871769, 2.7061135731218195,
+    2.6564064112613597, 2.6109722484318474, 2.5690336259249378,
+    2.5300096723888275, 2.4934545220953721, 2.4590181774118305,
+    2.4264206455337498, 2.3954342780110625, 2.3658713701176386,
+    2.3375752413392368, 2.310413683698763, 2.2842740596774718,
+    2.2590595738691985, 2.2346863955909795, 2.2110814088787034,
+    2.1881804320760492, 2.1659267937489219, 2.1442701823603953,
+    2.1231657086739766, 2.1025731351892385, 2.0824562379920168,
+    2.0627822745083084, 2.0435215366550676, 2.0246469733773855,
+    2.0061338699634721, 1.9879595741276199, 1.9701032608543265,
+    1.9525457295535567, 1.9352692282966228, 1.9182573008645099,
+    1.9014946531051511, 1.884967035707759, 1.8686611409944887,
+    1.8525645117280911, 1.836665460258446, 1.8209529965961255,
+    1.8054167642192285, 1.7900469825998586, 1.7748343955860695,
+    1.7597702248995934, 1.7448461281138004, 1.7300541605637305,
+    1.7153867407136676, 1.7008366185699169, 1.6863968467791681,
+    1.6720607540976009, 1.6578219209540241, 1.6436741568628686,
+    1.6296114794706347, 1.615628095043161, 1.6017183802213781,
+    1.5878768648905761, 1.5740982160230008, 1.5603772223661689,
+    1.5467087798599104, 1.5330878776740433, 1.5195095847659401,
+    1.5059690368632033, 1.492461423781354, 1.4789819769899242,
+    1.4655259573427108, 1.4520886428892246, 1.4386653166845635,
+    1.4252512545140601, 1.4118417124470577, 1.3984319141310053,
+    1.3850170377326518, 1.3715922024273426, 1.3581524543301435,
+    1.344692751753547, 1.3312079496656273, 1.3176927832094141,
+    1.3041418501286168, 1.2905495919261964, 1.2769102735601556,
+    1.2632179614546211, 1.2494664995730682, 1.2356494832633627,
+    1.2217602305399964, 1.2077917504159497, 1.1937367078331287,
+    1.1795873846639882, 1.1653356361647524, 1.1509728421488674,
+    1.1364898520131608, 1.1218769225825422, 1.107123647534036,
+    1.0922188769072774, 1.0771506248928957, 1.0619059636948243,
+    1.0464709007640454, 1.0308302360681956, 1.0149673952513305,
+    0.99886423349298359, 0.98250080351542901, 0.9658550794011499,
+    0.94890262551130644, 0.93161619661515083, 0.91396525102303228,
+    0.89591535258093769, 0.87742742911292337, 0.85845684319381321,
+    0.83895221429757738, 0.81885390670035729, 0.79809206064405691,
+    0.77658398789475991, 0.75423066445405562, 0.73091191064248884,
+    0.70647961133543646, 0.68074791866915463, 0.65347863873997525,
+    0.6243585973360507, 0.59296294247144832, 0.55869217840818519,
+    0.52065603876206057, 0.47743783729668982, 0.42654798635542351,
+    0.36287143109703196, 0.27232086481396467, 0
+};
+
+/* Normal f(x[i]) */
+static const double zig_f_norm[ZIG_NORM_LAYERS + 1] = {
+    0.0010143525641203791, 0.0026696290838809228, 0.0055489952207713449,
+    0.0086244844128598851, 0.011839478657884862, 0.015167298010546568,
+    0.018592102737011288, 0.022103304615927098, 0.025693291935934271,
+    0.02935631744000685, 0.033087886146225751, 0.036884388786656203,
+    0.040742868074444175, 0.044660862200491425, 0.048636295859867805,
+    0.052667401903051012, 0.056752663481049848, 0.060890770348040406,
+    0.065080585213068073, 0.069321117393577908, 0.073611501884113403,
+    0.077950982513973394, 0.082338898242235656, 0.086774671894780178,
+    0.091257800826830257, 0.095787849121731439, 0.10036444102865587,
+    0.10498725540942132, 0.10965602101484027, 0.11437051244886601,
+    0.11913054670765083, 0.12393598020286782, 0.12878670619594321,
+    0.13368265258343937, 0.1386237799845946, 0.14361008009062776,
+    0.14864157424234226, 0.15371831220818166, 0.1588403711394793,
+    0.16400785468342038, 0.169220892237365, 0.1744796383307895,
+    0.17978427212329545, 0.18513499700899219, 0.19053204031913715,
+    0.19597565311627774, 0.20146611007431367, 0.20700370943992652,
+    0.2125887730717303, 0.2182216465543054, 0.22390269938500842,
+    0.22963232523211613, 0.23541094226347908, 0.24123899354543982,
+    0.24711694751232141, 0.25304529850732577, 0.25902456739620483,
+    0.26505530225558921, 0.27113807913838461, 0.27727350291918812,
+    0.28346220822323298, 0.28970486044295984, 0.29600215684693298,
+    0.30235482778648354, 0.30876363800618112, 0.31522938806501088,
+    0.32175291587598492, 0.3283350983728503, 0.33497685331358917,
+    0.34167914123155041, 0.34844296754632659, 0.35526938484791709,
+    0.36215949536931757, 0.36911445366447221, 0.37613546951056259,
+    0.3832238110559012, 0.39038080823731458, 0.39760785649387331,
+    0.40490642080722294, 0.412278040102661, 0.41972433204957438,
+    0.42724699830499607, 0.43484783024999091, 0.44252871527546844,
+    0.45029164368203922, 0.45813871626787206, 0.46607215268945612,
+    0.47409430069301695, 0.48220764632948521, 0.49041482528384411,
+    0.4987186354709795, 0.50712205107556896, 0.51562823824400184,
+    0.52424057267298407, 0.53296265938383613, 0.5417983550254255,
+    0.55075179311460454, 0.55982741270408687, 0.56902999106795094,
+    0.57836468111976314, 0.58783705443470657, 0.59745315094451668,
+    0.60721953662512029, 0.61714337081888093, 0.62723248524992725,
+    0.6374954773350423, 0.64794182111022247, 0.65858200005008805,
+    0.66942766734889037, 0.68049184099733406, 0.69178914343667508,
+    0.70333609901615812, 0.7151515074104986, 0.72725691834418482,
+    0.73967724367264731, 0.75244155917461142, 0.7655841738977045,
+    0.7791460859296877, 0.79317701177130506, 0.80773829468296054,
+    0.82290721138140899, 0.83878360529598961, 0.85550060786945059,
+    0.87324304891006954, 0.8922816507840261, 0.9130436479717402,
+    0.93628268168505957, 0.96359969312708615, 1
+};
+
+/* Exponential layer edges x[i] */
+static const double zig_x_exp[ZIG_EXP_LAYERS + 1] = {
+    8.697117470131051, 7.6971174701310501, 6.9410336293772126,
+    6.4783784938325697, 6.1441646657724727, 5.8821443157953999,
+    5.6664101674540337, 5.4828906275260625, 5.323090505754398,
+    5.1814872813015, 5.0542884899813041, 4.9387770859012505,
+    4.832939741025112, 4.7352429966017411, 4.6444918854200852,
+    4.5597370617073514, 4.4802117465284219, 4.4052876934735732,
+    4.334443680317273, 4.2672424802773659, 4.2033137137351844,
+    4.1423408656640515, 4.0840513104082978, 4.0282085446479368,
+    3.9746060666737888, 3.9230625001354897, 3.8734176703995091,
+    3.8255294185223367, 3.7792709924116679, 3.7345288940397974,
+    3.6912010902374188, 3.6491955157608538, 3.6084288131289095,
+    3.568825265648337, 3.5303158891293434, 3.4928376547740596,
+    3.4563328211327602, 3.4207483572511199, 3.386035442460301,
+    3.3521490309001094, 3.319047470970748, 3.2866921715990687,
+    3.2550473085704499, 3.2240795652862642, 3.1937579032122403,
+    3.1640533580259729, 3.1349388580844404, 3.1063890623398245,
+    3.0783802152540902, 3.0508900166154551, 3.0238975044556766,
+    2.9973829495161306, 2.9713277599210897, 2.9457143948950457,
+    2.9205262865127408, 2.8957477686001418, 2.8713640120155364,
+    2.8473609656351888, 2.8237253024500353, 2.8004443702507378,
+    2.7775061464397566, 2.7548991965623446, 2.7326126361947001,
+    2.7106360958679288, 2.6889596887418037, 2.6675739807732666,
+    2.6464699631518092, 2.6256390267977885, 2.6050729387408356,
+    2.5847638202141408, 2.5647041263169053, 2.54488662711187,
+    2.525304390037828, 2.505950763528594, 2.4868193617402095,
+    2.4679040502973648, 2.4491989329782498, 2.4306983392644197,
+    2.4123968126888706, 2.3942890999214579, 2.3763701405361406,
+    2.3586350574093373, 2.3410791477030344, 2.3236978743901964,
+    2.3064868582835798, 2.2894418705322694, 2.2725588255531548,
+    2.2558337743672192, 2.239262898312909, 2.2228425031110368,
+    2.2065690132576639, 2.19043896672322, 2.1744490099377747,
+    2.158595893043886, 2.142876465399842, 2.1272876713173683,
+    2.1118265460190422, 2.096490211801715, 2.0812758743932251,
+    2.0661808194905755, 2.0512024094685848, 2.0363380802487696,
+    2.0215853383189262, 2.0069417578945186, 1.9924049782135766,
+    1.9779727009573604, 1.9636426877895483, 1.9494127580071849,
+    1.9352807862970514, 1.9212447005915281, 1.9073024800183875,
+    1.8934521529393082, 1.8796917950722112, 1.866019527692828,
+    1.8524335159111756, 1.83893196701888, 1.8255131289035198,
+    1.8121752885263906, 1.7989167704602909, 1.785735935484126,
+    1.7726311792313056, 1.7596009308890748, 1.7466436519460744,
+    1.7337578349855716, 1.7209420025219353, 1.7081947058780578,
+    1.6955145241015379, 1.6829000629175539, 1.6703499537164521,
+    1.6578628525741728, 1.6454374393037237, 1.6330724165359913,
+    1.6207665088282579, 1.6085184617988584, 1.5963270412864834,
+    1.5841910325326889, 1.5721092393862297, 1.5600804835278881,
+    1.5481036037145135, 1.5361774550410321, 1.5243009082192263,
+    1.5124728488721171, 1.5006921768428167, 1.4889578055167461,
+    1.4772686611561339, 1.4656236822457454, 1.4540218188487934,
+    1.4424620319720125, 1.4309432929388797, 1.4194645827699832,
+    1.4080248915695357, 1.3966232179170421, 1.3852585682631222,
+    1.3739299563284908, 1.362636402505087, 1.3513769332583354,
+    1.3401505805295051, 1.328956381137117, 1.3177933761763252,
+    1.3066606104151746, 1.2955571316866015, 1.2844819902750131,
+    1.2734342382962416, 1.2624129290696158, 1.251417116480853,
+    1.240445854334407, 1.2294981956938498, 1.218573192208791,
+    1.2076698934267622, 1.196787346088404, 1.1859245934042031,
+    1.1750806743109123, 1.1642546227056796, 1.1534454666557754,
+    1.1426522275816735, 1.1318739194110792, 1.1211095477013311,
+    1.1103581087274119, 1.0996185885325982, 1.0888899619385479,
+    1.0781711915113732, 1.0674612264799688, 1.0567590016025523,
+    1.0460634359770451, 1.0353734317905294, 1.0246878730026183,
+    1.0140056239570978, 1.0033255279156981, 0.99264640550727723,
+    0.98196705308506393, 0.97128624098390481, 0.96060271166866795,
+    0.94991517776407741, 0.93922231995526384, 0.92852278474721195,
+    0.91781518207004575, 0.90709808271569181, 0.89637001558989149,
+    0.88562946476175308, 0.87487486629102673, 0.86410460481100604,
+    0.85331700984237491, 0.84251035181037004, 0.83168283773427465,
+    0.82083260655441337, 0.80995772405741995, 0.79905617735548873,
+    0.7881258688694941, 0.77716460975913126, 0.76617011273543623,
+    0.7551399841819838, 0.74407171550050955, 0.73296267358436695,
+    0.72181009030875776, 0.71061105090965648, 0.6993624811032334,
+    0.68806113277374936, 0.67670356802952414, 0.66528614139267939,
+    0.6538049798476665, 0.64225596042453792, 0.63063468493349195,
+    0.61893645139487774, 0.60715622162030169, 0.59528858429150444,
+    0.58332771274877115, 0.57126731653258989, 0.55910058551154218,
+    0.54682012516331213, 0.53441788123716705, 0.52188505159213661,
+    0.50921198244365595, 0.4963880455186726, 0.4834014916534633,
+    0.47023927508217045, 0.45688684093142179, 0.44332786607355412,
+    0.42954394022541259, 0.41551416960035825, 0.4012146788962796,
+    0.3866179779411214, 0.37169214532991918, 0.3563997602583957,
+    0.34069648106485118, 0.32452911701691145, 0.30783295467493427,
+    0.29052795549123261, 0.27251318547846703, 0.25365836338591446,
+    0.23379048305967726, 0.21267151063096923, 0.18995868962243467,
+    0.16512762256419042, 0.13730498094001628, 0.10483850756582322,
+    0.063852163815007607, 0
+};
+
+/* Exponential f(x[i]) */
+static const double zig_f_exp[ZIG_EXP_LAYERS + 1] = {
+    0.00016706669230796367, 0.0004541343538414966, 0.00096726928232717432,
+    0.0015362997803015726, 0.0021459677437189071, 0.0027887987935740757,
+    0.003460264777836904, 0.004157295120833797, 0.0048776559835423958,
+    0.0056196422072054891, 0.0063819059373191834, 0.0071633531836349908,
+    0.0079630774380170435, 0.008780314985808977, 0.0096144136425022116,
+    0.010464810181029981, 0.0113310135978346, 0.012212592426255378,
+    0.013109164931254991, 0.014020391403181943, 0.014945968011691148,
+    0.015885621839973156, 0.016839106826039941, 0.017806200410911355,
+    0.018786700744696024, 0.01978042433800974, 0.020787204072578114,
+    0.021806887504283581, 0.02283933540638524, 0.023884420511558174,
+    0.024942026419731787, 0.026012046645134221, 0.027094383780955803,
+    0.028188948763978646, 0.029295660224637411, 0.030414443910466622,
+    0.031545232172893622, 0.032687963508959555, 0.033842582150874358,
+    0.035009037697397431, 0.036187284781931443, 0.037377282772959382,
+    0.038578995503074871, 0.039792391023374139, 0.04101744138041484,
+    0.042254122413316254, 0.043502413568888197, 0.044762297732943289,
+    0.046033761076175184, 0.047316792913181561, 0.048611385573379504,
+    0.049917534282706379, 0.051235237055126281, 0.052564494593071685,
+    0.05390531019604608, 0.05525768967669703, 0.05662164128374287,
+    0.057997175631200659, 0.05938430563342028, 0.06078304644547966,
+    0.062193415408541036, 0.063615431999807376, 0.065049117786753805,
+    0.066494496385339816, 0.067951593421936643, 0.069420436498728783,
+    0.070901055162371843, 0.072393480875708752, 0.073897746992364746,
+    0.07541388873405841, 0.076941943170480517, 0.078481949201606435,
+    0.080033947542319905, 0.081597980709237419, 0.083174093009632397,
+    0.084762330532368146, 0.086362741140756927, 0.087975374467270231,
+    0.089600281910032886, 0.091237516631040197, 0.092887133556043569,
+    0.094549189376055873, 0.096223742550432825, 0.097910853311492213,
+    0.099610583670637132, 0.10132299742595363, 0.1030481601712577,
+    0.10478613930657016, 0.10653700405000163, 0.10830082545103376,
+    0.11007767640518536, 0.11186763167005628, 0.11367076788274429,
+    0.11548716357863351, 0.11731689921155553, 0.11916005717532764,
+    0.12101672182667479, 0.12288697950954511, 0.12477091858083093,
+    0.12666862943751067, 0.1285802045452282, 0.13050573846833077,
+    0.13244532790138749, 0.1343990717022136, 0.13636707092642883,
+    0.13834942886358018, 0.1403462510748624, 0.14235764543247215,
+    0.14438372216063472, 0.14642459387834489, 0.14848037564386674,
+    0.15055118500103984, 0.1526371420274428, 0.15473836938446803,
+    0.15685499236936515, 0.15898713896931413, 0.16113493991759195,
+    0.16329852875190173, 0.16547804187493592, 0.16767361861725008,
+    0.16988540130252755, 0.17211353531531998, 0.17435816917135341,
+    0.17661945459049483, 0.17889754657247828, 0.18119260347549626,
+    0.18350478709776744, 0.18583426276219708, 0.18818119940425426,
+    0.19054576966319536, 0.1929281499767713, 0.19532852067956319,
+    0.19774706610509882, 0.20018397469191121, 0.20263943909370896,
+    0.20511365629383765, 0.20760682772422198, 0.21011915938898823,
+    0.21265086199297822, 0.21520215107537863, 0.21777324714870047,
+    0.22036437584335944, 0.22297576805812011, 0.22560766011668396,
+    0.22826029393071662, 0.23093391716962736, 0.23362878343743329,
+    0.23634515245705956, 0.23908329026244909, 0.24184346939887713,
+    0.24462596913189202, 0.24743107566532754, 0.25025908236886218,
+    0.25311029001562935, 0.25598500703041527, 0.25888354974901606,
+    0.26180624268936281, 0.26475341883506204, 0.26772541993204463,
+    0.27072259679905986, 0.2737453096528028, 0.27679392844851719,
+    0.27986883323697276, 0.28297041453878063, 0.28609907373707671,
+    0.28925522348967758, 0.29243928816189241, 0.29565170428126097,
+    0.29889292101558151, 0.30216340067569331, 0.30546361924459003,
+    0.30879406693455996, 0.31215524877417938, 0.31554768522712873,
+    0.31897191284495702, 0.322428484956089, 0.32591797239355602,
+    0.32944096426413616, 0.33299806876180876, 0.33658991402867738,
+    0.34021714906677986, 0.34388044470450224, 0.34758049462163682,
+    0.35131801643748317, 0.35509375286678729, 0.35890847294874956,
+    0.3627629733548175, 0.36665807978151388, 0.37059464843514572,
+    0.37457356761590188, 0.37859575940958051, 0.3826621814960095,
+    0.38677382908413738, 0.39093173698479677, 0.39513698183328982,
+    0.39939068447523074, 0.40369401253052994, 0.40804818315203206,
+    0.41245446599716085, 0.41691418643300254, 0.42142872899761624,
+    0.42599954114303401, 0.4306281372884585, 0.43531610321563624,
+    0.44006510084235351, 0.44487687341454812, 0.44975325116275461,
+    0.45469615747461511, 0.4597076156421373, 0.46478975625042579,
+    0.46994482528395959, 0.47517519303737699, 0.48048336393045382,
+    0.48587198734188453, 0.49134386959403215, 0.49690198724154916,
+    0.50254950184134728, 0.50828977641064244, 0.51412639381474812,
+    0.52006317736823315, 0.52610421398361928, 0.53225388026304277,
+    0.53851687200286136, 0.54489823767243917, 0.55140341654064084,
+    0.558038282262587, 0.56480919291239973, 0.57172304866482526,
+    0.57878735860284447, 0.58601031847726748, 0.59340090169173287,
+    0.60096896636523167, 0.60872538207962146, 0.61668218091520699,
+    0.62485273870366531, 0.6332519942143654, 0.64189671642726531,
+    0.65080583341457021, 0.66000084107899892, 0.66950631673192396,
+    0.67935057226476459, 0.6895664961170771, 0.70019265508278727,
+    0.71127476080507501, 0.72286765959357102, 0.73503809243142249,
+    0.74786862198519399, 0.76146338884989506, 0.77595685204011433,
+    0.79152763697249429, 0.80842165152300693, 0.82699329664304877,
+    0.84778550062398783, 0.87170433238120149, 0.90046992992574371,
+    0.93814368086217081, 1
+};
+
+#endif /* ZIGGURAT_H */
@@ -30,6 +30,31 @@ int main(void) {
   STATUS_MSG(rv);
 #endif
 
+#if defined(XR_TESTS_SECURE_ALLOC)
+  rv = secure_alloc_run_test();
+  STATUS_MSG(rv);
+#endif
+
+#if defined(XR_TESTS_AES)
+  rv = aes256_run_test();
+  STATUS_MSG(rv);
+#endif
+
+#if defined(XR_TESTS_CHACHA20)
+  rv = chacha20_run_test();
+  STATUS_MSG(rv);
+#endif
+
+#if defined(XR_TESTS_CRC)
+  rv = crc32_run_test();
+  STATUS_MSG(rv);
+#endif
+
+#if defined(XR_TESTS_SHA512)
+  rv = sha512_run_test();
+  STATUS_MSG(rv);
+#endif
+
 #if defined(XR_TESTS_CTR_DRBG)
   rv = ctr_drbg_run_test();
   STATUS_MSG(rv);
@@ -44,5 +69,35 @@ int main(void) {
   rv = hmac_drbg_run_test();
   STATUS_MSG(rv);
 #endif
+
+#if defined(XR_TESTS_CHACHA_DRBG)
+  rv = chacha_drbg_run_test();
+  STATUS_MSG(rv);
+#endif
+
+#if defined(XR_TESTS_RANDOM)
+  rv = random_run_test();
+  STATUS_MSG(rv);
+#endif
+
+#if defined(XR_TESTS_XR_RNG)
+  rv = xr_rng_run_test();
+  STATUS_MSG(rv);
+#endif
+
+#if defined(XR_TESTS_XR_STREAM)
+  rv = xr_stream_run_test();
+  STATUS_MSG(rv);
+#endif
+
+#if defined(XR_TESTS_RNG_SEED)
+  rv = rngseed_run_test();
+  STATUS_MSG(rv);
+#endif
+
+#if defined(XR_TESTS_RNG_POSIX) && !defined(_WIN32)
+  rv = rngposix_run_test();
+  STATUS_MSG(rv);
+#endif
   return 0;
 }
@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include <stdint.h>
 
 #define GUARD(cond)                                                            \
@@ -14,9 +15,32 @@ extern int test_ent(const char *filename, size_t nb);
 extern int test_bignum(void);
 // common/crypto_mem.c
 extern int test_mem(void);
+// common/secure_alloc.c
+extern int secure_alloc_run_test(void);
+// crypto/aes.c
+extern int aes256_run_test(void);
+// crypto/chacha20.c
+extern int chacha20_run_test(void);
+// crypto/crc.c
+extern int crc32_run_test(void);
+// crypto/sha512.c
+extern int sha512_run_test(void);
 // rand/ctr_drbg.c
 extern int ctr_drbg_run_test(void);
 // rand/hash_drbg.c
 extern int hash_drbg_run_test(void);
 // rand/hmac_drbg.c
 extern int hmac_drbg_run_test(void);
+// rand/random.c
+extern int random_run_test(void);
+// rand/chacha_drbg.c
+extern int chacha_drbg_run_test(void);
+// rand/xr_rng.c
+extern int xr_rng_run_test(void);
+// rand/xr_stream.c
+extern int xr_stream_run_test(void);
+
+// rand/rngseed.c
+extern int rngseed_run_test(void);
+// rand/rngposix.c
+extern int rngposix_run_test(void);
@@ -1,7 +1,12 @@
 #include "common/bignum.h"
 #include "common/defs.h"
 #include "rand/hmac_drbg.h"
+#include "rand/xr_rng.h"
+#ifdef _WIN32
 #include "rand/rngw32.h"
+#else
+#include "rand/rngposix.h"
+#endif
 #include "test.h"
 
 #define BUFFER_SIZE 32
@@ -24,6 +29,12 @@ int test_bignum(void) {
 
   GUARD(0 == bn_self_test(hmac_drbg_generate, state, 1, NULL));
 
+  /* Parallel prime search, one generator per worker */
+  GUARD(0 == bn_generate_prime_parallel(&X, 1024, 4, &xr_rng_bn_factory));
+  GUARD(1024 == bn_msb(&X));
+  GUARD(1 == bn_check_probable_prime(&X, 27, (f_rng_t)hmac_drbg_generate,
+                                     state));
+
 exit:
   zeroize(entropy, BUFFER_SIZE);
   zeroize(nonce, BUFFER_SIZE);
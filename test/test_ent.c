@@ -1,56 +1,35 @@
 #include "common/defs.h"
-#include "rand/hash_drbg.h"
+#include "rand/xr_stream.h"
+#ifdef _WIN32
 #include "rand/rngw32.h"
+#else
+#include "rand/rngposix.h"
+#endif
 #include "test.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 
-#define ENTROPY_IN_LEN 256
-#define NONCE_IN_LEN 256
+static int ent_progress_cb(void *ctx, const xr_stream_progress *progress) {
+  (void)ctx;
+  if (progress->written == progress->total)
+    printf("%.1f MB/s\n", progress->bytes_per_sec / 1e6);
+  return 0;
+}
 
 int test_ent(const char *filename, size_t nb) {
-  int ret = 0, rv;
-  FILE *fp = NULL;
-  size_t done;
-  HASH_DRBG_STATE *ctx = NULL;
-  byte entropy[ENTROPY_IN_LEN];
-  byte nonce[NONCE_IN_LEN];
-  byte rand[HASH_DRBG_MAX_OUT_LEN];
+  int ret = 0;
+  xr_rng *rng = NULL;
 
-  GUARD(NULL != (fp = fopen(filename, "r")));
-  GUARD(NULL != (ctx = hash_drbg_new()));
+  /* The stream overwrites in place, it never truncates */
+  remove(filename);
   GUARD(1 == RngStart());
-
-  GUARD(1 == RngFetchBytes(entropy, ENTROPY_IN_LEN));
-  GUARD(1 == RngFetchBytes(nonce, NONCE_IN_LEN));
-  GUARD(ERR_HASH_DRBG_SUCCESS == hash_drbg_init(ctx, entropy, ENTROPY_IN_LEN,
-                                                nonce, NONCE_IN_LEN, NULL, 0));
-
-  done = 0;
-  for (;;) {
-    if (done >= nb)
-      break;
-    if (ERR_HASH_DRBG_SUCCESS !=
-        (rv = hash_drbg_generate(ctx, rand, HASH_DRBG_MAX_OUT_LEN, NULL, 0))) {
-      if (rv == ERR_HASH_DRBG_DO_RESEED) {
-        GUARD(1 == RngFetchBytes(entropy, ENTROPY_IN_LEN));
-        GUARD(ERR_HASH_DRBG_SUCCESS ==
-              hash_drbg_reseed(ctx, entropy, ENTROPY_IN_LEN, NULL, 0));
-      } else {
-        ret = 1;
-        goto exit;
-      }
-      GUARD(ERR_HASH_DRBG_SUCCESS ==
-            hash_drbg_generate(ctx, rand, HASH_DRBG_MAX_OUT_LEN, NULL, 0));
-    }
-
-    fwrite(rand, sizeof(byte), HASH_DRBG_MAX_OUT_LEN, fp);
-    done += HASH_DRBG_MAX_OUT_LEN;
-  }
+  GUARD(NULL != (rng = xr_rng_new_engine(XR_RNG_HASH_DRBG, NULL, NULL)));
+  GUARD(SUCCESS ==
+        xr_stream_to_file(filename, nb, rng, ent_progress_cb, NULL));
 
 exit:
+  xr_rng_free(rng);
   RngStop();
-  hash_drbg_clear(ctx);
-  fclose(fp);
   return ret;
 }
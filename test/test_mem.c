@@ -35,7 +35,15 @@ int test_mem(void) {
   GUARD(!memcmp(a, b, 32));
 
   // xr_memcmp
-  GUARD(xr_memcmp(a, b, 32));
+  GUARD(xr_memcmp(a, b, 32) == 0);
+  for (size_t len = 0; len <= 32; len++) {
+    GUARD(xr_memcmp(a, b, len) == 0);
+    for (size_t i = 0; i < len; i++) {
+      b[i] ^= 0x80;
+      GUARD(xr_memcmp(a, b, len) != 0);
+      b[i] ^= 0x80;
+    }
+  }
 
   // xr_strcmp (equal same length)
   char s1[] = "eq same length";